@@ -0,0 +1,124 @@
+#!/bin/bash
+
+# Runs the benchmark suite in scripts/bench/ and writes the results as JSON,
+# so runs can be compared across versions.
+#
+#   ./bench.sh [--seconds n] [--out file] [filter]
+#
+#   --seconds  Duration of each measurement (default 2)
+#   --out      Results file (default bench-results/<version>-<timestamp>.json)
+#   filter     Only run benches whose file name contains this string
+#
+# Each scripts/bench/<name>.bench.js runs with scripts/bench/harness.js
+# prepended; cold start is timed here, as `jade --eval ''` back to back.
+
+RUNTIME="${JADE:-./build/jade}"
+BENCH_DIR="scripts/bench"
+SECONDS_PER_BENCH=2
+OUT=""
+FILTER=""
+STARTUP_RUNS=200
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --seconds) SECONDS_PER_BENCH="$2"; shift 2 ;;
+        --out) OUT="$2"; shift 2 ;;
+        *) FILTER="$1"; shift ;;
+    esac
+done
+
+if [ ! -f "$RUNTIME" ]; then
+    echo "Error: Runtime executable not found at $RUNTIME"
+    echo "Please build the runtime first by running:"
+    echo "  cd build && cmake .. && make"
+    exit 1
+fi
+
+VERSION=$("$RUNTIME" --version | sed 's/.* v//')
+STAMP=$(date -u +%Y%m%dT%H%M%SZ)
+if [ -z "$OUT" ]; then
+    mkdir -p bench-results
+    OUT="bench-results/${VERSION}-${STAMP}.json"
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+strip_ansi() {
+    sed 's/\x1B\[[0-9;]*[mK]//g'
+}
+
+# Nearest-rank percentile of a sorted file of numbers
+percentile() {
+    local file="$1" p="$2"
+    local n
+    n=$(wc -l < "$file")
+    local rank=$(( (n * p + 999) / 1000 ))
+    [ "$rank" -lt 1 ] && rank=1
+    sed -n "${rank}p" "$file"
+}
+
+run_bench() {
+    local file="$1"
+    local name
+    name=$(basename "$file" .bench.js)
+    echo "Running bench: $name"
+
+    cat "$BENCH_DIR/harness.js" "$file" > "$WORK/$name.js"
+    "$RUNTIME" "$WORK/$name.js" "$WORK/$name.jsonl" "$SECONDS_PER_BENCH" 2>&1 \
+        | strip_ansi | grep '^LOG: BENCH ' | sed 's/^LOG: BENCH /  /'
+    if [ ! -s "$WORK/$name.jsonl" ]; then
+        echo "  BENCH FAILED: $name"
+        return
+    fi
+    cat "$WORK/$name.jsonl" >> "$WORK/results.jsonl"
+}
+
+run_startup() {
+    echo "Running bench: startup"
+    "$RUNTIME" --eval '' > /dev/null 2>&1
+
+    local total=0
+    : > "$WORK/startup.txt"
+    for ((i = 0; i < STARTUP_RUNS; i++)); do
+        local start end
+        start=$(date +%s%N)
+        "$RUNTIME" --eval '' > /dev/null 2>&1
+        end=$(date +%s%N)
+        local us=$(( (end - start) / 1000 ))
+        total=$(( total + us ))
+        echo "$us" >> "$WORK/startup.txt"
+    done
+    sort -n "$WORK/startup.txt" -o "$WORK/startup.txt"
+
+    local p50 p99 p999
+    p50=$(percentile "$WORK/startup.txt" 500)
+    p99=$(percentile "$WORK/startup.txt" 990)
+    p999=$(percentile "$WORK/startup.txt" 999)
+    local ops_per_sec=$(( STARTUP_RUNS * 1000000 / (total > 0 ? total : 1) ))
+
+    ms() { printf "%d.%03d" $(( $1 / 1000 )) $(( $1 % 1000 )); }
+    echo "  startup.eval_empty: ${ops_per_sec} ops/s  p50 $(ms "$p50")ms  p99 $(ms "$p99")ms  p999 $(ms "$p999")ms"
+    printf '{"name":"startup.eval_empty","ops":%d,"seconds":%s,"opsPerSec":%d,"p50Ms":%s,"p99Ms":%s,"p999Ms":%s}\n' \
+        "$STARTUP_RUNS" "$(ms $(( total / 1000 )))" "$ops_per_sec" "$(ms "$p50")" "$(ms "$p99")" "$(ms "$p999")" \
+        >> "$WORK/results.jsonl"
+}
+
+: > "$WORK/results.jsonl"
+for file in "$BENCH_DIR"/*.bench.js; do
+    [ -n "$FILTER" ] && [[ "$(basename "$file")" != *"$FILTER"* ]] && continue
+    run_bench "$file"
+done
+if [ -z "$FILTER" ] || [[ "startup" == *"$FILTER"* ]]; then
+    run_startup
+fi
+
+{
+    printf '{"version":"%s","timestamp":"%s","host":"%s","cpus":%d,"secondsPerBench":%s,"results":[\n' \
+        "$VERSION" "$STAMP" "$(uname -srm)" "$(getconf _NPROCESSORS_ONLN)" "$SECONDS_PER_BENCH"
+    sed '$!s/$/,/' "$WORK/results.jsonl"
+    printf ']}\n'
+} > "$OUT"
+
+echo ""
+echo "Results written to $OUT"
@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Measures process startup: context creation, API binding and an empty
+# event loop, by running `jade --eval ''` back to back.
+#
+#   ./bench_startup.sh [runs]     (default 200)
+
+RUNTIME="./build/jade"
+RUNS="${1:-200}"
+
+if [ ! -f "$RUNTIME" ]; then
+    echo "Error: Runtime executable not found at $RUNTIME"
+    echo "Please build the runtime first by running:"
+    echo "  cd build && cmake .. && make"
+    exit 1
+fi
+
+# Warm the page cache and the dynamic loader before timing
+"$RUNTIME" --eval '' > /dev/null 2>&1
+
+min=""
+max=0
+total=0
+for ((i = 0; i < RUNS; i++)); do
+    start=$(date +%s%N)
+    "$RUNTIME" --eval '' > /dev/null 2>&1
+    end=$(date +%s%N)
+
+    us=$(( (end - start) / 1000 ))
+    total=$(( total + us ))
+    [ -z "$min" ] || [ "$us" -lt "$min" ] && min=$us
+    [ "$us" -gt "$max" ] && max=$us
+done
+
+fmt_ms() {
+    printf "%d.%03d" $(( $1 / 1000 )) $(( $1 % 1000 ))
+}
+
+echo "jade --eval '' x $RUNS"
+echo "  mean: $(fmt_ms $(( total / RUNS ))) ms"
+echo "  min:  $(fmt_ms "$min") ms"
+echo "  max:  $(fmt_ms "$max") ms"
@@ -37,7 +37,19 @@
 
 #include <JavaScriptCore/JavaScript.h>
 #include <uv.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+/**
+ * Storage class for per-thread runtime state. Each cluster worker runs its own
+ * loop and JS context on its own thread, so module-level state that belongs to
+ * a loop or context is declared with this.
+ */
+#if defined(_MSC_VER)
+#define JADE_THREAD_LOCAL __declspec(thread)
+#else
+#define JADE_THREAD_LOCAL __thread
+#endif
 
 // =====================================================================================
 //                          JAVASCRIPT ENGINE INTERFACE
@@ -56,73 +68,237 @@ JSGlobalContextRef create_js_context();
  */
 void execute_js(JSGlobalContextRef ctx, const char* script);
 
+/**
+ * Executes `len` bytes of JS source, registered under `source_url` (may be NULL)
+ * so stack traces and inspectors name the script.
+ * @param source  UTF-8 code; source[len] must be a NUL byte (a mapped file's
+ *                zero-filled tail counts).
+ */
+void execute_js_source(JSGlobalContextRef ctx, const char* source, size_t len, const char* source_url);
+
+/**
+ * Creates a JS string from UTF-8 bytes that are not necessarily NUL-terminated.
+ * Embedded NULs are preserved and invalid sequences become U+FFFD.
+ * @param data  UTF-8 bytes.
+ * @param len   Number of bytes.
+ * @return      New JSStringRef (release with JSStringRelease()).
+ */
+JSStringRef js_string_from_utf8(const char* data, size_t len);
+
+/**
+ * Property names used on hot paths, interned once per thread by
+ * create_js_context() and shared by every module on that thread.
+ * Use ATOM(statusCode); the JSStringRef is borrowed and must not be released.
+ */
+#define JADE_ATOMS(X) \
+    X(body) X(encoding) X(end) X(flags) X(headers) X(highWaterMark) X(host) \
+    X(httpVersion) X(id) X(idleTimeout) X(isDirectory) X(isFile) X(keepAlive) X(length) \
+    X(maxAge) X(maxFreeSockets) X(maxPayload) X(maxSockets) X(method) X(mode) X(mtimeMs) X(name) \
+    X(params) X(pingInterval) X(port) X(rejectUnauthorized) X(root) X(size) X(stack) X(start) \
+    X(status) X(statusCode) X(url) X(workers)
+
+typedef enum {
+#define JADE_ATOM_ENUM(name) JADE_ATOM_##name,
+    JADE_ATOMS(JADE_ATOM_ENUM)
+#undef JADE_ATOM_ENUM
+    JADE_ATOM_COUNT
+} JadeAtom;
+
+extern JADE_THREAD_LOCAL JSStringRef jade_atoms[JADE_ATOM_COUNT];
+
+#define ATOM(name) (jade_atoms[JADE_ATOM_##name])
+
+/**
+ * Creates the calling thread's atom table; later calls do nothing.
+ */
+void atoms_init(void);
+
 
 // =====================================================================================
 //                          EVENT LOOP INTERFACE
 // =====================================================================================
 
 /**
- * Global event loop instance.
+ * Event loop of the calling thread (the default loop on the main thread).
  */
-extern uv_loop_t* loop;
+extern JADE_THREAD_LOCAL uv_loop_t* loop;
 
 /**
- * Initializes libuv's default event loop.
+ * Initializes the calling thread's event loop. Uses libuv's default loop
+ * unless a worker thread has already installed its own.
  */
 void init_event_loop();
 
 /**
- * Starts the event loop (blocks until all handles are closed).
+ * Starts the event loop (blocks until all handles are closed). Promise
+ * reactions queued by a callback run as soon as that callback returns.
  */
 void run_event_loop();
 
+/**
+ * Per-iteration timings of the calling thread's loop, updated in its check
+ * phase. Busy time excludes time blocked in the kernel; lag is how long past
+ * the next timer's due time the poll phase returned.
+ */
+typedef struct {
+    uint64_t started_ns;        // uv_hrtime() when the loop first ran
+    uint64_t iterations;
+    uint64_t last_iteration_ns;
+    uint64_t last_busy_ns;
+    uint64_t max_busy_ns;
+    uint64_t busy_ns;           // Totals since started_ns
+    uint64_t idle_ns;
+    uint64_t last_lag_ns;
+    uint64_t max_lag_ns;
+} LoopMetrics;
+
+/**
+ * Copies the current loop timings (all zero before run_event_loop()).
+ */
+void loop_metrics_read(LoopMetrics* out);
+
 
 // =====================================================================================
 //                          TIMER API
 // =====================================================================================
 
 /**
- * Global timer ID tracker.
+ * Native timer callback.
+ */
+typedef void (*TimerCallback)(void* data);
+
+/**
+ * Schedules a native callback on the calling thread's timer wheel.
+ * @param timeout   Delay in milliseconds (0 is treated as 1).
+ * @param repeat    Repeat interval in milliseconds, or 0 for a one-shot timer.
+ * @param callback  Function to run.
+ * @param data      Passed to the callback.
+ * @return          Timer ID (never 0 unless allocation failed).
+ */
+uint64_t timer_start(uint64_t timeout, uint64_t repeat, TimerCallback callback, void* data);
+
+/**
+ * Lets the loop exit while this timer is still pending (like Node's unref()).
+ */
+void timer_unref(uint64_t id);
+
+/**
+ * Cancels a timer. Safe to call from the timer's own callback and with IDs of
+ * timers that already fired.
+ * @return  true if the timer was still scheduled.
  */
-extern uint32_t next_timer_id;
+bool timer_stop(uint64_t id);
+
+/**
+ * Number of live timers (JS and native) on the calling thread's wheel.
+ */
+size_t timer_count(void);
+
+typedef struct TickTask TickTask;
+typedef void (*TickCallback)(TickTask* task);
+
+/**
+ * Native work deferred to the end of the current loop iteration, after I/O
+ * callbacks have run. Owners embed one and recover themselves from it.
+ */
+struct TickTask {
+    TickTask* next;
+    TickTask* prev;
+    TickCallback callback;
+    bool scheduled;
+};
+
+/**
+ * Queues `task` for the end of this iteration; does nothing if it is already
+ * queued. Polling does not block while tasks are queued.
+ */
+void tick_task_schedule(TickTask* task, TickCallback callback);
+
+/**
+ * Removes `task` from the queue if it is there.
+ */
+void tick_task_cancel(TickTask* task);
 
 /**
  * Schedules a JS function to execute after a specified delay.
  * @param ctx       JS context for callback execution.
  * @param callback  JS function reference.
  * @param timeout   Delay in milliseconds.
+ * @return          Timer ID.
  */
-void set_timeout(JSContextRef ctx, JSObjectRef callback, uint64_t timeout);
+uint64_t set_timeout(JSContextRef ctx, JSObjectRef callback, uint64_t timeout);
 
 /**
  * Cancels a scheduled timeout function.
  * @param ctx       JS context for callback execution.
  * @param timer_id  ID of the timeout to clear.
  */
-void clear_timeout(JSContextRef ctx, uint32_t timer_id);
+void clear_timeout(JSContextRef ctx, uint64_t timer_id);
 
 /**
  * Schedules a JS function to execute repeatedly at a fixed interval.
  * @param ctx       JS context for callback execution.
  * @param callback  JS function reference.
  * @param interval  Interval time in milliseconds.
+ * @return          Timer ID.
  */
-void set_interval(JSContextRef ctx, JSObjectRef callback, uint64_t interval);
+uint64_t set_interval(JSContextRef ctx, JSObjectRef callback, uint64_t interval);
 
 /**
  * Cancels a scheduled interval function.
  * @param ctx       JS context for callback execution.
  * @param timer_id  ID of the interval to clear.
  */
-void clear_interval(JSContextRef ctx, uint32_t timer_id);
+void clear_interval(JSContextRef ctx, uint64_t timer_id);
 
 /**
- * Asynchronous readFile function
+ * Asynchronous readFile function: `fs.readFile(path, [options], callback)`.
+ * Sizes the read with fstat and maps files of 1 MiB or more. Pass
+ * `{ encoding: null }` (or "arraybuffer") to receive an ArrayBuffer that
+ * owns the bytes instead of a UTF-8 decoded string.
  */
 JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef function,
                         JSObjectRef thisObject, size_t argc,
                         const JSValueRef args[], JSValueRef* exception);
 
+/**
+ * `fs.createReadStream(path[, { highWaterMark, start, end, encoding }])`.
+ * Emits "data" chunks of at most highWaterMark bytes, then "end" and "close";
+ * pause()/resume() control the flow. Chunks are strings unless
+ * `encoding: null`, which yields ArrayBuffers.
+ */
+JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef function,
+                                 JSObjectRef thisObject, size_t argc,
+                                 const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `fs.createWriteStream(path[, { highWaterMark, flags }])`. write() returns
+ * false once highWaterMark bytes are queued and "drain" follows when the queue
+ * empties; end() flushes, emits "finish" and closes.
+ */
+JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `fs.statMany(paths, callback)`. Stats every path on the threadpool in
+ * per-thread chunks and calls `callback(errors, stats)` once; `errors` is null
+ * when all succeeded, otherwise an array with an error string (or null) per path.
+ * Each stat is `{ size, mode, mtimeMs, isFile, isDirectory }`, or null on error.
+ */
+JSValueRef fs_stat_many(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `fs.readMany(paths, [options], callback)`. Reads whole files the same way,
+ * delivering `callback(errors, contents)` with strings, or Buffers when
+ * `{ encoding: null }` is passed.
+ */
+JSValueRef fs_read_many(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception);
+
 /**
  * Asynchronous writeFile function
  */
@@ -137,10 +313,34 @@ JSValueRef fs_exists(JSContextRef ctx, JSObjectRef function,
                      JSObjectRef thisObject, size_t argc,
                      const JSValueRef args[], JSValueRef* exception);
 
+/**
+ * `fs.promises.readFile(path, [options])`: fs.readFile() delivered through a
+ * native promise, which resolves with the contents or rejects with the error string.
+ */
+JSValueRef fs_promises_read_file(JSContextRef ctx, JSObjectRef function,
+                                 JSObjectRef thisObject, size_t argc,
+                                 const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `fs.promises.writeFile(path, content)`: resolves with undefined once written.
+ */
+JSValueRef fs_promises_write_file(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `fs.promises.exists(path)`: resolves with a boolean; never rejects.
+ */
+JSValueRef fs_promises_exists(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception);
+
 
 
 /**
- * Creates a TCP server that listens for connections.
+ * Creates a TCP server; `callback(socket)` runs for every accepted connection.
+ * Sockets are duplex: "data"/"end"/"close"/"drain" events, pause()/resume(),
+ * write() returning false past highWaterMark, end() and destroy().
  */
 JSValueRef net_create_server(JSContextRef ctx, JSObjectRef function,
                              JSObjectRef thisObject, size_t argc,
@@ -155,9 +355,21 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef function,
 
 
 /**
- * Writes data to a connected client socket.
+ * `net.connect(port[, host][, listener])` or `net.connect({ port, host, highWaterMark }[, listener])`.
+ * Returns a Socket that emits "connect" once the connection is up; writes made
+ * before that are held and sent in order.
+ */
+JSValueRef net_connect(JSContextRef ctx, JSObjectRef function,
+                       JSObjectRef thisObject, size_t argc,
+                       const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `http.request(url[, { method, body, encoding }][, callback])`. The general
+ * form of the helpers below; a body without a method is sent as POST.
+ * Without a callback every client call returns a promise that resolves with
+ * `{ statusCode, headers, body }` or rejects with the error string.
  */
-JSValueRef client_write(JSContextRef ctx, JSObjectRef function,
+JSValueRef http_request(JSContextRef ctx, JSObjectRef function,
                         JSObjectRef thisObject, size_t argc,
                         const JSValueRef args[], JSValueRef* exception);
 
@@ -189,6 +401,24 @@ JSValueRef http_delete(JSContextRef ctx, JSObjectRef function,
                       JSObjectRef thisObject, size_t argc,
                       const JSValueRef args[], JSValueRef* exception);
 
+/**
+ * Configures the keep-alive agent used by http.request/get/post/put/delete.
+ * Accepts { keepAlive, maxSockets, maxFreeSockets, idleTimeout }; omitted
+ * fields keep their current values.
+ */
+JSValueRef http_set_agent_options(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `http.websocket(url[, { maxPayload, pingInterval, rejectUnauthorized }])`.
+ * Upgrades a ws:// or wss:// connection made through the agent and returns
+ * the WebSocket at once; it emits "open" after the handshake.
+ */
+JSValueRef http_websocket(JSContextRef ctx, JSObjectRef function,
+                          JSObjectRef thisObject, size_t argc,
+                          const JSValueRef args[], JSValueRef* exception);
+
 /**
  * Creates an HTTP server that listens on the given port.
  */
@@ -196,6 +426,13 @@ JSValueRef http_create_server(JSContextRef ctx, JSObjectRef function,
                               JSObjectRef thisObject, size_t argc,
                               const JSValueRef args[], JSValueRef* exception);
 
+/**
+ * Creates an HTTP server serving TLS: `https.createServer({ key, cert }[, callback])`.
+ */
+JSValueRef https_create_server(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
+                               const JSValueRef args[], JSValueRef* exception);
+
 /**
  * Starts the HTTP server on the given port.
  */
@@ -205,6 +442,947 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef function,
 
 
 
+// =====================================================================================
+//                          MEMORY POOLS
+// =====================================================================================
+
+/**
+ * A pool of fixed-size objects carved from slabs. Declare one per hot struct:
+ *
+ *     static JADE_THREAD_LOCAL MemPool foo_pool = MEM_POOL_INIT("foo", Foo);
+ *
+ * Pools register themselves with the calling thread on first allocation.
+ */
+typedef struct MemPool {
+    const char* name;
+    size_t object_size;
+    void* free_list;
+    struct MemPoolSlab* slabs;
+    size_t capacity;            // Objects carved so far
+    size_t in_use;
+    uint64_t hits;              // Allocations served from the free list
+    uint64_t misses;            // Allocations that had to add a slab
+    bool registered;
+    struct MemPool* next;       // Thread's pool registry
+} MemPool;
+
+#define MEM_POOL_INIT(pool_name, type) { .name = (pool_name), .object_size = sizeof(type) }
+
+/**
+ * Takes an object from the pool. Contents are unspecified (see pool_free()).
+ * @return  Object, or NULL if a new slab could not be allocated.
+ */
+void* pool_alloc(MemPool* pool);
+
+/**
+ * Takes a zeroed object from the pool.
+ */
+void* pool_calloc(MemPool* pool);
+
+/**
+ * Returns an object to its pool. Only the first pointer-sized word is
+ * overwritten; fresh slab memory starts zeroed.
+ */
+void pool_free(MemPool* pool, void* object);
+
+/**
+ * First pool registered on the calling thread (follow `next`).
+ */
+MemPool* pool_registry(void);
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+/**
+ * uv_alloc_cb handing out pooled READ_BUFFER_SIZE buffers.
+ */
+void read_buffer_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
+
+/**
+ * Returns a buffer from read_buffer_alloc() once its bytes have been consumed.
+ * Call this from every read callback, including EOF and error paths.
+ */
+void read_buffer_release(const uv_buf_t* buf);
+
+
+// =====================================================================================
+//                          HTTP PARSER
+// =====================================================================================
+
+#define HTTP_MAX_HEADERS        64
+#define HTTP_MAX_HEAD_SIZE      (80 * 1024)
+#define HTTP_MAX_BODY_SIZE      (64ULL * 1024 * 1024)
+#define HTTP_MAX_METHOD_LENGTH  15
+
+typedef enum {
+    HTTP_PARSER_REQUEST,
+    HTTP_PARSER_RESPONSE
+} HttpParserType;
+
+typedef enum {
+    HTTP_PARSE_HEAD,            // Accumulating start line + headers
+    HTTP_PARSE_BODY_IDENTITY,   // Content-Length body
+    HTTP_PARSE_BODY_EOF,        // Response body delimited by connection close
+    HTTP_PARSE_CHUNK_SIZE,      // Reading a chunk-size line
+    HTTP_PARSE_CHUNK_DATA,      // Reading chunk payload
+    HTTP_PARSE_CHUNK_DATA_END,  // Expecting CRLF after chunk payload
+    HTTP_PARSE_TRAILERS,        // Reading (and discarding) trailer fields
+    HTTP_PARSE_COMPLETE,        // A full message is available
+    HTTP_PARSE_ERROR            // Malformed input, see `error`
+} HttpParseState;
+
+/**
+ * A header field stored as offsets into HttpParser.head.
+ */
+typedef struct {
+    size_t name_off;
+    size_t name_len;
+    size_t value_off;
+    size_t value_len;
+} HttpHeader;
+
+/**
+ * Incremental HTTP/1.x parser state for one message at a time.
+ * Buffers are owned by the parser and survive http_parser_reset().
+ */
+typedef struct {
+    HttpParserType type;
+    HttpParseState state;
+    int error;                  // Suggested HTTP status on HTTP_PARSE_ERROR
+
+    char* head;                 // Raw start line + headers (NUL-terminated once complete)
+    size_t head_len;
+    size_t head_cap;
+    size_t scan_pos;            // Where the CRLFCRLF search resumes
+
+    size_t method_off, method_len;
+    size_t url_off, url_len;
+    int status_code;
+    size_t reason_off, reason_len;
+    int version_major, version_minor;
+
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    size_t header_count;
+
+    uint64_t content_length;
+    bool has_content_length;
+    bool chunked;
+    bool keep_alive;
+    bool upgrade;
+    bool expect_continue;
+    bool skip_body;             // Set by the caller for responses to HEAD
+
+    uint64_t remaining;         // Bytes left in the current body/chunk
+    size_t line_len;            // Chunk-size / trailer line progress
+    bool in_chunk_ext;
+
+    char* body;                 // Decoded body (NUL-terminated)
+    size_t body_len;
+    size_t body_cap;
+} HttpParser;
+
+/**
+ * Prepares a parser for requests or responses.
+ */
+void http_parser_init(HttpParser* parser, HttpParserType type);
+
+/**
+ * Readies the parser for the next message on the same connection.
+ */
+void http_parser_reset(HttpParser* parser);
+
+/**
+ * Releases buffers owned by the parser.
+ */
+void http_parser_free(HttpParser* parser);
+
+/**
+ * Feeds bytes to the parser.
+ * @return  Number of bytes consumed. Stops early once a message completes or
+ *          an error occurs; unconsumed bytes belong to the next message.
+ */
+size_t http_parser_execute(HttpParser* parser, const char* data, size_t len);
+
+/**
+ * Signals end of stream (completes read-until-EOF response bodies).
+ */
+void http_parser_finish(HttpParser* parser);
+
+/**
+ * Case-insensitive lookup of the first header named `name` (lowercase).
+ * @return  Pointer into the head buffer, or NULL if absent.
+ */
+const char* http_parser_find_header(const HttpParser* parser, const char* name, size_t* value_len);
+
+
+// =====================================================================================
+//                          HTTP ROUTER
+// =====================================================================================
+
+#define HTTP_ROUTE_MAX_PARAMS   16
+
+typedef struct HttpRouter HttpRouter;
+
+/**
+ * One (method, pattern) pair; `data` belongs to the caller.
+ */
+typedef struct {
+    char method[HTTP_MAX_METHOD_LENGTH + 1];    // "*" matches any method
+    char** names;                               // Parameter names in pattern order
+    size_t param_count;
+    void* data;
+} HttpRoute;
+
+typedef struct {
+    const char* value;          // Points into the matched path, still percent-encoded
+    size_t len;
+} HttpRouteParam;
+
+typedef struct {
+    const HttpRoute* route;     // NULL if nothing matched
+    const char* allow;          // Methods of a route whose path matched but method did not
+    HttpRouteParam params[HTTP_ROUTE_MAX_PARAMS];
+} HttpRouteMatch;
+
+HttpRouter* http_router_new(void);
+
+/**
+ * Frees the tree, passing each route's data to `free_data` (which may be NULL).
+ */
+void http_router_free(HttpRouter* router, void (*free_data)(void* data));
+
+/**
+ * Adds a route. Patterns are paths whose segments may be `:name` (one
+ * non-empty segment) or, last, `*name` (the rest of the path, possibly empty).
+ * @param route  Set to the new route, or the existing one for the same method
+ *               and pattern shape, whose `data` the caller then replaces.
+ * @return  NULL, or a message describing why the pattern is invalid.
+ */
+const char* http_router_add(HttpRouter* router, const char* method, const char* pattern, HttpRoute** route);
+
+/**
+ * Matches a path (without its query string). Static segments win over
+ * parameters and parameters over wildcards; HEAD falls back to GET routes.
+ * @return  true if `match->route` was set.
+ */
+bool http_router_match(const HttpRouter* router, const char* method, size_t method_len,
+                       const char* path, size_t path_len, HttpRouteMatch* match);
+
+
+// =====================================================================================
+//                          STREAM WRITES
+// =====================================================================================
+
+#define WRITE_BATCH_INLINE_BUFS   8
+#define WRITE_BATCH_INLINE_ARENA  512
+
+typedef struct WriteBatch WriteBatch;
+typedef void (*WriteBatchCallback)(WriteBatch* batch, int status);
+
+/**
+ * A set of buffers sent with one vectored write.
+ * Slices either point into the batch's own arena or into pinned JS buffers.
+ */
+struct WriteBatch {
+    uv_write_t req;
+    JSContextRef ctx;
+    uv_buf_t* bufs;
+    size_t nbufs;
+    size_t bufs_cap;
+    size_t total;                       // Bytes across all slices
+    uv_buf_t inline_bufs[WRITE_BATCH_INLINE_BUFS];
+    JSValueRef* pinned;                 // JS objects protected until completion
+    size_t pinned_count;
+    size_t pinned_cap;
+    struct WriteBatchChunk* chunks;     // Overflow arena chunks
+    size_t inline_used;
+    char inline_arena[WRITE_BATCH_INLINE_ARENA];
+    WriteBatchCallback callback;
+    void* data;                         // Owner context for the callback
+    uint32_t flags;                     // Owner-defined flags
+};
+
+/**
+ * Creates an empty batch bound to a JS context (used for pinning).
+ */
+WriteBatch* write_batch_new(JSContextRef ctx);
+
+/**
+ * Releases a batch that was never sent.
+ */
+void write_batch_free(WriteBatch* batch);
+
+/**
+ * Reserves `len` bytes owned by the batch. The pointer stays valid until the
+ * batch is freed.
+ */
+char* write_batch_alloc(WriteBatch* batch, size_t len);
+
+/**
+ * Appends a slice by reference. Use len 0 to reserve a placeholder slot.
+ * @return  Index of the slot, usable with write_batch_set().
+ */
+size_t write_batch_add(WriteBatch* batch, const char* data, size_t len);
+
+/**
+ * Replaces the contents of a previously added slot.
+ */
+void write_batch_set(WriteBatch* batch, size_t index, const char* data, size_t len);
+
+/**
+ * Empties every slot from `from` onwards (the slots remain, with length 0).
+ */
+void write_batch_clear(WriteBatch* batch, size_t from);
+
+/**
+ * Keeps a JS value alive until the batch is freed.
+ */
+void write_batch_pin(WriteBatch* batch, JSValueRef value);
+
+/**
+ * Appends a JS value: ArrayBuffers and typed arrays are referenced in place,
+ * anything else is converted to a UTF-8 string inside the batch arena.
+ * @return  Number of bytes added.
+ */
+size_t write_batch_add_value(WriteBatch* batch, JSValueRef value, JSValueRef* exception);
+
+/**
+ * Sends the batch with uv_try_write(), queueing any remainder with uv_write().
+ * The callback runs (possibly synchronously) once all bytes were handed off
+ * or an error occurred; the batch is freed right after it returns.
+ * @return  0 or a libuv error code.
+ */
+int write_batch_send(WriteBatch* batch, uv_stream_t* stream, WriteBatchCallback callback);
+
+/**
+ * Returns the backing bytes of an ArrayBuffer or typed array view.
+ * @return  false if the value is not binary data.
+ */
+bool js_value_get_bytes(JSContextRef ctx, JSValueRef value, const char** data, size_t* len);
+
+
+// =====================================================================================
+//                          BUFFERS
+// =====================================================================================
+
+/**
+ * Creates the calling thread's Buffer prototype; bind_js_native_apis() calls it.
+ */
+void buffer_init(JSContextRef ctx);
+
+/**
+ * Wraps `len` bytes as a Buffer (a Uint8Array with Buffer.prototype) without
+ * copying; JSC calls `deallocator(bytes, deallocator_context)` on collection.
+ */
+JSObjectRef js_buffer_new(JSContextRef ctx, void* bytes, size_t len,
+                          JSTypedArrayBytesDeallocator deallocator, void* deallocator_context);
+
+/**
+ * Same as js_buffer_new() for malloc'd bytes, which the Buffer frees.
+ */
+JSObjectRef js_buffer_from_malloc(JSContextRef ctx, char* bytes, size_t len);
+
+/**
+ * Creates a Buffer holding a copy of `len` bytes.
+ */
+JSObjectRef js_buffer_copy(JSContextRef ctx, const void* data, size_t len);
+
+/**
+ * @return  true for Buffers made by this runtime.
+ */
+bool js_value_is_buffer(JSContextRef ctx, JSValueRef value);
+
+/**
+ * `Buffer.from(value[, encoding])` for strings (utf8, latin1, hex, base64),
+ * ArrayBuffers (shared), typed arrays (copied) and arrays of byte values.
+ */
+JSValueRef buffer_from(JSContextRef ctx, JSObjectRef function,
+                       JSObjectRef thisObject, size_t argc,
+                       const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `Buffer.alloc(size[, fill])`
+ */
+JSValueRef buffer_alloc(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `Buffer.byteLength(value[, encoding])`
+ */
+JSValueRef buffer_byte_length(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `Buffer.isBuffer(value)`
+ */
+JSValueRef buffer_is_buffer(JSContextRef ctx, JSObjectRef function,
+                            JSObjectRef thisObject, size_t argc,
+                            const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * `Buffer.concat(list[, totalLength])`
+ */
+JSValueRef buffer_concat(JSContextRef ctx, JSObjectRef function,
+                         JSObjectRef thisObject, size_t argc,
+                         const JSValueRef args[], JSValueRef* exception);
+
+
+// =====================================================================================
+//                          JSON
+// =====================================================================================
+
+/**
+ * Parses `len` bytes of UTF-8 JSON text into a JS value, as JSON.parse would.
+ * `data[len]` must be a NUL (HTTP parser bodies are); plain ASCII skips the
+ * UTF-16 conversion.
+ * @return  The value, or undefined with `*exception` set.
+ */
+JSValueRef json_parse_utf8(JSContextRef ctx, const char* data, size_t len, JSValueRef* exception);
+
+/**
+ * Serializes a value as JSON.stringify would and appends it to the batch as UTF-8.
+ * @return  Bytes added; 0 with `*exception` set if the value does not serialize.
+ */
+size_t json_stringify_to_batch(WriteBatch* batch, JSValueRef value, JSValueRef* exception);
+
+/**
+ * @return  true if the bytes, less surrounding whitespace, are an object or array.
+ */
+bool json_is_document(const char* data, size_t len);
+
+
+// =====================================================================================
+//                          COMPRESSION
+// =====================================================================================
+
+typedef enum {
+    CONTENT_ENCODING_IDENTITY,
+    CONTENT_ENCODING_GZIP,
+    CONTENT_ENCODING_DEFLATE,
+    CONTENT_ENCODING_BR,        // Only with JADE_HAVE_BROTLI
+    CONTENT_ENCODING_COUNT
+} ContentEncoding;
+
+typedef enum {
+    COMPRESS_NONE,              // Buffer as the coding sees fit
+    COMPRESS_FLUSH,             // Emit everything written so far (a chunk boundary)
+    COMPRESS_FINISH             // End the stream
+} CompressFlush;
+
+#define COMPRESS_LEVEL_DEFAULT  -1      // zlib 6, brotli 5
+#define COMPRESS_LEVEL_BEST     100     // zlib 9, brotli 11
+
+/**
+ * Growable malloc'd output; `data[len]` is kept a NUL.
+ */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} CompressBuffer;
+
+typedef struct Compressor Compressor;
+
+/**
+ * @return  The coding's token for Content-Encoding ("gzip", "br", ...).
+ */
+const char* content_encoding_name(ContentEncoding encoding);
+
+/**
+ * @return  The Accept-Encoding value the HTTP client sends.
+ */
+const char* content_encoding_accept(void);
+
+/**
+ * Reads a Content-Encoding value.
+ * @return  The coding, or IDENTITY for identity, unsupported codings and lists.
+ */
+ContentEncoding content_encoding_parse(const char* value, size_t len);
+
+/**
+ * Picks the best supported coding from an Accept-Encoding value, honouring
+ * q-values and `*`; equal weights prefer br, then gzip, then deflate.
+ * @return  IDENTITY if nothing acceptable is supported.
+ */
+ContentEncoding content_encoding_negotiate(const char* accept, size_t len);
+
+/**
+ * @return  true for text-like media types (any text type, JSON, JavaScript, XML, ...)
+ *          that are worth compressing; parameters are ignored.
+ */
+bool content_type_compressible(const char* type, size_t len);
+
+/**
+ * Creates a streaming compressor; `level` is 1-9 or a COMPRESS_LEVEL_ constant.
+ * Safe to use from any thread, one thread at a time.
+ * @return  NULL if the coding could not be initialized.
+ */
+Compressor* compressor_new(ContentEncoding encoding, int level);
+
+/**
+ * Compresses `len` bytes, appending the output to `out`.
+ * @return  false if the stream is broken (it must then be freed).
+ */
+bool compressor_write(Compressor* compressor, const char* data, size_t len,
+                      CompressFlush flush, CompressBuffer* out);
+
+void compressor_free(Compressor* compressor);
+
+/**
+ * Decodes a whole body into `out` (NUL-terminated). Gzip also accepts
+ * concatenated members and deflate also accepts a raw deflate stream.
+ * @return  NULL, or a message if the data is corrupt or decodes past `limit`
+ *          bytes; `out` is left empty then.
+ */
+const char* decompress_buffer(ContentEncoding encoding, const char* data, size_t len,
+                              size_t limit, CompressBuffer* out);
+
+
+// =====================================================================================
+//                          TLS
+// =====================================================================================
+
+typedef struct TlsContext TlsContext;
+typedef struct TlsSession TlsSession;
+
+/**
+ * Receives decrypted bytes for a session's owner, in order.
+ * @return  false once the owner has closed, to stop delivering.
+ */
+typedef bool (*TlsDataCallback)(void* owner, const char* data, size_t len);
+
+/**
+ * Builds a server context from a PEM certificate chain and private key.
+ * Session tickets use keys shared by every thread, so a worker resumes
+ * sessions another worker issued.
+ * @return  NULL with `*error` set if either does not load or they do not match.
+ */
+TlsContext* tls_server_context_new(const char* cert, size_t cert_len, const char* key, size_t key_len,
+                                   const char** error);
+
+void tls_context_free(TlsContext* context);
+
+/**
+ * Starts the server side of a connection on `stream`.
+ */
+TlsSession* tls_session_server(TlsContext* context, uv_stream_t* stream,
+                               TlsDataCallback on_data, void* owner);
+
+/**
+ * Starts a client handshake with `host` (sent as SNI and checked against the
+ * certificate unless `verify` is false). A session cached from an earlier
+ * connection to the same host and port is offered for resumption.
+ */
+TlsSession* tls_session_client(uv_stream_t* stream, const char* host, int port, bool verify,
+                               TlsDataCallback on_data, void* owner);
+
+/**
+ * Decrypts bytes read from the socket, answering the handshake as needed and
+ * passing any plaintext to the data callback.
+ * @return  0, UV_EOF once the peer sent close_notify, or UV_EPROTO (see
+ *          tls_session_error()).
+ */
+int tls_session_feed(TlsSession* session, const char* data, size_t len);
+
+/**
+ * Encrypts a batch and sends it on the session's stream. Like
+ * write_batch_send(), the callback runs once the ciphertext was handed off
+ * and the batch is freed after it; batches sent before the handshake ends
+ * are held until then.
+ * @return  0 or a libuv error code.
+ */
+int tls_session_write(TlsSession* session, WriteBatch* batch, WriteBatchCallback callback);
+
+/**
+ * Whether the handshake has completed.
+ */
+bool tls_session_established(const TlsSession* session);
+
+/**
+ * Queues close_notify; the connection is closed by its owner.
+ */
+void tls_session_shutdown(TlsSession* session);
+
+/**
+ * Why the last tls_session_feed() failed.
+ */
+const char* tls_session_error(const TlsSession* session);
+
+/**
+ * Frees a session once its stream is closed; held batches report UV_ECANCELED.
+ */
+void tls_session_free(TlsSession* session);
+
+
+// =====================================================================================
+//                          WEBSOCKETS
+// =====================================================================================
+
+#define WEBSOCKET_KEY_LENGTH            24      // Base64 of the 16-byte handshake nonce
+#define WEBSOCKET_ACCEPT_LENGTH         28      // Base64 of a SHA-1 digest
+#define WEBSOCKET_DEFAULT_MAX_PAYLOAD   (16 * 1024 * 1024)
+#define WEBSOCKET_DEFAULT_PING_INTERVAL 30000   // ms
+
+typedef struct WebSocket WebSocket;
+
+/**
+ * `{ maxPayload, pingInterval }` for server.websocket() and http.websocket().
+ */
+typedef struct {
+    size_t max_payload;         // Largest message accepted, after reassembly
+    uint64_t ping_interval;     // ms between keepalive pings; 0 disables them
+} WebSocketOptions;
+
+/**
+ * Asks the owner to close the connection; it calls websocket_detach() once
+ * the handle is closed.
+ */
+typedef void (*WebSocketCloseCallback)(void* owner);
+
+/**
+ * Reads WebSocket options from `value` (which may be NULL or not an object),
+ * filling in defaults.
+ * @return  false with `*exception` set for an invalid value.
+ */
+bool websocket_options_read(JSContextRef ctx, JSValueRef value, WebSocketOptions* options,
+                            JSValueRef* exception);
+
+/**
+ * Computes the Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+ */
+void websocket_accept_key(const char* key, size_t len, char accept[WEBSOCKET_ACCEPT_LENGTH + 1]);
+
+/**
+ * Generates a random Sec-WebSocket-Key for a client handshake.
+ */
+void websocket_client_key(char key[WEBSOCKET_KEY_LENGTH + 1]);
+
+/**
+ * Creates a WebSocket and its JS object, in the CONNECTING state. Client
+ * sockets mask the frames they send.
+ */
+WebSocket* websocket_new(JSContextRef ctx, bool client, const WebSocketOptions* options);
+
+JSObjectRef websocket_object(const WebSocket* ws);
+
+/**
+ * Opens the WebSocket on an upgraded connection. Frames go out on `stream`,
+ * through `tls` when it is set; both stay the owner's. Clients emit "open".
+ */
+void websocket_attach(WebSocket* ws, uv_stream_t* stream, TlsSession* tls,
+                      WebSocketCloseCallback close_transport, void* owner);
+
+/**
+ * Parses bytes read from the connection (plaintext on TLS).
+ */
+void websocket_receive(WebSocket* ws, const char* data, size_t len);
+
+/**
+ * Reports that the connection is gone, or could not be opened when `error`
+ * is set; emits "error" (if any) and "close".
+ */
+void websocket_detach(WebSocket* ws, const char* error);
+
+/**
+ * `http.broadcast(data, sockets)`: sends one message to every open WebSocket
+ * in the array, encoding the frame once.
+ * @return  How many sockets it was queued on.
+ */
+JSValueRef websocket_broadcast(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
+                               const JSValueRef args[], JSValueRef* exception);
+
+
+// =====================================================================================
+//                          EVENT LISTENERS
+// =====================================================================================
+
+#define EVENT_NAME_MAX 32
+
+/**
+ * Listeners registered with `obj.on(name, fn)` on a native object. Embed one
+ * in the object's native struct, zero-initialized.
+ */
+typedef struct {
+    struct EventListener* head;
+} EventListeners;
+
+/**
+ * Registers `callback` for event `name`. Both are validated from JS values.
+ * @return  false with `*exception` set if the arguments are unusable.
+ */
+bool event_listeners_on(EventListeners* listeners, JSContextRef ctx, JSValueRef name,
+                        JSValueRef callback, JSValueRef* exception);
+
+/**
+ * Whether any listener is registered for `name`.
+ */
+bool event_listeners_has(const EventListeners* listeners, const char* name);
+
+/**
+ * Calls every listener for `name` in registration order with `this` bound to
+ * `thisObject`. Listeners may add further listeners while it runs.
+ * @return  Whether any listener ran.
+ */
+bool event_listeners_emit(EventListeners* listeners, JSContextRef ctx, JSObjectRef thisObject,
+                          const char* name, size_t argc, const JSValueRef args[]);
+
+/**
+ * Drops (and unprotects) every listener.
+ */
+void event_listeners_clear(EventListeners* listeners, JSContextRef ctx);
+
+
+// =====================================================================================
+//                          COMPLETIONS
+// =====================================================================================
+
+/**
+ * Where an async request's outcome goes: a Node-style callback, or the
+ * resolve/reject pair of the promise returned to the caller. Embed one in the
+ * request's native struct.
+ */
+typedef struct {
+    JSObjectRef callback;
+    JSObjectRef resolve;
+    JSObjectRef reject;
+} Completion;
+
+/**
+ * Protects `callback` when it is a function; otherwise (usually undefined)
+ * makes a deferred promise and protects its resolve/reject functions.
+ * @return  The value the API returns to JS (the promise, or undefined in
+ *          callback mode), or NULL with `*exception` set.
+ */
+JSValueRef completion_init(Completion* completion, JSContextRef ctx, JSValueRef callback,
+                           JSValueRef* exception);
+
+/**
+ * Calls `callback(error, value)` (just `callback(error)` when `value` is
+ * NULL), or rejects with `error` / resolves with `value`. A NULL or null
+ * `error` means success. Releases the completion.
+ */
+void completion_settle(Completion* completion, JSContextRef ctx, JSValueRef error, JSValueRef value);
+
+/**
+ * completion_settle() with `message` as the error string and a null value.
+ */
+void completion_settle_error(Completion* completion, JSContextRef ctx, const char* message);
+
+/**
+ * Unprotects whatever the completion still holds; a no-op once settled.
+ */
+void completion_release(Completion* completion, JSContextRef ctx);
+
+
+// =====================================================================================
+//                          CONSOLE
+// =====================================================================================
+
+typedef enum {
+    CONSOLE_LOG,
+    CONSOLE_WARN,
+    CONSOLE_INFO,
+    CONSOLE_DEBUG,
+    CONSOLE_ERROR
+} ConsoleLevel;
+
+/**
+ * Formats `args` as one console line (space separated, or a JSON object in
+ * JSON mode) into the calling thread's ring; it reaches stdout at the end of
+ * the loop iteration.
+ */
+JSValueRef console_write_values(JSContextRef ctx, ConsoleLevel level, size_t argc,
+                                const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * printf-style console line from native code, ordered with JS console output.
+ */
+void console_printf(ConsoleLevel level, const char* fmt, ...);
+
+/**
+ * `console.configure({ json, onFull: "block" | "drop", bufferSize })`.
+ */
+JSValueRef js_console_configure(JSContextRef ctx, JSObjectRef function,
+                                JSObjectRef thisObject, size_t argc,
+                                const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * Writes out whatever the calling thread's console still holds and closes its
+ * stream; run_event_loop() calls this once the loop drains.
+ */
+void console_close(void);
+
+
+// =====================================================================================
+//                          METRICS
+// =====================================================================================
+
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} ByteCounters;
+
+/**
+ * Counters the modules bump on their hot paths; plain per-thread integers,
+ * read by process.metrics() and the Prometheus endpoint.
+ */
+typedef struct {
+    ByteCounters net;           // net sockets, both directions
+    ByteCounters http_server;   // http.createServer connections
+    ByteCounters http_client;   // Keep-alive agent sockets
+    ByteCounters websocket;     // Upgraded connections, frames included
+    size_t fs_work;             // fs jobs waiting on or running in the threadpool
+    size_t dns_lookups;         // uv_getaddrinfo() calls in flight
+    uint64_t dns_cache_hits;    // HTTP client connects answered from the DNS cache
+    uint64_t tls_handshakes;    // Completed TLS handshakes, client and server
+    uint64_t tls_resumed;       // Those that resumed an earlier session
+} RuntimeCounters;
+
+extern JADE_THREAD_LOCAL RuntimeCounters runtime_counters;
+
+/**
+ * `process.metrics()`: loop timings, handles by type, in-flight requests,
+ * socket byte counts, threadpool depth, timers and memory for this thread.
+ */
+JSValueRef js_process_metrics(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception);
+
+/**
+ * Renders the same metrics in the Prometheus text exposition format.
+ * @return  malloc'd text (caller frees), `*len` set to its length.
+ */
+char* metrics_format_prometheus(size_t* len);
+
+
+// =====================================================================================
+//                          PROFILER
+// =====================================================================================
+
+typedef struct {
+    const char* path;           // Output file; a ".cpuprofile" suffix selects Chrome's format
+    unsigned interval_us;       // Sampling period in CPU time (0 for the default of 1000)
+} ProfilerOptions;
+
+/**
+ * Starts sampling the calling (loop) thread. The profile is written by
+ * profiler_stop(), or at exit if the script ends the process first.
+ * Call after init_event_loop().
+ * @return  false if the profiler is already running or the timer failed.
+ */
+bool profiler_start(const ProfilerOptions* options);
+
+/**
+ * Stops sampling and writes the profile.
+ */
+void profiler_stop(void);
+
+/**
+ * True on the thread being profiled; spans on other threads cost one branch.
+ */
+extern JADE_THREAD_LOCAL bool profiler_enabled;
+
+/**
+ * Span stack depth saved by an enter call, or -1 when profiling is off.
+ * Prefer the PROFILE_*SPAN macros, which exit the span at end of scope.
+ */
+typedef int ProfileSpan;
+
+ProfileSpan profile_span_enter(const char* label);
+ProfileSpan profile_span_enter_api(JSContextRef ctx, const char* label);
+ProfileSpan profile_span_enter_call(JSContextRef ctx, JSObjectRef function, const char* label);
+void profile_span_exit(ProfileSpan* span);
+
+/**
+ * Span markers; each ends with its scope, so several in one scope nest:
+ *
+ *     PROFILE_SPAN("http.client.read");              // libuv callback
+ *     PROFILE_API_SPAN(ctx, "http.get");             // JS -> native, records the JS stack
+ *     PROFILE_CALL_SPAN(ctx, callback, "timer");     // native -> JS, records the callee
+ */
+#if defined(__GNUC__)
+#define PROFILE_SPAN_NAME_(line) profile_span_##line
+#define PROFILE_SPAN_VAR_(line) PROFILE_SPAN_NAME_(line)
+#define PROFILE_SPAN_SCOPE_(enter) \
+    ProfileSpan PROFILE_SPAN_VAR_(__LINE__) __attribute__((cleanup(profile_span_exit))) = \
+        (profiler_enabled ? (enter) : -1)
+#define PROFILE_SPAN(label) PROFILE_SPAN_SCOPE_(profile_span_enter(label))
+#define PROFILE_API_SPAN(ctx, label) PROFILE_SPAN_SCOPE_(profile_span_enter_api(ctx, label))
+#define PROFILE_CALL_SPAN(ctx, function, label) \
+    PROFILE_SPAN_SCOPE_(profile_span_enter_call(ctx, function, label))
+#else
+#define PROFILE_SPAN(label) ((void)0)
+#define PROFILE_API_SPAN(ctx, label) ((void)0)
+#define PROFILE_CALL_SPAN(ctx, function, label) ((void)0)
+#endif
+
+
+// =====================================================================================
+//                          CLUSTER
+// =====================================================================================
+
+/**
+ * Index of the worker running on the calling thread (0 for the main thread).
+ */
+extern JADE_THREAD_LOCAL int cluster_worker_id;
+
+/**
+ * Records the script every worker evaluates, in execute_js_source() form.
+ * Must outlive cluster_wait().
+ */
+void cluster_set_script(const char* source, size_t len, const char* source_url);
+
+/**
+ * Starts `workers - 1` additional threads, each with its own loop and JS
+ * context, running the recorded script. The calling (main) thread counts as
+ * worker 0. Only the first call from the main thread has any effect.
+ * @return  Number of workers now running.
+ */
+int cluster_start(int workers);
+
+/**
+ * Blocks until every worker thread has drained its loop.
+ */
+void cluster_wait(void);
+
+/**
+ * Number of workers sharing listening ports (1 when not clustered).
+ */
+int cluster_worker_count(void);
+
+/**
+ * Number of CPUs, used for `workers: "auto"` and `--workers auto`.
+ */
+int cluster_cpu_count(void);
+
+/**
+ * Reads the `workers` listen option: a number, or "auto" for one per CPU.
+ * @return  Requested worker count, or 0 when the option is absent.
+ */
+int cluster_workers_option(JSContextRef ctx, JSValueRef options);
+
+/**
+ * Binds a listening TCP handle. In cluster mode every worker binds the same
+ * address with SO_REUSEPORT so the kernel balances accepts across loops; where
+ * that is unavailable the first worker's socket is duplicated instead.
+ * @return  0 or a libuv error code.
+ */
+int cluster_bind(uv_tcp_t* handle, const struct sockaddr_in* addr);
+
+
+// =====================================================================================
+//                          WORKER THREADS
+// =====================================================================================
+
+/**
+ * Defines the global `Worker` constructor. On a worker thread the first
+ * context also gets `parentPort` and `workerData`.
+ */
+void worker_bind_globals(JSContextRef ctx, JSObjectRef global);
+
+
 // =====================================================================================
 //                          SYSTEM API INTERFACE
 // =====================================================================================
@@ -215,4 +1393,11 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef function,
  */
 void bind_js_native_apis(JSGlobalContextRef ctx);
 
+/**
+ * Class for global objects (timer functions), created once per thread along
+ * with the console/process/fs/http namespace classes.
+ * @return Thread-local class; never released.
+ */
+JSClassRef js_global_class(void);
+
 #endif // RUNTIME_H
\ No newline at end of file
@@ -68,6 +68,11 @@ fi
 run_test "Console API" "scripts/tests/console.test.js"
 run_test "Timers API" "scripts/tests/timers.test.js"
 run_test "Process API" "scripts/tests/process.test.js"
+run_test "FS API" "scripts/tests/fs.test.js"
+run_test "Buffer API" "scripts/tests/buffer.test.js"
+run_test "Net API" "scripts/tests/net.test.js"
+run_test "HTTP API" "scripts/tests/http.test.js"
+run_test "Worker API" "scripts/tests/worker.test.js"
 run_test "Runtime Info" "scripts/tests/runtime.test.js"
 
 if [ "$MODE" == "save" ]; then
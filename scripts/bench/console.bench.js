@@ -0,0 +1,6 @@
+// console.log throughput: argument formatting plus one printf per call
+// (bench.sh sends stdout to a pipe, as a log collector would)
+benchMain(async () => {
+    benchSync("console.log.string", () => console.log("request handled in 12ms"), 100);
+    benchSync("console.log.mixed", (i) => console.log("request", i, "status", 200, "ok", true), 100);
+});
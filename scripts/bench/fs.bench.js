@@ -0,0 +1,20 @@
+// fs.readFile of 1 KiB, 1 MiB and 100 MiB files, as Buffers (no UTF-8 decode)
+const FILES = [
+    { label: "1k", size: 1024, concurrency: 16 },
+    { label: "1m", size: 1024 * 1024, concurrency: 4 },
+    { label: "100m", size: 100 * 1024 * 1024, concurrency: 1 }
+];
+
+benchMain(async () => {
+    for (const file of FILES) {
+        const path = `/tmp/jade-bench-${file.label}.dat`;
+        await fs.promises.writeFile(path, "x".repeat(file.size));
+
+        const options = { concurrency: file.concurrency, extra: { bytesPerOp: file.size } };
+        await benchAsync(`fs.readFile.${file.label}`, options, (done) => {
+            fs.readFile(path, { encoding: null }, (err, data) => {
+                done(err || (data.length !== file.size ? "short read" : null));
+            });
+        });
+    }
+});
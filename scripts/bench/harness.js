@@ -0,0 +1,127 @@
+// Benchmark harness: bench.sh prepends this file to each *.bench.js.
+//
+//   jade <bench>.js <results.jsonl> [seconds]
+//
+// Each bench calls benchSync()/benchAsync() (or benchRecord() directly) from an
+// async function handed to benchMain(). Results are written to the results
+// file as one JSON object per line; a "BENCH" summary line is logged for each.
+
+const BENCH_OUT = process.argv[2];
+const BENCH_SECONDS = Number(process.argv[3]) || 2;
+const benchResults = [];
+
+function benchNow() {
+    const t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+}
+
+function benchPercentile(sorted, p) {
+    if (sorted.length === 0) return 0;
+    const i = Math.ceil(p * sorted.length) - 1;
+    return sorted[Math.min(sorted.length - 1, Math.max(0, i))];
+}
+
+// latencies: per-operation milliseconds; extra: bench-specific fields (a
+// `bytesPerOp` field adds mbPerSec)
+function benchRecord(name, ops, elapsedMs, latencies, extra) {
+    latencies.sort((a, b) => a - b);
+    const result = {
+        name,
+        ops,
+        seconds: elapsedMs / 1e3,
+        opsPerSec: elapsedMs > 0 ? ops / (elapsedMs / 1e3) : 0,
+        p50Ms: benchPercentile(latencies, 0.5),
+        p99Ms: benchPercentile(latencies, 0.99),
+        p999Ms: benchPercentile(latencies, 0.999)
+    };
+    Object.assign(result, extra || {});
+    if (result.bytesPerOp) result.mbPerSec = result.opsPerSec * result.bytesPerOp / (1024 * 1024);
+    benchResults.push(result);
+
+    let line = `BENCH ${name}: ${Math.round(result.opsPerSec)} ops/s` +
+               `  p50 ${result.p50Ms.toFixed(4)}ms  p99 ${result.p99Ms.toFixed(4)}ms` +
+               `  p999 ${result.p999Ms.toFixed(4)}ms`;
+    if (result.mbPerSec !== undefined) line += `  ${result.mbPerSec.toFixed(1)} MB/s`;
+    console.log(line);
+    return result;
+}
+
+// Runs fn in batches for BENCH_SECONDS; latency is the per-op mean of each batch,
+// since one hrtime() call costs about as much as the operations being timed
+function benchSync(name, fn, batch, extra) {
+    batch = batch || 1000;
+    const latencies = [];
+    let ops = 0;
+    const start = benchNow();
+    const deadline = start + BENCH_SECONDS * 1e3;
+    let now = start;
+    while (now < deadline) {
+        const t0 = now;
+        for (let i = 0; i < batch; i++) fn(i);
+        now = benchNow();
+        latencies.push((now - t0) / batch);
+        ops += batch;
+    }
+    return benchRecord(name, ops, now - start, latencies, Object.assign({ batch }, extra || {}));
+}
+
+// Keeps `concurrency` calls of op(done) in flight for BENCH_SECONDS or until
+// `maxOps` complete; each op calls done(err) once
+function benchAsync(name, options, op) {
+    const concurrency = options.concurrency || 1;
+    const maxOps = options.maxOps || Infinity;
+    const latencies = [];
+    let started = 0, completed = 0, failed = 0;
+
+    return new Promise((resolve) => {
+        const start = benchNow();
+        const deadline = start + BENCH_SECONDS * 1e3;
+
+        const launch = () => {
+            if (started >= maxOps || benchNow() >= deadline) return false;
+            started++;
+            const t0 = benchNow();
+            let finished = false;
+            op((err) => {
+                if (finished) return;
+                finished = true;
+                latencies.push(benchNow() - t0);
+                completed++;
+                if (err) failed++;
+                if (!launch() && completed === started) {
+                    const extra = Object.assign({ concurrency, errors: failed }, options.extra || {});
+                    resolve(benchRecord(name, completed, benchNow() - start, latencies, extra));
+                }
+            });
+            return true;
+        };
+
+        let launched = 0;
+        while (launched < concurrency && launch()) launched++;
+        if (launched === 0) resolve(benchRecord(name, 0, 0, latencies, options.extra));
+    });
+}
+
+// Starts the shared bench servers (scripts/bench/servers.js) on their own thread
+function benchServers() {
+    return new Promise((resolve) => {
+        const worker = new Worker("scripts/bench/servers.js");
+        worker.on("message", (msg) => {
+            if (msg.ready) resolve(msg);
+        });
+    });
+}
+
+function benchMain(main) {
+    main().then(() => {
+        const lines = benchResults.map((r) => JSON.stringify(r)).join("\n") + "\n";
+        if (!BENCH_OUT) process.exit(0);
+        fs.writeFile(BENCH_OUT, lines, (err) => {
+            if (err) console.error("BENCH could not write results:", err);
+            process.exit(err ? 1 : 0);
+        });
+    }, (err) => {
+        console.error("BENCH failed:", err);
+        process.exit(1);
+    });
+}
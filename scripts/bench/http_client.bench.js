@@ -0,0 +1,11 @@
+// HTTP client RPS: http.get through the keep-alive agent against a local server
+benchMain(async () => {
+    const servers = await benchServers();
+    const url = `http://127.0.0.1:${servers.httpPort}/`;
+
+    for (const concurrency of [1, 16]) {
+        await benchAsync(`http.client.get.c${concurrency}`, { concurrency }, (done) => {
+            http.get(url, (err) => done(err));
+        });
+    }
+});
@@ -0,0 +1,61 @@
+// HTTP server RPS from a built-in load generator: raw keep-alive connections,
+// each with `depth` requests written back to back (depth 1 is plain keep-alive)
+const CONNECTIONS = 32;
+const REQUEST = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+const STATUS_LINE = "HTTP/1.1 200";
+
+function loadGenerate(name, port, depth) {
+    const latencies = [];
+    let completed = 0;
+    let open = 0;
+    const start = benchNow();
+    const deadline = start + BENCH_SECONDS * 1e3;
+
+    return new Promise((resolve) => {
+        const finish = () => {
+            if (--open > 0) return;
+            resolve(benchRecord(name, completed, benchNow() - start, latencies,
+                                { connections: CONNECTIONS, pipelining: depth }));
+        };
+
+        for (let c = 0; c < CONNECTIONS; c++) {
+            open++;
+            const sent = [];     // Send times of requests awaiting a response
+            let tail = "";
+            const socket = net.connect({ port, host: "127.0.0.1" });
+
+            const fill = () => {
+                if (benchNow() >= deadline) return;
+                socket.cork();
+                while (sent.length < depth) {
+                    sent.push(benchNow());
+                    socket.write(REQUEST);
+                }
+                socket.uncork();
+            };
+
+            socket.on("data", (chunk) => {
+                // Responses are fixed-size and never contain the status line in
+                // their body, so counting status lines counts responses
+                const text = tail + chunk.toString();
+                let at = text.indexOf(STATUS_LINE);
+                while (at !== -1) {
+                    latencies.push(benchNow() - sent.shift());
+                    completed++;
+                    at = text.indexOf(STATUS_LINE, at + STATUS_LINE.length);
+                }
+                tail = text.slice(-(STATUS_LINE.length - 1));
+                if (sent.length === 0 && benchNow() >= deadline) socket.end();
+                else fill();
+            });
+            socket.on("close", finish);
+            fill();
+        }
+    });
+}
+
+benchMain(async () => {
+    const servers = await benchServers();
+    await loadGenerate("http.server.keepalive", servers.httpPort, 1);
+    await loadGenerate("http.server.pipelined_16", servers.httpPort, 16);
+});
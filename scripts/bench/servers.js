@@ -0,0 +1,16 @@
+// Worker side of the network benches: an HTTP server and a TCP echo server on
+// their own loop, so the load generator on the main thread does not share a CPU
+// with the server it measures
+const HTTP_PORT = 18090;
+const ECHO_PORT = 18091;
+
+http.createServer((req, res) => {
+    res.writeHead(200, { "Content-Type": "text/plain" });
+    res.end("hello world");
+}).listen(HTTP_PORT);
+
+net.createServer((socket) => {
+    socket.on("data", (chunk) => socket.write(chunk));
+}).listen(ECHO_PORT);
+
+parentPort.postMessage({ ready: true, httpPort: HTTP_PORT, echoPort: ECHO_PORT });
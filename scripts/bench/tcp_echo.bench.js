@@ -0,0 +1,44 @@
+// TCP echo throughput: one connection keeps `WINDOW` bytes in flight through the
+// echo server; each op is one chunk's round trip
+const CHUNK = 64 * 1024;
+const WINDOW = 16;
+
+benchMain(async () => {
+    const servers = await benchServers();
+    const payload = Buffer.alloc(CHUNK);
+    const socket = net.connect({ port: servers.echoPort, host: "127.0.0.1" });
+
+    const latencies = [];
+    const sent = [];
+    let received = 0;
+    let start = 0;
+    let deadline = 0;
+
+    await new Promise((resolve) => {
+        socket.on("connect", () => {
+            start = benchNow();
+            deadline = start + BENCH_SECONDS * 1e3;
+            for (let i = 0; i < WINDOW; i++) {
+                sent.push(benchNow());
+                socket.write(payload);
+            }
+        });
+        socket.on("data", (chunk) => {
+            received += chunk.length;
+            while (received >= CHUNK) {
+                received -= CHUNK;
+                latencies.push(benchNow() - sent.shift());
+                if (benchNow() < deadline) {
+                    sent.push(benchNow());
+                    socket.write(payload);
+                }
+            }
+            if (sent.length === 0) {
+                benchRecord("tcp.echo.64k", latencies.length, benchNow() - start, latencies,
+                            { window: WINDOW, bytesPerOp: CHUNK });
+                socket.destroy();
+                resolve();
+            }
+        });
+    });
+});
@@ -0,0 +1,7 @@
+// Timer wheel: create/cancel throughput and zero-delay timers firing
+benchMain(async () => {
+    const noop = () => {};
+    benchSync("timers.create_cancel", () => clearTimeout(setTimeout(noop, 1000)));
+
+    await benchAsync("timers.fire_0ms", { concurrency: 100 }, (done) => setTimeout(done, 0));
+});
@@ -1,6 +1,6 @@
 const server = http.createServer((req, res) => {
     console.log(`Received ${req.method} request for ${req.url}`);
-    res.end();
+    res.end("Hello, World!");
 });
 
 server.listen(8080);
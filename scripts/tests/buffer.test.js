@@ -0,0 +1,21 @@
+// Test Buffer.from encodes strings and Buffer#toString decodes them
+const buf = Buffer.from("héllo");
+console.log("BUFFER TEST: UTF-8 bytes:", buf.length, "text:", buf.toString());
+console.log("BUFFER TEST: Is Uint8Array:", buf instanceof Uint8Array, "isBuffer:", Buffer.isBuffer(buf));
+console.log("BUFFER TEST: Hex:", buf.toString("hex"), "base64:", buf.toString("base64"));
+console.log("BUFFER TEST: Decoded base64:", Buffer.from("aGVsbG8=", "base64").toString());
+console.log("BUFFER TEST: Latin-1 bytes:", Buffer.from("héllo", "latin1").length);
+
+// Test byte arrays, ArrayBuffers (shared) and slices of the output
+const bytes = Buffer.from([104, 105, 0, 33]);
+console.log("BUFFER TEST: From array:", bytes.toString("hex"), "slice:", bytes.toString("utf8", 0, 2));
+
+const ab = new ArrayBuffer(2);
+const view = Buffer.from(ab);
+new Uint8Array(ab)[0] = 7;
+console.log("BUFFER TEST: Shares ArrayBuffer:", view[0] === 7);
+
+// Test alloc, concat and byteLength
+console.log("BUFFER TEST: Alloc:", Buffer.alloc(3).toString("hex"), Buffer.alloc(2, 65).toString());
+console.log("BUFFER TEST: Concat:", Buffer.concat([Buffer.from("ab"), Buffer.from("cd")]).toString());
+console.log("BUFFER TEST: Byte length:", Buffer.byteLength("héllo"), Buffer.byteLength(bytes));
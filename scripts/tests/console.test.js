@@ -4,3 +4,16 @@ console.warn("LOG TEST: Warning message");
 console.info("LOG TEST: Info message");
 console.debug("LOG TEST: Debug message");
 console.error("LOG TEST: Error message");
+
+// Test JSON line mode: quotes and newlines are escaped, one object per line
+console.configure({ json: true, onFull: "drop", bufferSize: 65536 });
+console.log("LOG TEST: JSON", { toString: () => "with \"quotes\"\nand a newline" }, 42);
+console.configure({ json: false, onFull: "block" });
+console.log("LOG TEST: Back to text");
+
+// Test bad options are rejected
+try {
+    console.configure({ onFull: "wait" });
+} catch (e) {
+    console.log("LOG TEST: Rejected onFull:", e);
+}
@@ -0,0 +1,111 @@
+// Test fs.readFile returns files larger than a single read chunk in full
+const path = "scripts/results/fs_read.tmp";
+const content = "0123456789".repeat(5000);
+
+fs.writeFile(path, content, (err) => {
+    if (err) {
+        console.log("FS TEST: writeFile failed:", err);
+        return;
+    }
+
+    fs.readFile(path, (err, data) => {
+        console.log("FS TEST: String length matches:", !err && data.length === content.length);
+    });
+
+    // Raw bytes come back as a Buffer, or a bare ArrayBuffer on request
+    fs.readFile(path, { encoding: null }, (err, data) => {
+        console.log("FS TEST: Buffer:", Buffer.isBuffer(data), "bytes:", data.byteLength);
+    });
+    fs.readFile(path, "arraybuffer", (err, data) => {
+        console.log("FS TEST: ArrayBuffer:", data instanceof ArrayBuffer, "bytes:", data.byteLength);
+    });
+});
+
+// Test files of 1 MiB or more, which are mmap'd on the threadpool, come back in full
+const bigPath = "scripts/results/fs_big.tmp";
+const bigContent = "abcdefghijklmnop".repeat(1024 * 96);
+fs.writeFile(bigPath, bigContent, (err) => {
+    fs.readFile(bigPath, (err, data) => {
+        console.log("FS TEST: Mapped string matches:", !err && data === bigContent);
+    });
+    fs.readFile(bigPath, { encoding: null }, (err, data) => {
+        console.log("FS TEST: Mapped Buffer:", Buffer.isBuffer(data), "bytes:", data.byteLength,
+                    "tail:", data.toString().slice(-4));
+    });
+});
+
+// Test files that report no size (procfs) are read until EOF instead
+fs.readFile("/proc/self/status", (err, data) => {
+    console.log("FS TEST: Sizeless file read:", !err && data.indexOf("Name:") === 0);
+});
+
+// Test binary content with NUL bytes survives writeFile/readFile
+const binPath = "scripts/results/fs_binary.tmp";
+fs.writeFile(binPath, Buffer.from([0, 1, 0, 255]), (err) => {
+    fs.readFile(binPath, { encoding: null }, (err, data) => {
+        console.log("FS TEST: Binary round trip:", !err && data.toString("hex"));
+    });
+});
+
+// Test errors are passed to the callback
+fs.readFile("scripts/tests/does-not-exist.txt", (err, data) => {
+    console.log("FS TEST: Missing file error:", typeof err === "string", "data:", data);
+});
+
+// Test write/read streams round-trip in chunks with backpressure
+const streamPath = "scripts/results/fs_stream.tmp";
+const out = fs.createWriteStream(streamPath, { highWaterMark: 1024 });
+let written = 0;
+let drains = 0;
+
+function pump() {
+    while (written < 2000) {
+        if (!out.write(`line ${written++}\n`)) return;
+    }
+    out.end();
+}
+out.on("drain", () => {
+    drains++;
+    pump();
+});
+out.on("finish", () => {
+    let chunks = 0;
+    let text = "";
+    const input = fs.createReadStream(streamPath, { highWaterMark: 4096 });
+    input.on("data", (chunk) => {
+        chunks++;
+        text += chunk;
+    });
+    input.on("end", () => {
+        console.log("FS TEST: Stream drains:", drains > 0, "chunks:", chunks > 1,
+                    "lines:", text.split("\n").length - 1);
+    });
+});
+pump();
+
+// Test batched stat/read deliver one callback with per-path results
+const batchPaths = ["scripts/tests/fs.test.js", "scripts/tests/does-not-exist.txt", "scripts/tests"];
+fs.statMany(batchPaths, (errors, stats) => {
+    console.log("FS TEST: statMany file:", stats[0].isFile, "missing:", typeof errors[1] === "string",
+                "dir:", stats[2].isDirectory);
+});
+fs.readMany(batchPaths.slice(0, 2), (errors, contents) => {
+    console.log("FS TEST: readMany content:", contents[0].indexOf("statMany") !== -1,
+                "missing:", errors[0] === null && contents[1] === null);
+});
+
+// Test fs.promises settles natively, continuing await chains without extra loop turns
+const promisePath = "scripts/results/fs_promise.tmp";
+(async () => {
+    await fs.promises.writeFile(promisePath, "promised");
+    const text = await fs.promises.readFile(promisePath);
+    const bytes = await fs.promises.readFile(promisePath, { encoding: null });
+    const exists = await fs.promises.exists(promisePath);
+    let rejected = false;
+    try {
+        await fs.promises.readFile("scripts/tests/does-not-exist.txt");
+    } catch (err) {
+        rejected = typeof err === "string";
+    }
+    console.log("FS TEST: Promises:", text, Buffer.isBuffer(bytes), exists, "rejected:", rejected);
+})();
@@ -0,0 +1,250 @@
+// Test JSON bodies: req.json() and res.json() on the server, response.json() on the client
+const server = http.createServer((req, res) => {
+    if (req.url === "/empty") {
+        res.end();
+        return;
+    }
+    const body = req.json();
+    res.json({ echo: body, method: req.method });
+});
+server.listen(18019);
+
+// Test server.route(): handlers get req.params; prepared responses, 404 and 405 are answered natively
+const router = http.createServer();
+router.route("GET", "/users/:id/files/*path", (req, res) => {
+    res.json({ id: req.params.id, path: req.params.path });
+});
+router.route("GET", "/users/new", { body: "new user form" });
+router.route("GET", "/health", { status: 200, headers: { "Content-Type": "application/json" }, body: '{"ok":true}' });
+router.websocket("/chat/:room", (ws, req) => {
+    ws.on("message", (data, isBinary) => {
+        if (data === "broadcast") http.broadcast("to " + req.params.room, [ws]);
+        else ws.send(data);
+    });
+});
+router.listen(18020);
+
+// Test compression: text bodies above the threshold are gzip/br encoded, and the client decodes them
+const compressed = http.createServer((req, res) => {
+    if (req.url === "/chunks") {
+        res.write("chunk one\n".repeat(200));
+        res.end("chunk two\n".repeat(200));
+        return;
+    }
+    res.end("compress me\n".repeat(req.url === "/large" ? 20000 : 200));
+});
+compressed.listen(18021, { compression: true });
+
+// Test the incremental parser over raw sockets: pipelining, chunked bodies, 100-continue and errors
+const raw = http.createServer((req, res) => {
+    if (req.url === "/headers") {
+        // Lazy header objects: repeated fields are joined, rawHeaders keeps wire order
+        res.setHeader("X-A", ["1", "2"]);
+        res.json({ joined: req.headers["x-a"], host: req.headers.host, raw: req.rawHeaders });
+        return;
+    }
+    res.end(req.method + " " + req.url + " [" + req.body + "]");
+});
+raw.listen(18022);
+
+// Sends each step once the previous step's `until` text has arrived; resolves with
+// everything read when the server closes the socket
+function exchange(port, steps) {
+    return new Promise((resolve) => {
+        const socket = net.connect({ port, host: "127.0.0.1" });
+        let received = "";
+        let step = 0;
+        socket.on("data", (chunk) => {
+            received += chunk.toString();
+            while (step < steps.length && steps[step].until && received.indexOf(steps[step].until) !== -1) {
+                if (++step < steps.length) socket.write(steps[step].send);
+            }
+        });
+        socket.on("close", () => resolve(received));
+        socket.write(steps[0].send);
+    });
+}
+
+function statusLines(text) {
+    return (text.match(/HTTP\/1\.1 \d{3}[^\r]*/g) || []).join(" | ");
+}
+
+// Test res.sendFile: validators, conditional requests, ranges and root confinement
+const files = http.createServer((req, res) => {
+    res.sendFile(req.url, { root: "scripts/tests" });
+});
+files.listen(18023);
+
+function fileRequest(path, headers) {
+    return exchange(18023, [{ send: "GET " + path + " HTTP/1.1\r\nHost: x\r\n" + headers + "Connection: close\r\n\r\n" }]);
+}
+
+function headerValue(text, name) {
+    const match = text.match(new RegExp("\r\n" + name + ": ([^\r]*)", "i"));
+    return match ? match[1] : null;
+}
+
+// Test the keep-alive agent: a plain TCP server counts the sockets it is asked on
+let agentSockets = 0;
+const counting = net.createServer((socket) => {
+    agentSockets++;
+    socket.on("data", () => {
+        socket.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok");
+    });
+});
+counting.listen(18024);
+
+(async () => {
+    const res = await http.post("http://127.0.0.1:18019/", ' {"name":"jade","tags":["é",1]}\n');
+    console.log("HTTP TEST: Content-Type:", res.headers["content-type"]);
+    const data = res.json();
+    console.log("HTTP TEST: json():", data.method, data.echo.name, data.echo.tags[0], data.echo.tags[1]);
+    console.log("HTTP TEST: body:", res.body);
+
+    const empty = await http.get("http://127.0.0.1:18019/empty");
+    console.log("HTTP TEST: empty body reads as:", empty.body);
+    try {
+        empty.json();
+    } catch (err) {
+        console.log("HTTP TEST: empty json() throws:", err);
+    }
+
+    const routed = (await http.get("http://127.0.0.1:18020/users/a%20b/files/docs/x.txt?v=1")).json();
+    console.log("HTTP TEST: route params:", routed.id, routed.path);
+    console.log("HTTP TEST: static segment wins:", (await http.get("http://127.0.0.1:18020/users/new")).body);
+    const health = await http.get("http://127.0.0.1:18020/health");
+    console.log("HTTP TEST: prepared response:", health.headers["content-type"], health.json().ok);
+    console.log("HTTP TEST: unrouted path:", (await http.get("http://127.0.0.1:18020/nope")).statusCode);
+    const wrong = await http.post("http://127.0.0.1:18020/health", "x");
+    console.log("HTTP TEST: wrong method:", wrong.statusCode, wrong.headers.allow);
+
+    for (const path of ["/", "/large", "/chunks"]) {
+        const res = await http.get("http://127.0.0.1:18021" + path);
+        console.log("HTTP TEST: compressed", path, res.headers["content-encoding"], res.headers.vary, res.body.length);
+    }
+
+    // HEAD negotiates like GET, so it advertises the compressed length and coding
+    const headOnly = await exchange(18021, [{
+        send: "HEAD /large HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n"
+    }]);
+    const gzipped = await exchange(18021, [{
+        send: "GET /large HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n"
+    }]);
+    console.log("HTTP TEST: HEAD matches GET:", headerValue(headOnly, "Content-Encoding"),
+                headerValue(headOnly, "Content-Length") === headerValue(gzipped, "Content-Length"),
+                headerValue(headOnly, "Vary"));
+
+    // TLS: bad key material is rejected up front, and a plain HTTP port fails the handshake
+    try {
+        https.createServer({ key: "not a key", cert: "not a cert" });
+    } catch (err) {
+        console.log("HTTP TEST: https.createServer with bad PEM throws:", err);
+    }
+    try {
+        await https.get("https://127.0.0.1:18021/");
+    } catch (err) {
+        console.log("HTTP TEST: https:// to a plain HTTP port rejects");
+    }
+
+    // Two pipelined requests in one write are answered in order on the same socket
+    const pipelined = await exchange(18022, [{
+        send: "GET /first HTTP/1.1\r\nHost: x\r\n\r\nGET /second HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"
+    }]);
+    console.log("HTTP TEST: pipelined in order:", pipelined.indexOf("GET /first") < pipelined.indexOf("GET /second"),
+                statusLines(pipelined));
+
+    // A keep-alive socket stays open for a second request sent after the first response
+    const reused = await exchange(18022, [
+        { send: "GET /one HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n", until: "GET /one" },
+        { send: "GET /two HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n" }
+    ]);
+    console.log("HTTP TEST: keep-alive reuse:", reused.indexOf("GET /two") !== -1, statusLines(reused));
+
+    const chunked = await exchange(18022, [{
+        send: "POST /chunked HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n" +
+              "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"
+    }]);
+    console.log("HTTP TEST: chunked body:", chunked.slice(chunked.indexOf("POST")));
+
+    // The body is only sent once the server has answered 100 Continue
+    const continued = await exchange(18022, [
+        { send: "POST /expect HTTP/1.1\r\nHost: x\r\nExpect: 100-continue\r\nContent-Length: 4\r\nConnection: close\r\n\r\n",
+          until: "100 Continue" },
+        { send: "ping" }
+    ]);
+    console.log("HTTP TEST: expect:", statusLines(continued), continued.slice(continued.indexOf("POST")));
+
+    const manyHeaders = "X-H: 1\r\n".repeat(65);
+    for (const request of [
+        "GET / HTTP/1.1\r\nHost: x\r\nNo colon here\r\n\r\n",
+        "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 999999999999\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: x\r\n" + manyHeaders + "\r\n",
+        "POST / HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: gzip\r\n\r\n"
+    ]) {
+        console.log("HTTP TEST: parse error reply:", statusLines(await exchange(18022, [{ send: request }])));
+    }
+
+    const file = await fileRequest("/buffer.test.js", "");
+    const etag = headerValue(file, "ETag");
+    const lastModified = headerValue(file, "Last-Modified");
+    console.log("HTTP TEST: sendFile:", statusLines(file), "etag:", etag !== null, "last-modified:", lastModified !== null);
+    console.log("HTTP TEST: sendFile If-None-Match:", statusLines(await fileRequest("/buffer.test.js", "If-None-Match: " + etag + "\r\n")));
+    console.log("HTTP TEST: sendFile If-Modified-Since:",
+                statusLines(await fileRequest("/buffer.test.js", "If-Modified-Since: " + lastModified + "\r\n")));
+    const range = await fileRequest("/buffer.test.js", "Range: bytes=3-6\r\n");
+    console.log("HTTP TEST: sendFile range:", statusLines(range), headerValue(range, "Content-Range"),
+                range.slice(range.indexOf("\r\n\r\n") + 4));
+    const unsatisfiable = await fileRequest("/buffer.test.js", "Range: bytes=99999999-\r\n");
+    console.log("HTTP TEST: sendFile unsatisfiable range:", statusLines(unsatisfiable), headerValue(unsatisfiable, "Content-Range"));
+    console.log("HTTP TEST: sendFile stale If-Range:",
+                statusLines(await fileRequest("/buffer.test.js", "Range: bytes=3-6\r\nIf-Range: \"stale\"\r\n")));
+    console.log("HTTP TEST: sendFile outside root:", statusLines(await fileRequest("/../../README.md", "")));
+
+    const echoed = await exchange(18022, [{
+        send: "GET /headers HTTP/1.1\r\nHost: x\r\nX-A: 1\r\nx-a: 2\r\nConnection: close\r\n\r\n"
+    }]);
+    const seen = JSON.parse(echoed.slice(echoed.indexOf("\r\n\r\n") + 4));
+    console.log("HTTP TEST: req.headers:", seen.joined, seen.host, "rawHeaders:", seen.raw.join(","));
+    const fromServer = await http.get("http://127.0.0.1:18022/headers");
+    const rawPairs = [];
+    for (let i = 0; i < fromServer.rawHeaders.length; i += 2) {
+        if (fromServer.rawHeaders[i] === "X-A") rawPairs.push(fromServer.rawHeaders[i + 1]);
+    }
+    console.log("HTTP TEST: response.headers:", fromServer.headers["x-a"], "rawHeaders:", rawPairs.join(","),
+                "keys:", Object.keys(fromServer.headers).indexOf("x-a") !== -1);
+
+    // Sequential requests to one host go over the agent's single kept-alive socket
+    for (let i = 0; i < 3; i++) await http.get("http://127.0.0.1:18024/agent/" + i);
+    console.log("HTTP TEST: agent sockets for 3 requests:", agentSockets);
+
+    // Two lookups of one name in a row: the first resolves, the second is answered from
+    // the cache, and both connect through the happy-eyeballs race
+    const hits = process.metrics().http.dnsCacheHits;
+    const first = await http.get("http://localhost:18019/empty");
+    const afterFirst = process.metrics().http.dnsCacheHits - hits;
+    const second = await http.get("http://localhost:18024/dns");
+    console.log("HTTP TEST: DNS cache:", first.statusCode, second.statusCode, "hits:", afterFirst,
+                process.metrics().http.dnsCacheHits - hits);
+
+    // WebSocket: echo, a binary round trip, broadcast and the close handshake
+    const ws = http.websocket("ws://127.0.0.1:18020/chat/lobby");
+    const messages = [];
+    const closed = new Promise((resolve) => {
+        ws.on("message", (data, isBinary) => {
+            messages.push(isBinary ? "binary:" + data.length : data);
+            if (messages.length === 3) ws.close(1000, "done");
+        });
+        ws.on("close", (code, reason) => resolve(code + " " + reason));
+    });
+    ws.on("open", () => {
+        ws.send("hello");
+        ws.send(Buffer.alloc(70000));
+        ws.send("broadcast");
+    });
+    console.log("HTTP TEST: websocket closed with:", await closed);
+    console.log("HTTP TEST: websocket messages:", messages.join(", "));
+    process.exit(0);
+})().catch((err) => {
+    console.error("HTTP TEST failed:", err);
+    process.exit(1);
+});
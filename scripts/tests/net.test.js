@@ -0,0 +1,26 @@
+// Test an echo server: reads arrive as Buffers and are written straight back,
+// with corked fragments going out as one write
+const server = net.createServer((socket) => {
+    socket.on("data", (chunk) => {
+        socket.cork();
+        for (const part of ["<", chunk, ">"]) socket.write(part);
+        socket.uncork();
+    });
+    socket.on("end", () => console.log("NET TEST: Server saw end after", socket.bytesRead, "bytes"));
+});
+server.listen(18018);
+
+// Test net.connect: writes made while connecting are held and sent in order
+const client = net.connect({ port: 18018, host: "127.0.0.1", highWaterMark: 4 }, () => {
+    console.log("NET TEST: Connected");
+    client.end("-bye");
+});
+console.log("NET TEST: write() past highWaterMark returns:", client.write("hello"));
+
+let received = "";
+client.on("drain", () => console.log("NET TEST: Drained"));
+client.on("data", (chunk) => { received += chunk.toString(); });
+client.on("close", (hadError) => {
+    console.log("NET TEST: Echoed:", received, "hadError:", hadError, "written:", client.bytesWritten);
+    process.exit(0);
+});
@@ -1,6 +1,28 @@
 // Test process.argv
 console.log("PROCESS TEST: Arguments:", process.argv);
 
+// Test process.poolStats (timers come from the "timer.node" pool)
+setTimeout(() => {
+    const stats = process.poolStats()["timer.node"];
+    console.log("PROCESS TEST: Timer pool in use:", stats.inUse >= 1, "misses:", stats.misses >= 1);
+}, 10);
+
+// Test process.metrics reports loop timings and live timers
+setTimeout(() => {
+    const m = process.metrics();
+    console.log("PROCESS TEST: Metrics iterations:", m.loop.iterations > 0,
+                "timers:", m.timers >= 1, "handles:", m.handles.total > 0, "rss:", m.memory.rss > 0);
+}, 50);
+
+// Test process.hrtime is monotonic and diffs against an earlier tuple. Timers are
+// scheduled from the loop's cached millisecond clock, so allow a few ms of slack
+const hrStart = process.hrtime();
+setTimeout(() => {
+    const [sec, nsec] = process.hrtime(hrStart);
+    const elapsedMs = sec * 1e3 + nsec / 1e6;
+    console.log("PROCESS TEST: hrtime elapsed >= 15ms:", elapsedMs >= 15, "nanoseconds < 1e9:", nsec < 1e9);
+}, 20);
+
 // Test process.exit
 setTimeout(() => {
     console.log("PROCESS TEST: Exiting with code 42");
@@ -15,4 +15,15 @@ const intervalId = setInterval(() => {
         clearInterval(intervalId);
         console.log("TIMER TEST: Interval cleared");
     }
-}, 200);
\ No newline at end of file
+}, 200);
+
+// Test that timers fire in deadline order, ties in creation order
+const order = [];
+setTimeout(() => order.push("c"), 30);
+setTimeout(() => order.push("a"), 10);
+setTimeout(() => order.push("b"), 10);
+const cancelled = setTimeout(() => order.push("x"), 20);
+clearTimeout(cancelled);
+setTimeout(() => {
+    console.log(`TIMER TEST: Order ${order.join("")}`);
+}, 40);
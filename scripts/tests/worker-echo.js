@@ -0,0 +1,10 @@
+// Worker side of worker.test.js: doubles numbers and inverts bytes on its own thread
+parentPort.on("message", (msg) => {
+    if (msg.bytes) {
+        const out = new Uint8Array(msg.bytes.length);
+        for (let i = 0; i < out.length; i++) out[i] = 255 - msg.bytes[i];
+        parentPort.postMessage({ bytes: out, label: workerData.label, note: msg.note });
+        return;
+    }
+    parentPort.postMessage({ doubled: msg.n * 2, label: workerData.label });
+});
@@ -0,0 +1,19 @@
+// Test a worker thread: JSON values and binary data in both directions
+const worker = new Worker("scripts/tests/worker-echo.js", { workerData: { label: "echo" } });
+console.log("WORKER TEST: Thread id:", worker.threadId);
+
+let replies = 0;
+worker.on("message", (msg) => {
+    if (msg.doubled !== undefined) {
+        console.log("WORKER TEST: Doubled:", msg.doubled, "label:", msg.label);
+    } else {
+        console.log("WORKER TEST: Inverted bytes:", Array.from(msg.bytes).join(","), "Uint8Array:", msg.bytes instanceof Uint8Array);
+        // A user key that looks like a blob marker comes back as plain data
+        console.log("WORKER TEST: Marker-like note:", JSON.stringify(msg.note));
+    }
+    if (++replies === 2) worker.terminate();
+});
+worker.on("exit", (code) => console.log("WORKER TEST: Exited with code", code));
+
+worker.postMessage({ n: 21 });
+worker.postMessage({ bytes: new Uint8Array([0, 1, 254]), note: { __jadeBlob: 0 } });
@@ -0,0 +1,385 @@
+/**
+ * =====================================================================================
+ *
+ *        BUFFER.C - Binary Buffers for Native I/O
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - The global `Buffer` (from, alloc, byteLength, isBuffer, concat)
+ * - Wrapping native byte ranges as Buffers without copying them
+ * - Encoding and decoding utf8, latin1, hex and base64
+ *
+ * Representation:
+ * - A Buffer is a Uint8Array whose prototype is the per-thread Buffer prototype,
+ *   which adds toString() on top of Uint8Array.prototype; anything that takes
+ *   bytes (js_value_get_bytes) accepts Buffers, typed arrays and ArrayBuffers
+ *
+ * Memory Management:
+ * - js_buffer_new() hands ownership of the bytes to JSC, which calls the
+ *   deallocator when the Buffer is collected
+ * - The prototype object is protected for the life of the thread's context
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+typedef enum {
+    BUFFER_UTF8,
+    BUFFER_LATIN1,
+    BUFFER_HEX,
+    BUFFER_BASE64,
+    BUFFER_UNKNOWN
+} BufferEncoding;
+
+static JADE_THREAD_LOCAL JSClassRef buffer_prototype_class = NULL;
+static JADE_THREAD_LOCAL JSObjectRef buffer_prototype = NULL;
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static JSValueRef buffer_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
+}
+
+static void buffer_free_bytes(void* bytes, void* context) {
+    free(bytes);
+}
+
+// `undefined` means utf8; unrecognised names yield BUFFER_UNKNOWN
+static BufferEncoding buffer_encoding(JSContextRef ctx, JSValueRef value) {
+    if (!value || JSValueIsUndefined(ctx, value)) return BUFFER_UTF8;
+    if (!JSValueIsString(ctx, value)) return BUFFER_UNKNOWN;
+
+    JSStringRef str = JSValueToStringCopy(ctx, value, NULL);
+    BufferEncoding encoding = BUFFER_UNKNOWN;
+    if (JSStringIsEqualToUTF8CString(str, "utf8") || JSStringIsEqualToUTF8CString(str, "utf-8")) {
+        encoding = BUFFER_UTF8;
+    } else if (JSStringIsEqualToUTF8CString(str, "latin1") || JSStringIsEqualToUTF8CString(str, "binary")) {
+        encoding = BUFFER_LATIN1;
+    } else if (JSStringIsEqualToUTF8CString(str, "hex")) {
+        encoding = BUFFER_HEX;
+    } else if (JSStringIsEqualToUTF8CString(str, "base64")) {
+        encoding = BUFFER_BASE64;
+    }
+    JSStringRelease(str);
+    return encoding;
+}
+
+static int hex_value(JSChar c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int base64_value(JSChar c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+' || c == '-') return 62;
+    if (c == '/' || c == '_') return 63;
+    return -1;
+}
+
+// Encodes a JS string into a malloc'd byte array
+static char* buffer_encode_string(JSStringRef str, BufferEncoding encoding, size_t* out_len) {
+    if (encoding == BUFFER_UTF8) {
+        size_t max = JSStringGetMaximumUTF8CStringSize(str);
+        char* bytes = malloc(max);
+        *out_len = JSStringGetUTF8CString(str, bytes, max) - 1;
+        return bytes;
+    }
+
+    const JSChar* chars = JSStringGetCharactersPtr(str);
+    size_t len = JSStringGetLength(str);
+    char* bytes = malloc(len ? len : 1);
+    size_t n = 0;
+
+    if (encoding == BUFFER_LATIN1) {
+        for (size_t i = 0; i < len; i++) bytes[n++] = (char)(chars[i] & 0xFF);
+    } else if (encoding == BUFFER_HEX) {
+        // Stops at the first pair that is not valid hex, as Node does
+        for (size_t i = 0; i + 1 < len; i += 2) {
+            int hi = hex_value(chars[i]), lo = hex_value(chars[i + 1]);
+            if (hi < 0 || lo < 0) break;
+            bytes[n++] = (char)(hi << 4 | lo);
+        }
+    } else {
+        // Skips whitespace and padding; accepts the URL-safe alphabet too
+        uint32_t acc = 0;
+        int bits = 0;
+        for (size_t i = 0; i < len; i++) {
+            int v = base64_value(chars[i]);
+            if (v < 0) continue;
+            acc = (acc << 6) | (uint32_t)v;
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                bytes[n++] = (char)((acc >> bits) & 0xFF);
+            }
+        }
+    }
+
+    *out_len = n;
+    return bytes;
+}
+
+static JSStringRef buffer_decode(const unsigned char* data, size_t len, BufferEncoding encoding) {
+    if (encoding == BUFFER_UTF8) return js_string_from_utf8((const char*)data, len);
+
+    size_t out_len = encoding == BUFFER_LATIN1 ? len
+                   : encoding == BUFFER_HEX ? len * 2
+                   : (len + 2) / 3 * 4;
+    JSChar stack_buf[256];
+    JSChar* out = out_len <= 256 ? stack_buf : malloc(out_len * sizeof(JSChar));
+    size_t n = 0;
+
+    if (encoding == BUFFER_LATIN1) {
+        for (size_t i = 0; i < len; i++) out[n++] = data[i];
+    } else if (encoding == BUFFER_HEX) {
+        static const char digits[] = "0123456789abcdef";
+        for (size_t i = 0; i < len; i++) {
+            out[n++] = digits[data[i] >> 4];
+            out[n++] = digits[data[i] & 0x0F];
+        }
+    } else {
+        for (size_t i = 0; i < len; i += 3) {
+            uint32_t triple = (uint32_t)data[i] << 16;
+            if (i + 1 < len) triple |= (uint32_t)data[i + 1] << 8;
+            if (i + 2 < len) triple |= data[i + 2];
+            out[n++] = base64_chars[(triple >> 18) & 0x3F];
+            out[n++] = base64_chars[(triple >> 12) & 0x3F];
+            out[n++] = i + 1 < len ? base64_chars[(triple >> 6) & 0x3F] : '=';
+            out[n++] = i + 2 < len ? base64_chars[triple & 0x3F] : '=';
+        }
+    }
+
+    JSStringRef str = JSStringCreateWithCharacters(out, n);
+    if (out != stack_buf) free(out);
+    return str;
+}
+
+// ================== Buffer Objects ================== //
+
+static JSObjectRef buffer_adopt(JSContextRef ctx, JSObjectRef array) {
+    if (array && buffer_prototype) JSObjectSetPrototype(ctx, array, buffer_prototype);
+    return array;
+}
+
+JSObjectRef js_buffer_new(JSContextRef ctx, void* bytes, size_t len,
+                          JSTypedArrayBytesDeallocator deallocator, void* deallocator_context) {
+    if (!bytes) {
+        bytes = malloc(1);
+        deallocator = buffer_free_bytes;
+        deallocator_context = NULL;
+    }
+    JSObjectRef array = JSObjectMakeTypedArrayWithBytesNoCopy(ctx, kJSTypedArrayTypeUint8Array, bytes, len,
+                                                              deallocator, deallocator_context, NULL);
+    return buffer_adopt(ctx, array);
+}
+
+JSObjectRef js_buffer_from_malloc(JSContextRef ctx, char* bytes, size_t len) {
+    return js_buffer_new(ctx, bytes, len, buffer_free_bytes, NULL);
+}
+
+JSObjectRef js_buffer_copy(JSContextRef ctx, const void* data, size_t len) {
+    char* bytes = malloc(len ? len : 1);
+    if (len) memcpy(bytes, data, len);
+    return js_buffer_from_malloc(ctx, bytes, len);
+}
+
+bool js_value_is_buffer(JSContextRef ctx, JSValueRef value) {
+    if (!buffer_prototype || !JSValueIsObject(ctx, value)) return false;
+    if (JSValueGetTypedArrayType(ctx, value, NULL) != kJSTypedArrayTypeUint8Array) return false;
+    return JSValueIsStrictEqual(ctx, JSObjectGetPrototype(ctx, (JSObjectRef)value), buffer_prototype);
+}
+
+// `buf.toString([encoding[, start[, end]]])`
+static JSValueRef buffer_to_string(JSContextRef ctx, JSObjectRef function,
+                                   JSObjectRef thisObject, size_t argc,
+                                   const JSValueRef args[], JSValueRef* exception) {
+    const char* data;
+    size_t len;
+    if (!js_value_get_bytes(ctx, thisObject, &data, &len)) {
+        return buffer_throw(ctx, exception, "Buffer.prototype.toString called on a non-buffer");
+    }
+
+    BufferEncoding encoding = buffer_encoding(ctx, argc > 0 ? args[0] : NULL);
+    if (encoding == BUFFER_UNKNOWN) return buffer_throw(ctx, exception, "Unknown buffer encoding");
+
+    size_t start = 0, end = len;
+    if (argc > 1 && !JSValueIsUndefined(ctx, args[1])) {
+        double n = JSValueToNumber(ctx, args[1], NULL);
+        start = n > 0 ? (n < (double)len ? (size_t)n : len) : 0;
+    }
+    if (argc > 2 && !JSValueIsUndefined(ctx, args[2])) {
+        double n = JSValueToNumber(ctx, args[2], NULL);
+        end = n > 0 ? (n < (double)len ? (size_t)n : len) : 0;
+    }
+    if (end < start) end = start;
+
+    JSStringRef str = buffer_decode((const unsigned char*)data + start, end - start, encoding);
+    JSValueRef result = JSValueMakeString(ctx, str);
+    JSStringRelease(str);
+    return result;
+}
+
+static const JSStaticFunction buffer_prototype_functions[] = {
+    { "toString", buffer_to_string, kJSPropertyAttributeDontEnum },
+    { NULL, NULL, 0 }
+};
+
+void buffer_init(JSContextRef ctx) {
+    if (buffer_prototype) return;
+
+    if (!buffer_prototype_class) {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.className = "Buffer";
+        def.staticFunctions = buffer_prototype_functions;
+        buffer_prototype_class = JSClassCreate(&def);
+    }
+
+    // Buffer.prototype sits between instances and Uint8Array.prototype
+    JSObjectRef sample = JSObjectMakeTypedArray(ctx, kJSTypedArrayTypeUint8Array, 0, NULL);
+    buffer_prototype = JSObjectMake(ctx, buffer_prototype_class, NULL);
+    JSObjectSetPrototype(ctx, buffer_prototype, JSObjectGetPrototype(ctx, sample));
+    JSValueProtect(ctx, buffer_prototype);
+}
+
+// ================== Buffer API ================== //
+
+// `Buffer.from(string[, encoding])`, `Buffer.from(arrayBuffer)` (shared),
+// `Buffer.from(bufferOrView)` (copied) and `Buffer.from(array)`
+JSValueRef buffer_from(JSContextRef ctx, JSObjectRef function,
+                       JSObjectRef thisObject, size_t argc,
+                       const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1) return buffer_throw(ctx, exception, "Buffer.from requires a value");
+    JSValueRef value = args[0];
+
+    if (JSValueIsString(ctx, value)) {
+        BufferEncoding encoding = buffer_encoding(ctx, argc > 1 ? args[1] : NULL);
+        if (encoding == BUFFER_UNKNOWN) return buffer_throw(ctx, exception, "Unknown buffer encoding");
+
+        JSStringRef str = JSValueToStringCopy(ctx, value, exception);
+        if (!str) return JSValueMakeUndefined(ctx);
+        size_t len;
+        char* bytes = buffer_encode_string(str, encoding, &len);
+        JSStringRelease(str);
+        return js_buffer_from_malloc(ctx, bytes, len);
+    }
+
+    if (!JSValueIsObject(ctx, value)) return buffer_throw(ctx, exception, "Buffer.from requires a string, buffer or array");
+    JSObjectRef object = (JSObjectRef)value;
+
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, value, NULL);
+    if (type == kJSTypedArrayTypeArrayBuffer) {
+        // A view over the same memory, as in Node
+        JSObjectRef array = JSObjectMakeTypedArrayWithArrayBuffer(ctx, kJSTypedArrayTypeUint8Array, object, exception);
+        return array ? buffer_adopt(ctx, array) : JSValueMakeUndefined(ctx);
+    }
+
+    const char* data;
+    size_t len;
+    if (js_value_get_bytes(ctx, value, &data, &len)) return js_buffer_copy(ctx, data, len);
+
+    double length = JSValueToNumber(ctx, JSObjectGetProperty(ctx, object, ATOM(length), NULL), NULL);
+    len = length > 0 && length <= UINT32_MAX ? (size_t)length : 0;
+    char* bytes = malloc(len ? len : 1);
+    for (size_t i = 0; i < len; i++) {
+        double n = JSValueToNumber(ctx, JSObjectGetPropertyAtIndex(ctx, object, (unsigned)i, NULL), NULL);
+        bytes[i] = n == n ? (char)((int64_t)n & 0xFF) : 0;
+    }
+    return js_buffer_from_malloc(ctx, bytes, len);
+}
+
+// `Buffer.alloc(size[, fill])` - zero-filled unless `fill` is a byte value
+JSValueRef buffer_alloc(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception) {
+    double size = argc > 0 ? JSValueToNumber(ctx, args[0], NULL) : 0;
+    if (!(size >= 0) || size > UINT32_MAX) return buffer_throw(ctx, exception, "Invalid buffer size");
+
+    size_t len = (size_t)size;
+    int fill = 0;
+    if (argc > 1 && JSValueIsNumber(ctx, args[1])) fill = (int)((int64_t)JSValueToNumber(ctx, args[1], NULL) & 0xFF);
+
+    char* bytes = fill ? malloc(len ? len : 1) : calloc(1, len ? len : 1);
+    if (!bytes) return buffer_throw(ctx, exception, "Memory allocation failed");
+    if (fill) memset(bytes, fill, len);
+    return js_buffer_from_malloc(ctx, bytes, len);
+}
+
+// `Buffer.byteLength(stringOrBytes[, encoding])`
+JSValueRef buffer_byte_length(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1) return JSValueMakeNumber(ctx, 0);
+
+    const char* data;
+    size_t len;
+    if (js_value_get_bytes(ctx, args[0], &data, &len)) return JSValueMakeNumber(ctx, (double)len);
+
+    BufferEncoding encoding = buffer_encoding(ctx, argc > 1 ? args[1] : NULL);
+    if (encoding == BUFFER_UNKNOWN) return buffer_throw(ctx, exception, "Unknown buffer encoding");
+
+    JSStringRef str = JSValueToStringCopy(ctx, args[0], exception);
+    if (!str) return JSValueMakeUndefined(ctx);
+    char* bytes = buffer_encode_string(str, encoding, &len);
+    JSStringRelease(str);
+    free(bytes);
+    return JSValueMakeNumber(ctx, (double)len);
+}
+
+// `Buffer.isBuffer(value)`
+JSValueRef buffer_is_buffer(JSContextRef ctx, JSObjectRef function,
+                            JSObjectRef thisObject, size_t argc,
+                            const JSValueRef args[], JSValueRef* exception) {
+    return JSValueMakeBoolean(ctx, argc > 0 && js_value_is_buffer(ctx, args[0]));
+}
+
+// `Buffer.concat(list[, totalLength])`
+JSValueRef buffer_concat(JSContextRef ctx, JSObjectRef function,
+                         JSObjectRef thisObject, size_t argc,
+                         const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1 || !JSValueIsArray(ctx, args[0])) return buffer_throw(ctx, exception, "Buffer.concat requires an array");
+    JSObjectRef list = (JSObjectRef)args[0];
+
+    double length = JSValueToNumber(ctx, JSObjectGetProperty(ctx, list, ATOM(length), NULL), NULL);
+    size_t count = length > 0 && length <= UINT32_MAX ? (size_t)length : 0;
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char* data;
+        size_t len;
+        if (!js_value_get_bytes(ctx, JSObjectGetPropertyAtIndex(ctx, list, (unsigned)i, NULL), &data, &len)) {
+            return buffer_throw(ctx, exception, "Buffer.concat list items must be buffers");
+        }
+        total += len;
+    }
+
+    if (argc > 1 && JSValueIsNumber(ctx, args[1])) {
+        double limit = JSValueToNumber(ctx, args[1], NULL);
+        if (!(limit >= 0) || limit > UINT32_MAX) return buffer_throw(ctx, exception, "Invalid buffer size");
+        total = (size_t)limit;
+    }
+
+    char* bytes = calloc(1, total ? total : 1);
+    if (!bytes) return buffer_throw(ctx, exception, "Memory allocation failed");
+    size_t off = 0;
+    for (size_t i = 0; i < count && off < total; i++) {
+        const char* data;
+        size_t len;
+        js_value_get_bytes(ctx, JSObjectGetPropertyAtIndex(ctx, list, (unsigned)i, NULL), &data, &len);
+        if (len > total - off) len = total - off;
+        memcpy(bytes + off, data, len);
+        off += len;
+    }
+    return js_buffer_from_malloc(ctx, bytes, total);
+}
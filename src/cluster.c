@@ -0,0 +1,227 @@
+/**
+ * =====================================================================================
+ *
+ *        CLUSTER.C - Multi-Core Worker Loops Sharing Listening Ports
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Spawning worker threads, each with its own uv_loop_t and JS context
+ * - Re-running the entry script in every worker
+ * - Binding listeners so all workers accept on the same port
+ *
+ * Port Sharing:
+ * - SO_REUSEPORT (SO_REUSEPORT_LB on FreeBSD): every worker owns a socket and
+ *   the kernel spreads incoming connections across them
+ * - Fallback: the first worker binds, later workers dup() that socket and
+ *   poll the shared accept queue from their own loops
+ *
+ * Threading Model:
+ * - Nothing JS-related crosses threads; each worker is a full runtime instance
+ * - Loop-bound module state is declared JADE_THREAD_LOCAL
+ * - process.exit() from any worker ends the whole process
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "runtime.h"
+
+#if defined(SO_REUSEPORT_LB)
+#define CLUSTER_REUSEPORT SO_REUSEPORT_LB
+#elif defined(__linux__) && defined(SO_REUSEPORT)
+// Other BSDs accept SO_REUSEPORT but hand every connection to one socket
+#define CLUSTER_REUSEPORT SO_REUSEPORT
+#endif
+
+#define CLUSTER_MAX_SHARED 64
+
+typedef struct {
+    uv_thread_t thread;
+    uv_loop_t loop;
+    int id;
+} ClusterWorker;
+
+typedef struct {
+    int port;
+    int fd;
+} SharedListener;
+
+JADE_THREAD_LOCAL int cluster_worker_id = 0;
+
+static const char* cluster_script = NULL;
+static size_t cluster_script_len = 0;
+static const char* cluster_script_url = NULL;
+static ClusterWorker* cluster_workers = NULL;
+static int cluster_size = 1;
+static bool cluster_started = false;
+
+static uv_once_t cluster_once = UV_ONCE_INIT;
+static uv_mutex_t cluster_lock;
+static SharedListener shared_listeners[CLUSTER_MAX_SHARED];
+static int shared_count = 0;
+static bool reuseport_unavailable = false;
+
+static void cluster_init_lock(void) {
+    uv_mutex_init(&cluster_lock);
+}
+
+void cluster_set_script(const char* source, size_t len, const char* source_url) {
+    cluster_script = source;
+    cluster_script_len = len;
+    cluster_script_url = source_url;
+}
+
+int cluster_worker_count(void) {
+    return cluster_size;
+}
+
+int cluster_cpu_count(void) {
+    uv_cpu_info_t* cpus;
+    int count = 0;
+    if (uv_cpu_info(&cpus, &count) == 0) uv_free_cpu_info(cpus, count);
+    return count > 0 ? count : 1;
+}
+
+static void cluster_worker_main(void* arg) {
+    ClusterWorker* worker = (ClusterWorker*)arg;
+    cluster_worker_id = worker->id;
+
+    uv_loop_init(&worker->loop);
+    loop = &worker->loop;
+
+    JSGlobalContextRef ctx = create_js_context();
+    init_event_loop();
+    execute_js_source(ctx, cluster_script, cluster_script_len, cluster_script_url);
+    run_event_loop();
+
+    JSGlobalContextRelease(ctx);
+    uv_loop_close(&worker->loop);
+}
+
+int cluster_start(int workers) {
+    if (cluster_worker_id != 0 || cluster_started || workers <= 1) return cluster_size;
+    if (!cluster_script) {
+        fprintf(stderr, "ERROR: cluster mode has no script to run in workers\n");
+        return cluster_size;
+    }
+
+    uv_once(&cluster_once, cluster_init_lock);
+    cluster_started = true;
+    cluster_size = workers;
+    cluster_workers = calloc(workers, sizeof(ClusterWorker));
+
+    for (int i = 1; i < workers; i++) {
+        ClusterWorker* worker = &cluster_workers[i];
+        worker->id = i;
+        int result = uv_thread_create(&worker->thread, cluster_worker_main, worker);
+        if (result < 0) {
+            fprintf(stderr, "ERROR: Failed to start worker %d: %s\n", i, uv_strerror(result));
+            cluster_size = i;
+            break;
+        }
+    }
+    return cluster_size;
+}
+
+void cluster_wait(void) {
+    if (!cluster_started || cluster_worker_id != 0) return;
+    for (int i = 1; i < cluster_size; i++) {
+        uv_thread_join(&cluster_workers[i].thread);
+    }
+    free(cluster_workers);
+    cluster_workers = NULL;
+}
+
+int cluster_workers_option(JSContextRef ctx, JSValueRef options) {
+    if (!options || !JSValueIsObject(ctx, options)) return 0;
+
+    JSValueRef value = JSObjectGetProperty(ctx, (JSObjectRef)options, ATOM(workers), NULL);
+
+    if (JSValueIsNumber(ctx, value)) {
+        double n = JSValueToNumber(ctx, value, NULL);
+        return n >= 1 && n <= 1024 ? (int)n : 0;
+    }
+    if (JSValueIsString(ctx, value)) {
+        JSStringRef str = JSValueToStringCopy(ctx, value, NULL);
+        bool is_auto = JSStringIsEqualToUTF8CString(str, "auto");
+        JSStringRelease(str);
+        if (is_auto) return cluster_cpu_count();
+    }
+    return 0;
+}
+
+#ifdef CLUSTER_REUSEPORT
+static int cluster_bind_reuseport(uv_tcp_t* handle, const struct sockaddr_in* addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return uv_translate_sys_error(errno);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (setsockopt(fd, SOL_SOCKET, CLUSTER_REUSEPORT, &on, sizeof(on)) != 0) {
+        close(fd);
+        return UV_ENOTSUP;
+    }
+
+    if (bind(fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0) {
+        int err = uv_translate_sys_error(errno);
+        close(fd);
+        return err;
+    }
+
+    int result = uv_tcp_open(handle, fd);
+    if (result < 0) close(fd);
+    return result;
+}
+#endif
+
+static int cluster_bind_shared(uv_tcp_t* handle, const struct sockaddr_in* addr) {
+    int port = ntohs(addr->sin_port);
+    int result;
+
+    uv_mutex_lock(&cluster_lock);
+    for (int i = 0; i < shared_count; i++) {
+        if (shared_listeners[i].port != port) continue;
+
+        int fd = dup(shared_listeners[i].fd);
+        uv_mutex_unlock(&cluster_lock);
+        if (fd < 0) return uv_translate_sys_error(errno);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        result = uv_tcp_open(handle, fd);
+        if (result < 0) close(fd);
+        return result;
+    }
+
+    result = uv_tcp_bind(handle, (const struct sockaddr*)addr, 0);
+    uv_os_fd_t fd;
+    if (result == 0 && shared_count < CLUSTER_MAX_SHARED && uv_fileno((uv_handle_t*)handle, &fd) == 0) {
+        shared_listeners[shared_count].port = port;
+        shared_listeners[shared_count].fd = fd;
+        shared_count++;
+    }
+    uv_mutex_unlock(&cluster_lock);
+    return result;
+}
+
+int cluster_bind(uv_tcp_t* handle, const struct sockaddr_in* addr) {
+    if (cluster_size <= 1) return uv_tcp_bind(handle, (const struct sockaddr*)addr, 0);
+
+#ifdef CLUSTER_REUSEPORT
+    if (!reuseport_unavailable) {
+        int result = cluster_bind_reuseport(handle, addr);
+        if (result != UV_ENOTSUP) return result;
+        reuseport_unavailable = true;
+    }
+#endif
+    return cluster_bind_shared(handle, addr);
+}
@@ -0,0 +1,83 @@
+/**
+ * =====================================================================================
+ *
+ *        COMPLETION.C - Callback or Promise Delivery for Async Requests
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Choosing, per call, between a Node-style `callback(err, value)` and a
+ *   native promise made with JSObjectMakeDeferredPromise
+ * - Settling either form from a libuv callback with one call
+ *
+ * Memory Management:
+ * - The callback, or the promise's resolve/reject pair, stays protected from
+ *   completion_init() until completion_settle() or completion_release()
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdlib.h>
+#include "runtime.h"
+
+JSValueRef completion_init(Completion* completion, JSContextRef ctx, JSValueRef callback,
+                           JSValueRef* exception) {
+    completion->callback = NULL;
+    completion->resolve = NULL;
+    completion->reject = NULL;
+
+    if (callback && JSValueIsObject(ctx, callback) && JSObjectIsFunction(ctx, (JSObjectRef)callback)) {
+        completion->callback = (JSObjectRef)callback;
+        JSValueProtect(ctx, completion->callback);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    JSObjectRef promise = JSObjectMakeDeferredPromise(ctx, &completion->resolve, &completion->reject, exception);
+    if (!promise) {
+        completion->resolve = completion->reject = NULL;
+        return NULL;
+    }
+    JSValueProtect(ctx, completion->resolve);
+    JSValueProtect(ctx, completion->reject);
+    return promise;
+}
+
+void completion_settle(Completion* completion, JSContextRef ctx, JSValueRef error, JSValueRef value) {
+    bool failed = error && !JSValueIsNull(ctx, error) && !JSValueIsUndefined(ctx, error);
+
+    // Released first, so a callback that starts the same request again cannot see stale state
+    JSObjectRef callback = completion->callback;
+    JSObjectRef target = failed ? completion->reject : completion->resolve;
+    JSObjectRef resolve = completion->resolve;
+    JSObjectRef reject = completion->reject;
+    completion->callback = completion->resolve = completion->reject = NULL;
+
+    PROFILE_CALL_SPAN(ctx, callback, callback ? "callback" : "promise");
+    if (callback) {
+        JSValueRef args[] = { failed ? error : JSValueMakeNull(ctx), value };
+        JSObjectCallAsFunction(ctx, callback, NULL, value ? 2 : 1, args, NULL);
+        JSValueUnprotect(ctx, callback);
+    } else if (target) {
+        // JSC drains its microtask queue as this outermost call returns, so the
+        // awaiting code resumes here rather than on a later loop iteration
+        JSValueRef arg = failed ? error : value ? value : JSValueMakeUndefined(ctx);
+        JSObjectCallAsFunction(ctx, target, NULL, 1, &arg, NULL);
+        JSValueUnprotect(ctx, resolve);
+        JSValueUnprotect(ctx, reject);
+    }
+}
+
+void completion_settle_error(Completion* completion, JSContextRef ctx, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    JSValueRef error = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    completion_settle(completion, ctx, error, JSValueMakeNull(ctx));
+}
+
+void completion_release(Completion* completion, JSContextRef ctx) {
+    if (completion->callback) JSValueUnprotect(ctx, completion->callback);
+    if (completion->resolve) JSValueUnprotect(ctx, completion->resolve);
+    if (completion->reject) JSValueUnprotect(ctx, completion->reject);
+    completion->callback = completion->resolve = completion->reject = NULL;
+}
@@ -0,0 +1,408 @@
+/**
+ * =====================================================================================
+ *
+ *        COMPRESS.C - HTTP Content Codings (gzip, deflate, br)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Picking a response coding from a request's Accept-Encoding
+ * - Streaming compressors for response bodies: each write appends its output
+ *   to a growable buffer, optionally flushed so a chunk can go out on its own
+ * - One-shot decompression of client response bodies, bounded in size
+ *
+ * Design:
+ * - zlib provides gzip and deflate (the zlib format, as HTTP defines it);
+ *   brotli is used when the build found it (JADE_HAVE_BROTLI)
+ * - Compressors hold no shared state, so a body can be compressed on the
+ *   threadpool while the loop carries on
+ *
+ * =====================================================================================
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include "runtime.h"
+
+#ifdef JADE_HAVE_BROTLI
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#endif
+
+#define COMPRESS_OUT_STEP   16384
+#define COMPRESS_MAX_PIECE  (1u << 30)  // zlib counts input in 32-bit units
+#define BROTLI_STREAM_LGWIN 18          // 256 KiB window for per-response encoders
+
+struct Compressor {
+    ContentEncoding encoding;
+    z_stream zlib;
+#ifdef JADE_HAVE_BROTLI
+    BrotliEncoderState* brotli;
+#endif
+};
+
+static const char* const encoding_names[CONTENT_ENCODING_COUNT] = {
+    "identity", "gzip", "deflate", "br"
+};
+
+const char* content_encoding_name(ContentEncoding encoding) {
+    return encoding_names[encoding];
+}
+
+const char* content_encoding_accept(void) {
+#ifdef JADE_HAVE_BROTLI
+    return "gzip, deflate, br";
+#else
+    return "gzip, deflate";
+#endif
+}
+
+static bool encoding_supported(ContentEncoding encoding) {
+#ifndef JADE_HAVE_BROTLI
+    if (encoding == CONTENT_ENCODING_BR) return false;
+#endif
+    return true;
+}
+
+static bool token_is(const char* s, size_t len, const char* token) {
+    return strlen(token) == len && strncasecmp(s, token, len) == 0;
+}
+
+static ContentEncoding encoding_from_token(const char* s, size_t len, bool* known) {
+    *known = true;
+    if (token_is(s, len, "gzip") || token_is(s, len, "x-gzip")) return CONTENT_ENCODING_GZIP;
+    if (token_is(s, len, "deflate")) return CONTENT_ENCODING_DEFLATE;
+    if (token_is(s, len, "br")) return CONTENT_ENCODING_BR;
+    *known = token_is(s, len, "identity");
+    return CONTENT_ENCODING_IDENTITY;
+}
+
+ContentEncoding content_encoding_parse(const char* value, size_t len) {
+    while (len > 0 && (value[0] == ' ' || value[0] == '\t')) value++, len--;
+    while (len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t')) len--;
+
+    bool known;
+    ContentEncoding encoding = encoding_from_token(value, len, &known);
+    return encoding_supported(encoding) ? encoding : CONTENT_ENCODING_IDENTITY;
+}
+
+// Parses a `q=` weight in thousandths; anything malformed counts as 1
+static int accept_weight(const char* s, size_t len) {
+    while (len > 0 && (*s == ' ' || *s == '\t')) s++, len--;
+    if (len < 2 || (s[0] != 'q' && s[0] != 'Q') || s[1] != '=') return 1000;
+    s += 2;
+    len -= 2;
+    if (len == 0 || (s[0] != '0' && s[0] != '1')) return 1000;
+
+    int weight = (s[0] - '0') * 1000;
+    int scale = 100;
+    if (len > 1 && s[1] == '.') {
+        for (size_t i = 2; i < len && scale > 0 && isdigit((unsigned char)s[i]); i++) {
+            weight += (s[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return weight > 1000 ? 1000 : weight;
+}
+
+ContentEncoding content_encoding_negotiate(const char* accept, size_t len) {
+    // -1: not mentioned; the server's preference breaks ties (br, gzip, deflate)
+    int weights[CONTENT_ENCODING_COUNT] = { -1, -1, -1, -1 };
+    int wildcard = -1;
+
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (accept[i] == ' ' || accept[i] == '\t' || accept[i] == ',')) i++;
+        size_t start = i;
+        while (i < len && accept[i] != ',' && accept[i] != ';' && accept[i] != ' ' && accept[i] != '\t') i++;
+        size_t end = i;
+        while (i < len && accept[i] != ',' && accept[i] != ';') i++;
+
+        int weight = 1000;
+        if (i < len && accept[i] == ';') {
+            size_t params = ++i;
+            while (i < len && accept[i] != ',') i++;
+            weight = accept_weight(accept + params, i - params);
+        }
+        if (end == start) continue;
+
+        bool known;
+        ContentEncoding encoding = encoding_from_token(accept + start, end - start, &known);
+        if (known) weights[encoding] = weight;
+        else if (end - start == 1 && accept[start] == '*') wildcard = weight;
+    }
+
+    static const ContentEncoding preference[] = {
+        CONTENT_ENCODING_BR, CONTENT_ENCODING_GZIP, CONTENT_ENCODING_DEFLATE
+    };
+    ContentEncoding best = CONTENT_ENCODING_IDENTITY;
+    int best_weight = 0;
+    for (size_t k = 0; k < sizeof(preference) / sizeof(preference[0]); k++) {
+        ContentEncoding encoding = preference[k];
+        int weight = weights[encoding] >= 0 ? weights[encoding] : wildcard;
+        if (encoding_supported(encoding) && weight > best_weight) {
+            best = encoding;
+            best_weight = weight;
+        }
+    }
+    return best;
+}
+
+bool content_type_compressible(const char* type, size_t len) {
+    const char* semi = memchr(type, ';', len);
+    if (semi) len = (size_t)(semi - type);
+    while (len > 0 && (type[len - 1] == ' ' || type[len - 1] == '\t')) len--;
+
+    static const char* const exact[] = {
+        "application/json", "application/javascript", "application/xml",
+        "application/wasm", "application/x-ndjson", "image/x-icon", "font/ttf", "font/otf", NULL
+    };
+    for (size_t i = 0; exact[i]; i++) {
+        if (token_is(type, len, exact[i])) return true;
+    }
+    if (len > 5 && strncasecmp(type, "text/", 5) == 0) return true;
+    return (len > 5 && strncasecmp(type + len - 5, "+json", 5) == 0) ||
+           (len > 4 && strncasecmp(type + len - 4, "+xml", 4) == 0);
+}
+
+// Makes room for at least `extra` more bytes plus a terminating NUL
+static void compress_reserve(CompressBuffer* out, size_t extra) {
+    if (out->cap - out->len > extra) return;
+    size_t cap = out->cap ? out->cap : COMPRESS_OUT_STEP;
+    while (cap - out->len <= extra) cap *= 2;
+    out->data = realloc(out->data, cap);
+    out->cap = cap;
+}
+
+// ------------------------- Compression ------------------------- //
+
+Compressor* compressor_new(ContentEncoding encoding, int level) {
+    Compressor* c = calloc(1, sizeof(Compressor));
+    c->encoding = encoding;
+
+#ifdef JADE_HAVE_BROTLI
+    if (encoding == CONTENT_ENCODING_BR) {
+        int quality = level == COMPRESS_LEVEL_BEST ? BROTLI_MAX_QUALITY
+                    : level == COMPRESS_LEVEL_DEFAULT ? 5 : level;
+        if (quality < BROTLI_MIN_QUALITY) quality = BROTLI_MIN_QUALITY;
+        if (quality > BROTLI_MAX_QUALITY) quality = BROTLI_MAX_QUALITY;
+        c->brotli = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+        if (!c->brotli) {
+            free(c);
+            return NULL;
+        }
+        BrotliEncoderSetParameter(c->brotli, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+        if (level != COMPRESS_LEVEL_BEST) {
+            BrotliEncoderSetParameter(c->brotli, BROTLI_PARAM_LGWIN, BROTLI_STREAM_LGWIN);
+        }
+        return c;
+    }
+#endif
+
+    int zlevel = level == COMPRESS_LEVEL_BEST ? Z_BEST_COMPRESSION
+               : level == COMPRESS_LEVEL_DEFAULT ? Z_DEFAULT_COMPRESSION : level;
+    if (zlevel != Z_DEFAULT_COMPRESSION && zlevel < Z_BEST_SPEED) zlevel = Z_BEST_SPEED;
+    if (zlevel > Z_BEST_COMPRESSION) zlevel = Z_BEST_COMPRESSION;
+    // 15 bits of window in the zlib format; +16 selects the gzip wrapper
+    int window = encoding == CONTENT_ENCODING_GZIP ? 15 + 16 : 15;
+    if (deflateInit2(&c->zlib, zlevel, Z_DEFLATED, window, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static bool compressor_write_zlib(Compressor* c, const char* data, size_t len, int mode, CompressBuffer* out) {
+    z_stream* z = &c->zlib;
+    z->next_in = (Bytef*)data;
+    z->avail_in = (uInt)len;
+
+    for (;;) {
+        compress_reserve(out, COMPRESS_OUT_STEP);
+        size_t room = out->cap - out->len - 1;
+        if (room > COMPRESS_MAX_PIECE) room = COMPRESS_MAX_PIECE;
+        z->next_out = (Bytef*)out->data + out->len;
+        z->avail_out = (uInt)room;
+
+        int r = deflate(z, mode);
+        out->len += room - z->avail_out;
+        if (r == Z_STREAM_ERROR) return false;
+        if (mode == Z_FINISH ? r == Z_STREAM_END : z->avail_out != 0) return true;
+    }
+}
+
+#ifdef JADE_HAVE_BROTLI
+static bool compressor_write_brotli(Compressor* c, const char* data, size_t len,
+                                    BrotliEncoderOperation op, CompressBuffer* out) {
+    const uint8_t* next_in = (const uint8_t*)data;
+    size_t avail_in = len;
+
+    for (;;) {
+        compress_reserve(out, COMPRESS_OUT_STEP);
+        size_t room = out->cap - out->len - 1;
+        size_t avail_out = room;
+        uint8_t* next_out = (uint8_t*)out->data + out->len;
+
+        if (!BrotliEncoderCompressStream(c->brotli, op, &avail_in, &next_in, &avail_out, &next_out, NULL)) {
+            return false;
+        }
+        out->len += room - avail_out;
+        if (avail_in == 0 && !BrotliEncoderHasMoreOutput(c->brotli) &&
+            (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(c->brotli))) return true;
+    }
+}
+#endif
+
+bool compressor_write(Compressor* c, const char* data, size_t len, CompressFlush flush, CompressBuffer* out) {
+    // Large inputs go in pieces; only the last one carries the flush
+    do {
+        size_t piece = len > COMPRESS_MAX_PIECE ? COMPRESS_MAX_PIECE : len;
+        bool last = piece == len;
+        bool ok;
+
+#ifdef JADE_HAVE_BROTLI
+        if (c->encoding == CONTENT_ENCODING_BR) {
+            BrotliEncoderOperation op = !last || flush == COMPRESS_NONE ? BROTLI_OPERATION_PROCESS
+                                      : flush == COMPRESS_FLUSH ? BROTLI_OPERATION_FLUSH
+                                      : BROTLI_OPERATION_FINISH;
+            ok = compressor_write_brotli(c, data, piece, op, out);
+        } else
+#endif
+        {
+            int mode = !last || flush == COMPRESS_NONE ? Z_NO_FLUSH
+                     : flush == COMPRESS_FLUSH ? Z_SYNC_FLUSH : Z_FINISH;
+            ok = compressor_write_zlib(c, data, piece, mode, out);
+        }
+        if (!ok) return false;
+
+        data += piece;
+        len -= piece;
+    } while (len > 0);
+
+    out->data[out->len] = '\0';
+    return true;
+}
+
+void compressor_free(Compressor* c) {
+    if (!c) return;
+#ifdef JADE_HAVE_BROTLI
+    if (c->encoding == CONTENT_ENCODING_BR) {
+        BrotliEncoderDestroyInstance(c->brotli);
+        free(c);
+        return;
+    }
+#endif
+    deflateEnd(&c->zlib);
+    free(c);
+}
+
+// ------------------------- Decompression ------------------------- //
+
+static const char* decompress_zlib(ContentEncoding encoding, const char* data, size_t len,
+                                   size_t limit, CompressBuffer* out) {
+    // 15 + 32 detects a zlib or gzip header; some servers send raw deflate, retried below
+    int window = 15 + 32;
+    bool retried = false;
+    z_stream z;
+
+restart:
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, window) != Z_OK) return "Out of memory";
+    z.next_in = (Bytef*)data;
+    z.avail_in = (uInt)len;
+    out->len = 0;
+
+    for (;;) {
+        compress_reserve(out, COMPRESS_OUT_STEP);
+        size_t room = out->cap - out->len - 1;
+        if (room > COMPRESS_MAX_PIECE) room = COMPRESS_MAX_PIECE;
+        z.next_out = (Bytef*)out->data + out->len;
+        z.avail_out = (uInt)room;
+
+        int r = inflate(&z, Z_NO_FLUSH);
+        out->len += room - z.avail_out;
+
+        if (out->len > limit) {
+            inflateEnd(&z);
+            return "Decompressed body exceeds the size limit";
+        }
+        if (r == Z_STREAM_END) {
+            // Concatenated gzip members decode as one body
+            if (z.avail_in == 0 || encoding != CONTENT_ENCODING_GZIP) break;
+            inflateReset(&z);
+            continue;
+        }
+        if (r == Z_DATA_ERROR && encoding == CONTENT_ENCODING_DEFLATE && !retried && z.total_out == 0) {
+            inflateEnd(&z);
+            window = -15;
+            retried = true;
+            goto restart;
+        }
+        if (r != Z_OK) {
+            inflateEnd(&z);
+            return "Invalid compressed response body";
+        }
+    }
+    inflateEnd(&z);
+    return NULL;
+}
+
+#ifdef JADE_HAVE_BROTLI
+static const char* decompress_brotli(const char* data, size_t len, size_t limit, CompressBuffer* out) {
+    BrotliDecoderState* state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    if (!state) return "Out of memory";
+    const uint8_t* next_in = (const uint8_t*)data;
+    size_t avail_in = len;
+    const char* error = NULL;
+
+    for (;;) {
+        compress_reserve(out, COMPRESS_OUT_STEP);
+        size_t room = out->cap - out->len - 1;
+        size_t avail_out = room;
+        uint8_t* next_out = (uint8_t*)out->data + out->len;
+
+        BrotliDecoderResult r = BrotliDecoderDecompressStream(state, &avail_in, &next_in,
+                                                              &avail_out, &next_out, NULL);
+        out->len += room - avail_out;
+        if (out->len > limit) {
+            error = "Decompressed body exceeds the size limit";
+            break;
+        }
+        if (r == BROTLI_DECODER_RESULT_SUCCESS) break;
+        if (r != BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) {
+            error = "Invalid compressed response body";
+            break;
+        }
+    }
+    BrotliDecoderDestroyInstance(state);
+    return error;
+}
+#endif
+
+const char* decompress_buffer(ContentEncoding encoding, const char* data, size_t len,
+                              size_t limit, CompressBuffer* out) {
+    const char* error;
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+
+#ifdef JADE_HAVE_BROTLI
+    if (encoding == CONTENT_ENCODING_BR) error = decompress_brotli(data, len, limit, out);
+    else
+#endif
+    error = len > COMPRESS_MAX_PIECE ? "Decompressed body exceeds the size limit"
+          : decompress_zlib(encoding, data, len, limit, out);
+
+    if (error) {
+        free(out->data);
+        out->data = NULL;
+        out->len = 0;
+        out->cap = 0;
+        return error;
+    }
+    out->data[out->len] = '\0';
+    return NULL;
+}
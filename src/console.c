@@ -0,0 +1,575 @@
+/**
+ * =====================================================================================
+ *
+ *        CONSOLE.C - Buffered Console Backend (console.*, console.configure)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Formatting console arguments in one pass (one UTF-8 conversion per
+ *   argument into a reused scratch buffer) and appending the line to a
+ *   per-loop ring buffer
+ * - Flushing the ring once per loop iteration, from a tick task, to stdout
+ * - The full-ring policy and the optional JSON line format
+ *
+ * Policies (console.configure({ onFull })):
+ * - "block" (default): every flush is a blocking write(2) of the whole ring, as with
+ *   Node's stdout on pipes; a full ring flushes immediately, so no line is lost
+ * - "drop": flushes are asynchronous uv_write()s to a uv_tty_t/uv_pipe_t; lines
+ *   arriving while the ring is full are dropped and counted, and a warning
+ *   with the count is logged once there is room again
+ * - Regular files are always written synchronously; they never apply backpressure
+ *
+ * Ordering:
+ * - Each loop thread has its own ring and stream, so lines from one thread
+ *   stay in order; lines from different threads interleave whole
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "runtime.h"
+
+#define CONSOLE_DEFAULT_CAPACITY (1024 * 1024)
+#define CONSOLE_MIN_CAPACITY     4096
+#define CONSOLE_MAX_CAPACITY     (256 * 1024 * 1024)
+
+typedef struct {
+    const char* prefix;
+    const char* color;
+    const char* json;
+} ConsoleLevelInfo;
+
+static const ConsoleLevelInfo console_levels[] = {
+    [CONSOLE_LOG] = { "LOG", "\033[0m", "log" },
+    [CONSOLE_WARN] = { "WARN", "\033[33m", "warn" },
+    [CONSOLE_INFO] = { "INFO", "\033[34m", "info" },
+    [CONSOLE_DEBUG] = { "DEBUG", "\033[90m", "debug" },
+    [CONSOLE_ERROR] = { "ERROR", "\033[31m", "error" },
+};
+
+typedef enum {
+    CONSOLE_FULL_BLOCK,
+    CONSOLE_FULL_DROP
+} ConsoleFullPolicy;
+
+typedef struct {
+    bool initialized;
+    bool json;
+    bool broken;                // stdout went away (EPIPE); output is discarded
+    ConsoleFullPolicy policy;
+
+    // Ring of formatted bytes not yet known to be written
+    char* ring;
+    size_t cap;
+    size_t start;
+    size_t len;
+    size_t pending_cap;         // Resize requested while a write was in flight
+
+    // Asynchronous stream ("drop" policy on a tty or pipe)
+    bool stream_open;
+    bool writing;
+    bool cancelled;             // In-flight write abandoned by console_stream_close()
+    size_t in_flight;           // Bytes from `start` handed to uv_write()
+    union {
+        uv_handle_t handle;
+        uv_stream_t stream;
+        uv_tty_t tty;
+        uv_pipe_t pipe;
+    } out;
+    uv_write_t write_req;
+
+    TickTask flush_task;
+    uint64_t dropped;           // Lines dropped since the last warning
+
+    char* scratch;              // Line being formatted
+    size_t scratch_cap;
+    char* raw;                  // One argument, before JSON escaping
+    size_t raw_cap;
+
+    int64_t stamp_sec;          // Second `stamp` was formatted for
+    char stamp[24];             // "YYYY-MM-DDTHH:MM:SS"
+} ConsoleSink;
+
+static JADE_THREAD_LOCAL ConsoleSink sink;
+
+static void console_flush(void);
+static void console_report_dropped(void);
+static size_t console_timestamp(char* out);
+
+// ------------------------- Buffers ------------------------- //
+
+static bool console_reserve(char** buf, size_t* cap, size_t need) {
+    if (need <= *cap) return true;
+    size_t grown = *cap ? *cap : 256;
+    while (grown < need) grown *= 2;
+    char* data = realloc(*buf, grown);
+    if (!data) return false;
+    *buf = data;
+    *cap = grown;
+    return true;
+}
+
+// The ring's contents as (up to) two contiguous segments
+static size_t console_segments(size_t offset, size_t len, uv_buf_t bufs[2]) {
+    size_t from = (sink.start + offset) % sink.cap;
+    size_t first = sink.cap - from < len ? sink.cap - from : len;
+    bufs[0] = uv_buf_init(sink.ring + from, (unsigned)first);
+    if (first == len) return 1;
+    bufs[1] = uv_buf_init(sink.ring, (unsigned)(len - first));
+    return 2;
+}
+
+static void console_consume(size_t n) {
+    sink.start = (sink.start + n) % sink.cap;
+    sink.len -= n;
+    if (sink.len == 0) sink.start = 0;
+}
+
+static void console_ring_push(const char* data, size_t n) {
+    size_t end = (sink.start + sink.len) % sink.cap;
+    size_t first = sink.cap - end < n ? sink.cap - end : n;
+    memcpy(sink.ring + end, data, first);
+    memcpy(sink.ring, data + first, n - first);
+    sink.len += n;
+}
+
+// Applies a requested capacity once nothing points into the old ring
+static void console_apply_capacity(void) {
+    if (!sink.pending_cap || sink.writing) return;
+    size_t cap = sink.pending_cap;
+    if (cap < sink.len) return;
+    char* ring = malloc(cap);
+    if (!ring) return;
+
+    uv_buf_t bufs[2];
+    size_t count = console_segments(0, sink.len, bufs);
+    size_t at = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(ring + at, bufs[i].base, bufs[i].len);
+        at += bufs[i].len;
+    }
+    free(sink.ring);
+    sink.ring = ring;
+    sink.cap = cap;
+    sink.start = 0;
+    sink.pending_cap = 0;
+}
+
+// ------------------------- Output ------------------------- //
+
+// Blocking write, also when the descriptor was left non-blocking by a stream
+static void console_write_fd(const char* data, size_t len) {
+    while (len > 0 && !sink.broken) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { STDOUT_FILENO, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            sink.broken = true;
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// Writes out everything not already owned by an in-flight uv_write()
+static void console_flush_sync(void) {
+    if (sink.writing) return;
+    uv_buf_t bufs[2];
+    size_t count = console_segments(0, sink.len, bufs);
+    for (size_t i = 0; i < count && sink.len; i++) console_write_fd(bufs[i].base, bufs[i].len);
+    sink.start = sink.len = 0;
+    console_apply_capacity();
+}
+
+static void on_console_stream_closed(uv_handle_t* handle) {
+    sink.stream_open = false;
+}
+
+static bool console_stream_open(void) {
+    if (sink.stream_open) return true;
+    if (!loop) return false;
+
+    // Streams own a duplicate, so closing one leaves fd 1 open
+    uv_handle_type type = uv_guess_handle(STDOUT_FILENO);
+    if (type == UV_TTY) {
+        int fd = dup(STDOUT_FILENO);
+        if (fd < 0) return false;
+        if (uv_tty_init(loop, &sink.out.tty, fd, 0) != 0) {
+            close(fd);
+            return false;
+        }
+        // libuv reopens the tty where it can, so non-blocking mode does not
+        // leak to other writers; the duplicate is then unused
+        uv_os_fd_t used;
+        if (uv_fileno(&sink.out.handle, &used) == 0 && used != fd) close(fd);
+    } else if (type == UV_NAMED_PIPE || type == UV_TCP) {
+        int fd = dup(STDOUT_FILENO);
+        if (fd < 0) return false;
+        uv_pipe_init(loop, &sink.out.pipe, 0);
+        if (uv_pipe_open(&sink.out.pipe, fd) != 0) {
+            uv_close(&sink.out.handle, NULL);
+            close(fd);
+            return false;
+        }
+    } else {
+        return false;
+    }
+    uv_unref(&sink.out.handle);
+    sink.stream_open = true;
+    return true;
+}
+
+// Abandons an in-flight write: what the kernel took is consumed, the rest is
+// written synchronously by the next flush
+static void console_stream_close(void) {
+    if (!sink.stream_open || uv_is_closing(&sink.out.handle)) return;
+    if (sink.writing) {
+        size_t queued = uv_stream_get_write_queue_size(&sink.out.stream);
+        console_consume(sink.in_flight > queued ? sink.in_flight - queued : 0);
+        sink.writing = false;
+        sink.cancelled = true;
+        sink.in_flight = 0;
+    }
+    uv_close(&sink.out.handle, on_console_stream_closed);
+}
+
+static void on_console_written(uv_write_t* req, int status) {
+    if (sink.cancelled) {
+        sink.cancelled = false;
+        return;
+    }
+    sink.writing = false;
+    if (status < 0) {
+        // EPIPE and friends: nobody is reading any more
+        sink.broken = true;
+        sink.start = sink.len = 0;
+        return;
+    }
+    console_consume(sink.in_flight);
+    sink.in_flight = 0;
+    console_apply_capacity();
+    if (sink.dropped) console_report_dropped();
+    if (sink.len) console_flush();
+}
+
+static void console_flush(void) {
+    if (sink.broken) {
+        sink.start = sink.len = 0;
+        return;
+    }
+    if (sink.writing || sink.len == 0) return;
+
+    if (sink.policy == CONSOLE_FULL_BLOCK || !console_stream_open()) {
+        console_flush_sync();
+        return;
+    }
+
+    uv_buf_t bufs[2];
+    size_t count = console_segments(0, sink.len, bufs);
+    if (uv_write(&sink.write_req, &sink.out.stream, bufs, (unsigned)count, on_console_written) != 0) {
+        console_flush_sync();
+        return;
+    }
+    sink.writing = true;
+    sink.in_flight = sink.len;
+}
+
+static void on_console_flush_task(TickTask* task) {
+    console_flush();
+}
+
+// process.exit() skips the loop's shutdown path
+static void on_console_exit(void) {
+    console_stream_close();
+    console_flush_sync();
+}
+
+static bool console_init(void) {
+    static bool exit_hook;
+    if (sink.initialized) return sink.ring != NULL;
+    sink.initialized = true;
+    sink.policy = CONSOLE_FULL_BLOCK;
+    sink.cap = CONSOLE_DEFAULT_CAPACITY;
+    sink.ring = malloc(sink.cap);
+    sink.stamp_sec = -1;
+    if (!__atomic_exchange_n(&exit_hook, true, __ATOMIC_ACQ_REL)) atexit(on_console_exit);
+    return sink.ring != NULL;
+}
+
+static void console_append_line(const char* line, size_t n);
+
+static void console_report_dropped(void) {
+    char line[192];
+    uint64_t dropped = sink.dropped;
+    sink.dropped = 0;
+
+    int len;
+    if (sink.json) {
+        char stamp[32];
+        console_timestamp(stamp);
+        len = snprintf(line, sizeof(line),
+                       "{\"time\":\"%s\",\"level\":\"warn\",\"msg\":\"console dropped %llu lines\",\"dropped\":%llu}\n",
+                       stamp, (unsigned long long)dropped, (unsigned long long)dropped);
+    } else {
+        len = snprintf(line, sizeof(line), "%sWARN: console dropped %llu lines\033[0m\n",
+                       console_levels[CONSOLE_WARN].color, (unsigned long long)dropped);
+    }
+    console_append_line(line, (size_t)len);
+}
+
+static void console_append_line(const char* line, size_t n) {
+    if (sink.broken) return;
+
+    if (sink.cap - sink.len < n) {
+        if (sink.policy == CONSOLE_FULL_BLOCK || !console_stream_open()) {
+            console_flush_sync();
+            if (n > sink.cap) {
+                // Longer than the whole ring: straight out, behind what was queued
+                console_write_fd(line, n);
+                return;
+            }
+        } else {
+            console_flush();
+            if (sink.cap - sink.len < n) {
+                sink.dropped++;
+                return;
+            }
+        }
+    }
+
+    if (sink.dropped) {
+        // Room for the warning too, or it waits for the next line
+        if (sink.cap - sink.len < n + 192) {
+            sink.dropped++;
+            return;
+        }
+        console_report_dropped();
+    }
+
+    console_ring_push(line, n);
+    if (loop) tick_task_schedule(&sink.flush_task, on_console_flush_task);
+    else console_flush_sync();
+}
+
+// ------------------------- Formatting ------------------------- //
+
+// "YYYY-MM-DDTHH:MM:SS.mmmZ"; the part up to seconds is reformatted once a second
+static size_t console_timestamp(char* out) {
+    uv_timeval64_t tv;
+    uv_gettimeofday(&tv);
+    if (tv.tv_sec != sink.stamp_sec) {
+        time_t sec = (time_t)tv.tv_sec;
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(sink.stamp, sizeof(sink.stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+        sink.stamp_sec = tv.tv_sec;
+    }
+    return (size_t)sprintf(out, "%s.%03dZ", sink.stamp, (int)(tv.tv_usec / 1000));
+}
+
+// Escaped copy of a UTF-8 string for a JSON string body; `out` holds 6 bytes per input byte
+static size_t console_json_escape(char* out, const char* in, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char* p = out;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)in[i];
+        switch (c) {
+            case '"': *p++ = '\\'; *p++ = '"'; break;
+            case '\\': *p++ = '\\'; *p++ = '\\'; break;
+            case '\n': *p++ = '\\'; *p++ = 'n'; break;
+            case '\r': *p++ = '\\'; *p++ = 'r'; break;
+            case '\t': *p++ = '\\'; *p++ = 't'; break;
+            default:
+                if (c < 0x20) {
+                    memcpy(p, "\\u00", 4);
+                    p[4] = hex[c >> 4];
+                    p[5] = hex[c & 15];
+                    p += 6;
+                } else {
+                    *p++ = (char)c;
+                }
+        }
+    }
+    return (size_t)(p - out);
+}
+
+// Appends one argument's text at `*len`, escaped in JSON mode
+static bool console_format_value(JSContextRef ctx, JSValueRef value, size_t* len, JSValueRef* exception) {
+    JSStringRef str = JSValueToStringCopy(ctx, value, exception);
+    if (!str) return false;
+    size_t max = JSStringGetMaximumUTF8CStringSize(str);
+
+    if (!sink.json) {
+        if (!console_reserve(&sink.scratch, &sink.scratch_cap, *len + max + 16)) {
+            JSStringRelease(str);
+            return false;
+        }
+        *len += JSStringGetUTF8CString(str, sink.scratch + *len, max) - 1;
+        JSStringRelease(str);
+        return true;
+    }
+
+    if (!console_reserve(&sink.raw, &sink.raw_cap, max) ||
+        !console_reserve(&sink.scratch, &sink.scratch_cap, *len + max * 6 + 16)) {
+        JSStringRelease(str);
+        return false;
+    }
+    size_t raw_len = JSStringGetUTF8CString(str, sink.raw, max) - 1;
+    JSStringRelease(str);
+    *len += console_json_escape(sink.scratch + *len, sink.raw, raw_len);
+    return true;
+}
+
+// Line head: color and prefix, or the JSON fields before "msg"
+static size_t console_line_head(ConsoleLevel level) {
+    const ConsoleLevelInfo* info = &console_levels[level];
+    if (!sink.json) return (size_t)sprintf(sink.scratch, "%s%s: ", info->color, info->prefix);
+
+    size_t len = (size_t)sprintf(sink.scratch, "{\"time\":\"");
+    len += console_timestamp(sink.scratch + len);
+    len += (size_t)sprintf(sink.scratch + len, "\",\"level\":\"%s\",\"msg\":\"", info->json);
+    return len;
+}
+
+static size_t console_line_tail(size_t len) {
+    const char* tail = sink.json ? "\"}\n" : "\033[0m\n";
+    size_t n = strlen(tail);
+    memcpy(sink.scratch + len, tail, n);
+    return len + n;
+}
+
+JSValueRef console_write_values(JSContextRef ctx, ConsoleLevel level, size_t argc,
+                                const JSValueRef args[], JSValueRef* exception) {
+    if (!console_init() || !console_reserve(&sink.scratch, &sink.scratch_cap, 128)) {
+        return JSValueMakeUndefined(ctx);
+    }
+
+    size_t len = console_line_head(level);
+    for (size_t i = 0; i < argc; i++) {
+        if (i > 0) sink.scratch[len++] = ' ';
+        if (!console_format_value(ctx, args[i], &len, exception)) return JSValueMakeUndefined(ctx);
+    }
+    len = console_line_tail(len);
+    console_append_line(sink.scratch, len);
+    return JSValueMakeUndefined(ctx);
+}
+
+void console_printf(ConsoleLevel level, const char* fmt, ...) {
+    if (!console_init() || !console_reserve(&sink.scratch, &sink.scratch_cap, 128)) return;
+
+    va_list args;
+    va_start(args, fmt);
+    char stack[512];
+    int n = vsnprintf(stack, sizeof(stack), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+
+    char* message = stack;
+    if ((size_t)n >= sizeof(stack)) {
+        message = malloc((size_t)n + 1);
+        if (!message) return;
+        va_start(args, fmt);
+        vsnprintf(message, (size_t)n + 1, fmt, args);
+        va_end(args);
+    }
+
+    size_t len = console_line_head(level);
+    if (console_reserve(&sink.scratch, &sink.scratch_cap, len + (size_t)n * 6 + 16)) {
+        if (sink.json) {
+            len += console_json_escape(sink.scratch + len, message, (size_t)n);
+        } else {
+            memcpy(sink.scratch + len, message, (size_t)n);
+            len += (size_t)n;
+        }
+        len = console_line_tail(len);
+        console_append_line(sink.scratch, len);
+    }
+    if (message != stack) free(message);
+}
+
+// ------------------------- Configuration ------------------------- //
+
+/**
+ * console.configure({ json, onFull, bufferSize }) - Output format, full-ring
+ * policy ("block" or "drop") and ring capacity in bytes for this thread
+ */
+JSValueRef js_console_configure(JSContextRef ctx, JSObjectRef function,
+                                JSObjectRef thisObject, size_t argc,
+                                const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1 || !JSValueIsObject(ctx, args[0])) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("console.configure() expects an options object");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+    if (!console_init()) return JSValueMakeUndefined(ctx);
+    JSObjectRef options = (JSObjectRef)args[0];
+
+    JSStringRef key = JSStringCreateWithUTF8CString("onFull");
+    JSValueRef onFull = JSObjectGetProperty(ctx, options, key, NULL);
+    JSStringRelease(key);
+    if (JSValueIsString(ctx, onFull)) {
+        JSStringRef policy = JSValueToStringCopy(ctx, onFull, NULL);
+        bool drop = JSStringIsEqualToUTF8CString(policy, "drop");
+        bool block = JSStringIsEqualToUTF8CString(policy, "block");
+        JSStringRelease(policy);
+        if (!drop && !block) {
+            JSStringRef msg = JSStringCreateWithUTF8CString("console.configure(): onFull must be \"block\" or \"drop\"");
+            *exception = JSValueMakeString(ctx, msg);
+            JSStringRelease(msg);
+            return JSValueMakeUndefined(ctx);
+        }
+        if (block && sink.policy == CONSOLE_FULL_DROP) {
+            // Later lines are written synchronously, so nothing may stay queued in libuv
+            console_stream_close();
+            console_flush_sync();
+        }
+        sink.policy = drop ? CONSOLE_FULL_DROP : CONSOLE_FULL_BLOCK;
+    }
+
+    key = JSStringCreateWithUTF8CString("json");
+    JSValueRef json = JSObjectGetProperty(ctx, options, key, NULL);
+    JSStringRelease(key);
+    if (!JSValueIsUndefined(ctx, json)) sink.json = JSValueToBoolean(ctx, json);
+
+    key = JSStringCreateWithUTF8CString("bufferSize");
+    JSValueRef size = JSObjectGetProperty(ctx, options, key, NULL);
+    JSStringRelease(key);
+    if (JSValueIsNumber(ctx, size)) {
+        double bytes = JSValueToNumber(ctx, size, NULL);
+        if (!(bytes >= CONSOLE_MIN_CAPACITY && bytes <= CONSOLE_MAX_CAPACITY)) {
+            JSStringRef msg = JSStringCreateWithUTF8CString("console.configure(): bufferSize must be between 4 KiB and 256 MiB");
+            *exception = JSValueMakeString(ctx, msg);
+            JSStringRelease(msg);
+            return JSValueMakeUndefined(ctx);
+        }
+        sink.pending_cap = (size_t)bytes;
+        if (sink.pending_cap < sink.len) console_flush_sync();
+        console_apply_capacity();
+    }
+    return JSValueMakeUndefined(ctx);
+}
+
+void console_close(void) {
+    if (!sink.initialized) return;
+    tick_task_cancel(&sink.flush_task);
+    console_stream_close();
+    if (sink.dropped) console_report_dropped();
+    tick_task_cancel(&sink.flush_task);
+    console_flush_sync();
+}
@@ -0,0 +1,82 @@
+/**
+ * =====================================================================================
+ *
+ *        EVENTS.C - Native Event Listener Lists
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - `obj.on(event, listener)` for native objects (streams, sockets)
+ * - Emitting events from C with arbitrary arguments
+ *
+ * Memory Management:
+ * - Listeners are protected while registered and unprotected by
+ *   event_listeners_clear(), which owners call on close or finalize
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+struct EventListener {
+    struct EventListener* next;
+    JSObjectRef callback;
+    char name[EVENT_NAME_MAX];
+};
+
+bool event_listeners_on(EventListeners* listeners, JSContextRef ctx, JSValueRef name,
+                        JSValueRef callback, JSValueRef* exception) {
+    if (!JSValueIsString(ctx, name) || !JSValueIsObject(ctx, callback) ||
+        !JSObjectIsFunction(ctx, (JSObjectRef)callback)) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("on() requires an event name and a listener function");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return false;
+    }
+
+    struct EventListener* listener = calloc(1, sizeof(struct EventListener));
+    JSStringRef nameRef = JSValueToStringCopy(ctx, name, exception);
+    JSStringGetUTF8CString(nameRef, listener->name, sizeof(listener->name));
+    JSStringRelease(nameRef);
+    listener->callback = (JSObjectRef)callback;
+    JSValueProtect(ctx, callback);
+
+    // Append, so listeners run in registration order
+    struct EventListener** tail = &listeners->head;
+    while (*tail) tail = &(*tail)->next;
+    *tail = listener;
+    return true;
+}
+
+bool event_listeners_has(const EventListeners* listeners, const char* name) {
+    for (const struct EventListener* l = listeners->head; l; l = l->next) {
+        if (strcmp(l->name, name) == 0) return true;
+    }
+    return false;
+}
+
+bool event_listeners_emit(EventListeners* listeners, JSContextRef ctx, JSObjectRef thisObject,
+                          const char* name, size_t argc, const JSValueRef args[]) {
+    bool any = false;
+    for (struct EventListener* l = listeners->head; l; l = l->next) {
+        if (strcmp(l->name, name) != 0) continue;
+        any = true;
+        PROFILE_CALL_SPAN(ctx, l->callback, "event");
+        JSObjectCallAsFunction(ctx, l->callback, thisObject, argc, args, NULL);
+    }
+    return any;
+}
+
+void event_listeners_clear(EventListeners* listeners, JSContextRef ctx) {
+    struct EventListener* l = listeners->head;
+    listeners->head = NULL;
+    while (l) {
+        struct EventListener* next = l->next;
+        JSValueUnprotect(ctx, l->callback);
+        free(l);
+        l = next;
+    }
+}
@@ -3,15 +3,37 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "runtime.h"
 
+#define FS_READ_MMAP_THRESHOLD  (1024 * 1024)   // Files at least this big are mapped, not read
+#define FS_READ_UNKNOWN_CHUNK   (64 * 1024)     // Growth step when fstat reports no size
+
+// What fs.readFile/readMany hand back
+typedef enum {
+    FS_READ_STRING,
+    FS_READ_BUFFER,
+    FS_READ_ARRAY_BUFFER
+} FsReadFormat;
+
 // File Read Request Structure
 typedef struct {
     uv_fs_t req;
+    uv_work_t work;
     uv_file file;
     JSContextRef ctx;
-    JSObjectRef callback;
-    uv_buf_t buffer;
+    Completion done;
+    char* data;            // malloc'd or mmap'd contents
+    size_t len;            // Bytes read so far
+    size_t cap;            // Size of `data`
+    size_t expected;       // st_size, 0 when the file does not report one
+    int error;
+    bool mapped;
+    FsReadFormat format;
 } FileReadRequest;
 
 // File Write Request Structure
@@ -19,21 +41,133 @@ typedef struct {
     uv_fs_t req;
     uv_file file;
     JSContextRef ctx;
-    JSObjectRef callback;
+    Completion done;
     uv_buf_t buffer;
+    JSValueRef pinned;     // Binary content written in place, or NULL when `buffer` is malloc'd
 } FileWriteRequest;
 
 // File Existence Check Request Structure
 typedef struct {
     uv_fs_t req;
     JSContextRef ctx;
-    JSObjectRef callback;
+    Completion done;
 } FileExistsRequest;
 
+static JADE_THREAD_LOCAL MemPool fs_read_pool = MEM_POOL_INIT("fs.read", FileReadRequest);
+static JADE_THREAD_LOCAL MemPool fs_write_pool = MEM_POOL_INIT("fs.write", FileWriteRequest);
+static JADE_THREAD_LOCAL MemPool fs_exists_pool = MEM_POOL_INIT("fs.exists", FileExistsRequest);
+
+
+static void fs_read_close(FileReadRequest* fr);
+static void fs_read_chunk(FileReadRequest* fr);
+
+static void fs_read_unmap(void* bytes, void* length) {
+    munmap(bytes, (size_t)(uintptr_t)length);
+}
+
+static void fs_read_free(void* bytes, void* context) {
+    free(bytes);
+}
+
+// Settles with `(err, data)`; ownership of the bytes moves to a Buffer or ArrayBuffer when one is made
+static void fs_read_deliver(FileReadRequest* fr) {
+    JSContextRef ctx = fr->ctx;
+    JSValueRef args[2];
+
+    if (fr->error < 0) {
+        fprintf(stderr, "fs.readFile() error: %s\n", uv_strerror(fr->error));
+        JSStringRef errMsg = JSStringCreateWithUTF8CString(uv_strerror(fr->error));
+        args[0] = JSValueMakeString(ctx, errMsg);
+        args[1] = JSValueMakeNull(ctx);
+        JSStringRelease(errMsg);
+    } else if (fr->format != FS_READ_STRING) {
+        // The buffer owns the bytes from here on: free() for heap data, munmap() for mappings
+        if (!fr->data) fr->data = malloc(1);
+        JSTypedArrayBytesDeallocator release = fr->mapped ? fs_read_unmap : fs_read_free;
+        void* release_context = (void*)(uintptr_t)fr->cap;
+        args[0] = JSValueMakeNull(ctx);
+        args[1] = fr->format == FS_READ_BUFFER
+            ? js_buffer_new(ctx, fr->data, fr->len, release, release_context)
+            : JSObjectMakeArrayBufferWithBytesNoCopy(ctx, fr->data, fr->len, release, release_context, NULL);
+        fr->data = NULL;
+    } else {
+        // Length-delimited, so embedded NUL bytes survive
+        JSStringRef fileData = js_string_from_utf8(fr->data ? fr->data : "", fr->len);
+        args[0] = JSValueMakeNull(ctx);
+        args[1] = JSValueMakeString(ctx, fileData);
+        JSStringRelease(fileData);
+    }
+
+    if (fr->data) {
+        if (fr->mapped) munmap(fr->data, fr->cap);
+        else free(fr->data);
+        fr->data = NULL;
+    }
+
+    completion_settle(&fr->done, ctx, args[0], args[1]);
+}
+
+// Close Callback Function
+static void on_file_read_closed(uv_fs_t* req) {
+    FileReadRequest* fr = (FileReadRequest*)req->data;
+    uv_fs_req_cleanup(req);
+    completion_release(&fr->done, fr->ctx);
+    pool_free(&fs_read_pool, fr);
+}
+
+// Delivers the result, then closes the file without blocking the loop
+static void fs_read_close(FileReadRequest* fr) {
+    fs_read_deliver(fr);
+    fr->req.data = fr;
+    uv_fs_close(loop, &fr->req, fr->file, on_file_read_closed);
+}
+
+// Maps and pre-faults a large file on the threadpool, so page faults never stall the loop
+static void fs_read_map_work(uv_work_t* work) {
+    FileReadRequest* fr = (FileReadRequest*)work->data;
+    void* data = mmap(NULL, fr->expected, PROT_READ, MAP_PRIVATE, fr->file, 0);
+    if (data == MAP_FAILED) {
+        fr->error = uv_translate_sys_error(errno);
+        return;
+    }
+
+    // Advice values are not flags, so each hint needs its own call
+    madvise(data, fr->expected, MADV_SEQUENTIAL);
+    madvise(data, fr->expected, MADV_WILLNEED);
+    long page = sysconf(_SC_PAGESIZE);
+    volatile const char* bytes = data;
+    for (size_t off = 0; off < fr->expected; off += (size_t)page) (void)bytes[off];
+
+    fr->data = data;
+    fr->len = fr->cap = fr->expected;
+    fr->mapped = true;
+}
+
+static void on_file_mapped(uv_work_t* work, int status) {
+    FileReadRequest* fr = (FileReadRequest*)work->data;
+
+    // Some files (procfs, some FUSE mounts) cannot be mapped; read them instead
+    if (status == 0 && fr->error < 0 && !fr->mapped) {
+        fr->error = 0;
+        fr->cap = fr->expected + 1;
+        fr->data = malloc(fr->cap);
+        if (!fr->data) {
+            fr->error = UV_ENOMEM;
+            fs_read_close(fr);
+            return;
+        }
+        fs_read_chunk(fr);
+        return;
+    }
+    if (status < 0) fr->error = status;
+    fs_read_close(fr);
+}
 
 // Read Callback Function
 void on_file_read(uv_fs_t* req) {
+    PROFILE_SPAN("fs.read");
     FileReadRequest* fr = (FileReadRequest*)req->data;
+    ssize_t result = req->result;
     uv_fs_req_cleanup(req);
 
     // Ensure valid request
@@ -42,79 +176,132 @@ void on_file_read(uv_fs_t* req) {
         return;
     }
 
-    // Handle read errors
-    if (req->result < 0) {
-        fprintf(stderr, "fs.readFile() error: %s\n", uv_strerror(req->result));
-        JSStringRef errMsg = JSStringCreateWithUTF8CString(uv_strerror(req->result));
-        JSValueRef args[] = { JSValueMakeString(fr->ctx, errMsg), JSValueMakeNull(fr->ctx) };
-        JSObjectCallAsFunction(fr->ctx, fr->callback, NULL, 2, args, NULL);
-        JSStringRelease(errMsg);
-    } else {
-        // Convert buffer to JS string
-        fr->buffer.base[req->result] = '\0'; // Ensure null termination
-        JSStringRef fileData = JSStringCreateWithUTF8CString(fr->buffer.base);
-        JSValueRef args[] = { JSValueMakeNull(fr->ctx), JSValueMakeString(fr->ctx, fileData) };
-        JSObjectCallAsFunction(fr->ctx, fr->callback, NULL, 2, args, NULL);
-        JSStringRelease(fileData);
+    if (result < 0) {
+        fr->error = (int)result;
+        fs_read_close(fr);
+        return;
     }
 
-    // Cleanup
-    uv_fs_close(uv_default_loop(), &fr->req, fr->file, NULL);
-    JSValueUnprotect(fr->ctx, fr->callback);
-    free(fr->buffer.base);
-    free(fr);
+    fr->len += (size_t)result;
+
+    // Done at EOF, or once the size fstat reported has arrived
+    if (result == 0 || (fr->expected && fr->len >= fr->expected)) {
+        fs_read_close(fr);
+        return;
+    }
+    fs_read_chunk(fr);
 }
 
-// Open File Callback
-void on_file_open(uv_fs_t* req) {
+// Reads into the free tail of the buffer, growing it when the file outruns its reported size
+static void fs_read_chunk(FileReadRequest* fr) {
+    if (fr->len == fr->cap) {
+        size_t cap = fr->cap ? fr->cap * 2 : FS_READ_UNKNOWN_CHUNK;
+        char* data = realloc(fr->data, cap);
+        if (!data) {
+            fr->error = UV_ENOMEM;
+            fs_read_close(fr);
+            return;
+        }
+        fr->data = data;
+        fr->cap = cap;
+    }
+
+    uv_buf_t buf = uv_buf_init(fr->data + fr->len, (unsigned int)(fr->cap - fr->len));
+    fr->req.data = fr;
+    uv_fs_read(loop, &fr->req, fr->file, &buf, 1, (int64_t)fr->len, on_file_read);
+}
+
+// Stat Callback Function: sizes the read before any data moves
+static void on_file_read_stat(uv_fs_t* req) {
     FileReadRequest* fr = (FileReadRequest*)req->data;
+    ssize_t result = req->result;
+    uv_stat_t st = req->statbuf;
+    uv_fs_req_cleanup(req);
 
-    if (!fr) {
-        fprintf(stderr, "Error: FileReadRequest is NULL in on_file_open()\n");
+    if (result < 0) {
+        fr->error = (int)result;
+        fs_read_close(fr);
+        return;
+    }
+    if ((st.st_mode & S_IFMT) == S_IFDIR) {
+        fr->error = UV_EISDIR;
+        fs_read_close(fr);
         return;
     }
 
-    if (req->result < 0) {
-        // Print error and return error to callback
-        fprintf(stderr, "fs.readFile() error: %s\n", uv_strerror(req->result));
-        JSStringRef errMsg = JSStringCreateWithUTF8CString(uv_strerror(req->result));
-        JSValueRef args[] = { JSValueMakeString(fr->ctx, errMsg), JSValueMakeNull(fr->ctx) };
-        JSObjectCallAsFunction(fr->ctx, fr->callback, NULL, 2, args, NULL);
-        JSStringRelease(errMsg);
-        JSValueUnprotect(fr->ctx, fr->callback);
-        free(fr);
+    // Only regular files report a size worth trusting
+    fr->expected = (st.st_mode & S_IFMT) == S_IFREG ? (size_t)st.st_size : 0;
+
+    if (fr->expected >= FS_READ_MMAP_THRESHOLD) {
+        fr->work.data = fr;
+        int status = uv_queue_work(loop, &fr->work, fs_read_map_work, on_file_mapped);
+        if (status < 0) {
+            fr->error = status;
+            fs_read_close(fr);
+        }
         return;
     }
 
-    fr->file = req->result;
+    // One spare byte, so the read that confirms EOF is not needed for a size-exact buffer
+    if (fr->expected > 0) {
+        fr->cap = fr->expected + 1;
+        fr->data = malloc(fr->cap);
+        if (!fr->data) {
+            fr->error = UV_ENOMEM;
+            fs_read_close(fr);
+            return;
+        }
+    }
+    fs_read_chunk(fr);
+}
 
-    // Allocate buffer
-    fr->buffer = uv_buf_init((char*)malloc(1024), 1024);
-    if (!fr->buffer.base) {
-        fprintf(stderr, "Memory allocation failed\n");
-        uv_fs_close(uv_default_loop(), &fr->req, fr->file, NULL);
-        JSValueUnprotect(fr->ctx, fr->callback);
-        free(fr);
+// Open File Callback
+void on_file_open(uv_fs_t* req) {
+    FileReadRequest* fr = (FileReadRequest*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+
+    if (!fr) {
+        fprintf(stderr, "Error: FileReadRequest is NULL in on_file_open()\n");
         return;
     }
 
-    // Read file asynchronously
-    uv_fs_read(uv_default_loop(), &fr->req, fr->file, &fr->buffer, 1, 0, on_file_read);
+    if (result < 0) {
+        // Nothing to close; report and release directly
+        fr->error = (int)result;
+        fs_read_deliver(fr);
+        completion_release(&fr->done, fr->ctx);
+        pool_free(&fs_read_pool, fr);
+        return;
+    }
+
+    fr->file = (uv_file)result;
+    fr->req.data = fr;
+    uv_fs_fstat(loop, &fr->req, fr->file, on_file_read_stat);
 }
 
-// `fs.readFile(path, callback)`
-JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef function,
-                        JSObjectRef thisObject, size_t argc,
-                        const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 2) {
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.readFile requires a path and callback");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
+// Reads `options` (an encoding string or `{ encoding }`); `null` or "buffer"
+// selects a Buffer, "arraybuffer" a bare ArrayBuffer
+static FsReadFormat fs_read_format(JSContextRef ctx, JSValueRef options) {
+    JSValueRef encoding = options;
+    if (JSValueIsObject(ctx, options) && !JSObjectIsFunction(ctx, (JSObjectRef)options)) {
+        encoding = JSObjectGetProperty(ctx, (JSObjectRef)options, ATOM(encoding), NULL);
+        if (JSValueIsNull(ctx, encoding)) return FS_READ_BUFFER;
     }
+    if (!JSValueIsString(ctx, encoding)) return FS_READ_STRING;
+
+    JSStringRef str = JSValueToStringCopy(ctx, encoding, NULL);
+    FsReadFormat format = JSStringIsEqualToUTF8CString(str, "arraybuffer") ? FS_READ_ARRAY_BUFFER
+                        : JSStringIsEqualToUTF8CString(str, "buffer") ? FS_READ_BUFFER
+                        : FS_READ_STRING;
+    JSStringRelease(str);
+    return format;
+}
 
-    // Convert JS string (path)
-    JSStringRef pathRef = JSValueToStringCopy(ctx, args[0], exception);
+// Copies a JS path argument to a malloc'd UTF-8 string; NULL with `*exception` set on failure
+static char* fs_path_copy(JSContextRef ctx, JSValueRef value, JSValueRef* exception) {
+    JSStringRef pathRef = JSValueToStringCopy(ctx, value, exception);
+    if (!pathRef) return NULL;
     size_t pathLen = JSStringGetMaximumUTF8CStringSize(pathRef);
     char* path = (char*)malloc(pathLen);
     if (!path) {
@@ -122,25 +309,30 @@ JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef function,
         JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
         *exception = JSValueMakeString(ctx, errMsg);
         JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
+        return NULL;
     }
     JSStringGetUTF8CString(pathRef, path, pathLen);
     JSStringRelease(pathRef);
+    return path;
+}
 
-    // Debug print
-    printf("Opening file: %s\n", path);
+// Whether `value` is a callable callback; sets `*exception` to `message` when not
+static bool fs_require_function(JSContextRef ctx, JSValueRef value, const char* message, JSValueRef* exception) {
+    if (JSValueIsObject(ctx, value) && JSObjectIsFunction(ctx, (JSObjectRef)value)) return true;
+    JSStringRef errMsg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, errMsg);
+    JSStringRelease(errMsg);
+    return false;
+}
 
-    // Ensure callback is a function
-    if (!JSValueIsObject(ctx, args[1]) || !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
-        free(path);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Second argument must be a function");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
-    }
+// Starts a read; a NULL `callback` returns a promise instead
+static JSValueRef fs_read_start(JSContextRef ctx, JSValueRef pathValue, FsReadFormat format,
+                                JSValueRef callback, JSValueRef* exception) {
+    char* path = fs_path_copy(ctx, pathValue, exception);
+    if (!path) return JSValueMakeUndefined(ctx);
 
     // Create File Read Request
-    FileReadRequest* fr = (FileReadRequest*)malloc(sizeof(FileReadRequest));
+    FileReadRequest* fr = (FileReadRequest*)pool_calloc(&fs_read_pool);
     if (!fr) {
         free(path);
         JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
@@ -149,21 +341,70 @@ JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef function,
         return JSValueMakeUndefined(ctx);
     }
 
+    JSValueRef result = completion_init(&fr->done, ctx, callback, exception);
+    if (!result) {
+        free(path);
+        pool_free(&fs_read_pool, fr);
+        return JSValueMakeUndefined(ctx);
+    }
     fr->ctx = ctx;
-    fr->callback = (JSObjectRef)args[1];
-    JSValueProtect(ctx, fr->callback);
+    fr->format = format;
 
     // Open File Asynchronously
-    uv_fs_open(uv_default_loop(), &fr->req, path, O_RDONLY, 0, on_file_open);
     fr->req.data = fr;
+    uv_fs_open(loop, &fr->req, path, O_RDONLY, 0, on_file_open);
     free(path);
 
-    return JSValueMakeUndefined(ctx);
+    return result;
 }
 
+// `fs.readFile(path, [options], callback)`
+JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.readFile");
+    if (argc < 2) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.readFile requires a path and callback");
+        *exception = JSValueMakeString(ctx, errMsg);
+        JSStringRelease(errMsg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    JSValueRef callback = args[argc >= 3 ? 2 : 1];
+    if (!fs_require_function(ctx, callback, "Last argument must be a function", exception)) {
+        return JSValueMakeUndefined(ctx);
+    }
+    FsReadFormat format = argc >= 3 ? fs_read_format(ctx, args[1]) : FS_READ_STRING;
+    return fs_read_start(ctx, args[0], format, callback, exception);
+}
+
+// `fs.promises.readFile(path, [options])`
+JSValueRef fs_promises_read_file(JSContextRef ctx, JSObjectRef function,
+                                 JSObjectRef thisObject, size_t argc,
+                                 const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.promises.readFile");
+    if (argc < 1) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.promises.readFile requires a path");
+        *exception = JSValueMakeString(ctx, errMsg);
+        JSStringRelease(errMsg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    FsReadFormat format = argc >= 2 ? fs_read_format(ctx, args[1]) : FS_READ_STRING;
+    return fs_read_start(ctx, args[0], format, NULL, exception);
+}
+
+
+static void fs_write_release(FileWriteRequest* fw) {
+    if (fw->pinned) JSValueUnprotect(fw->ctx, fw->pinned);
+    else free(fw->buffer.base);
+    completion_release(&fw->done, fw->ctx);
+    pool_free(&fs_write_pool, fw);
+}
 
 // Write Callback Function
 void on_file_write(uv_fs_t* req) {
+    PROFILE_SPAN("fs.write");
     FileWriteRequest* fw = (FileWriteRequest*)req->data;
     uv_fs_req_cleanup(req);
 
@@ -177,25 +418,22 @@ void on_file_write(uv_fs_t* req) {
     if (req->result < 0) {
         fprintf(stderr, "fs.writeFile() error: %s\n", uv_strerror(req->result));
         JSStringRef errMsg = JSStringCreateWithUTF8CString(uv_strerror(req->result));
-        JSValueRef args[] = { JSValueMakeString(fw->ctx, errMsg) };
-        JSObjectCallAsFunction(fw->ctx, fw->callback, NULL, 1, args, NULL);
+        completion_settle(&fw->done, fw->ctx, JSValueMakeString(fw->ctx, errMsg), NULL);
         JSStringRelease(errMsg);
     } else {
-        // Call JS callback with no error
-        JSValueRef args[] = { JSValueMakeNull(fw->ctx) };
-        JSObjectCallAsFunction(fw->ctx, fw->callback, NULL, 1, args, NULL);
+        // Settle with no error
+        completion_settle(&fw->done, fw->ctx, NULL, NULL);
     }
 
     // Cleanup
-    uv_fs_close(uv_default_loop(), &fw->req, fw->file, NULL);
-    JSValueUnprotect(fw->ctx, fw->callback);
-    free(fw->buffer.base);
-    free(fw);
+    uv_fs_close(loop, &fw->req, fw->file, NULL);
+    fs_write_release(fw);
 }
 
 // Open File Callback
 void on_file_open_write(uv_fs_t* req) {
     FileWriteRequest* fw = (FileWriteRequest*)req->data;
+    uv_fs_req_cleanup(req);
 
     if (!fw) {
         fprintf(stderr, "Error: FileWriteRequest is NULL in on_file_open_write()\n");
@@ -203,99 +441,112 @@ void on_file_open_write(uv_fs_t* req) {
     }
 
     if (req->result < 0) {
-        // Print error and return error to callback
+        // Print error and settle with it
         fprintf(stderr, "fs.writeFile() error: %s\n", uv_strerror(req->result));
         JSStringRef errMsg = JSStringCreateWithUTF8CString(uv_strerror(req->result));
-        JSValueRef args[] = { JSValueMakeString(fw->ctx, errMsg) };
-        JSObjectCallAsFunction(fw->ctx, fw->callback, NULL, 1, args, NULL);
+        completion_settle(&fw->done, fw->ctx, JSValueMakeString(fw->ctx, errMsg), NULL);
         JSStringRelease(errMsg);
-        JSValueUnprotect(fw->ctx, fw->callback);
-        free(fw);
+        fs_write_release(fw);
         return;
     }
 
     fw->file = req->result;
 
     // Write file asynchronously
-    uv_fs_write(uv_default_loop(), &fw->req, fw->file, &fw->buffer, 1, 0, on_file_write);
+    uv_fs_write(loop, &fw->req, fw->file, &fw->buffer, 1, 0, on_file_write);
 }
 
-// `fs.writeFile(path, content, callback)`
-JSValueRef fs_write_file(JSContextRef ctx, JSObjectRef function,
-                         JSObjectRef thisObject, size_t argc,
-                         const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 3) {
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.writeFile requires a path, content, and callback");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
-    }
+// Starts a write; a NULL `callback` returns a promise instead
+static JSValueRef fs_write_start(JSContextRef ctx, JSValueRef pathValue, JSValueRef contentValue,
+                                 JSValueRef callback, JSValueRef* exception) {
+    char* path = fs_path_copy(ctx, pathValue, exception);
+    if (!path) return JSValueMakeUndefined(ctx);
 
-    // Convert JS string (path)
-    JSStringRef pathRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t pathLen = JSStringGetMaximumUTF8CStringSize(pathRef);
-    char* path = (char*)malloc(pathLen);
-    if (!path) {
-        JSStringRelease(pathRef);
+    // Create File Write Request
+    FileWriteRequest* fw = (FileWriteRequest*)pool_alloc(&fs_write_pool);
+    if (!fw) {
+        free(path);
         JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
         *exception = JSValueMakeString(ctx, errMsg);
         JSStringRelease(errMsg);
         return JSValueMakeUndefined(ctx);
     }
-    JSStringGetUTF8CString(pathRef, path, pathLen);
-    JSStringRelease(pathRef);
 
-    // Convert JS string (content)
-    JSStringRef contentRef = JSValueToStringCopy(ctx, args[1], exception);
-    size_t contentLen = JSStringGetMaximumUTF8CStringSize(contentRef);
-    char* content = (char*)malloc(contentLen);
-    if (!content) {
-        free(path);
+    // Buffers and typed arrays are written from JSC memory, kept alive until the
+    // write completes; strings are encoded once, keeping their full length
+    const char* bytes;
+    size_t len;
+    if (js_value_get_bytes(ctx, contentValue, &bytes, &len)) {
+        fw->pinned = contentValue;
+        JSValueProtect(ctx, fw->pinned);
+        fw->buffer = uv_buf_init((char*)bytes, (unsigned int)len);
+    } else {
+        JSStringRef contentRef = JSValueToStringCopy(ctx, contentValue, exception);
+        if (!contentRef) {
+            free(path);
+            pool_free(&fs_write_pool, fw);
+            return JSValueMakeUndefined(ctx);
+        }
+        size_t contentMax = JSStringGetMaximumUTF8CStringSize(contentRef);
+        char* content = malloc(contentMax);
+        len = JSStringGetUTF8CString(contentRef, content, contentMax) - 1;
         JSStringRelease(contentRef);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
+        fw->pinned = NULL;
+        fw->buffer = uv_buf_init(content, (unsigned int)len);
     }
-    JSStringGetUTF8CString(contentRef, content, contentLen);
-    JSStringRelease(contentRef);
 
-    // Ensure callback is a function
-    if (!JSValueIsObject(ctx, args[2]) || !JSObjectIsFunction(ctx, (JSObjectRef)args[2])) {
+    fw->ctx = ctx;
+    JSValueRef result = completion_init(&fw->done, ctx, callback, exception);
+    if (!result) {
         free(path);
-        free(content);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Third argument must be a function");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
+        fs_write_release(fw);
         return JSValueMakeUndefined(ctx);
     }
 
-    // Create File Write Request
-    FileWriteRequest* fw = (FileWriteRequest*)malloc(sizeof(FileWriteRequest));
-    if (!fw) {
-        free(path);
-        free(content);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
+    // Open File Asynchronously (Create/Truncate mode)
+    fw->req.data = fw;
+    uv_fs_open(loop, &fw->req, path, O_WRONLY | O_CREAT | O_TRUNC, 0644, on_file_open_write);
+    free(path);
+
+    return result;
+}
+
+// `fs.writeFile(path, content, callback)`
+JSValueRef fs_write_file(JSContextRef ctx, JSObjectRef function,
+                         JSObjectRef thisObject, size_t argc,
+                         const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.writeFile");
+    if (argc < 3) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.writeFile requires a path, content, and callback");
         *exception = JSValueMakeString(ctx, errMsg);
         JSStringRelease(errMsg);
         return JSValueMakeUndefined(ctx);
     }
 
-    fw->ctx = ctx;
-    fw->callback = (JSObjectRef)args[2];
-    JSValueProtect(ctx, fw->callback);
-    fw->buffer = uv_buf_init(content, strlen(content));
+    if (!fs_require_function(ctx, args[2], "Third argument must be a function", exception)) {
+        return JSValueMakeUndefined(ctx);
+    }
+    return fs_write_start(ctx, args[0], args[1], args[2], exception);
+}
 
-    // Open File Asynchronously (Create/Truncate mode)
-    uv_fs_open(uv_default_loop(), &fw->req, path, O_WRONLY | O_CREAT | O_TRUNC, 0644, on_file_open_write);
-    fw->req.data = fw;
-    free(path);
+// `fs.promises.writeFile(path, content)`
+JSValueRef fs_promises_write_file(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.promises.writeFile");
+    if (argc < 2) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.promises.writeFile requires a path and content");
+        *exception = JSValueMakeString(ctx, errMsg);
+        JSStringRelease(errMsg);
+        return JSValueMakeUndefined(ctx);
+    }
 
-    return JSValueMakeUndefined(ctx);
+    return fs_write_start(ctx, args[0], args[1], NULL, exception);
 }
 
 // Stat Callback Function
 void on_file_stat(uv_fs_t* req) {
+    PROFILE_SPAN("fs.stat");
     FileExistsRequest* fe = (FileExistsRequest*)req->data;
     uv_fs_req_cleanup(req);
 
@@ -304,30 +555,51 @@ void on_file_stat(uv_fs_t* req) {
         return;
     }
 
-    JSValueRef args[2];
+    // A failed stat means the file does not exist; it is never an error
+    bool exists = req->result >= 0;
+    completion_settle(&fe->done, fe->ctx, NULL, JSValueMakeBoolean(fe->ctx, exists));
 
-    if (req->result < 0) {
-        // File does not exist
-        args[0] = JSValueMakeNull(fe->ctx);
-        args[1] = JSValueMakeBoolean(fe->ctx, false);
-    } else {
-        // File exists
-        args[0] = JSValueMakeNull(fe->ctx);
-        args[1] = JSValueMakeBoolean(fe->ctx, true);
+    // Cleanup
+    pool_free(&fs_exists_pool, fe);
+}
+
+// Starts an existence check; a NULL `callback` returns a promise instead
+static JSValueRef fs_exists_start(JSContextRef ctx, JSValueRef pathValue, JSValueRef callback,
+                                  JSValueRef* exception) {
+    char* path = fs_path_copy(ctx, pathValue, exception);
+    if (!path) return JSValueMakeUndefined(ctx);
+
+    // Create File Exists Request
+    FileExistsRequest* fe = (FileExistsRequest*)pool_alloc(&fs_exists_pool);
+    if (!fe) {
+        free(path);
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
+        *exception = JSValueMakeString(ctx, errMsg);
+        JSStringRelease(errMsg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    JSValueRef result = completion_init(&fe->done, ctx, callback, exception);
+    if (!result) {
+        free(path);
+        pool_free(&fs_exists_pool, fe);
+        return JSValueMakeUndefined(ctx);
     }
+    fe->ctx = ctx;
 
-    // Call the JavaScript callback
-    JSObjectCallAsFunction(fe->ctx, fe->callback, NULL, 2, args, NULL);
+    // Check File Existence Asynchronously
+    fe->req.data = fe;
+    uv_fs_stat(loop, &fe->req, path, on_file_stat);
+    free(path);
 
-    // Cleanup
-    JSValueUnprotect(fe->ctx, fe->callback);
-    free(fe);
+    return result;
 }
 
 // `fs.exists(path, callback)`
 JSValueRef fs_exists(JSContextRef ctx, JSObjectRef function,
                      JSObjectRef thisObject, size_t argc,
                      const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.exists");
     if (argc < 2) {
         JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.exists requires a path and callback");
         *exception = JSValueMakeString(ctx, errMsg);
@@ -335,47 +607,332 @@ JSValueRef fs_exists(JSContextRef ctx, JSObjectRef function,
         return JSValueMakeUndefined(ctx);
     }
 
-    // Convert JS string (path)
-    JSStringRef pathRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t pathLen = JSStringGetMaximumUTF8CStringSize(pathRef);
-    char* path = (char*)malloc(pathLen);
-    if (!path) {
-        JSStringRelease(pathRef);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
+    if (!fs_require_function(ctx, args[1], "Second argument must be a function", exception)) {
         return JSValueMakeUndefined(ctx);
     }
-    JSStringGetUTF8CString(pathRef, path, pathLen);
-    JSStringRelease(pathRef);
+    return fs_exists_start(ctx, args[0], args[1], exception);
+}
 
-    // Ensure callback is a function
-    if (!JSValueIsObject(ctx, args[1]) || !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
-        free(path);
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("Second argument must be a function");
+// `fs.promises.exists(path)`
+JSValueRef fs_promises_exists(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.promises.exists");
+    if (argc < 1) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString("fs.promises.exists requires a path");
         *exception = JSValueMakeString(ctx, errMsg);
         JSStringRelease(errMsg);
         return JSValueMakeUndefined(ctx);
     }
 
-    // Create File Exists Request
-    FileExistsRequest* fe = (FileExistsRequest*)malloc(sizeof(FileExistsRequest));
-    if (!fe) {
-        free(path);
+    return fs_exists_start(ctx, args[0], NULL, exception);
+}
+
+// =====================================================================================
+//                          BATCHED STAT / READ (fs.statMany, fs.readMany)
+// =====================================================================================
+
+#define FS_BATCH_MIN_PER_CHUNK  16      // Smaller chunks cost more in queueing than they save
+#define FS_BATCH_MAX_CHUNKS     128
+
+typedef struct FsBatch FsBatch;
+
+// Outcome for one path; filled on a worker thread, read on the loop thread
+typedef struct {
+    const char* path;
+    int error;
+    uint32_t mode;
+    uint64_t size;
+    double mtime_ms;
+    char* data;             // readMany contents (malloc'd)
+    size_t len;
+} FsBatchItem;
+
+// One uv_queue_work job covering items [begin, end)
+typedef struct {
+    uv_work_t work;
+    FsBatch* batch;
+    size_t begin;
+    size_t end;
+} FsBatchChunk;
+
+struct FsBatch {
+    JSContextRef ctx;
+    JSObjectRef callback;
+    bool read;              // readMany, not statMany
+    FsReadFormat format;
+    size_t count;
+    size_t pending_chunks;
+    FsBatchItem* items;
+    FsBatchChunk* chunks;
+    char* names;            // All paths, NUL-separated
+};
+
+// Worker-thread helper: loop-free syscalls, since uv_fs_*() would touch the loop's counters
+static void fs_batch_stat_item(FsBatchItem* item, int fd) {
+    struct stat st;
+    int r = fd >= 0 ? fstat(fd, &st) : stat(item->path, &st);
+    if (r != 0) {
+        item->error = uv_translate_sys_error(errno);
+        return;
+    }
+    item->mode = (uint32_t)st.st_mode;
+    item->size = (uint64_t)st.st_size;
+    item->mtime_ms = (double)st.st_mtim.tv_sec * 1e3 + (double)st.st_mtim.tv_nsec / 1e6;
+}
+
+static void fs_batch_read_item(FsBatchItem* item) {
+    int fd = open(item->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        item->error = uv_translate_sys_error(errno);
+        return;
+    }
+
+    fs_batch_stat_item(item, fd);
+    if (item->error == 0 && S_ISDIR(item->mode)) item->error = UV_EISDIR;
+
+    // Sized by fstat plus one byte to see EOF; grows for files that report no size
+    size_t cap = item->error == 0 && S_ISREG(item->mode) ? (size_t)item->size + 1 : FS_READ_UNKNOWN_CHUNK;
+    char* data = item->error == 0 ? malloc(cap) : NULL;
+    if (item->error == 0 && !data) item->error = UV_ENOMEM;
+
+    size_t len = 0;
+    while (item->error == 0) {
+        if (len == cap) {
+            char* grown = realloc(data, cap * 2);
+            if (!grown) {
+                item->error = UV_ENOMEM;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, data + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            item->error = uv_translate_sys_error(errno);
+        } else if (n == 0) {
+            break;
+        } else {
+            len += (size_t)n;
+        }
+    }
+    close(fd);
+
+    if (item->error < 0) {
+        free(data);
+        return;
+    }
+    item->data = data;
+    item->len = len;
+}
+
+static void fs_batch_work(uv_work_t* work) {
+    FsBatchChunk* chunk = (FsBatchChunk*)work->data;
+    FsBatch* batch = chunk->batch;
+    for (size_t i = chunk->begin; i < chunk->end; i++) {
+        if (batch->read) fs_batch_read_item(&batch->items[i]);
+        else fs_batch_stat_item(&batch->items[i], -1);
+    }
+}
+
+static JSValueRef fs_batch_error_value(JSContextRef ctx, int error) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(uv_strerror(error));
+    JSValueRef value = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return value;
+}
+
+static JSObjectRef fs_batch_stat_object(JSContextRef ctx, const FsBatchItem* item) {
+    JSObjectRef stat = JSObjectMake(ctx, NULL, NULL);
+    JSObjectSetProperty(ctx, stat, ATOM(size), JSValueMakeNumber(ctx, (double)item->size), kJSPropertyAttributeNone, NULL);
+    JSObjectSetProperty(ctx, stat, ATOM(mode), JSValueMakeNumber(ctx, item->mode), kJSPropertyAttributeNone, NULL);
+    JSObjectSetProperty(ctx, stat, ATOM(mtimeMs), JSValueMakeNumber(ctx, item->mtime_ms), kJSPropertyAttributeNone, NULL);
+    JSObjectSetProperty(ctx, stat, ATOM(isFile), JSValueMakeBoolean(ctx, S_ISREG(item->mode)), kJSPropertyAttributeNone, NULL);
+    JSObjectSetProperty(ctx, stat, ATOM(isDirectory), JSValueMakeBoolean(ctx, S_ISDIR(item->mode)), kJSPropertyAttributeNone, NULL);
+    return stat;
+}
+
+// Builds both result arrays and makes the single `callback(errors, results)` call
+static void fs_batch_deliver(FsBatch* batch) {
+    JSContextRef ctx = batch->ctx;
+    size_t count = batch->count;
+    JSValueRef* errors = malloc((count ? count : 1) * sizeof(JSValueRef));
+    JSValueRef* results = malloc((count ? count : 1) * sizeof(JSValueRef));
+    bool failed = false;
+
+    for (size_t i = 0; i < count; i++) {
+        FsBatchItem* item = &batch->items[i];
+        if (item->error < 0) {
+            failed = true;
+            errors[i] = fs_batch_error_value(ctx, item->error);
+            results[i] = JSValueMakeNull(ctx);
+            continue;
+        }
+
+        errors[i] = JSValueMakeNull(ctx);
+        if (!batch->read) {
+            results[i] = fs_batch_stat_object(ctx, item);
+        } else if (batch->format != FS_READ_STRING) {
+            // The buffer takes ownership of the malloc'd bytes
+            if (!item->data) item->data = malloc(1);
+            results[i] = batch->format == FS_READ_BUFFER
+                ? js_buffer_from_malloc(ctx, item->data, item->len)
+                : JSObjectMakeArrayBufferWithBytesNoCopy(ctx, item->data, item->len, fs_read_free, NULL, NULL);
+            item->data = NULL;
+        } else {
+            JSStringRef str = js_string_from_utf8(item->data, item->len);
+            results[i] = JSValueMakeString(ctx, str);
+            JSStringRelease(str);
+        }
+    }
+
+    JSValueRef args[2];
+    args[0] = failed ? JSObjectMakeArray(ctx, count, errors, NULL) : JSValueMakeNull(ctx);
+    args[1] = JSObjectMakeArray(ctx, count, results, NULL);
+    free(errors);
+    free(results);
+
+    PROFILE_CALL_SPAN(ctx, batch->callback, "callback");
+    JSObjectCallAsFunction(ctx, batch->callback, NULL, 2, args, NULL);
+}
+
+static void fs_batch_free(FsBatch* batch) {
+    for (size_t i = 0; i < batch->count; i++) free(batch->items[i].data);
+    JSValueUnprotect(batch->ctx, batch->callback);
+    free(batch->items);
+    free(batch->chunks);
+    free(batch->names);
+    free(batch);
+}
+
+static void on_fs_batch_chunk_done(uv_work_t* work, int status) {
+    FsBatchChunk* chunk = (FsBatchChunk*)work->data;
+    FsBatch* batch = chunk->batch;
+    runtime_counters.fs_work--;
+
+    if (status < 0) {
+        for (size_t i = chunk->begin; i < chunk->end; i++) batch->items[i].error = status;
+    }
+    if (--batch->pending_chunks > 0) return;
+
+    fs_batch_deliver(batch);
+    fs_batch_free(batch);
+}
+
+// One chunk per threadpool thread, as long as each still has a useful amount of work
+static size_t fs_batch_chunk_count(size_t count) {
+    static size_t threads = 0;
+    if (threads == 0) {
+        const char* env = getenv("UV_THREADPOOL_SIZE");
+        long n = env ? strtol(env, NULL, 10) : 0;
+        threads = n > 0 ? (size_t)(n < FS_BATCH_MAX_CHUNKS ? n : FS_BATCH_MAX_CHUNKS) : 4;
+    }
+    size_t chunks = count / FS_BATCH_MIN_PER_CHUNK;
+    if (chunks > threads) chunks = threads;
+    return chunks > 0 ? chunks : 1;
+}
+
+// Frees a batch that never started; `exception` (if given) gets the out-of-memory error
+static JSValueRef fs_batch_abort(JSContextRef ctx, FsBatch* batch, size_t* offsets, JSValueRef* exception) {
+    if (batch) {
+        free(batch->items);
+        free(batch->names);
+        free(batch);
+    }
+    free(offsets);
+    if (exception) {
         JSStringRef errMsg = JSStringCreateWithUTF8CString("Memory allocation failed");
         *exception = JSValueMakeString(ctx, errMsg);
         JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
     }
+    return JSValueMakeUndefined(ctx);
+}
 
-    fe->ctx = ctx;
-    fe->callback = (JSObjectRef)args[1];
-    JSValueProtect(ctx, fe->callback);
+// Shared entry point: `fs.statMany(paths, callback)` / `fs.readMany(paths, [options], callback)`
+static JSValueRef fs_batch_start(JSContextRef ctx, size_t argc, const JSValueRef args[],
+                                 bool read, const char* usage, JSValueRef* exception) {
+    JSValueRef callback = argc >= 3 && read ? args[2] : argc >= 2 ? args[1] : NULL;
+    if (argc < 2 || !JSValueIsArray(ctx, args[0]) ||
+        !JSValueIsObject(ctx, callback) || !JSObjectIsFunction(ctx, (JSObjectRef)callback)) {
+        JSStringRef errMsg = JSStringCreateWithUTF8CString(usage);
+        *exception = JSValueMakeString(ctx, errMsg);
+        JSStringRelease(errMsg);
+        return JSValueMakeUndefined(ctx);
+    }
 
-    // Check File Existence Asynchronously
-    uv_fs_stat(uv_default_loop(), &fe->req, path, on_file_stat);
-    fe->req.data = fe;
-    free(path);
+    JSObjectRef array = (JSObjectRef)args[0];
+    double length = JSValueToNumber(ctx, JSObjectGetProperty(ctx, array, ATOM(length), NULL), NULL);
+    size_t count = length > 0 && length <= UINT32_MAX ? (size_t)length : 0;
+
+    FsBatch* batch = calloc(1, sizeof(FsBatch));
+    if (!batch) return fs_batch_abort(ctx, NULL, NULL, exception);
+    batch->ctx = ctx;
+    batch->read = read;
+    batch->format = read && argc >= 3 ? fs_read_format(ctx, args[1]) : FS_READ_STRING;
+    batch->count = count;
+    batch->items = calloc(count ? count : 1, sizeof(FsBatchItem));
+
+    // Copy every path into one NUL-separated block before any work is queued
+    size_t names_len = 0, names_cap = count * 32 + 1;
+    size_t* offsets = malloc((count ? count : 1) * sizeof(size_t));
+    batch->names = malloc(names_cap);
+    if (!batch->items || !offsets || !batch->names) return fs_batch_abort(ctx, batch, offsets, exception);
+    for (size_t i = 0; i < count; i++) {
+        JSStringRef str = JSValueToStringCopy(ctx, JSObjectGetPropertyAtIndex(ctx, array, (unsigned)i, NULL), exception);
+        if (!str) return fs_batch_abort(ctx, batch, offsets, NULL);
+        size_t max_len = JSStringGetMaximumUTF8CStringSize(str);
+        if (names_len + max_len > names_cap) {
+            while (names_len + max_len > names_cap) names_cap *= 2;
+            char* names = realloc(batch->names, names_cap);
+            if (!names) {
+                JSStringRelease(str);
+                return fs_batch_abort(ctx, batch, offsets, exception);
+            }
+            batch->names = names;
+        }
+        offsets[i] = names_len;
+        names_len += JSStringGetUTF8CString(str, batch->names + names_len, max_len);
+        JSStringRelease(str);
+    }
 
+    size_t chunks = fs_batch_chunk_count(count);
+    size_t per_chunk = (count + chunks - 1) / chunks;
+    batch->chunks = calloc(chunks, sizeof(FsBatchChunk));
+    if (!batch->chunks) return fs_batch_abort(ctx, batch, offsets, exception);
+
+    for (size_t i = 0; i < count; i++) batch->items[i].path = batch->names + offsets[i];
+    free(offsets);
+
+    batch->callback = (JSObjectRef)callback;
+    JSValueProtect(ctx, batch->callback);
+
+    batch->pending_chunks = chunks;
+    for (size_t c = 0; c < chunks; c++) {
+        FsBatchChunk* chunk = &batch->chunks[c];
+        chunk->batch = batch;
+        chunk->begin = c * per_chunk < count ? c * per_chunk : count;
+        chunk->end = chunk->begin + per_chunk < count ? chunk->begin + per_chunk : count;
+        chunk->work.data = chunk;
+        runtime_counters.fs_work++;
+        int status = uv_queue_work(loop, &chunk->work, fs_batch_work, on_fs_batch_chunk_done);
+        if (status < 0) on_fs_batch_chunk_done(&chunk->work, status);
+    }
     return JSValueMakeUndefined(ctx);
 }
+
+// `fs.statMany(paths, callback)`
+JSValueRef fs_stat_many(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.statMany");
+    return fs_batch_start(ctx, argc, args, false, "fs.statMany requires an array of paths and a callback", exception);
+}
+
+// `fs.readMany(paths, [options], callback)`
+JSValueRef fs_read_many(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "fs.readMany");
+    return fs_batch_start(ctx, argc, args, true, "fs.readMany requires an array of paths and a callback", exception);
+}
@@ -0,0 +1,705 @@
+/**
+ * =====================================================================================
+ *
+ *        FS_STREAM.C - Chunked File Streams (fs.createReadStream / createWriteStream)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Reading files as a sequence of "data" events with pause()/resume()
+ * - Writing files from repeated write() calls with highWaterMark backpressure
+ *
+ * I/O Model:
+ * - Every stream has at most one uv_fs_t in flight and tracks its own file
+ *   offset, so reads and writes are positional and never race each other
+ * - Read streams reuse one chunk buffer for their whole life (pooled at the
+ *   default 64 KiB highWaterMark); UTF-8 sequences split across chunks are
+ *   carried over to the next read
+ * - Write streams swap two buffers: one collects new writes while the other
+ *   is being written, so memory stays near highWaterMark when callers honour
+ *   write()'s return value
+ *
+ * Memory Management:
+ * - A stream's JS object is protected from creation until "close"; the native
+ *   struct is freed by the class finalizer
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include "runtime.h"
+
+#define READ_STREAM_DEFAULT_HWM     (64 * 1024 - 4)   // Fits a pooled read buffer with the UTF-8 carry
+#define WRITE_STREAM_DEFAULT_HWM    (16 * 1024)
+#define UTF8_CARRY_MAX              3
+
+typedef struct {
+    uv_fs_t req;
+    JSContextRef ctx;
+    JSObjectRef object;
+    EventListeners listeners;
+    uv_file file;
+    uv_buf_t chunk;            // Reused for every read; UTF8_CARRY_MAX spare bytes up front
+    bool pooled_chunk;
+    size_t high_water_mark;
+    int64_t position;          // Offset of the next read
+    int64_t end;               // Last byte to read (inclusive), -1 for EOF
+    size_t carry;              // Incomplete UTF-8 sequence kept at the start of `chunk`
+    uint64_t bytes_read;
+    bool binary;               // Emit Buffers instead of strings
+    bool flowing;
+    bool busy;                 // Open or read in flight
+    bool destroyed;
+    bool closed;
+} ReadStream;
+
+typedef struct {
+    uv_fs_t req;
+    JSContextRef ctx;
+    JSObjectRef object;
+    EventListeners listeners;
+    uv_file file;
+    char* pending;             // Collects write() data while `inflight` is written
+    size_t pending_len;
+    size_t pending_cap;
+    char* inflight;
+    size_t inflight_len;
+    size_t inflight_cap;
+    size_t inflight_off;
+    size_t high_water_mark;
+    int64_t position;          // -1 in append mode
+    uint64_t bytes_written;
+    bool busy;                 // Open or write in flight
+    bool need_drain;
+    bool ending;
+    bool closed;
+} WriteStream;
+
+static JADE_THREAD_LOCAL JSClassRef read_stream_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef write_stream_class = NULL;
+
+static JSValueRef fs_stream_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
+}
+
+static JSValueRef fs_stream_error_value(JSContextRef ctx, int status) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(uv_strerror(status));
+    JSValueRef value = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return value;
+}
+
+// Reads a numeric option, leaving `*out` untouched when it is absent
+static bool fs_stream_number_option(JSContextRef ctx, JSValueRef options, JSStringRef name, double* out) {
+    if (!options || !JSValueIsObject(ctx, options)) return false;
+    JSValueRef value = JSObjectGetProperty(ctx, (JSObjectRef)options, name, NULL);
+    if (!JSValueIsNumber(ctx, value)) return false;
+    *out = JSValueToNumber(ctx, value, NULL);
+    return true;
+}
+
+static char* fs_stream_path(JSContextRef ctx, JSValueRef value, JSValueRef* exception) {
+    JSStringRef pathRef = JSValueToStringCopy(ctx, value, exception);
+    if (!pathRef) return NULL;
+    size_t pathLen = JSStringGetMaximumUTF8CStringSize(pathRef);
+    char* path = malloc(pathLen);
+    JSStringGetUTF8CString(pathRef, path, pathLen);
+    JSStringRelease(pathRef);
+    return path;
+}
+
+// ========================= READ STREAM ========================= //
+
+static void read_stream_next(ReadStream* rs);
+
+// Length of the prefix of `data` that does not end inside a UTF-8 sequence
+static size_t utf8_complete_prefix(const unsigned char* data, size_t len) {
+    size_t back = 0;
+    while (back < UTF8_CARRY_MAX && back < len && (data[len - 1 - back] & 0xC0) == 0x80) back++;
+    if (back == len) return len;
+
+    unsigned char lead = data[len - 1 - back];
+    size_t need = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+    return need > back ? len - 1 - back : len;
+}
+
+static void on_read_stream_closed(uv_fs_t* req) {
+    ReadStream* rs = (ReadStream*)req->data;
+    uv_fs_req_cleanup(req);
+
+    event_listeners_emit(&rs->listeners, rs->ctx, rs->object, "close", 0, NULL);
+    event_listeners_clear(&rs->listeners, rs->ctx);
+    JSValueUnprotect(rs->ctx, rs->object);
+}
+
+// Releases the file and buffer; "close" follows once the descriptor is closed
+static void read_stream_close(ReadStream* rs) {
+    if (rs->closed) return;
+    rs->closed = true;
+    rs->flowing = false;
+
+    if (rs->pooled_chunk) read_buffer_release(&rs->chunk);
+    else free(rs->chunk.base);
+    rs->chunk.base = NULL;
+
+    rs->req.data = rs;
+    if (rs->file >= 0) {
+        uv_fs_close(loop, &rs->req, rs->file, on_read_stream_closed);
+        rs->file = -1;
+    } else {
+        rs->req.result = 0;
+        on_read_stream_closed(&rs->req);
+    }
+}
+
+static void read_stream_fail(ReadStream* rs, int status) {
+    JSValueRef args[] = { fs_stream_error_value(rs->ctx, status) };
+    event_listeners_emit(&rs->listeners, rs->ctx, rs->object, "error", 1, args);
+    read_stream_close(rs);
+}
+
+static void read_stream_free_chunk(void* bytes, void* context) {
+    free(bytes);
+}
+
+// Emits `len` bytes starting at the carry as one "data" chunk
+static void read_stream_emit(ReadStream* rs, size_t len) {
+    JSContextRef ctx = rs->ctx;
+    char* base = rs->chunk.base + UTF8_CARRY_MAX - rs->carry;
+    size_t total = rs->carry + len;
+    JSValueRef chunk;
+
+    if (rs->binary) {
+        // JS owns its copy; the chunk buffer goes straight back into service
+        char* bytes = malloc(len ? len : 1);
+        memcpy(bytes, base, len);
+        chunk = js_buffer_new(ctx, bytes, len, read_stream_free_chunk, NULL);
+        rs->carry = 0;
+    } else {
+        size_t complete = len ? utf8_complete_prefix((const unsigned char*)base, total) : total;
+        JSStringRef str = js_string_from_utf8(base, complete);
+        chunk = JSValueMakeString(ctx, str);
+        JSStringRelease(str);
+
+        // Keep the incomplete tail just before the next read's landing spot
+        rs->carry = total - complete;
+        memmove(rs->chunk.base + UTF8_CARRY_MAX - rs->carry, base + complete, rs->carry);
+    }
+
+    JSValueRef args[] = { chunk };
+    event_listeners_emit(&rs->listeners, ctx, rs->object, "data", 1, args);
+}
+
+static void on_read_stream_read(uv_fs_t* req) {
+    PROFILE_SPAN("fs.stream.read");
+    ReadStream* rs = (ReadStream*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    rs->busy = false;
+
+    if (rs->destroyed) {
+        read_stream_close(rs);
+        return;
+    }
+    if (result < 0) {
+        read_stream_fail(rs, (int)result);
+        return;
+    }
+
+    if (result == 0) {
+        // A dangling partial sequence decodes to U+FFFD rather than vanishing
+        if (rs->carry) read_stream_emit(rs, 0);
+        if (!rs->destroyed) event_listeners_emit(&rs->listeners, rs->ctx, rs->object, "end", 0, NULL);
+        read_stream_close(rs);
+        return;
+    }
+
+    rs->position += result;
+    rs->bytes_read += (uint64_t)result;
+    read_stream_emit(rs, (size_t)result);
+
+    if (rs->destroyed) read_stream_close(rs);
+    else read_stream_next(rs);
+}
+
+// Issues the next positional read if the stream is flowing and idle
+static void read_stream_next(ReadStream* rs) {
+    if (!rs->flowing || rs->busy || rs->closed || rs->file < 0) return;
+
+    size_t len = rs->high_water_mark;
+    if (rs->end >= 0) {
+        int64_t left = rs->end - rs->position + 1;
+        if (left < (int64_t)len) len = left > 0 ? (size_t)left : 0;
+    }
+
+    // A zero-length read completes with result 0, which ends the stream
+    uv_buf_t buf = uv_buf_init(rs->chunk.base + UTF8_CARRY_MAX, (unsigned int)len);
+    rs->busy = true;
+    rs->req.data = rs;
+    int status = uv_fs_read(loop, &rs->req, rs->file, &buf, 1, rs->position, on_read_stream_read);
+    if (status < 0) {
+        rs->busy = false;
+        read_stream_fail(rs, status);
+    }
+}
+
+static void on_read_stream_open(uv_fs_t* req) {
+    ReadStream* rs = (ReadStream*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    rs->busy = false;
+
+    if (result < 0) {
+        read_stream_fail(rs, (int)result);
+        return;
+    }
+    rs->file = (uv_file)result;
+
+    if (rs->destroyed) {
+        read_stream_close(rs);
+        return;
+    }
+
+    JSValueRef args[] = { JSValueMakeNumber(rs->ctx, rs->file) };
+    event_listeners_emit(&rs->listeners, rs->ctx, rs->object, "open", 1, args);
+    read_stream_next(rs);
+}
+
+// `stream.on(event, listener)`; a "data" listener starts the flow
+static JSValueRef read_stream_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ReadStream* rs = (ReadStream*)JSObjectGetPrivate(thisObject);
+    if (!rs || rs->closed) return thisObject;
+    if (argc < 2) return fs_stream_throw(ctx, exception, "on() requires an event name and a listener function");
+    if (!event_listeners_on(&rs->listeners, ctx, args[0], args[1], exception)) return JSValueMakeUndefined(ctx);
+
+    if (event_listeners_has(&rs->listeners, "data") && !rs->flowing && !rs->destroyed) {
+        rs->flowing = true;
+        read_stream_next(rs);
+    }
+    return thisObject;
+}
+
+// `stream.pause()`
+static JSValueRef read_stream_pause(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                    size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ReadStream* rs = (ReadStream*)JSObjectGetPrivate(thisObject);
+    if (rs) rs->flowing = false;
+    return thisObject;
+}
+
+// `stream.resume()`
+static JSValueRef read_stream_resume(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                     size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ReadStream* rs = (ReadStream*)JSObjectGetPrivate(thisObject);
+    if (rs && !rs->closed && !rs->destroyed) {
+        rs->flowing = true;
+        read_stream_next(rs);
+    }
+    return thisObject;
+}
+
+// `stream.destroy()` / `stream.close()`
+static JSValueRef read_stream_destroy(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                      size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ReadStream* rs = (ReadStream*)JSObjectGetPrivate(thisObject);
+    if (!rs || rs->destroyed || rs->closed) return thisObject;
+
+    // An in-flight open or read finishes first and closes from its callback
+    rs->destroyed = true;
+    if (!rs->busy) read_stream_close(rs);
+    return thisObject;
+}
+
+static JSValueRef read_stream_get_bytes_read(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef* exception) {
+    ReadStream* rs = (ReadStream*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, rs ? (double)rs->bytes_read : 0);
+}
+
+static void read_stream_finalize(JSObjectRef object) {
+    free(JSObjectGetPrivate(object));
+}
+
+static const JSStaticFunction read_stream_functions[] = {
+    { "on", read_stream_on, kJSPropertyAttributeDontDelete },
+    { "pause", read_stream_pause, kJSPropertyAttributeDontDelete },
+    { "resume", read_stream_resume, kJSPropertyAttributeDontDelete },
+    { "destroy", read_stream_destroy, kJSPropertyAttributeDontDelete },
+    { "close", read_stream_destroy, kJSPropertyAttributeDontDelete },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue read_stream_values[] = {
+    { "bytesRead", read_stream_get_bytes_read, NULL, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete },
+    { NULL, NULL, NULL, 0 }
+};
+
+// `fs.createReadStream(path[, { highWaterMark, start, end, encoding }])`
+JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef function,
+                                 JSObjectRef thisObject, size_t argc,
+                                 const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1) return fs_stream_throw(ctx, exception, "fs.createReadStream requires a path");
+    JSValueRef options = argc > 1 ? args[1] : NULL;
+
+    double hwm = READ_STREAM_DEFAULT_HWM, start = 0, end = -1;
+    fs_stream_number_option(ctx, options, ATOM(highWaterMark), &hwm);
+    fs_stream_number_option(ctx, options, ATOM(start), &start);
+    fs_stream_number_option(ctx, options, ATOM(end), &end);
+    if (!(hwm >= 1 && hwm <= UINT32_MAX - UTF8_CARRY_MAX) || !(start >= 0) || (end >= 0 && end < start)) {
+        return fs_stream_throw(ctx, exception, "Invalid read stream options");
+    }
+
+    bool binary = false;
+    if (options && JSValueIsObject(ctx, options)) {
+        JSValueRef encoding = JSObjectGetProperty(ctx, (JSObjectRef)options, ATOM(encoding), NULL);
+        binary = JSValueIsNull(ctx, encoding);
+    }
+
+    char* path = fs_stream_path(ctx, args[0], exception);
+    if (!path) return JSValueMakeUndefined(ctx);
+
+    if (!read_stream_class) {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.className = "ReadStream";
+        def.staticFunctions = read_stream_functions;
+        def.staticValues = read_stream_values;
+        def.finalize = read_stream_finalize;
+        read_stream_class = JSClassCreate(&def);
+    }
+
+    ReadStream* rs = calloc(1, sizeof(ReadStream));
+    rs->ctx = ctx;
+    rs->file = -1;
+    rs->high_water_mark = (size_t)hwm;
+    rs->position = (int64_t)start;
+    rs->end = end >= 0 ? (int64_t)end : -1;
+    rs->binary = binary;
+
+    // The default size shares the socket read-buffer pool
+    if (rs->high_water_mark + UTF8_CARRY_MAX <= READ_BUFFER_SIZE) {
+        read_buffer_alloc(NULL, READ_BUFFER_SIZE, &rs->chunk);
+        rs->pooled_chunk = rs->chunk.base != NULL;
+    }
+    if (!rs->chunk.base) rs->chunk = uv_buf_init(malloc(rs->high_water_mark + UTF8_CARRY_MAX),
+                                                 (unsigned int)(rs->high_water_mark + UTF8_CARRY_MAX));
+
+    rs->object = JSObjectMake(ctx, read_stream_class, rs);
+    JSValueProtect(ctx, rs->object);
+
+    rs->busy = true;
+    rs->req.data = rs;
+    int status = uv_fs_open(loop, &rs->req, path, O_RDONLY, 0, on_read_stream_open);
+    free(path);
+    if (status < 0) {
+        rs->busy = false;
+        JSObjectRef object = rs->object;
+        read_stream_close(rs);
+        return object;
+    }
+    return rs->object;
+}
+
+// ========================= WRITE STREAM ========================= //
+
+static void write_stream_flush(WriteStream* ws);
+
+static void on_write_stream_closed(uv_fs_t* req) {
+    WriteStream* ws = (WriteStream*)req->data;
+    uv_fs_req_cleanup(req);
+
+    event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "close", 0, NULL);
+    event_listeners_clear(&ws->listeners, ws->ctx);
+    JSValueUnprotect(ws->ctx, ws->object);
+}
+
+static void write_stream_close(WriteStream* ws) {
+    if (ws->closed) return;
+    ws->closed = true;
+
+    free(ws->pending);
+    free(ws->inflight);
+    ws->pending = ws->inflight = NULL;
+    ws->pending_len = ws->pending_cap = ws->inflight_len = ws->inflight_cap = 0;
+
+    ws->req.data = ws;
+    if (ws->file >= 0) {
+        uv_fs_close(loop, &ws->req, ws->file, on_write_stream_closed);
+        ws->file = -1;
+    } else {
+        ws->req.result = 0;
+        on_write_stream_closed(&ws->req);
+    }
+}
+
+static void write_stream_fail(WriteStream* ws, int status) {
+    JSValueRef args[] = { fs_stream_error_value(ws->ctx, status) };
+    event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "error", 1, args);
+    write_stream_close(ws);
+}
+
+// Everything queued has reached the file
+static void write_stream_idle(WriteStream* ws) {
+    if (ws->need_drain) {
+        ws->need_drain = false;
+        event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "drain", 0, NULL);
+
+        // A drain listener may have written more
+        if (ws->busy || ws->closed) return;
+        if (ws->pending_len) {
+            write_stream_flush(ws);
+            return;
+        }
+    }
+
+    if (ws->ending) {
+        event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "finish", 0, NULL);
+        write_stream_close(ws);
+    }
+}
+
+static void on_write_stream_write(uv_fs_t* req) {
+    PROFILE_SPAN("fs.stream.write");
+    WriteStream* ws = (WriteStream*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    ws->busy = false;
+
+    if (ws->closed) return;
+    if (result < 0) {
+        write_stream_fail(ws, (int)result);
+        return;
+    }
+
+    ws->inflight_off += (size_t)result;
+    ws->bytes_written += (uint64_t)result;
+    if (ws->position >= 0) ws->position += result;
+
+    if (ws->inflight_off < ws->inflight_len) {
+        // Short write: send the rest of the same buffer
+        write_stream_flush(ws);
+    } else if (ws->pending_len) {
+        ws->inflight_len = ws->inflight_off = 0;
+        write_stream_flush(ws);
+    } else {
+        ws->inflight_len = ws->inflight_off = 0;
+        write_stream_idle(ws);
+    }
+}
+
+// Writes the in-flight buffer, first swapping in pending data if it is empty
+static void write_stream_flush(WriteStream* ws) {
+    if (ws->busy || ws->closed || ws->file < 0) return;
+
+    if (ws->inflight_off >= ws->inflight_len) {
+        if (!ws->pending_len) return;
+
+        // Swap buffers so both are reused
+        char* buf = ws->inflight;
+        size_t cap = ws->inflight_cap;
+        ws->inflight = ws->pending;
+        ws->inflight_cap = ws->pending_cap;
+        ws->inflight_len = ws->pending_len;
+        ws->inflight_off = 0;
+        ws->pending = buf;
+        ws->pending_cap = cap;
+        ws->pending_len = 0;
+    }
+
+    uv_buf_t buf = uv_buf_init(ws->inflight + ws->inflight_off, (unsigned int)(ws->inflight_len - ws->inflight_off));
+    int64_t offset = ws->position;
+    ws->busy = true;
+    ws->req.data = ws;
+    int status = uv_fs_write(loop, &ws->req, ws->file, &buf, 1, offset, on_write_stream_write);
+    if (status < 0) {
+        ws->busy = false;
+        write_stream_fail(ws, status);
+    }
+}
+
+static void on_write_stream_open(uv_fs_t* req) {
+    WriteStream* ws = (WriteStream*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    ws->busy = false;
+
+    if (result < 0) {
+        write_stream_fail(ws, (int)result);
+        return;
+    }
+    ws->file = (uv_file)result;
+
+    JSValueRef args[] = { JSValueMakeNumber(ws->ctx, ws->file) };
+    event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "open", 1, args);
+
+    if (ws->closed || ws->busy) return;
+    if (ws->pending_len) write_stream_flush(ws);
+    else write_stream_idle(ws);
+}
+
+// Appends a string or binary chunk to the pending buffer
+static bool write_stream_append(WriteStream* ws, JSContextRef ctx, JSValueRef value, JSValueRef* exception) {
+    const char* bytes;
+    size_t len;
+    JSStringRef str = NULL;
+
+    if (!js_value_get_bytes(ctx, value, &bytes, &len)) {
+        str = JSValueToStringCopy(ctx, value, exception);
+        if (!str) return false;
+        len = JSStringGetMaximumUTF8CStringSize(str);
+    }
+
+    if (ws->pending_len + len > ws->pending_cap) {
+        size_t cap = ws->pending_cap ? ws->pending_cap : ws->high_water_mark;
+        while (cap < ws->pending_len + len) cap *= 2;
+        ws->pending = realloc(ws->pending, cap);
+        ws->pending_cap = cap;
+    }
+
+    if (str) {
+        ws->pending_len += JSStringGetUTF8CString(str, ws->pending + ws->pending_len, len) - 1;
+        JSStringRelease(str);
+    } else {
+        memcpy(ws->pending + ws->pending_len, bytes, len);
+        ws->pending_len += len;
+    }
+    return true;
+}
+
+// `stream.write(chunk)` - returns false once highWaterMark bytes are queued
+static JSValueRef write_stream_write(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                     size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WriteStream* ws = (WriteStream*)JSObjectGetPrivate(thisObject);
+    if (!ws) return JSValueMakeBoolean(ctx, false);
+    if (ws->ending || ws->closed) return fs_stream_throw(ctx, exception, "write after end");
+    if (argc < 1) return fs_stream_throw(ctx, exception, "write() requires a chunk");
+
+    if (!write_stream_append(ws, ctx, args[0], exception)) return JSValueMakeUndefined(ctx);
+    write_stream_flush(ws);
+
+    size_t queued = ws->pending_len + (ws->inflight_len - ws->inflight_off);
+    bool below = queued < ws->high_water_mark;
+    if (!below) ws->need_drain = true;
+    return JSValueMakeBoolean(ctx, below);
+}
+
+// `stream.end([chunk])`
+static JSValueRef write_stream_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                   size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WriteStream* ws = (WriteStream*)JSObjectGetPrivate(thisObject);
+    if (!ws || ws->ending || ws->closed) return thisObject;
+
+    if (argc > 0 && !JSValueIsUndefined(ctx, args[0]) && !JSValueIsNull(ctx, args[0])) {
+        if (!write_stream_append(ws, ctx, args[0], exception)) return JSValueMakeUndefined(ctx);
+    }
+    ws->ending = true;
+    ws->need_drain = false;
+
+    if (ws->file >= 0 && !ws->busy) {
+        if (ws->pending_len) write_stream_flush(ws);
+        else write_stream_idle(ws);
+    }
+    return thisObject;
+}
+
+// `stream.on(event, listener)`
+static JSValueRef write_stream_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                  size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WriteStream* ws = (WriteStream*)JSObjectGetPrivate(thisObject);
+    if (!ws || ws->closed) return thisObject;
+    if (argc < 2) return fs_stream_throw(ctx, exception, "on() requires an event name and a listener function");
+    event_listeners_on(&ws->listeners, ctx, args[0], args[1], exception);
+    return thisObject;
+}
+
+static JSValueRef write_stream_get_bytes_written(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef* exception) {
+    WriteStream* ws = (WriteStream*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, ws ? (double)ws->bytes_written : 0);
+}
+
+static JSValueRef write_stream_get_writable_length(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef* exception) {
+    WriteStream* ws = (WriteStream*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, ws ? (double)(ws->pending_len + ws->inflight_len - ws->inflight_off) : 0);
+}
+
+static void write_stream_finalize(JSObjectRef object) {
+    free(JSObjectGetPrivate(object));
+}
+
+static const JSStaticFunction write_stream_functions[] = {
+    { "write", write_stream_write, kJSPropertyAttributeDontDelete },
+    { "end", write_stream_end, kJSPropertyAttributeDontDelete },
+    { "on", write_stream_on, kJSPropertyAttributeDontDelete },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue write_stream_values[] = {
+    { "bytesWritten", write_stream_get_bytes_written, NULL, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete },
+    { "writableLength", write_stream_get_writable_length, NULL, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete },
+    { NULL, NULL, NULL, 0 }
+};
+
+// `fs.createWriteStream(path[, { highWaterMark, flags }])` - flags "w" (default) or "a"
+JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1) return fs_stream_throw(ctx, exception, "fs.createWriteStream requires a path");
+    JSValueRef options = argc > 1 ? args[1] : NULL;
+
+    double hwm = WRITE_STREAM_DEFAULT_HWM;
+    fs_stream_number_option(ctx, options, ATOM(highWaterMark), &hwm);
+    if (!(hwm >= 1 && hwm <= UINT32_MAX)) return fs_stream_throw(ctx, exception, "Invalid write stream options");
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (options && JSValueIsObject(ctx, options)) {
+        JSValueRef value = JSObjectGetProperty(ctx, (JSObjectRef)options, ATOM(flags), NULL);
+        if (JSValueIsString(ctx, value)) {
+            JSStringRef str = JSValueToStringCopy(ctx, value, NULL);
+            bool append = JSStringIsEqualToUTF8CString(str, "a");
+            bool write = JSStringIsEqualToUTF8CString(str, "w");
+            JSStringRelease(str);
+            if (!append && !write) return fs_stream_throw(ctx, exception, "Unsupported write stream flags");
+            if (append) flags = O_WRONLY | O_CREAT | O_APPEND;
+        }
+    }
+
+    char* path = fs_stream_path(ctx, args[0], exception);
+    if (!path) return JSValueMakeUndefined(ctx);
+
+    if (!write_stream_class) {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.className = "WriteStream";
+        def.staticFunctions = write_stream_functions;
+        def.staticValues = write_stream_values;
+        def.finalize = write_stream_finalize;
+        write_stream_class = JSClassCreate(&def);
+    }
+
+    WriteStream* ws = calloc(1, sizeof(WriteStream));
+    ws->ctx = ctx;
+    ws->file = -1;
+    ws->high_water_mark = (size_t)hwm;
+    ws->position = (flags & O_APPEND) ? -1 : 0;
+
+    ws->object = JSObjectMake(ctx, write_stream_class, ws);
+    JSValueProtect(ctx, ws->object);
+
+    ws->busy = true;
+    ws->req.data = ws;
+    int status = uv_fs_open(loop, &ws->req, path, flags, 0644, on_write_stream_open);
+    free(path);
+    if (status < 0) {
+        ws->busy = false;
+        JSObjectRef object = ws->object;
+        write_stream_close(ws);
+        return object;
+    }
+    return ws->object;
+}
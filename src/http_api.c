@@ -4,652 +4,4283 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "runtime.h"
 
 // ========================= HTTP CLIENT (http.get) ========================= //
 
-typedef struct {
+#define HTTP_REQUEST_INLINE_URL         256
+#define HTTP_AGENT_BUCKETS              64
+#define HTTP_AGENT_DEFAULT_MAX_SOCKETS  256
+#define HTTP_AGENT_DEFAULT_MAX_FREE     256
+#define HTTP_AGENT_DEFAULT_IDLE_MS      4000
+#define HTTP_CONNECT_STAGGER_MS         250     // Happy eyeballs delay between attempts
+
+#define DNS_CACHE_BUCKETS               64
+#define DNS_CACHE_MAX_ENTRIES           512
+#define DNS_CACHE_TTL_MS                30000
+#define DNS_CACHE_NEGATIVE_TTL_MS       5000
+#define DNS_MAX_ADDRESSES               8
+
+typedef struct HttpConnection HttpConnection;
+typedef struct HttpAgentHost HttpAgentHost;
+
+typedef union {
+    struct sockaddr sa;
+    struct sockaddr_in in4;
+    struct sockaddr_in6 in6;
+} DnsAddress;
+
+// Cached lookup result for one host name, shared by every port
+typedef struct DnsEntry {
+    struct DnsEntry* next;      // Bucket chain
+    char* name;
+    uint32_t hash;
+    uint64_t expires;           // uv_now() deadline
+    int status;                 // 0, or the cached resolver error
+    int count;
+    DnsAddress addrs[DNS_MAX_ADDRESSES];  // Families interleaved, port unset
+    bool resolving;
+    HttpConnection* waiters;    // Connections waiting on the lookup in flight
+} DnsEntry;
+
+// One racing connect() for a connection; the winner's handle becomes its socket
+typedef struct HttpConnectAttempt {
     uv_tcp_t socket;
+    uv_connect_t req;
+    HttpConnection* conn;       // NULL once abandoned
+    struct HttpConnectAttempt* next;
+} HttpConnectAttempt;
+
+typedef struct HttpRequest {
     JSContextRef ctx;
-    JSObjectRef callback;
+    Completion done;       // The callback, or the returned promise's resolve/reject
     char* host;
     char* path;
-    char* response_data;
-    size_t response_size;
-    size_t response_len;
-    int status_code;
-    char* response_headers;
-    size_t headers_size;
-    size_t headers_len;
-    bool headers_parsed;
-    char* response_body;
-    size_t body_size;
-    size_t body_len;
+    int port;
     char* request_data;    // Added for POST data
     size_t request_data_len; // Added for POST data length
     const char* method;  // Added for HTTP method
+    struct HttpRequest* next_queued;  // Waiting for a socket to this host
+    bool retried;          // Already resent once after a stale keep-alive socket
+    bool binary_data;      // request_data came from a Buffer/typed array
+    bool buffer_body;      // `{ encoding: null }`: deliver the body as a Buffer
+    bool tls;              // https:// URL
+    bool insecure;         // `{ rejectUnauthorized: false }`: skip certificate checks
+    WebSocket* websocket;  // http.websocket(): upgraded instead of answered
+    char websocket_key[WEBSOCKET_KEY_LENGTH + 1];
+    char url_inline[HTTP_REQUEST_INLINE_URL];  // "host\0path\0" when it fits
 } HttpRequest;
 
-// Forward declarations
-void on_write_complete(uv_write_t* req, int status);
-void on_http_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
-void on_http_connect(uv_connect_t* req, int status);
-void on_dns_resolved(uv_getaddrinfo_t* resolver, int status, struct addrinfo* res);
-JSValueRef res_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
-                   size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception);
+// A socket owned by the agent; serves one request at a time
+struct HttpConnection {
+    uv_tcp_t* socket;           // The winning attempt's handle, NULL while connecting
+    HttpConnectAttempt* attempt;
+    TlsSession* tls;            // https:// hosts, from connect until close
+    HttpAgentHost* host;
+    HttpRequest* active;        // Request in flight, NULL while idle
+    HttpParser parser;          // Response head and decoded body
+    HttpConnection* idle_prev;
+    HttpConnection* idle_next;
+    uint64_t idle_timer;
+    unsigned requests_served;
+    bool received;              // Any byte of the current response has arrived
+    WebSocket* ws;              // Set once upgraded; the socket has left the agent
+
+    // Connecting
+    HttpConnection* dns_next;   // Next waiter on the same lookup
+    HttpConnectAttempt* attempts;
+    uint64_t stagger_timer;
+    DnsAddress addrs[DNS_MAX_ADDRESSES];
+    int addr_count;
+    int next_addr;
+    int last_error;
+
+    bool idle;
+    bool closing;
+};
+
+// Sockets and queued requests for one scheme, host and port
+struct HttpAgentHost {
+    HttpAgentHost* next;        // Bucket chain
+    char* name;
+    int port;
+    bool tls;
+    bool insecure;              // Its TLS sockets skipped certificate checks
+    HttpConnection* idle_head;  // Most recently used first
+    size_t idle_count;
+    size_t sockets;             // Connecting, busy and idle sockets
+    HttpRequest* queue_head;
+    HttpRequest* queue_tail;
+};
+
+typedef struct {
+    bool keep_alive;
+    size_t max_sockets;         // Per host
+    size_t max_free_sockets;    // Idle sockets kept per host
+    uint64_t idle_timeout;      // ms before an idle socket is closed
+    HttpAgentHost* buckets[HTTP_AGENT_BUCKETS];
+} HttpAgent;
+
+static JADE_THREAD_LOCAL HttpAgent http_agent = {
+    .keep_alive = true,
+    .max_sockets = HTTP_AGENT_DEFAULT_MAX_SOCKETS,
+    .max_free_sockets = HTTP_AGENT_DEFAULT_MAX_FREE,
+    .idle_timeout = HTTP_AGENT_DEFAULT_IDLE_MS,
+};
+
+typedef struct {
+    DnsEntry* buckets[DNS_CACHE_BUCKETS];
+    size_t count;
+} DnsCache;
+
+static JADE_THREAD_LOCAL DnsCache dns_cache;
+
+static JADE_THREAD_LOCAL MemPool http_request_pool = MEM_POOL_INIT("http.request", HttpRequest);
+static JADE_THREAD_LOCAL MemPool http_connection_out_pool = MEM_POOL_INIT("http.agent_socket", HttpConnection);
+static JADE_THREAD_LOCAL MemPool http_resolver_pool = MEM_POOL_INIT("uv.getaddrinfo", uv_getaddrinfo_t);
+static JADE_THREAD_LOCAL MemPool http_attempt_pool = MEM_POOL_INIT("http.connect_attempt", HttpConnectAttempt);
+
+// Forward declarations
+void on_http_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+void on_http_connect(uv_connect_t* req, int status);
+void on_dns_resolved(uv_getaddrinfo_t* resolver, int status, struct addrinfo* res);
+void on_client_read(uv_stream_t* client, ssize_t nread, const uv_buf_t* buf);
+JSValueRef res_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                   size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception);
+static JSObjectRef http_make_message_object(JSContextRef ctx, const HttpParser* p, const char* empty_body);
+static void http_agent_dispatch(HttpRequest* http);
+
+static JSValueRef http_throw(JSContextRef ctx, JSValueRef* exception, const char* message);
+
+// Splits `host[:port]` or `[v6addr][:port]`; returns false for a bad port
+static bool http_split_authority(const char* start, size_t len, int default_port,
+                                 const char** host, size_t* host_len, int* port) {
+    const char* end = start + len;
+    const char* port_start = NULL;
+    *port = default_port;
+
+    if (len > 0 && *start == '[') {
+        const char* close = memchr(start, ']', len);
+        if (!close) return false;
+        *host = start + 1;
+        *host_len = close - start - 1;
+        if (close + 1 < end) {
+            if (close[1] != ':') return false;
+            port_start = close + 2;
+        }
+    } else {
+        const char* colon = memchr(start, ':', len);
+        *host = start;
+        *host_len = colon ? (size_t)(colon - start) : len;
+        if (colon) port_start = colon + 1;
+    }
+
+    if (port_start) {
+        if (port_start == end) return false;
+        int value = 0;
+        for (const char* p = port_start; p < end; p++) {
+            if (*p < '0' || *p > '9') return false;
+            value = value * 10 + (*p - '0');
+            if (value > 65535) return false;
+        }
+        if (value == 0) return false;
+        *port = value;
+    }
+    return *host_len > 0;
+}
+
+// Parses `http[s]://host[:port][/path]` (or `ws[s]://` for WebSockets) into a
+// pooled request; NULL if the URL is not usable
+static HttpRequest* http_request_new(JSContextRef ctx, JSValueRef urlValue, const char* method,
+                                     bool websocket, JSValueRef* exception) {
+    JSStringRef urlRef = JSValueToStringCopy(ctx, urlValue, exception);
+    if (!urlRef) return NULL;
+
+    char stackUrl[HTTP_REQUEST_INLINE_URL];
+    size_t urlMax = JSStringGetMaximumUTF8CStringSize(urlRef);
+    char* url = urlMax <= sizeof(stackUrl) ? stackUrl : malloc(urlMax);
+    JSStringGetUTF8CString(urlRef, url, urlMax);
+    JSStringRelease(urlRef);
+
+    // Ensure HTTP(S) scheme; WebSockets take ws:// and wss:// as well
+    bool tls = strncmp(url, "https://", 8) == 0 || (websocket && strncmp(url, "wss://", 6) == 0);
+    if (!tls && strncmp(url, "http://", 7) != 0 && !(websocket && strncmp(url, "ws://", 5) == 0)) {
+        if (url != stackUrl) free(url);
+        return NULL;
+    }
+
+    // Parse host, port and path
+    const char* authority = strstr(url, "://") + 3;
+    const char* path_start = strchr(authority, '/');
+    size_t authority_len = path_start ? (size_t)(path_start - authority) : strlen(authority);
+    const char* path = path_start ? path_start : "/";
+    size_t path_len = strlen(path);
+
+    const char* host;
+    size_t host_len;
+    int port;
+    if (!http_split_authority(authority, authority_len, tls ? 443 : 80, &host, &host_len, &port)) {
+        if (url != stackUrl) free(url);
+        http_throw(ctx, exception, "Invalid host or port in URL");
+        return NULL;
+    }
+
+    HttpRequest* http = pool_calloc(&http_request_pool);
+    char* storage = http->url_inline;
+    if (host_len + path_len + 2 > sizeof(http->url_inline)) storage = malloc(host_len + path_len + 2);
+    memcpy(storage, host, host_len);
+    storage[host_len] = '\0';
+    memcpy(storage + host_len + 1, path, path_len + 1);
+    if (url != stackUrl) free(url);
+
+    http->host = storage;
+    http->path = storage + host_len + 1;
+    http->port = port;
+    http->tls = tls;
+    http->ctx = ctx;
+    http->method = method;
+    return http;
+}
+
+static void http_request_free(HttpRequest* http) {
+    if (http->host != http->url_inline) free(http->host);
+    free(http->request_data);
+    completion_release(&http->done, http->ctx);
+    pool_free(&http_request_pool, http);
+}
+
+// Hands the request to the agent, settling through `callback` or, when there
+// is none, a promise returned to the caller
+static JSValueRef http_request_send(HttpRequest* http, JSValueRef callback, JSValueRef* exception) {
+    JSContextRef ctx = http->ctx;
+    JSValueRef result = completion_init(&http->done, ctx, callback, exception);
+    if (!result) {
+        http_request_free(http);
+        return JSValueMakeUndefined(ctx);
+    }
+    http_agent_dispatch(http);
+    return result;
+}
+
+// Reports a failed request as `callback(err, null)` (or a rejection) and frees it
+static void http_request_fail_message(HttpRequest* http, const char* message) {
+    if (http->websocket) websocket_detach(http->websocket, message);
+    else completion_settle_error(&http->done, http->ctx, message);
+    http_request_free(http);
+}
+
+static void http_request_fail(HttpRequest* http, int status) {
+    http_request_fail_message(http, uv_strerror(status));
+}
+
+// Builds `{ statusCode, headers, body }` from a completed response; a Buffer
+// body takes over the parser's body buffer instead of copying it, and a string
+// body is made from the raw bytes only if it is read (json() parses them directly)
+static JSObjectRef http_response_object(JSContextRef ctx, HttpParser* parser, bool buffer_body) {
+    // Create response object; headers and body are read from the raw block on access.
+    // An empty string body reads as "{}", as before
+    JSObjectRef responseObj = http_make_message_object(ctx, parser, buffer_body ? NULL : "{}");
+
+    // Add status code
+    JSObjectSetProperty(ctx, responseObj, ATOM(statusCode),
+                       JSValueMakeNumber(ctx, parser->status_code),
+                       kJSPropertyAttributeNone, NULL);
+
+    if (buffer_body) {
+        JSObjectRef body = js_buffer_from_malloc(ctx, parser->body, parser->body_len);
+        parser->body = NULL;
+        parser->body_len = 0;
+        parser->body_cap = 0;
+        JSObjectSetProperty(ctx, responseObj, ATOM(body), body, kJSPropertyAttributeNone, NULL);
+    }
+    return responseObj;
+}
+
+// Undoes the Content-Encoding the request offered; other codings are left as sent
+static const char* http_response_decode(HttpParser* parser) {
+    size_t len;
+    const char* value = http_parser_find_header(parser, "content-encoding", &len);
+    ContentEncoding encoding = value ? content_encoding_parse(value, len) : CONTENT_ENCODING_IDENTITY;
+    if (encoding == CONTENT_ENCODING_IDENTITY || parser->body_len == 0) return NULL;
+
+    CompressBuffer out;
+    const char* error = decompress_buffer(encoding, parser->body, parser->body_len, HTTP_MAX_BODY_SIZE, &out);
+    if (error) return error;
+
+    free(parser->body);
+    parser->body = out.data;
+    parser->body_len = out.len;
+    parser->body_cap = out.cap;
+    return NULL;
+}
+
+// Calls `callback(null, response)` (or resolves with it) and frees the request
+static void http_request_deliver(HttpRequest* req, JSObjectRef response) {
+    completion_settle(&req->done, req->ctx, NULL, response);
+    http_request_free(req);
+}
+
+// ------------------------- Agent ------------------------- //
+
+static HttpAgentHost* http_agent_host(const HttpRequest* http) {
+    const char* name = http->host;
+    int port = http->port;
+    bool insecure = http->tls && http->insecure;
+    uint32_t hash = 2166136261u;
+    for (const char* p = name; *p; p++) hash = (hash ^ (uint8_t)tolower((unsigned char)*p)) * 16777619u;
+    hash = (hash ^ (uint32_t)port) * 16777619u;
+
+    HttpAgentHost** bucket = &http_agent.buckets[hash % HTTP_AGENT_BUCKETS];
+    for (HttpAgentHost* host = *bucket; host; host = host->next) {
+        if (host->port == port && host->tls == http->tls && host->insecure == insecure &&
+            strcasecmp(host->name, name) == 0) {
+            return host;
+        }
+    }
+
+    HttpAgentHost* host = calloc(1, sizeof(HttpAgentHost));
+    host->name = strdup(name);
+    host->port = port;
+    host->tls = http->tls;
+    host->insecure = insecure;
+    host->next = *bucket;
+    *bucket = host;
+    return host;
+}
+
+static void http_agent_idle_remove(HttpConnection* conn) {
+    HttpAgentHost* host = conn->host;
+    if (conn->idle_prev) conn->idle_prev->idle_next = conn->idle_next;
+    else host->idle_head = conn->idle_next;
+    if (conn->idle_next) conn->idle_next->idle_prev = conn->idle_prev;
+    conn->idle_prev = conn->idle_next = NULL;
+    conn->idle = false;
+    host->idle_count--;
+
+    timer_stop(conn->idle_timer);
+    conn->idle_timer = 0;
+    uv_ref((uv_handle_t*)conn->socket);
+}
+
+static void http_connection_free(HttpConnection* conn) {
+    http_parser_free(&conn->parser);
+    pool_free(&http_connection_out_pool, conn);
+}
+
+static void on_http_connection_closed(uv_handle_t* handle) {
+    HttpConnection* conn = (HttpConnection*)handle->data;
+    tls_session_free(conn->tls);
+    if (conn->ws) websocket_detach(conn->ws, NULL);
+    pool_free(&http_attempt_pool, conn->attempt);
+    http_connection_free(conn);
+}
+
+static void http_connection_open(HttpAgentHost* host, HttpRequest* http);
+
+// Opens sockets for queued requests while the host is under its limit
+static void http_agent_host_drain(HttpAgentHost* host) {
+    while (host->queue_head && host->sockets < http_agent.max_sockets) {
+        HttpRequest* http = host->queue_head;
+        host->queue_head = http->next_queued;
+        if (!host->queue_head) host->queue_tail = NULL;
+        http->next_queued = NULL;
+        http_connection_open(host, http);
+    }
+}
+
+static void http_connection_close(HttpConnection* conn) {
+    if (conn->closing) return;
+    conn->closing = true;
+
+    // Only connected sockets own a handle; connections fail only once every attempt has ended
+    if (conn->tls) tls_session_shutdown(conn->tls);
+    if (conn->ws) {
+        uv_close((uv_handle_t*)conn->socket, on_http_connection_closed);
+        return;
+    }
+
+    if (conn->idle) http_agent_idle_remove(conn);
+    HttpAgentHost* host = conn->host;
+    host->sockets--;
+    if (conn->socket) uv_close((uv_handle_t*)conn->socket, on_http_connection_closed);
+    else http_connection_free(conn);
+    http_agent_host_drain(host);
+}
+
+static void on_http_idle_timeout(void* data) {
+    HttpConnection* conn = (HttpConnection*)data;
+    conn->idle_timer = 0;
+    http_connection_close(conn);
+}
+
+// Sends `http` on an open connection
+static void http_connection_start(HttpConnection* conn, HttpRequest* http) {
+    conn->active = http;
+    conn->received = false;
+    http_parser_reset(&conn->parser);
+
+    // The request head is formatted into the batch; the body is sent by reference
+    WriteBatch* batch = write_batch_new(http->ctx);
+    size_t cap = strlen(http->path) + strlen(http->host) + 256;
+    char* request = write_batch_alloc(batch, cap);
+    const char* connection = http_agent.keep_alive ? "keep-alive" : "close";
+    bool v6 = strchr(http->host, ':') != NULL;
+
+    char host_header[HTTP_REQUEST_INLINE_URL + 16];
+    if (http->port == (http->tls ? 443 : 80)) {
+        snprintf(host_header, sizeof(host_header), v6 ? "[%s]" : "%s", http->host);
+    } else {
+        snprintf(host_header, sizeof(host_header), v6 ? "[%s]:%d" : "%s:%d", http->host, http->port);
+    }
+
+    int len;
+    if (http->websocket) {
+        len = snprintf(request, cap,
+            "GET %s HTTP/1.1\r\n"
+            "Host: %s\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: %s\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n",
+            http->path, host_header, http->websocket_key);
+    } else if (http->request_data) {
+        const char* content_type = http->binary_data ? "application/octet-stream"
+            : json_is_document(http->request_data, http->request_data_len) ? "application/json"
+            : "application/x-www-form-urlencoded";
+
+        len = snprintf(request, cap,
+            "%s %s HTTP/1.1\r\n"
+            "Host: %s\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n"
+            "Accept-Encoding: %s\r\n"
+            "Connection: %s\r\n\r\n",
+            http->method ? http->method : "POST", http->path, host_header,
+            content_type, http->request_data_len, content_encoding_accept(), connection);
+    } else {
+        len = snprintf(request, cap,
+            "%s %s HTTP/1.1\r\n"
+            "Host: %s\r\n"
+            "Accept-Encoding: %s\r\n"
+            "Connection: %s\r\n\r\n",
+            http->method ? http->method : "GET", http->path, host_header,
+            content_encoding_accept(), connection);
+    }
+
+    write_batch_add(batch, request, (size_t)len);
+
+    // The request may finish (and be freed) before a queued write drains, so the batch owns the body
+    if (http->request_data_len) {
+        char* body = write_batch_alloc(batch, http->request_data_len);
+        memcpy(body, http->request_data, http->request_data_len);
+        write_batch_add(batch, body, http->request_data_len);
+    }
+    runtime_counters.http_client.bytes_written += batch->total;
+    if (conn->tls) tls_session_write(conn->tls, batch, NULL);
+    else write_batch_send(batch, (uv_stream_t*)conn->socket, NULL);
+}
+
+// Returns a finished connection to its host: next queued request, idle list, or close
+static void http_connection_release(HttpConnection* conn, bool reusable) {
+    HttpAgentHost* host = conn->host;
+    conn->active = NULL;
+    conn->requests_served++;
+
+    if (!reusable || !http_agent.keep_alive) {
+        http_connection_close(conn);
+        return;
+    }
+
+    if (host->queue_head) {
+        HttpRequest* next = host->queue_head;
+        host->queue_head = next->next_queued;
+        if (!host->queue_head) host->queue_tail = NULL;
+        next->next_queued = NULL;
+        http_connection_start(conn, next);
+        return;
+    }
+
+    if (host->idle_count >= http_agent.max_free_sockets) {
+        http_connection_close(conn);
+        return;
+    }
+
+    // Idle sockets keep reading (to notice server-side closes) but do not hold the loop open
+    conn->idle = true;
+    conn->idle_prev = NULL;
+    conn->idle_next = host->idle_head;
+    if (host->idle_head) host->idle_head->idle_prev = conn;
+    host->idle_head = conn;
+    host->idle_count++;
+
+    uv_unref((uv_handle_t*)conn->socket);
+    conn->idle_timer = timer_start(http_agent.idle_timeout, 0, on_http_idle_timeout, conn);
+    timer_unref(conn->idle_timer);
+}
+
+// A reused socket that dies before any response byte was probably closed by the server while idle
+static bool http_connection_should_retry(HttpConnection* conn, HttpRequest* http) {
+    if (http->retried || conn->requests_served == 0 || conn->received) return false;
+    return !http->method || (strcmp(http->method, "POST") != 0 && strcmp(http->method, "PATCH") != 0);
+}
+
+static void http_connection_fail(HttpConnection* conn, int status, const char* message) {
+    HttpRequest* http = conn->active;
+    conn->active = NULL;
+
+    if (http && http_connection_should_retry(conn, http)) {
+        http->retried = true;
+        http_connection_close(conn);
+        http_agent_dispatch(http);
+        return;
+    }
+
+    http_connection_close(conn);
+    if (!http) return;
+    if (message) http_request_fail_message(http, message);
+    else http_request_fail(http, status);
+}
+
+static void http_connection_close_websocket(void* owner) {
+    http_connection_close((HttpConnection*)owner);
+}
+
+// Checks the 101 answer to http.websocket() and hands the socket to the
+// WebSocket; `rest` is what arrived after the response head
+static void http_connection_upgrade(HttpConnection* conn, const char* rest, size_t rest_len) {
+    HttpParser* parser = &conn->parser;
+    HttpRequest* http = conn->active;
+
+    size_t upgrade_len = 0, accept_len = 0;
+    const char* upgrade = http_parser_find_header(parser, "upgrade", &upgrade_len);
+    const char* accept = http_parser_find_header(parser, "sec-websocket-accept", &accept_len);
+    char expected[WEBSOCKET_ACCEPT_LENGTH + 1];
+    websocket_accept_key(http->websocket_key, WEBSOCKET_KEY_LENGTH, expected);
+
+    if (parser->status_code != 101 || !parser->upgrade || !upgrade ||
+        upgrade_len != 9 || strncasecmp(upgrade, "websocket", 9) != 0) {
+        char message[96];
+        snprintf(message, sizeof(message), "Server answered the WebSocket upgrade with status %d",
+                 parser->status_code);
+        http_connection_fail(conn, 0, message);
+        return;
+    }
+    if (!accept || accept_len != WEBSOCKET_ACCEPT_LENGTH || memcmp(accept, expected, accept_len) != 0) {
+        http_connection_fail(conn, 0, "Invalid Sec-WebSocket-Accept in the upgrade response");
+        return;
+    }
+
+    // The socket leaves the agent, so it no longer counts against maxSockets
+    WebSocket* ws = http->websocket;
+    HttpAgentHost* host = conn->host;
+    conn->active = NULL;
+    conn->ws = ws;
+    host->sockets--;
+    http->websocket = NULL;
+    http_request_free(http);
+
+    websocket_attach(ws, (uv_stream_t*)conn->socket, conn->tls, http_connection_close_websocket, conn);
+    if (rest_len && !conn->closing) websocket_receive(ws, rest, rest_len);
+    http_agent_host_drain(host);
+}
+
+// Feeds response bytes (plaintext on TLS sockets) to the parser; `nread` < 0 is EOF or an error
+static void http_connection_receive(HttpConnection* conn, const char* data, ssize_t nread) {
+    HttpParser* parser = &conn->parser;
+    size_t off = 0;
+    bool leftover = false;
+
+    if (!conn->active) {
+        // Idle: the server closed the socket or sent something unsolicited
+        if (nread != 0) http_connection_close(conn);
+        return;
+    }
+
+    if (nread > 0) {
+        // The parser keeps its own growable copy, so the read buffer goes straight back
+        conn->received = true;
+        runtime_counters.http_client.bytes_read += (uint64_t)nread;
+        while (off < (size_t)nread) {
+            off += http_parser_execute(parser, data + off, nread - off);
+            if (parser->state != HTTP_PARSE_COMPLETE) break;
+
+            // Interim 1xx responses precede the real one
+            if (parser->status_code >= 200 || parser->status_code == 101) break;
+            http_parser_reset(parser);
+        }
+        leftover = off < (size_t)nread;
+    } else if (nread < 0) {
+        http_parser_finish(parser);
+    }
+
+    if (parser->state == HTTP_PARSE_COMPLETE && conn->active->websocket) {
+        http_connection_upgrade(conn, data + off, nread > 0 ? (size_t)nread - off : 0);
+    } else if (parser->state == HTTP_PARSE_COMPLETE) {
+        HttpRequest* http = conn->active;
+        // Bytes past the response, an upgrade or a close-delimited body rule out reuse
+        bool reusable = nread > 0 && !leftover && parser->keep_alive && !parser->upgrade;
+
+        const char* error = http_response_decode(parser);
+        if (error) {
+            http_connection_fail(conn, 0, error);
+            return;
+        }
+
+        // Build the response before the parser is handed to the next queued request,
+        // and free the socket before the callback so it can be reused from there
+        JSObjectRef response = http_response_object(http->ctx, parser, http->buffer_body);
+        JSValueProtect(http->ctx, response);
+        http_connection_release(conn, reusable);
+        http_request_deliver(http, response);
+        JSValueUnprotect(http->ctx, response);
+    } else if (parser->state == HTTP_PARSE_ERROR) {
+        http_connection_fail(conn, 0, "Invalid HTTP response");
+    } else if (nread == UV_EOF) {
+        http_connection_fail(conn, 0, "Connection closed before the response completed");
+    } else if (nread < 0) {
+        http_connection_fail(conn, (int)nread, NULL);
+    }
+}
+
+static bool on_http_tls_data(void* owner, const char* data, size_t len) {
+    HttpConnection* conn = (HttpConnection*)owner;
+    if (conn->ws) websocket_receive(conn->ws, data, len);
+    else http_connection_receive(conn, data, (ssize_t)len);
+    return !conn->closing;
+}
+
+// Read Callback
+void on_http_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+    PROFILE_SPAN("http.client.read");
+    HttpConnection* conn = (HttpConnection*)stream->data;
+
+    // Upgraded: frames go to the WebSocket, and EOF or an error ends it
+    if (conn->ws) {
+        if (nread > 0 && conn->tls) {
+            if (tls_session_feed(conn->tls, buf->base, (size_t)nread) < 0) http_connection_close(conn);
+        } else if (nread > 0) {
+            websocket_receive(conn->ws, buf->base, (size_t)nread);
+        } else if (nread < 0) {
+            http_connection_close(conn);
+        }
+        read_buffer_release(buf);
+        return;
+    }
+
+    if (conn->tls && nread > 0) {
+        int result = tls_session_feed(conn->tls, buf->base, (size_t)nread);
+        read_buffer_release(buf);
+        if (result == UV_EOF) {
+            if (!conn->closing) http_connection_receive(conn, NULL, UV_EOF);
+        } else if (result < 0 && !conn->closing) {
+            if (conn->active) http_connection_fail(conn, 0, tls_session_error(conn->tls));
+            else http_connection_close(conn);
+        }
+        return;
+    }
+    if (conn->tls && nread < 0 && conn->active && !tls_session_established(conn->tls)) {
+        read_buffer_release(buf);
+        if (nread == UV_EOF) http_connection_fail(conn, 0, "Connection closed during the TLS handshake");
+        else http_connection_fail(conn, (int)nread, NULL);
+        return;
+    }
+
+    http_connection_receive(conn, buf->base, nread);
+    read_buffer_release(buf);
+}
+
+// ------------------------- DNS cache ------------------------- //
+
+static void http_connection_connect(HttpConnection* conn, const DnsEntry* entry);
+
+static void on_dns_negative(void* data) {
+    HttpConnection* conn = (HttpConnection*)data;
+    conn->stagger_timer = 0;
+    http_connection_fail(conn, conn->last_error, NULL);
+}
+
+// Fails `conn` on the next loop turn, so cached errors do not re-enter the caller
+static void http_connection_fail_later(HttpConnection* conn, int status) {
+    conn->last_error = status;
+    conn->stagger_timer = timer_start(0, 0, on_dns_negative, conn);
+}
+
+static DnsEntry* dns_cache_find(const char* name, uint32_t hash) {
+    for (DnsEntry* entry = dns_cache.buckets[hash % DNS_CACHE_BUCKETS]; entry; entry = entry->next) {
+        if (entry->hash == hash && strcasecmp(entry->name, name) == 0) return entry;
+    }
+    return NULL;
+}
+
+static void dns_cache_unlink(DnsEntry* entry) {
+    DnsEntry** link = &dns_cache.buckets[entry->hash % DNS_CACHE_BUCKETS];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    dns_cache.count--;
+    free(entry->name);
+    free(entry);
+}
+
+// Makes room for one entry: drop expired entries, then the one closest to expiry
+static void dns_cache_evict(uint64_t now) {
+    DnsEntry* victim = NULL;
+    for (int b = 0; b < DNS_CACHE_BUCKETS; b++) {
+        DnsEntry* entry = dns_cache.buckets[b];
+        while (entry) {
+            DnsEntry* next = entry->next;
+            if (!entry->resolving) {
+                if (entry->expires <= now) dns_cache_unlink(entry);
+                else if (!victim || entry->expires < victim->expires) victim = entry;
+            }
+            entry = next;
+        }
+    }
+    if (dns_cache.count >= DNS_CACHE_MAX_ENTRIES && victim) dns_cache_unlink(victim);
+}
+
+// Orders addresses the way RFC 8305 suggests: alternate families, starting with the first answer's
+static void dns_entry_fill(DnsEntry* entry, const struct addrinfo* res) {
+    DnsAddress v4[DNS_MAX_ADDRESSES], v6[DNS_MAX_ADDRESSES];
+    int n4 = 0, n6 = 0, first = AF_UNSPEC;
+
+    for (const struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET && n4 < DNS_MAX_ADDRESSES) {
+            memcpy(&v4[n4++].in4, ai->ai_addr, sizeof(struct sockaddr_in));
+        } else if (ai->ai_family == AF_INET6 && n6 < DNS_MAX_ADDRESSES) {
+            memcpy(&v6[n6++].in6, ai->ai_addr, sizeof(struct sockaddr_in6));
+        } else {
+            continue;
+        }
+        if (first == AF_UNSPEC) first = ai->ai_family;
+    }
+
+    DnsAddress* lead = first == AF_INET6 ? v6 : v4;
+    DnsAddress* other = first == AF_INET6 ? v4 : v6;
+    int nlead = first == AF_INET6 ? n6 : n4;
+    int nother = first == AF_INET6 ? n4 : n6;
+
+    entry->count = 0;
+    for (int i = 0; entry->count < DNS_MAX_ADDRESSES && (i < nlead || i < nother); i++) {
+        if (i < nlead) entry->addrs[entry->count++] = lead[i];
+        if (i < nother && entry->count < DNS_MAX_ADDRESSES) entry->addrs[entry->count++] = other[i];
+    }
+}
+
+// DNS Resolution Callback
+void on_dns_resolved(uv_getaddrinfo_t* resolver, int status, struct addrinfo* res) {
+    PROFILE_SPAN("http.client.dns");
+    DnsEntry* entry = (DnsEntry*)resolver->data;
+    pool_free(&http_resolver_pool, resolver);
+    runtime_counters.dns_lookups--;
+
+    entry->resolving = false;
+    entry->status = status;
+    if (status == 0) {
+        dns_entry_fill(entry, res);
+        if (entry->count == 0) entry->status = UV_EAI_NODATA;
+        uv_freeaddrinfo(res);
+    }
+    // getaddrinfo does not report record TTLs, so a fixed one bounds staleness
+    entry->expires = uv_now(loop) + (entry->status == 0 ? DNS_CACHE_TTL_MS : DNS_CACHE_NEGATIVE_TTL_MS);
+
+    // Everyone who asked while the lookup was running shares its answer
+    HttpConnection* conn = entry->waiters;
+    entry->waiters = NULL;
+    while (conn) {
+        HttpConnection* next = conn->dns_next;
+        conn->dns_next = NULL;
+        if (entry->status == 0) http_connection_connect(conn, entry);
+        else http_connection_fail(conn, entry->status, NULL);
+        conn = next;
+    }
+}
+
+// Resolves `conn->host`, answering from the cache or joining a lookup already in flight
+static void dns_lookup(HttpConnection* conn) {
+    const char* name = conn->host->name;
+
+    // Literal addresses never touch the resolver
+    DnsEntry literal = { .count = 1 };
+    if (uv_inet_pton(AF_INET, name, &literal.addrs[0].in4.sin_addr) == 0) {
+        literal.addrs[0].in4.sin_family = AF_INET;
+        http_connection_connect(conn, &literal);
+        return;
+    }
+    if (uv_inet_pton(AF_INET6, name, &literal.addrs[0].in6.sin6_addr) == 0) {
+        literal.addrs[0].in6.sin6_family = AF_INET6;
+        http_connection_connect(conn, &literal);
+        return;
+    }
+
+    uint32_t hash = 2166136261u;
+    for (const char* p = name; *p; p++) hash = (hash ^ (uint8_t)tolower((unsigned char)*p)) * 16777619u;
+
+    uint64_t now = uv_now(loop);
+    DnsEntry* entry = dns_cache_find(name, hash);
+    if (entry && !entry->resolving && entry->expires > now) {
+        runtime_counters.dns_cache_hits++;
+        if (entry->status == 0) http_connection_connect(conn, entry);
+        else http_connection_fail_later(conn, entry->status);
+        return;
+    }
+
+    if (!entry) {
+        if (dns_cache.count >= DNS_CACHE_MAX_ENTRIES) dns_cache_evict(now);
+        entry = calloc(1, sizeof(DnsEntry));
+        entry->name = strdup(name);
+        entry->hash = hash;
+        entry->next = dns_cache.buckets[hash % DNS_CACHE_BUCKETS];
+        dns_cache.buckets[hash % DNS_CACHE_BUCKETS] = entry;
+        dns_cache.count++;
+    }
+
+    conn->dns_next = entry->waiters;
+    entry->waiters = conn;
+    if (entry->resolving) return;
+
+    // AF_UNSPEC so AAAA answers are used; unreachable families just lose the connect race
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    uv_getaddrinfo_t* resolver = pool_alloc(&http_resolver_pool);
+    resolver->data = entry;
+    entry->resolving = true;
+    runtime_counters.dns_lookups++;
+
+    int result = uv_getaddrinfo(loop, resolver, on_dns_resolved, name, NULL, &hints);
+    if (result < 0) {
+        runtime_counters.dns_lookups--;
+        pool_free(&http_resolver_pool, resolver);
+        entry->resolving = false;
+        entry->waiters = NULL;
+        entry->expires = 0;
+        conn->dns_next = NULL;
+        http_connection_fail(conn, result, NULL);
+    }
+}
+
+// ------------------------- Happy eyeballs ------------------------- //
+
+static void on_http_attempt_closed(uv_handle_t* handle) {
+    pool_free(&http_attempt_pool, handle->data);
+}
+
+static void http_attempt_abandon(HttpConnectAttempt* attempt) {
+    attempt->conn = NULL;
+    attempt->socket.data = attempt;
+    uv_close((uv_handle_t*)&attempt->socket, on_http_attempt_closed);
+}
+
+static void http_attempt_next(HttpConnection* conn);
+
+static void on_http_stagger(void* data) {
+    HttpConnection* conn = (HttpConnection*)data;
+    conn->stagger_timer = 0;
+    http_attempt_next(conn);
+}
+
+void on_http_connect(uv_connect_t* req, int status) {
+    PROFILE_SPAN("http.client.connect");
+    HttpConnectAttempt* attempt = (HttpConnectAttempt*)req->data;
+    HttpConnection* conn = attempt->conn;
+    if (!conn) return;  // Lost the race; already closing
+
+    // Unlink from the connection's attempt list
+    HttpConnectAttempt** link = &conn->attempts;
+    while (*link != attempt) link = &(*link)->next;
+    *link = attempt->next;
+
+    if (status < 0) {
+        conn->last_error = status;
+        http_attempt_abandon(attempt);
+
+        // A refused address moves on to the next one right away
+        if (conn->next_addr < conn->addr_count) {
+            timer_stop(conn->stagger_timer);
+            conn->stagger_timer = 0;
+            http_attempt_next(conn);
+        } else if (!conn->attempts) {
+            timer_stop(conn->stagger_timer);
+            conn->stagger_timer = 0;
+            http_connection_fail(conn, status, NULL);
+        }
+        return;
+    }
+
+    // Winner: keep its socket, drop every other attempt
+    timer_stop(conn->stagger_timer);
+    conn->stagger_timer = 0;
+    while (conn->attempts) {
+        HttpConnectAttempt* loser = conn->attempts;
+        conn->attempts = loser->next;
+        http_attempt_abandon(loser);
+    }
+
+    attempt->socket.data = conn;
+    conn->socket = &attempt->socket;
+    conn->attempt = attempt;
+
+    // The request is held by the session until the handshake completes
+    if (conn->host->tls) {
+        conn->tls = tls_session_client((uv_stream_t*)conn->socket, conn->host->name, conn->host->port,
+                                       !conn->host->insecure, on_http_tls_data, conn);
+        if (!conn->tls) {
+            http_connection_fail(conn, 0, "Could not start a TLS session");
+            return;
+        }
+    }
+    uv_read_start((uv_stream_t*)conn->socket, read_buffer_alloc, on_http_read);
+    http_connection_start(conn, conn->active);
+}
+
+// Starts connecting to the next address; later ones follow every HTTP_CONNECT_STAGGER_MS
+static void http_attempt_next(HttpConnection* conn) {
+    while (conn->next_addr < conn->addr_count) {
+        DnsAddress* addr = &conn->addrs[conn->next_addr++];
+        HttpConnectAttempt* attempt = pool_calloc(&http_attempt_pool);
+        uv_tcp_init(loop, &attempt->socket);
+        attempt->conn = conn;
+        attempt->req.data = attempt;
+
+        int result = uv_tcp_connect(&attempt->req, &attempt->socket, &addr->sa, on_http_connect);
+        if (result < 0) {
+            conn->last_error = result;
+            http_attempt_abandon(attempt);
+            continue;
+        }
+
+        attempt->next = conn->attempts;
+        conn->attempts = attempt;
+        if (conn->next_addr < conn->addr_count) {
+            conn->stagger_timer = timer_start(HTTP_CONNECT_STAGGER_MS, 0, on_http_stagger, conn);
+        }
+        return;
+    }
+
+    // Nothing could even be started
+    if (!conn->attempts) http_connection_fail(conn, conn->last_error, NULL);
+}
+
+static void http_connection_connect(HttpConnection* conn, const DnsEntry* entry) {
+    uint16_t port = htons((uint16_t)conn->host->port);
+    conn->addr_count = entry->count;
+    conn->next_addr = 0;
+    for (int i = 0; i < entry->count; i++) {
+        conn->addrs[i] = entry->addrs[i];
+        if (conn->addrs[i].sa.sa_family == AF_INET6) conn->addrs[i].in6.sin6_port = port;
+        else conn->addrs[i].in4.sin_port = port;
+    }
+    http_attempt_next(conn);
+}
+
+// Starts a new socket to `host` for `http`
+static void http_connection_open(HttpAgentHost* host, HttpRequest* http) {
+    HttpConnection* conn = pool_calloc(&http_connection_out_pool);
+    conn->host = host;
+    conn->active = http;
+    http_parser_init(&conn->parser, HTTP_PARSER_RESPONSE);
+    host->sockets++;
+    dns_lookup(conn);
+}
+
+// Runs `http` on an idle socket, a new socket, or queues it behind the host's limit
+static void http_agent_dispatch(HttpRequest* http) {
+    HttpAgentHost* host = http_agent_host(http);
+
+    if (host->idle_head) {
+        HttpConnection* conn = host->idle_head;
+        http_agent_idle_remove(conn);
+        http_connection_start(conn, http);
+    } else if (host->sockets < http_agent.max_sockets) {
+        http_connection_open(host, http);
+    } else {
+        if (host->queue_tail) host->queue_tail->next_queued = http;
+        else host->queue_head = http;
+        host->queue_tail = http;
+    }
+}
+
+// `http.setAgentOptions({ keepAlive, maxSockets, maxFreeSockets, idleTimeout })`
+JSValueRef http_set_agent_options(JSContextRef ctx, JSObjectRef function,
+                                  JSObjectRef thisObject, size_t argc,
+                                  const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1 || !JSValueIsObject(ctx, args[0])) {
+        return http_throw(ctx, exception, "http.setAgentOptions requires an options object");
+    }
+    JSObjectRef options = (JSObjectRef)args[0];
+
+    JSStringRef names[] = { ATOM(keepAlive), ATOM(maxSockets), ATOM(maxFreeSockets), ATOM(idleTimeout) };
+    for (int i = 0; i < 4; i++) {
+        JSValueRef value = JSObjectGetProperty(ctx, options, names[i], exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
+        if (JSValueIsUndefined(ctx, value)) continue;
+
+        if (i == 0) {
+            http_agent.keep_alive = JSValueToBoolean(ctx, value);
+            continue;
+        }
+
+        double n = JSValueToNumber(ctx, value, exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
+        if (!(n >= (i == 2 ? 0 : 1))) return http_throw(ctx, exception, "Invalid agent option value");
+
+        size_t count = n > 1e9 ? (size_t)1e9 : (size_t)n;
+        if (i == 1) http_agent.max_sockets = count;
+        else if (i == 2) http_agent.max_free_sockets = count;
+        else http_agent.idle_timeout = count;
+    }
+
+    // A higher limit may let queued requests start now
+    for (int b = 0; b < HTTP_AGENT_BUCKETS; b++) {
+        for (HttpAgentHost* host = http_agent.buckets[b]; host; host = host->next) {
+            http_agent_host_drain(host);
+        }
+    }
+    return JSValueMakeUndefined(ctx);
+}
+
+// Copies a request body into a malloc'd buffer: bytes as they are, anything
+// else as its string form in UTF-8
+static char* http_copy_body(JSContextRef ctx, JSValueRef value, size_t* len, bool* binary, JSValueRef* exception) {
+    const char* bytes;
+    if (js_value_get_bytes(ctx, value, &bytes, len)) {
+        char* data = malloc(*len ? *len : 1);
+        if (*len) memcpy(data, bytes, *len);
+        *binary = true;
+        return data;
+    }
+
+    JSStringRef dataRef = JSValueToStringCopy(ctx, value, exception);
+    if (!dataRef) return NULL;
+    size_t dataMax = JSStringGetMaximumUTF8CStringSize(dataRef);
+    char* data = malloc(dataMax);
+    *len = JSStringGetUTF8CString(dataRef, data, dataMax) - 1;
+    JSStringRelease(dataRef);
+    *binary = false;
+    return data;
+}
+
+typedef struct {
+    bool buffer_body;
+    bool insecure;
+} HttpClientOptions;
+
+// Finds the callback after `fixed` leading arguments and an optional options
+// object; `{ encoding: null }` (or "buffer") asks for a Buffer body and
+// `{ rejectUnauthorized: false }` accepts any https:// certificate. NULL when
+// there is no callback, which makes the call return a promise
+static JSValueRef http_client_callback(JSContextRef ctx, size_t argc, const JSValueRef args[],
+                                       size_t fixed, HttpClientOptions* options) {
+    options->buffer_body = false;
+    options->insecure = false;
+    if (argc > fixed && JSValueIsObject(ctx, args[fixed]) && !JSObjectIsFunction(ctx, (JSObjectRef)args[fixed])) {
+        JSObjectRef object = (JSObjectRef)args[fixed];
+        JSValueRef encoding = JSObjectGetProperty(ctx, object, ATOM(encoding), NULL);
+        if (JSValueIsNull(ctx, encoding)) {
+            options->buffer_body = true;
+        } else if (JSValueIsString(ctx, encoding)) {
+            JSStringRef str = JSValueToStringCopy(ctx, encoding, NULL);
+            options->buffer_body = JSStringIsEqualToUTF8CString(str, "buffer");
+            JSStringRelease(str);
+        }
+        JSValueRef reject = JSObjectGetProperty(ctx, object, ATOM(rejectUnauthorized), NULL);
+        options->insecure = JSValueIsBoolean(ctx, reject) && !JSValueToBoolean(ctx, reject);
+        return argc > fixed + 1 ? args[fixed + 1] : NULL;
+    }
+    return argc > fixed ? args[fixed] : NULL;
+}
+
+// Methods http.request() accepts; the request keeps a pointer to the static name
+static const char* const http_request_methods[] = { "GET", "POST", "PUT", "DELETE", "PATCH", "OPTIONS", NULL };
+
+static const char* http_method_name(JSContextRef ctx, JSValueRef value) {
+    if (!JSValueIsString(ctx, value)) return NULL;
+    JSStringRef str = JSValueToStringCopy(ctx, value, NULL);
+    const char* name = NULL;
+    for (size_t i = 0; http_request_methods[i] && !name; i++) {
+        if (JSStringIsEqualToUTF8CString(str, http_request_methods[i])) name = http_request_methods[i];
+    }
+    JSStringRelease(str);
+    return name;
+}
+
+// `http.request(url[, { method, body, encoding, rejectUnauthorized }][, callback])`
+JSValueRef http_request(JSContextRef ctx, JSObjectRef function,
+                        JSObjectRef thisObject, size_t argc,
+                        const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.request");
+    if (argc < 1) return http_throw(ctx, exception, "http.request requires a url");
+
+    HttpClientOptions options;
+    JSValueRef callback = http_client_callback(ctx, argc, args, 1, &options);
+
+    const char* method = NULL;
+    JSValueRef body = NULL;
+    if (argc > 1 && JSValueIsObject(ctx, args[1]) && !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
+        JSObjectRef spec = (JSObjectRef)args[1];
+        JSValueRef methodValue = JSObjectGetProperty(ctx, spec, ATOM(method), NULL);
+        if (!JSValueIsUndefined(ctx, methodValue)) {
+            method = http_method_name(ctx, methodValue);
+            if (!method) return http_throw(ctx, exception, "Unsupported HTTP method");
+        }
+        body = JSObjectGetProperty(ctx, spec, ATOM(body), NULL);
+        if (JSValueIsUndefined(ctx, body) || JSValueIsNull(ctx, body)) body = NULL;
+    }
+    if (body && !method) method = "POST";
+
+    HttpRequest* http = http_request_new(ctx, args[0], method, false, exception);
+    if (!http) return JSValueMakeUndefined(ctx);
+    http->buffer_body = options.buffer_body;
+    http->insecure = options.insecure;
+
+    if (body) {
+        http->request_data = http_copy_body(ctx, body, &http->request_data_len, &http->binary_data, exception);
+        if (!http->request_data) {
+            http_request_free(http);
+            return JSValueMakeUndefined(ctx);
+        }
+    }
+    return http_request_send(http, callback, exception);
+}
+
+// `http.get(url[, options][, callback])`
+JSValueRef http_get(JSContextRef ctx, JSObjectRef function,
+                    JSObjectRef thisObject, size_t argc,
+                    const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.get");
+    if (argc < 1) return JSValueMakeUndefined(ctx);
+
+    HttpClientOptions options;
+    JSValueRef callback = http_client_callback(ctx, argc, args, 1, &options);
+    HttpRequest* http = http_request_new(ctx, args[0], NULL, false, exception);
+    if (!http) return JSValueMakeUndefined(ctx);
+    http->buffer_body = options.buffer_body;
+    http->insecure = options.insecure;
+
+    return http_request_send(http, callback, exception);
+}
+
+// `http.post(url, data[, options][, callback])`
+JSValueRef http_post(JSContextRef ctx, JSObjectRef function,
+                    JSObjectRef thisObject, size_t argc,
+                    const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.post");
+    if (argc < 2) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("http.post requires a url and data");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    HttpClientOptions options;
+    JSValueRef callback = http_client_callback(ctx, argc, args, 2, &options);
+    HttpRequest* http = http_request_new(ctx, args[0], "POST", false, exception);
+    if (!http) return JSValueMakeUndefined(ctx);
+    http->buffer_body = options.buffer_body;
+    http->insecure = options.insecure;
+
+    // Parse data
+    http->request_data = http_copy_body(ctx, args[1], &http->request_data_len, &http->binary_data, exception);
+    if (!http->request_data) {
+        http_request_free(http);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    return http_request_send(http, callback, exception);
+}
+
+// `http.put(url, data[, options][, callback])`
+JSValueRef http_put(JSContextRef ctx, JSObjectRef function,
+                   JSObjectRef thisObject, size_t argc,
+                   const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.put");
+    if (argc < 2) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("http.put requires a url and data");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    HttpClientOptions options;
+    JSValueRef callback = http_client_callback(ctx, argc, args, 2, &options);
+    HttpRequest* http = http_request_new(ctx, args[0], "PUT", false, exception);
+    if (!http) return JSValueMakeUndefined(ctx);
+    http->buffer_body = options.buffer_body;
+    http->insecure = options.insecure;
+
+    // Parse data
+    http->request_data = http_copy_body(ctx, args[1], &http->request_data_len, &http->binary_data, exception);
+    if (!http->request_data) {
+        http_request_free(http);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    return http_request_send(http, callback, exception);
+}
+
+// `http.delete(url[, options][, callback])`
+JSValueRef http_delete(JSContextRef ctx, JSObjectRef function,
+                      JSObjectRef thisObject, size_t argc,
+                      const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.delete");
+    if (argc < 1) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("http.delete requires a url");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    HttpClientOptions options;
+    JSValueRef callback = http_client_callback(ctx, argc, args, 1, &options);
+    HttpRequest* http = http_request_new(ctx, args[0], "DELETE", false, exception);
+    if (!http) return JSValueMakeUndefined(ctx);
+    http->buffer_body = options.buffer_body;
+    http->insecure = options.insecure;
+
+    return http_request_send(http, callback, exception);
+}
+
+// `http.websocket(url[, options])` - the returned WebSocket emits "open" once
+// the agent's connection has been upgraded, or "error" and "close" if it fails
+JSValueRef http_websocket(JSContextRef ctx, JSObjectRef function,
+                          JSObjectRef thisObject, size_t argc,
+                          const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "http.websocket");
+    if (argc < 1) return http_throw(ctx, exception, "http.websocket requires a url");
+
+    WebSocketOptions ws_options;
+    if (!websocket_options_read(ctx, argc > 1 ? args[1] : NULL, &ws_options, exception)) {
+        return JSValueMakeUndefined(ctx);
+    }
+    HttpClientOptions options;
+    http_client_callback(ctx, argc, args, 1, &options);
+
+    HttpRequest* http = http_request_new(ctx, args[0], "GET", true, exception);
+    if (!http) {
+        if (*exception) return JSValueMakeUndefined(ctx);
+        return http_throw(ctx, exception, "http.websocket requires a ws://, wss://, http:// or https:// URL");
+    }
+    http->insecure = options.insecure;
+    http->websocket = websocket_new(ctx, true, &ws_options);
+    websocket_client_key(http->websocket_key);
+
+    JSObjectRef ws = websocket_object(http->websocket);
+    http_agent_dispatch(http);
+    return ws;
+}
+
+// ========================= HTTP SERVER (http.createServer) ========================= //
+
+#define HTTP_KEEP_ALIVE_TIMEOUT_MS  5000
+#define HTTP_MAX_PIPELINE_BUFFER    (1024 * 1024)
+#define HTTP_LISTEN_BACKLOG         511
+#define HTTP_COMPRESS_THRESHOLD     1024            // Default `compression.threshold`
+#define HTTP_COMPRESS_ASYNC_MIN     (64 * 1024)     // Bodies compressed on the threadpool
+
+typedef struct {
+    uv_tcp_t server;
+    JSContextRef ctx;
+    JSObjectRef callback;     // Requests no route matched; NULL answers them with 404/405
+    char* metrics_path;       // `listen(port, { metricsPath })`, answered without calling JS
+    HttpRouter* router;       // `server.route()` table, NULL until the first route
+    bool compress;            // `listen(port, { compression })`
+    int compress_level;
+    size_t compress_threshold;  // Smaller complete bodies are sent as they are
+    TlsContext* tls;          // https.createServer() certificate and key
+} HttpServer;
+
+// Response header set with setHeader()/writeHead(); strings live in the response batch
+typedef struct {
+    const char* name;
+    size_t name_len;
+    const char* value;
+    size_t value_len;
+} HttpOutHeader;
+
+#define HTTP_WRITE_CLOSE_AFTER  0x1
+#define HTTP_BODY_SLOT          2   // Slot 0: header block, slot 1: chunk-size line
+
+typedef struct HttpSendFile HttpSendFile;
+typedef struct HttpCompressJob HttpCompressJob;
+
+// Structure to track client connections.
+// A connection serves one request at a time; pipelined requests wait in
+// `pending` until the current response has ended.
+typedef struct {
+    uv_tcp_t handle;
+    uint64_t idle_timer;      // Keep-alive timeout on the timer wheel (0 if unarmed)
+    HttpServer* server;
+    HttpParser parser;
+    char* pending;            // Received bytes not yet fed to the parser
+    size_t pending_off;
+    size_t pending_len;
+    size_t pending_cap;
+    JSObjectRef req;          // Current request (protected while awaiting res.end)
+    JSObjectRef res;
+    WriteBatch* out;          // Response bytes collected but not yet sent
+    HttpOutHeader* out_headers;
+    size_t out_header_count;
+    size_t out_header_cap;
+    int status_code;
+    const char* reason;       // Custom reason phrase from writeHead (in `out`)
+    size_t reason_len;
+    bool headers_sent;
+    bool chunked_response;
+    bool user_content_length;
+    bool user_content_type;
+    bool user_content_encoding;
+    bool encoding_chosen;     // Compression was decided for the current response
+    bool keep_alive;          // Current request allows a persistent connection
+    bool awaiting_response;   // Dispatched to JS, res.end() not called yet
+    bool continue_sent;
+    bool processing;          // Guards against re-entrant parsing from res.end()
+    bool reading;
+    bool finished;            // No further requests will be served
+    bool closing;
+    bool close_deferred;      // uv_close() waits for the res.sendFile() request holding the socket fd
+    HttpSendFile* send_file;  // res.sendFile() in progress
+    Compressor* encoder;      // Compresses the current response body as it is written
+    HttpCompressJob* compress_job;  // res.end() body being compressed on the threadpool
+    TlsSession* tls;          // https.createServer() connections
+    WebSocket* ws;            // Set once a server.websocket() route upgraded the connection
+} ClientContext;
+
+static JADE_THREAD_LOCAL MemPool http_connection_pool = MEM_POOL_INIT("http.connection", ClientContext);
+
+static JADE_THREAD_LOCAL JSClassRef http_response_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef http_server_class = NULL;
+
+static void http_client_close(ClientContext* client);
+static void http_client_resume(ClientContext* client);
+static void http_route_target_free(void* data);
+static void http_response_finish(ClientContext* client, bool keep_alive);
+static bool http_sendfile_defers_close(const HttpSendFile* send);
+
+// Finalize callback for the server object
+static void server_finalize(JSObjectRef object) {
+    HttpServer* server = (HttpServer*)JSObjectGetPrivate(object);
+    if (server) {
+        uv_close((uv_handle_t*)&server->server, NULL);
+        free(server->metrics_path);
+        http_router_free(server->router, http_route_target_free);
+        tls_context_free(server->tls);
+        free(server);
+    }
+}
+
+static const char* http_status_text(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 426: return "Upgrade Required";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default:  return "Unknown";
+    }
+}
+
+static JSValueRef http_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
+}
+
+static void on_client_context_closed(uv_handle_t* handle) {
+    ClientContext* client = (ClientContext*)handle->data;
+
+    // Held writes report back to the connection, so the session goes first
+    tls_session_free(client->tls);
+    if (client->ws) websocket_detach(client->ws, NULL);
+    http_parser_free(&client->parser);
+    free(client->pending);
+    free(client->out_headers);
+    pool_free(&http_connection_pool, client);
+}
+
+// A res.end() body compressed off the loop (see http_response_compress_async)
+struct HttpCompressJob {
+    uv_work_t req;
+    ClientContext* client;    // NULL once the connection is gone
+    WriteBatch* batch;        // The response, head not yet built
+    Compressor* encoder;
+    CompressBuffer out;
+    bool ok;
+};
+
+// Detaches the in-flight res object so late res.end() calls become no-ops
+static void http_client_release_exchange(ClientContext* client) {
+    if (client->out) {
+        write_batch_free(client->out);
+        client->out = NULL;
+    }
+    if (client->encoder) {
+        compressor_free(client->encoder);
+        client->encoder = NULL;
+    }
+    if (client->compress_job) {
+        // The job finishes on its own and drops the response
+        client->compress_job->client = NULL;
+        client->compress_job = NULL;
+    }
+    if (client->res) {
+        JSObjectSetPrivate(client->res, NULL);
+        JSValueUnprotect(client->server->ctx, client->res);
+        JSValueUnprotect(client->server->ctx, client->req);
+        client->res = NULL;
+        client->req = NULL;
+    }
+    client->awaiting_response = false;
+}
+
+static void http_client_close(ClientContext* client) {
+    if (client->closing) return;
+    client->closing = true;
+    client->finished = true;
+
+    http_client_release_exchange(client);
+    uv_read_stop((uv_stream_t*)&client->handle);
+    timer_stop(client->idle_timer);
+    client->idle_timer = 0;
+    if (client->tls) tls_session_shutdown(client->tls);
+
+    // A sendfile() on the threadpool must not see the descriptor closed and reused,
+    // and a transfer waiting on the file cache still points at this connection
+    if (client->send_file && http_sendfile_defers_close(client->send_file)) {
+        client->close_deferred = true;
+        return;
+    }
+    uv_close((uv_handle_t*)&client->handle, on_client_context_closed);
+}
+
+static void on_response_written(WriteBatch* batch, int status) {
+    ClientContext* client = (ClientContext*)batch->data;
+    if (status >= 0) runtime_counters.http_server.bytes_written += batch->total;
+    if (status < 0 || (batch->flags & HTTP_WRITE_CLOSE_AFTER)) {
+        http_client_close(client);
+    }
+}
+
+// Sends a batch to the client, through the TLS session on https connections
+static int http_client_write(ClientContext* client, WriteBatch* batch, WriteBatchCallback callback) {
+    if (client->tls) return tls_session_write(client->tls, batch, callback);
+    return write_batch_send(batch, (uv_stream_t*)&client->handle, callback);
+}
+
+// Queues `len` bytes for the client; the payload is copied into the batch arena
+static void http_client_send(ClientContext* client, const char* data, size_t len, bool close_after) {
+    WriteBatch* batch = write_batch_new(client->server->ctx);
+    char* copy = write_batch_alloc(batch, len);
+    memcpy(copy, data, len);
+    write_batch_add(batch, copy, len);
+    batch->data = client;
+    batch->flags = close_after ? HTTP_WRITE_CLOSE_AFTER : 0;
+    http_client_write(client, batch, on_response_written);
+}
+
+// Answers a request that cannot be served and closes the connection; `extra`
+// holds any further header lines
+static void http_client_reject(ClientContext* client, int status, const char* extra) {
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+        "HTTP/1.1 %d %s\r\n"
+        "%s"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n\r\n",
+        status, http_status_text(status), extra);
+
+    client->finished = true;
+    http_client_release_exchange(client);
+    uv_read_stop((uv_stream_t*)&client->handle);
+    client->reading = false;
+    http_client_send(client, response, len, true);
+}
+
+// Answers a malformed request and closes the connection
+static void http_client_send_error(ClientContext* client, int status) {
+    http_client_reject(client, status, "");
+}
+
+static void on_client_idle_timeout(void* data) {
+    ClientContext* client = (ClientContext*)data;
+    client->idle_timer = 0;
+    http_client_close(client);
+}
+
+// Starts/stops the socket read side depending on how much is buffered
+static void http_client_update_reading(ClientContext* client) {
+    if (client->finished) return;
+
+    bool backlogged = client->pending_len - client->pending_off > HTTP_MAX_PIPELINE_BUFFER;
+    if (backlogged && client->reading) {
+        uv_read_stop((uv_stream_t*)&client->handle);
+        client->reading = false;
+    } else if (!backlogged && !client->reading) {
+        uv_read_start((uv_stream_t*)&client->handle, read_buffer_alloc, on_client_read);
+        client->reading = true;
+    }
+
+    timer_stop(client->idle_timer);
+    client->idle_timer = client->awaiting_response ? 0 :
+        timer_start(HTTP_KEEP_ALIVE_TIMEOUT_MS, 0, on_client_idle_timeout, client);
+}
+
+// ------------------------- Incoming headers ------------------------- //
+
+// Where a message's `body` property stands relative to the raw bytes
+typedef enum {
+    HTTP_BODY_NONE,             // No raw bytes kept (Buffer bodies are a plain property)
+    HTTP_BODY_LAZY,             // Converted from the raw bytes on first access
+    HTTP_BODY_CACHING,          // Being stored as an own property by the getter
+    HTTP_BODY_CACHED,           // An own property made from the raw bytes
+    HTTP_BODY_REPLACED          // Assigned or deleted by a script
+} HttpBodyState;
+
+// Header fields and body of one incoming message, copied out of the parser so
+// they outlive the connection's buffers. `res.headers` looks fields up here on
+// access and `res.rawHeaders` walks them in order; `body` becomes a JS string
+// only when read, and `json()` parses the raw bytes instead. Nothing is
+// converted to JS strings until a script asks for it
+typedef struct {
+    int refs;                   // Held by the message object and its headers object
+    size_t count;
+    const char* head;           // Points just past `fields`
+    const char* body;           // Points just past `head`; NUL-terminated
+    size_t body_len;
+    const char* empty_body;     // `body` for an empty body
+    HttpBodyState body_state;
+    HttpHeader fields[];
+} HttpHeaderBlock;
+
+static JADE_THREAD_LOCAL JSClassRef http_headers_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef http_message_class = NULL;
+
+// Copies the head and, unless `empty_body` is NULL, the body
+static HttpHeaderBlock* http_header_block_new(const HttpParser* p, const char* empty_body) {
+    size_t fields_size = p->header_count * sizeof(HttpHeader);
+    size_t body_len = empty_body && p->body ? p->body_len : 0;
+    HttpHeaderBlock* block = malloc(sizeof(HttpHeaderBlock) + fields_size + p->head_len + body_len + 1);
+    block->refs = 2;
+    block->count = p->header_count;
+    memcpy(block->fields, p->headers, fields_size);
+    block->head = (const char*)block->fields + fields_size;
+    memcpy((char*)block->head, p->head, p->head_len);
+
+    char* body = (char*)block->head + p->head_len;
+    if (body_len) memcpy(body, p->body, body_len);
+    body[body_len] = '\0';
+    block->body = body;
+    block->body_len = body_len;
+    block->empty_body = empty_body;
+    block->body_state = empty_body ? HTTP_BODY_LAZY : HTTP_BODY_NONE;
+    return block;
+}
+
+static void http_header_block_finalize(JSObjectRef object) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (block && --block->refs == 0) free(block);
+}
+
+static bool http_header_matches(const HttpHeaderBlock* block, const HttpHeader* h, const char* name, size_t len) {
+    return h->name_len == len && strncasecmp(block->head + h->name_off, name, len) == 0;
+}
+
+// Copies a property name as UTF-8 into a buffer of HTTP_HEADER_KEY_BUF bytes;
+// only lowercase names address header fields, as the keys of the eager
+// headers object were always lowercased
+#define HTTP_HEADER_KEY_MAX 255
+#define HTTP_HEADER_KEY_BUF (HTTP_HEADER_KEY_MAX * 3 + 1)
+
+static bool http_header_key(JSStringRef property, char* buf, size_t* len) {
+    if (JSStringGetLength(property) > HTTP_HEADER_KEY_MAX) return false;
+    *len = JSStringGetUTF8CString(property, buf, HTTP_HEADER_KEY_BUF) - 1;
+    for (size_t i = 0; i < *len; i++) {
+        if (buf[i] >= 'A' && buf[i] <= 'Z') return false;
+    }
+    return *len > 0;
+}
+
+static bool http_headers_has(JSContextRef ctx, JSObjectRef object, JSStringRef property) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    char name[HTTP_HEADER_KEY_BUF];
+    size_t len;
+    if (!block || !http_header_key(property, name, &len)) return false;
+
+    for (size_t i = 0; i < block->count; i++) {
+        if (http_header_matches(block, &block->fields[i], name, len)) return true;
+    }
+    return false;
+}
+
+// Repeated fields are joined with ", ", as the eager object did
+static JSValueRef http_headers_get(JSContextRef ctx, JSObjectRef object, JSStringRef property, JSValueRef* exception) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    char name[HTTP_HEADER_KEY_BUF];
+    size_t len;
+    if (!block || !http_header_key(property, name, &len)) return NULL;
+
+    const HttpHeader* first = NULL;
+    size_t total = 0;
+    size_t matches = 0;
+    for (size_t i = 0; i < block->count; i++) {
+        const HttpHeader* h = &block->fields[i];
+        if (!http_header_matches(block, h, name, len)) continue;
+        if (!first) first = h;
+        total += (matches++ ? 2 : 0) + h->value_len;
+    }
+    if (!first) return NULL;
+
+    JSStringRef value;
+    if (matches == 1) {
+        value = js_string_from_utf8(block->head + first->value_off, first->value_len);
+    } else {
+        char* joined = malloc(total);
+        size_t off = 0;
+        for (const HttpHeader* h = first; h < block->fields + block->count; h++) {
+            if (!http_header_matches(block, h, name, len)) continue;
+            if (off) {
+                memcpy(joined + off, ", ", 2);
+                off += 2;
+            }
+            memcpy(joined + off, block->head + h->value_off, h->value_len);
+            off += h->value_len;
+        }
+        value = js_string_from_utf8(joined, off);
+        free(joined);
+    }
+
+    JSValueRef result = JSValueMakeString(ctx, value);
+    JSStringRelease(value);
+    return result;
+}
+
+// Lists each distinct field once, lowercased, for Object.keys() and for...in
+static void http_headers_names(JSContextRef ctx, JSObjectRef object, JSPropertyNameAccumulatorRef names) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (!block) return;
+
+    for (size_t i = 0; i < block->count; i++) {
+        const HttpHeader* h = &block->fields[i];
+        const char* field = block->head + h->name_off;
+        if (h->name_len == 0 || h->name_len > HTTP_HEADER_KEY_MAX) continue;
+
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = http_header_matches(block, &block->fields[j], field, h->name_len);
+        }
+        if (seen) continue;
+
+        char name[HTTP_HEADER_KEY_MAX + 1];
+        for (size_t k = 0; k < h->name_len; k++) name[k] = (char)tolower((unsigned char)field[k]);
+        name[h->name_len] = '\0';
+        JSStringRef nameRef = JSStringCreateWithUTF8CString(name);
+        JSPropertyNameAccumulatorAddName(names, nameRef);
+        JSStringRelease(nameRef);
+    }
+}
+
+// `rawHeaders` - [name, value, name, value, ...] in wire order and case
+static JSValueRef http_message_raw_headers(JSContextRef ctx, JSObjectRef object,
+                                           JSStringRef property, JSValueRef* exception) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (!block) return JSObjectMakeArray(ctx, 0, NULL, NULL);
+
+    JSValueRef* items = malloc((block->count ? block->count * 2 : 1) * sizeof(JSValueRef));
+    for (size_t i = 0; i < block->count; i++) {
+        const HttpHeader* h = &block->fields[i];
+        JSStringRef name = js_string_from_utf8(block->head + h->name_off, h->name_len);
+        JSStringRef value = js_string_from_utf8(block->head + h->value_off, h->value_len);
+        items[i * 2] = JSValueMakeString(ctx, name);
+        items[i * 2 + 1] = JSValueMakeString(ctx, value);
+        JSStringRelease(name);
+        JSStringRelease(value);
+    }
+    JSObjectRef array = JSObjectMakeArray(ctx, block->count * 2, items, NULL);
+    free(items);
+    return array;
+}
+
+static bool http_message_is_body(HttpHeaderBlock* block, JSStringRef property) {
+    return block && block->body_state != HTTP_BODY_NONE && JSStringIsEqual(property, ATOM(body));
+}
+
+// `body` - the raw bytes as a string, made on first access and then kept as an
+// ordinary own property (returning NULL forwards to it)
+static JSValueRef http_message_get_property(JSContextRef ctx, JSObjectRef object,
+                                            JSStringRef property, JSValueRef* exception) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (!http_message_is_body(block, property) || block->body_state != HTTP_BODY_LAZY) return NULL;
+
+    JSStringRef text = block->body_len ? js_string_from_utf8(block->body, block->body_len)
+                                       : JSStringCreateWithUTF8CString(block->empty_body);
+    JSValueRef value = JSValueMakeString(ctx, text);
+    JSStringRelease(text);
+
+    block->body_state = HTTP_BODY_CACHING;
+    JSObjectSetProperty(ctx, object, ATOM(body), value, kJSPropertyAttributeNone, NULL);
+    block->body_state = HTTP_BODY_CACHED;
+    return value;
+}
+
+// Assignments go to the default store; afterwards the raw bytes no longer describe `body`
+static bool http_message_set_property(JSContextRef ctx, JSObjectRef object, JSStringRef property,
+                                      JSValueRef value, JSValueRef* exception) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (http_message_is_body(block, property) && block->body_state != HTTP_BODY_CACHING) {
+        block->body_state = HTTP_BODY_REPLACED;
+    }
+    return false;
+}
+
+static bool http_message_delete_property(JSContextRef ctx, JSObjectRef object, JSStringRef property,
+                                         JSValueRef* exception) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (http_message_is_body(block, property)) block->body_state = HTTP_BODY_REPLACED;
+    return false;
+}
+
+static void http_message_names(JSContextRef ctx, JSObjectRef object, JSPropertyNameAccumulatorRef names) {
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(object);
+    if (block && block->body_state == HTTP_BODY_LAZY) JSPropertyNameAccumulatorAddName(names, ATOM(body));
+}
+
+// `message.json()` - parses the body from its raw bytes; a body that is a
+// Buffer, or was replaced by a script, is parsed from the current `body`
+static JSValueRef http_message_json(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                    size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_SPAN("http.json.parse");
+    HttpHeaderBlock* block = (HttpHeaderBlock*)JSObjectGetPrivate(thisObject);
+    if (block && block->body_state != HTTP_BODY_NONE && block->body_state != HTTP_BODY_REPLACED) {
+        return json_parse_utf8(ctx, block->body, block->body_len, exception);
+    }
+
+    JSValueRef body = JSObjectGetProperty(ctx, thisObject, ATOM(body), exception);
+    if (*exception) return JSValueMakeUndefined(ctx);
+
+    const char* bytes;
+    size_t len;
+    if (js_value_get_bytes(ctx, body, &bytes, &len)) {
+        char* copy = malloc(len + 1);
+        memcpy(copy, bytes, len);
+        copy[len] = '\0';
+        JSValueRef value = json_parse_utf8(ctx, copy, len, exception);
+        free(copy);
+        return value;
+    }
+
+    JSStringRef text = JSValueToStringCopy(ctx, body, exception);
+    if (!text) return JSValueMakeUndefined(ctx);
+    JSValueRef value = JSValueMakeFromJSONString(ctx, text);
+    JSStringRelease(text);
+    return value ? value : http_throw(ctx, exception, "Invalid JSON");
+}
+
+static const JSStaticValue http_message_values[] = {
+    { "rawHeaders", http_message_raw_headers, NULL, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontEnum },
+    { NULL, NULL, NULL, 0 }
+};
+
+static const JSStaticFunction http_message_functions[] = {
+    { "json", http_message_json, kJSPropertyAttributeDontEnum | kJSPropertyAttributeDontDelete },
+    { NULL, NULL, 0 }
+};
+
+// Makes the `req`/`res` object for a parsed message with lazy `headers`,
+// `rawHeaders` and (unless `empty_body` is NULL) `body`, which is
+// `empty_body` when the message had none
+static JSObjectRef http_make_message_object(JSContextRef ctx, const HttpParser* p, const char* empty_body) {
+    if (!http_message_class) {
+        JSClassDefinition headersDef = kJSClassDefinitionEmpty;
+        headersDef.className = "IncomingHeaders";
+        headersDef.hasProperty = http_headers_has;
+        headersDef.getProperty = http_headers_get;
+        headersDef.getPropertyNames = http_headers_names;
+        headersDef.finalize = http_header_block_finalize;
+        http_headers_class = JSClassCreate(&headersDef);
+
+        JSClassDefinition messageDef = kJSClassDefinitionEmpty;
+        messageDef.className = "IncomingMessage";
+        messageDef.staticValues = http_message_values;
+        messageDef.staticFunctions = http_message_functions;
+        messageDef.getProperty = http_message_get_property;
+        messageDef.setProperty = http_message_set_property;
+        messageDef.deleteProperty = http_message_delete_property;
+        messageDef.getPropertyNames = http_message_names;
+        messageDef.finalize = http_header_block_finalize;
+        http_message_class = JSClassCreate(&messageDef);
+    }
+
+    HttpHeaderBlock* block = http_header_block_new(p, empty_body);
+    JSObjectRef message = JSObjectMake(ctx, http_message_class, block);
+    JSObjectRef headers = JSObjectMake(ctx, http_headers_class, block);
+    JSObjectSetProperty(ctx, message, ATOM(headers), headers, kJSPropertyAttributeNone, NULL);
+    return message;
+}
+
+static void http_set_string_property(JSContextRef ctx, JSObjectRef object, JSStringRef name,
+                                     const char* data, size_t len) {
+    JSStringRef valueRef = js_string_from_utf8(data, len);
+    JSObjectSetProperty(ctx, object, name, JSValueMakeString(ctx, valueRef), kJSPropertyAttributeNone, NULL);
+    JSStringRelease(valueRef);
+}
+
+// ------------------------- Routing (server.route) ------------------------- //
+
+// What a route leads to: a JS handler, or a response prepared at registration
+typedef struct {
+    JSContextRef ctx;
+    JSObjectRef handler;        // Called as handler(req, res); NULL for a prepared response
+    JSStringRef* names;         // `req.params` keys, set in pattern order so every
+                                // params object of a route gets the same shape
+    size_t name_count;
+    char* head;                 // Prepared response: status line and headers up to Content-Length
+    size_t head_len;
+    char* body;
+    size_t body_len;
+    bool websocket;             // server.websocket(): handler(ws, req) after the upgrade
+    WebSocketOptions websocket_options;
+} HttpRouteTarget;
+
+static const char* http_date_header(size_t* len);
+
+static void http_route_target_free(void* data) {
+    HttpRouteTarget* target = (HttpRouteTarget*)data;
+    if (target->handler) JSValueUnprotect(target->ctx, target->handler);
+    for (size_t i = 0; i < target->name_count; i++) JSStringRelease(target->names[i]);
+    free(target->names);
+    free(target->head);
+    free(target->body);
+    free(target);
+}
+
+// Copies a JS value as malloc'd UTF-8; NULL with `*exception` set if it has no string form
+static char* http_value_to_utf8(JSContextRef ctx, JSValueRef value, size_t* len, JSValueRef* exception) {
+    JSStringRef str = JSValueToStringCopy(ctx, value, exception);
+    if (!str) return NULL;
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(str);
+    char* out = malloc(max_len);
+    *len = JSStringGetUTF8CString(str, out, max_len) - 1;
+    JSStringRelease(str);
+    return out;
+}
+
+// Formats `{ status, headers, body }` into the target; false with `*exception` set if invalid
+static bool http_route_prepare_response(HttpRouteTarget* target, JSContextRef ctx, JSObjectRef spec,
+                                        JSValueRef* exception) {
+    JSValueRef statusValue = JSObjectGetProperty(ctx, spec, ATOM(status), exception);
+    int status = JSValueIsUndefined(ctx, statusValue) ? 200 : (int)JSValueToNumber(ctx, statusValue, exception);
+    if (*exception) return false;
+    if (status < 100 || status > 999) {
+        http_throw(ctx, exception, "Invalid status code");
+        return false;
+    }
+
+    const char* bytes = NULL;
+    JSValueRef bodyValue = JSObjectGetProperty(ctx, spec, ATOM(body), exception);
+    if (*exception) return false;
+    if (js_value_get_bytes(ctx, bodyValue, &bytes, &target->body_len)) {
+        target->body = malloc(target->body_len ? target->body_len : 1);
+        memcpy(target->body, bytes, target->body_len);
+    } else if (!JSValueIsUndefined(ctx, bodyValue) && !JSValueIsNull(ctx, bodyValue)) {
+        target->body = http_value_to_utf8(ctx, bodyValue, &target->body_len, exception);
+        if (!target->body) return false;
+    }
+
+    size_t cap = 256;
+    size_t len = 0;
+    char* head = malloc(cap);
+    bool has_type = false;
+
+    const char* reason = http_status_text(status);
+    len += (size_t)snprintf(head, cap, "HTTP/1.1 %d %s\r\n", status, reason);
+
+    JSValueRef headersValue = JSObjectGetProperty(ctx, spec, ATOM(headers), exception);
+    if (!*exception && JSValueIsObject(ctx, headersValue)) {
+        JSObjectRef headers = (JSObjectRef)headersValue;
+        JSPropertyNameArrayRef names = JSObjectCopyPropertyNames(ctx, headers);
+        size_t count = JSPropertyNameArrayGetCount(names);
+        for (size_t i = 0; i < count && !*exception; i++) {
+            JSStringRef nameRef = JSPropertyNameArrayGetNameAtIndex(names, i);
+            size_t name_max = JSStringGetMaximumUTF8CStringSize(nameRef);
+            char* name = malloc(name_max);
+            size_t name_len = JSStringGetUTF8CString(nameRef, name, name_max) - 1;
+            size_t value_len = 0;
+            char* value = http_value_to_utf8(ctx, JSObjectGetProperty(ctx, headers, nameRef, NULL), &value_len, exception);
+
+            bool valid = value && name_len > 0;
+            for (size_t k = 0; valid && k < name_len; k++) {
+                unsigned char c = (unsigned char)name[k];
+                valid = c > ' ' && c < 0x7F && c != ':';
+            }
+            for (size_t k = 0; valid && k < value_len; k++) {
+                valid = value[k] != '\r' && value[k] != '\n' && value[k] != '\0';
+            }
+            if (!valid && !*exception) http_throw(ctx, exception, "Invalid HTTP header in route response");
+
+            // Framing is the server's; a prepared body always carries its length
+            bool framing = (name_len == 14 && strncasecmp(name, "content-length", 14) == 0) ||
+                           (name_len == 17 && strncasecmp(name, "transfer-encoding", 17) == 0) ||
+                           (name_len == 10 && strncasecmp(name, "connection", 10) == 0);
+            if (valid && !framing) {
+                if (name_len == 12 && strncasecmp(name, "content-type", 12) == 0) has_type = true;
+                if (len + name_len + value_len + 4 > cap) {
+                    cap = (len + name_len + value_len + 4) * 2;
+                    head = realloc(head, cap);
+                }
+                memcpy(head + len, name, name_len);
+                len += name_len;
+                memcpy(head + len, ": ", 2);
+                len += 2;
+                memcpy(head + len, value, value_len);
+                len += value_len;
+                memcpy(head + len, "\r\n", 2);
+                len += 2;
+            }
+            free(name);
+            free(value);
+        }
+        JSPropertyNameArrayRelease(names);
+    }
+    if (*exception) {
+        free(head);
+        return false;
+    }
+
+    if (len + 64 > cap) head = realloc(head, cap = len + 64);
+    if (!has_type) len += (size_t)snprintf(head + len, cap - len, "Content-Type: text/plain\r\n");
+    len += (size_t)snprintf(head + len, cap - len, "Content-Length: %zu\r\n", target->body_len);
+    target->head = head;
+    target->head_len = len;
+    return true;
+}
+
+// Adds `target` for (method, pattern), replacing a target already there;
+// false with `*exception` set if the pattern is invalid
+static bool http_server_add_route(HttpServer* server, JSContextRef ctx, const char* method,
+                                  const char* pattern, HttpRouteTarget* target, JSValueRef* exception) {
+    if (!server->router) server->router = http_router_new();
+    HttpRoute* route;
+    const char* error = http_router_add(server->router, method, pattern, &route);
+    if (error) {
+        http_throw(ctx, exception, error);
+        return false;
+    }
+
+    if (route->data) http_route_target_free(route->data);
+    route->data = target;
+    target->name_count = route->param_count;
+    target->names = route->param_count ? malloc(route->param_count * sizeof(JSStringRef)) : NULL;
+    for (size_t i = 0; i < route->param_count; i++) {
+        target->names[i] = JSStringCreateWithUTF8CString(route->names[i]);
+    }
+    return true;
+}
+
+// `server.route(method, pattern, handler)` - `handler` is a function called
+// as handler(req, res) with `req.params`, or `{ status, headers, body }`,
+// which is then answered from C without calling into JS
+static JSValueRef http_server_route(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                    size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    HttpServer* server = (HttpServer*)JSObjectGetPrivate(thisObject);
+    if (!server) return http_throw(ctx, exception, "Invalid server object");
+    if (argc < 3 || !JSValueIsString(ctx, args[0]) || !JSValueIsString(ctx, args[1]) || !JSValueIsObject(ctx, args[2])) {
+        return http_throw(ctx, exception, "server.route requires a method, a pattern and a handler");
+    }
+
+    size_t method_len, pattern_len;
+    char* method = http_value_to_utf8(ctx, args[0], &method_len, exception);
+    char* pattern = http_value_to_utf8(ctx, args[1], &pattern_len, exception);
+    for (size_t i = 0; i < method_len; i++) method[i] = (char)toupper((unsigned char)method[i]);
+
+    HttpRouteTarget* target = calloc(1, sizeof(HttpRouteTarget));
+    target->ctx = ctx;
+    JSObjectRef handler = (JSObjectRef)args[2];
+    bool ok = true;
+    if (JSObjectIsFunction(ctx, handler)) {
+        target->handler = handler;
+        JSValueProtect(ctx, handler);
+    } else {
+        ok = http_route_prepare_response(target, ctx, handler, exception);
+    }
+
+    if (ok) ok = http_server_add_route(server, ctx, method, pattern, target, exception);
+
+    if (!ok) http_route_target_free(target);
+    free(method);
+    free(pattern);
+    return thisObject;
+}
+
+// `server.websocket(pattern, handler[, { maxPayload, pingInterval }])` - GET
+// requests to `pattern` are upgraded in C and `handler(ws, req)` runs once the
+// connection is a WebSocket; plain requests to it get a 426
+static JSValueRef http_server_websocket(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                        size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    HttpServer* server = (HttpServer*)JSObjectGetPrivate(thisObject);
+    if (!server) return http_throw(ctx, exception, "Invalid server object");
+    if (argc < 2 || !JSValueIsString(ctx, args[0]) || !JSValueIsObject(ctx, args[1]) ||
+        !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
+        return http_throw(ctx, exception, "server.websocket requires a pattern and a handler function");
+    }
+
+    WebSocketOptions options;
+    if (!websocket_options_read(ctx, argc > 2 ? args[2] : NULL, &options, exception)) return thisObject;
+
+    size_t pattern_len;
+    char* pattern = http_value_to_utf8(ctx, args[0], &pattern_len, exception);
+    HttpRouteTarget* target = calloc(1, sizeof(HttpRouteTarget));
+    target->ctx = ctx;
+    target->handler = (JSObjectRef)args[1];
+    JSValueProtect(ctx, target->handler);
+    target->websocket = true;
+    target->websocket_options = options;
+
+    if (!http_server_add_route(server, ctx, "GET", pattern, target, exception)) http_route_target_free(target);
+    free(pattern);
+    return thisObject;
+}
+
+static int http_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// `req.params` with percent-decoded values; malformed escapes are kept as they are
+static JSObjectRef http_route_params(JSContextRef ctx, const HttpRouteTarget* target, const HttpRouteMatch* match) {
+    JSObjectRef params = JSObjectMake(ctx, NULL, NULL);
+    for (size_t i = 0; i < target->name_count; i++) {
+        const char* in = match->params[i].value;
+        size_t in_len = match->params[i].len;
+        char stack_buf[256];
+        char* out = in_len <= sizeof(stack_buf) ? stack_buf : malloc(in_len);
+        size_t n = 0;
+        for (size_t k = 0; k < in_len; k++) {
+            int hi, lo;
+            if (in[k] == '%' && k + 2 < in_len &&
+                (hi = http_hex_digit(in[k + 1])) >= 0 && (lo = http_hex_digit(in[k + 2])) >= 0) {
+                out[n++] = (char)(hi << 4 | lo);
+                k += 2;
+            } else {
+                out[n++] = in[k];
+            }
+        }
+        JSStringRef value = js_string_from_utf8(out, n);
+        JSObjectSetProperty(ctx, params, target->names[i], JSValueMakeString(ctx, value), kJSPropertyAttributeNone, NULL);
+        JSStringRelease(value);
+        if (out != stack_buf) free(out);
+    }
+    return params;
+}
+
+// Answers from C with a prepared head (status line through Content-Length);
+// the connection stays open if the request allows it
+static void http_client_send_prepared(ClientContext* client, const char* head, size_t head_len,
+                                      const char* body, size_t body_len) {
+    const HttpParser* p = &client->parser;
+    bool keep_alive = p->keep_alive;
+    if (p->method_len == 4 && memcmp(p->head + p->method_off, "HEAD", 4) == 0) body_len = 0;
+
+    size_t date_len;
+    const char* date = http_date_header(&date_len);
+    const char* connection = keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    size_t connection_len = strlen(connection);
+
+    WriteBatch* batch = write_batch_new(client->server->ctx);
+    size_t total = head_len + date_len + connection_len + body_len;
+    char* out = write_batch_alloc(batch, total);
+    memcpy(out, head, head_len);
+    memcpy(out + head_len, date, date_len);
+    memcpy(out + head_len + date_len, connection, connection_len);
+    if (body_len) memcpy(out + head_len + date_len + connection_len, body, body_len);
+    write_batch_add(batch, out, total);
+    batch->data = client;
+    batch->flags = keep_alive ? 0 : HTTP_WRITE_CLOSE_AFTER;
+
+    http_response_finish(client, keep_alive);
+    http_client_write(client, batch, on_response_written);
+}
+
+// 404, or 405 with `Allow` when the path is routed for other methods
+static void http_client_send_unrouted(ClientContext* client, const char* allow) {
+    char head[512];
+    int len = allow
+        ? snprintf(head, sizeof(head),
+                   "HTTP/1.1 405 Method Not Allowed\r\nAllow: %s\r\n"
+                   "Content-Type: text/plain\r\nContent-Length: 18\r\n", allow)
+        : snprintf(head, sizeof(head),
+                   "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 9\r\n");
+    if (len < 0 || (size_t)len >= sizeof(head)) {
+        http_client_send_error(client, 500);
+        return;
+    }
+    http_client_send_prepared(client, head, (size_t)len, allow ? "Method Not Allowed" : "Not Found",
+                              allow ? 18 : 9);
+}
+
+// Whether a GET is for the server's metrics path (query string ignored)
+static bool http_client_wants_metrics(const ClientContext* client) {
+    const HttpParser* p = &client->parser;
+    const char* path = client->server->metrics_path;
+    if (!path || p->method_len != 3 || memcmp(p->head + p->method_off, "GET", 3) != 0) return false;
+
+    const char* url = p->head + p->url_off;
+    size_t url_len = p->url_len;
+    const char* query = memchr(url, '?', url_len);
+    if (query) url_len = (size_t)(query - url);
+    return strlen(path) == url_len && memcmp(path, url, url_len) == 0;
+}
+
+// Answers a metrics scrape from C, so a busy script cannot delay or skew it
+static void http_client_serve_metrics(ClientContext* client) {
+    size_t body_len;
+    char* body = metrics_format_prometheus(&body_len);
+    if (!body) {
+        http_client_send_error(client, 500);
+        return;
+    }
+
+    char head[192];
+    int head_len = snprintf(head, sizeof(head),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n\r\n",
+        body_len, client->parser.keep_alive ? "keep-alive" : "close");
+
+    WriteBatch* batch = write_batch_new(client->server->ctx);
+    char* out = write_batch_alloc(batch, (size_t)head_len + body_len);
+    memcpy(out, head, (size_t)head_len);
+    memcpy(out + head_len, body, body_len);
+    free(body);
+    write_batch_add(batch, out, (size_t)head_len + body_len);
+    batch->data = client;
+    batch->flags = client->parser.keep_alive ? 0 : HTTP_WRITE_CLOSE_AFTER;
+
+    http_response_finish(client, client->parser.keep_alive);
+    http_client_write(client, batch, on_response_written);
+}
+
+// The `req` object a handler is called with
+static JSObjectRef http_client_request_object(ClientContext* client, const HttpRouteTarget* target,
+                                              const HttpRouteMatch* match) {
+    JSContextRef ctx = client->server->ctx;
+    HttpParser* p = &client->parser;
+
+    JSObjectRef req = http_make_message_object(ctx, p, "");
+    http_set_string_property(ctx, req, ATOM(method), p->head + p->method_off, p->method_len);
+    http_set_string_property(ctx, req, ATOM(url), p->head + p->url_off, p->url_len);
+
+    char version[8];
+    int version_len = snprintf(version, sizeof(version), "%d.%d", p->version_major, p->version_minor);
+    http_set_string_property(ctx, req, ATOM(httpVersion), version, version_len);
+    if (target) {
+        JSObjectSetProperty(ctx, req, ATOM(params), http_route_params(ctx, target, match),
+                            kJSPropertyAttributeNone, NULL);
+    }
+    return req;
+}
+
+static void http_log_exception(JSContextRef ctx, JSValueRef exception, const char* where) {
+    JSStringRef msg = JSValueToStringCopy(ctx, exception, NULL);
+    char buf[512] = "";
+    if (msg) {
+        JSStringGetUTF8CString(msg, buf, sizeof(buf));
+        JSStringRelease(msg);
+    }
+    fprintf(stderr, "ERROR: Uncaught exception in %s: %s\n", where, buf);
+}
+
+// Whether a comma-separated header value lists `token` (case-insensitive)
+static bool http_header_has_token(const char* value, size_t len, const char* token) {
+    size_t token_len = strlen(token);
+    const char* end = value + len;
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t' || *value == ',')) value++;
+        const char* item = value;
+        while (value < end && *value != ',') value++;
+        const char* item_end = value;
+        while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t')) item_end--;
+        if ((size_t)(item_end - item) == token_len && strncasecmp(item, token, token_len) == 0) return true;
+    }
+    return false;
+}
+
+static void http_client_close_websocket(void* owner) {
+    http_client_close((ClientContext*)owner);
+}
+
+// Answers the handshake for a server.websocket() route and hands the
+// connection to a WebSocket, which gets everything read from then on
+static void http_client_upgrade(ClientContext* client, const HttpRouteTarget* target,
+                                const HttpRouteMatch* match) {
+    JSContextRef ctx = client->server->ctx;
+    HttpParser* p = &client->parser;
+
+    size_t upgrade_len = 0, key_len = 0, version_len = 0;
+    const char* upgrade = http_parser_find_header(p, "upgrade", &upgrade_len);
+    const char* key = http_parser_find_header(p, "sec-websocket-key", &key_len);
+    const char* version = http_parser_find_header(p, "sec-websocket-version", &version_len);
+
+    static const char versions[] = "Upgrade: websocket\r\nSec-WebSocket-Version: 13\r\n";
+    if (!p->upgrade || !upgrade || !http_header_has_token(upgrade, upgrade_len, "websocket")) {
+        http_client_reject(client, 426, versions);
+        return;
+    }
+    if (!version || version_len != 2 || memcmp(version, "13", 2) != 0) {
+        http_client_reject(client, 426, versions);
+        return;
+    }
+    if (!key || key_len != WEBSOCKET_KEY_LENGTH) {
+        http_client_send_error(client, 400);
+        return;
+    }
+
+    char accept[WEBSOCKET_ACCEPT_LENGTH + 1];
+    websocket_accept_key(key, key_len, accept);
+    char response[160];
+    int len = snprintf(response, sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    http_client_send(client, response, (size_t)len, false);
+
+    // No further HTTP on this connection; it stays open and reading without the idle timeout
+    JSObjectRef req = http_client_request_object(client, target, match);
+    client->finished = true;
+    timer_stop(client->idle_timer);
+    client->idle_timer = 0;
+    if (!client->reading) {
+        uv_read_start((uv_stream_t*)&client->handle, read_buffer_alloc, on_client_read);
+        client->reading = true;
+    }
+
+    WebSocket* ws = websocket_new(ctx, false, &target->websocket_options);
+    client->ws = ws;
+    websocket_attach(ws, (uv_stream_t*)&client->handle, client->tls, http_client_close_websocket, client);
+
+    JSValueRef exception = NULL;
+    JSValueRef args[] = { websocket_object(ws), req };
+    PROFILE_CALL_SPAN(ctx, target->handler, "http.server.websocket");
+    JSObjectCallAsFunction(ctx, target->handler, NULL, 2, args, &exception);
+    if (exception) http_log_exception(ctx, exception, "WebSocket handler");
+}
+
+// Hands a fully parsed request to the JS callback
+static void http_client_dispatch(ClientContext* client) {
+    JSContextRef ctx = client->server->ctx;
+    HttpParser* p = &client->parser;
+
+    if (http_client_wants_metrics(client)) {
+        http_client_serve_metrics(client);
+        return;
+    }
+
+    // Routes are matched on the raw path before any JS object exists, so
+    // prepared responses, 404s and 405s never enter JS
+    HttpRouteMatch match;
+    const HttpRouteTarget* target = NULL;
+    if (client->server->router) {
+        const char* url = p->head + p->url_off;
+        const char* query = memchr(url, '?', p->url_len);
+        size_t path_len = query ? (size_t)(query - url) : p->url_len;
+        if (http_router_match(client->server->router, p->head + p->method_off, p->method_len,
+                              url, path_len, &match)) {
+            target = (const HttpRouteTarget*)match.route->data;
+        } else if (!client->server->callback) {
+            http_client_send_unrouted(client, match.allow);
+            return;
+        }
+    }
+    if (target && !target->handler) {
+        http_client_send_prepared(client, target->head, target->head_len, target->body, target->body_len);
+        return;
+    }
+    if (target && target->websocket) {
+        http_client_upgrade(client, target, &match);
+        return;
+    }
+    JSObjectRef handler = target ? target->handler : client->server->callback;
+    if (!handler) {
+        http_client_send_unrouted(client, NULL);
+        return;
+    }
+
+    client->keep_alive = p->keep_alive;
+    client->awaiting_response = true;
+
+    JSObjectRef req = http_client_request_object(client, target, &match);
+
+    // Response methods come from the class's static function table
+    JSObjectRef res = JSObjectMake(ctx, http_response_class, client);
+    client->status_code = 200;
+    client->reason = NULL;
+    client->out_header_count = 0;
+    client->headers_sent = false;
+    client->chunked_response = false;
+    client->user_content_length = false;
+    client->user_content_type = false;
+    client->user_content_encoding = false;
+    client->encoding_chosen = false;
+
+    client->req = req;
+    client->res = res;
+    JSValueProtect(ctx, req);
+    JSValueProtect(ctx, res);
+
+    JSValueRef exception = NULL;
+    JSValueRef args[] = { req, res };
+    PROFILE_CALL_SPAN(ctx, handler, "http.server.request");
+    JSObjectCallAsFunction(ctx, handler, NULL, 2, args, &exception);
+
+    if (exception) {
+        http_log_exception(ctx, exception, "request handler");
+        if (client->awaiting_response && !client->closing && !client->compress_job) {
+            http_client_send_error(client, 500);
+        }
+    }
+}
+
+// Runs the parser over buffered bytes, dispatching each complete request.
+// Returns how many bytes were used; parsing pauses while a response is pending.
+static size_t http_client_consume(ClientContext* client, const char* data, size_t len) {
+    size_t off = 0;
+
+    while (!client->finished && !client->awaiting_response && off < len) {
+        off += http_parser_execute(&client->parser, data + off, len - off);
+
+        if (client->parser.state == HTTP_PARSE_ERROR) {
+            http_client_send_error(client, client->parser.error);
+            return len;
+        }
+        if (client->parser.state == HTTP_PARSE_COMPLETE) {
+            http_client_dispatch(client);
+
+            // Whatever followed the handshake is already WebSocket frames
+            if (client->ws) {
+                if (off < len && !client->closing) websocket_receive(client->ws, data + off, len - off);
+                return len;
+            }
+            continue;
+        }
+
+        // Waiting for more data; let a client that sent Expect know it may proceed
+        if (client->parser.expect_continue && !client->continue_sent &&
+            client->parser.state != HTTP_PARSE_HEAD) {
+            static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            http_client_send(client, cont, sizeof(cont) - 1, false);
+            client->continue_sent = true;
+        }
+    }
+
+    return off;
+}
+
+static void http_client_buffer(ClientContext* client, const char* data, size_t len) {
+    if (client->pending_off > 0) {
+        memmove(client->pending, client->pending + client->pending_off, client->pending_len - client->pending_off);
+        client->pending_len -= client->pending_off;
+        client->pending_off = 0;
+    }
+    if (client->pending_len + len > client->pending_cap) {
+        size_t cap = client->pending_cap ? client->pending_cap : 4096;
+        while (cap < client->pending_len + len) cap *= 2;
+        client->pending = realloc(client->pending, cap);
+        client->pending_cap = cap;
+    }
+    memcpy(client->pending + client->pending_len, data, len);
+    client->pending_len += len;
+}
+
+// Continues with pipelined requests after a response has been completed
+static void http_client_resume(ClientContext* client) {
+    if (client->processing || client->closing) return;
+
+    client->processing = true;
+    size_t used = http_client_consume(client, client->pending + client->pending_off,
+                                      client->pending_len - client->pending_off);
+    client->pending_off += used;
+    if (client->pending_off == client->pending_len) {
+        client->pending_off = 0;
+        client->pending_len = 0;
+    }
+    client->processing = false;
+
+    if (!client->closing) http_client_update_reading(client);
+}
+
+// Formats the Date header at most once per second
+static const char* http_date_header(size_t* len) {
+    static JADE_THREAD_LOCAL char cached[64];
+    static JADE_THREAD_LOCAL size_t cached_len = 0;
+    static JADE_THREAD_LOCAL time_t cached_at = 0;
+
+    time_t now = time(NULL);
+    if (now != cached_at || cached_len == 0) {
+        struct tm tm_utc;
+        gmtime_r(&now, &tm_utc);
+        cached_len = strftime(cached, sizeof(cached), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_utc);
+        cached_at = now;
+    }
+    *len = cached_len;
+    return cached;
+}
+
+static WriteBatch* http_response_batch(ClientContext* client) {
+    if (!client->out) {
+        client->out = write_batch_new(client->server->ctx);
+        write_batch_add(client->out, NULL, 0);  // Header block
+        write_batch_add(client->out, NULL, 0);  // Chunk-size line
+    }
+    return client->out;
+}
+
+static bool http_response_status_has_body(const ClientContext* client) {
+    int status = client->status_code;
+    return !(status >= 100 && status < 200) && status != 204 && status != 304;
+}
+
+static bool http_response_has_body(ClientContext* client) {
+    const HttpParser* p = &client->parser;
+    bool head_request = p->method_len == 4 && memcmp(p->head + p->method_off, "HEAD", 4) == 0;
+    return !head_request && http_response_status_has_body(client);
+}
+
+// Copies a JS value into the response arena as UTF-8
+static const char* http_response_copy_string(ClientContext* client, JSContextRef ctx, JSValueRef value,
+                                             size_t* len, JSValueRef* exception) {
+    JSStringRef str = JSValueToStringCopy(ctx, value, exception);
+    if (!str) return NULL;
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(str);
+    char* dst = write_batch_alloc(http_response_batch(client), max_len);
+    *len = JSStringGetUTF8CString(str, dst, max_len) - 1;
+    JSStringRelease(str);
+    return dst;
+}
+
+// Records (or replaces) a response header after validating it
+static bool http_response_set_header(ClientContext* client, JSContextRef ctx, JSValueRef name_value,
+                                     JSValueRef value, bool replace, JSValueRef* exception) {
+    size_t name_len, value_len;
+    const char* name = http_response_copy_string(client, ctx, name_value, &name_len, exception);
+    if (!name) return false;
+
+    for (size_t i = 0; i < name_len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c <= ' ' || c >= 0x7F || c == ':') {
+            http_throw(ctx, exception, "Invalid HTTP header name");
+            return false;
+        }
+    }
+    if (name_len == 0) {
+        http_throw(ctx, exception, "Invalid HTTP header name");
+        return false;
+    }
+
+    // Arrays produce one header line per element (e.g. Set-Cookie)
+    if (JSValueIsArray(ctx, value)) {
+        JSObjectRef array = (JSObjectRef)value;
+        unsigned count = (unsigned)JSValueToNumber(ctx, JSObjectGetProperty(ctx, array, ATOM(length), NULL), NULL);
+
+        JSStringRef nameRef = JSValueToStringCopy(ctx, name_value, NULL);
+        JSValueRef nameString = JSValueMakeString(ctx, nameRef);
+        JSStringRelease(nameRef);
+        for (unsigned i = 0; i < count; i++) {
+            JSValueRef item = JSObjectGetPropertyAtIndex(ctx, array, i, NULL);
+            if (!http_response_set_header(client, ctx, nameString, item, replace && i == 0, exception)) return false;
+        }
+        return true;
+    }
+
+    const char* val = http_response_copy_string(client, ctx, value, &value_len, exception);
+    if (!val) return false;
+    for (size_t i = 0; i < value_len; i++) {
+        if (val[i] == '\r' || val[i] == '\n' || val[i] == '\0') {
+            http_throw(ctx, exception, "Invalid character in HTTP header value");
+            return false;
+        }
+    }
+
+    if (name_len == 14 && strncasecmp(name, "content-length", 14) == 0) {
+        client->user_content_length = true;
+    } else if (name_len == 12 && strncasecmp(name, "content-type", 12) == 0) {
+        client->user_content_type = true;
+    } else if (name_len == 16 && strncasecmp(name, "content-encoding", 16) == 0) {
+        client->user_content_encoding = true;
+    } else if (name_len == 17 && strncasecmp(name, "transfer-encoding", 17) == 0) {
+        client->chunked_response = true;
+    } else if (name_len == 10 && strncasecmp(name, "connection", 10) == 0 &&
+               value_len == 5 && strncasecmp(val, "close", 5) == 0) {
+        client->keep_alive = false;
+    }
+
+    if (replace) {
+        // Drop earlier values of the same header
+        size_t kept = 0;
+        for (size_t i = 0; i < client->out_header_count; i++) {
+            HttpOutHeader* h = &client->out_headers[i];
+            if (h->name_len == name_len && strncasecmp(h->name, name, name_len) == 0) continue;
+            client->out_headers[kept++] = *h;
+        }
+        client->out_header_count = kept;
+    }
+
+    if (client->out_header_count == client->out_header_cap) {
+        client->out_header_cap = client->out_header_cap ? client->out_header_cap * 2 : 8;
+        client->out_headers = realloc(client->out_headers, client->out_header_cap * sizeof(HttpOutHeader));
+    }
+    HttpOutHeader* h = &client->out_headers[client->out_header_count++];
+    h->name = name;
+    h->name_len = name_len;
+    h->value = val;
+    h->value_len = value_len;
+    return true;
+}
+
+// Writes the status line and header block into slot 0 of the batch
+static void http_response_build_head(ClientContext* client, WriteBatch* batch, bool ending,
+                                     bool has_body, size_t body_len) {
+    char framing[64] = "";
+
+    if (has_body && !client->user_content_length && !client->chunked_response) {
+        if (ending) {
+            snprintf(framing, sizeof(framing), "Content-Length: %zu\r\n", body_len);
+        } else if (client->parser.version_major == 1 && client->parser.version_minor >= 1) {
+            snprintf(framing, sizeof(framing), "Transfer-Encoding: chunked\r\n");
+            client->chunked_response = true;
+        } else {
+            // HTTP/1.0 clients get a close-delimited body
+            client->keep_alive = false;
+        }
+    } else if (!has_body && !client->user_content_length && ending &&
+               client->status_code != 204 && client->status_code != 304 &&
+               !(client->status_code >= 100 && client->status_code < 200)) {
+        // HEAD responses advertise the length the body would have had
+        snprintf(framing, sizeof(framing), "Content-Length: %zu\r\n", body_len);
+    }
+
+    const char* reason = client->reason ? client->reason : http_status_text(client->status_code);
+    size_t reason_len = client->reason ? client->reason_len : strlen(reason);
+    size_t date_len;
+    const char* date = http_date_header(&date_len);
+    const char* connection = client->keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    const char* default_type = client->user_content_type ? "" : "Content-Type: text/plain\r\n";
+
+    size_t size = 32 + reason_len + date_len + strlen(framing) + strlen(connection) + strlen(default_type);
+    for (size_t i = 0; i < client->out_header_count; i++) {
+        size += client->out_headers[i].name_len + client->out_headers[i].value_len + 4;
+    }
+
+    char* head = write_batch_alloc(batch, size);
+    size_t len = (size_t)snprintf(head, size, "HTTP/1.1 %d ", client->status_code);
+    memcpy(head + len, reason, reason_len);
+    len += reason_len;
+    memcpy(head + len, "\r\n", 2);
+    len += 2;
+    for (size_t i = 0; i < client->out_header_count; i++) {
+        const HttpOutHeader* h = &client->out_headers[i];
+        memcpy(head + len, h->name, h->name_len);
+        len += h->name_len;
+        memcpy(head + len, ": ", 2);
+        len += 2;
+        memcpy(head + len, h->value, h->value_len);
+        len += h->value_len;
+        memcpy(head + len, "\r\n", 2);
+        len += 2;
+    }
+#define HTTP_APPEND(str, n) do { memcpy(head + len, (str), (n)); len += (n); } while (0)
+    HTTP_APPEND(default_type, strlen(default_type));
+    HTTP_APPEND(date, date_len);
+    HTTP_APPEND(framing, strlen(framing));
+    HTTP_APPEND(connection, strlen(connection));
+    HTTP_APPEND("\r\n", 2);
+#undef HTTP_APPEND
+
+    write_batch_set(batch, 0, head, len);
+    client->headers_sent = true;
+}
+
+// ------------------------- Compression ------------------------- //
+
+static void http_response_add_header(ClientContext* client, const char* name, const char* value, size_t value_len);
+
+// Value of a header the handler set, or NULL
+static const char* http_response_find_header(const ClientContext* client, const char* name, size_t* len) {
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < client->out_header_count; i++) {
+        const HttpOutHeader* h = &client->out_headers[i];
+        if (h->name_len == name_len && strncasecmp(h->name, name, name_len) == 0) {
+            *len = h->value_len;
+            return h->value;
+        }
+    }
+    return NULL;
+}
+
+// Whether the server compresses this type of response; `encoding` is what the
+// request accepts (IDENTITY for none), and the response varies on it either way
+static bool http_response_compressible(const ClientContext* client, const char* type, size_t type_len,
+                                       ContentEncoding* encoding) {
+    if (!client->server->compress || client->user_content_encoding) return false;
+    if (!content_type_compressible(type, type_len)) return false;
+
+    size_t len;
+    const char* accept = http_parser_find_header(&client->parser, "accept-encoding", &len);
+    *encoding = accept ? content_encoding_negotiate(accept, len) : CONTENT_ENCODING_IDENTITY;
+    return true;
+}
+
+// Decides, once per response and before its head is built, whether the body
+// is compressed; Content-Encoding and Vary are added to the headers
+static void http_response_choose_encoding(ClientContext* client, bool ending, size_t body_len) {
+    if (client->encoding_chosen) return;
+    client->encoding_chosen = true;
+
+    // Handler-set framing, partial content and small complete bodies go out as they are
+    if (client->user_content_length || client->chunked_response || client->status_code == 206) return;
+    if (ending && body_len < client->server->compress_threshold) return;
+
+    size_t type_len = 10;
+    const char* type = client->user_content_type
+        ? http_response_find_header(client, "content-type", &type_len) : "text/plain";
+    ContentEncoding encoding;
+    if (!type || !http_response_compressible(client, type, type_len, &encoding)) return;
+
+    http_response_add_header(client, "Vary", "Accept-Encoding", 15);
+    if (encoding == CONTENT_ENCODING_IDENTITY) return;
+    client->encoder = compressor_new(encoding, client->server->compress_level);
+    if (!client->encoder) return;
+
+    const char* name = content_encoding_name(encoding);
+    http_response_add_header(client, "Content-Encoding", name, strlen(name));
+}
+
+// Runs the body slots through the compressor; a write that does not end the
+// response is flushed so it can be framed as a chunk of its own
+static bool http_compress_body(Compressor* encoder, const WriteBatch* batch, bool ending, CompressBuffer* out) {
+    CompressFlush flush = ending ? COMPRESS_FINISH : COMPRESS_FLUSH;
+    if (batch->nbufs <= HTTP_BODY_SLOT) return compressor_write(encoder, "", 0, flush, out);
+
+    for (size_t i = HTTP_BODY_SLOT; i < batch->nbufs; i++) {
+        CompressFlush mode = i + 1 == batch->nbufs ? flush : COMPRESS_NONE;
+        if (!compressor_write(encoder, batch->bufs[i].base, batch->bufs[i].len, mode, out)) return false;
+    }
+    return true;
+}
+
+// Swaps the body slots for compressed bytes, which the batch then owns
+static void http_response_replace_body(WriteBatch* batch, CompressBuffer* out) {
+    write_batch_clear(batch, HTTP_BODY_SLOT);
+    if (out->len) {
+        char* body = write_batch_alloc(batch, out->len);
+        memcpy(body, out->data, out->len);
+        write_batch_add(batch, body, out->len);
+    }
+    free(out->data);
+    out->data = NULL;
+}
+
+static bool http_response_encode(ClientContext* client, WriteBatch* batch, bool ending) {
+    if (!ending && batch->total == 0) return true;
+
+    CompressBuffer out = { 0 };
+    bool ok = http_compress_body(client->encoder, batch, ending, &out);
+    if (ending || !ok) {
+        compressor_free(client->encoder);
+        client->encoder = NULL;
+    }
+    if (!ok) {
+        free(out.data);
+        return false;
+    }
+    http_response_replace_body(batch, &out);
+    return true;
+}
+
+static void http_compress_work(uv_work_t* req) {
+    HttpCompressJob* job = (HttpCompressJob*)req->data;
+    job->ok = http_compress_body(job->encoder, job->batch, true, &job->out);
+}
+
+static void http_response_flush(ClientContext* client, bool ending);
+
+static void on_http_compress_done(uv_work_t* req, int status) {
+    HttpCompressJob* job = (HttpCompressJob*)req->data;
+    ClientContext* client = job->client;
+    compressor_free(job->encoder);
+
+    if (!client || !job->ok) {
+        write_batch_free(job->batch);
+        free(job->out.data);
+        free(job);
+        if (client) {
+            client->compress_job = NULL;
+            http_client_close(client);
+        }
+        return;
+    }
+
+    client->compress_job = NULL;
+    client->out = job->batch;
+    http_response_replace_body(job->batch, &job->out);
+    free(job);
+
+    bool keep_alive = client->keep_alive;
+    http_response_flush(client, true);
+    http_response_finish(client, keep_alive && client->keep_alive);
+    http_client_resume(client);
+}
+
+// Large complete bodies are compressed on the threadpool. The exchange stays
+// open meanwhile, so pipelined requests keep waiting their turn.
+static bool http_response_compress_async(ClientContext* client) {
+    WriteBatch* batch = http_response_batch(client);
+    if (client->headers_sent || batch->total < HTTP_COMPRESS_ASYNC_MIN || !http_response_status_has_body(client)) {
+        return false;
+    }
+    http_response_choose_encoding(client, true, batch->total);
+    if (!client->encoder) return false;
+
+    HttpCompressJob* job = calloc(1, sizeof(HttpCompressJob));
+    job->req.data = job;
+    job->client = client;
+    job->batch = batch;
+    job->encoder = client->encoder;
+    client->encoder = NULL;
+    client->out = NULL;
+    client->compress_job = job;
+
+    // Later calls on `res` are no-ops, as after a synchronous end
+    JSObjectSetPrivate(client->res, NULL);
+    uv_queue_work(loop, &job->req, http_compress_work, on_http_compress_done);
+    return true;
+}
+
+// Sends everything collected so far as one vectored write
+static void http_response_flush(ClientContext* client, bool ending) {
+    WriteBatch* batch = http_response_batch(client);
+    bool has_body = http_response_has_body(client);
+
+    // HEAD bodies are encoded like their GET's, so Content-Length, Content-Encoding
+    // and Vary match it, and only then dropped
+    bool encodes = http_response_status_has_body(client);
+    if (encodes && !client->headers_sent) http_response_choose_encoding(client, ending, batch->total);
+    if (encodes && client->encoder && !http_response_encode(client, batch, ending)) {
+        // A broken compression stream cannot be continued, and neither can the body
+        client->out = NULL;
+        write_batch_free(batch);
+        http_client_close(client);
+        return;
+    }
+
+    size_t body_len = batch->total;
+    client->out = NULL;
+
+    if (!has_body) write_batch_clear(batch, HTTP_BODY_SLOT);
+
+    // The header block goes out in the same write as the first body bytes
+    if (!client->headers_sent) http_response_build_head(client, batch, ending, has_body, body_len);
+
+    if (has_body && client->chunked_response) {
+        if (body_len > 0) {
+            char* line = write_batch_alloc(batch, 20);
+            int n = snprintf(line, 20, "%zx\r\n", body_len);
+            write_batch_set(batch, 1, line, n);
+            write_batch_add(batch, "\r\n", 2);
+        }
+        if (ending) write_batch_add(batch, "0\r\n\r\n", 5);
+    }
+
+    batch->data = client;
+    batch->flags = ending && !client->keep_alive ? HTTP_WRITE_CLOSE_AFTER : 0;
+    http_client_write(client, batch, on_response_written);
+}
+
+// Ends the exchange once its last bytes are queued; the caller resumes or closes
+static void http_response_finish(ClientContext* client, bool keep_alive) {
+    http_client_release_exchange(client);
+    http_parser_reset(&client->parser);
+    client->continue_sent = false;
+    if (!keep_alive) client->finished = true;
+}
+
+// Sends the rest of the response and moves on to the next request
+static void http_response_end(ClientContext* client) {
+    if (http_response_compress_async(client)) return;
+
+    bool keep_alive = client->keep_alive;
+    http_response_flush(client, true);
+    http_response_finish(client, keep_alive && client->keep_alive);
+    http_client_resume(client);
+}
+
+// `res.writeHead(statusCode[, reasonPhrase][, headers])`
+static JSValueRef res_write_head(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || !client->awaiting_response || client->send_file) return thisObject;
+    if (client->headers_sent) return http_throw(ctx, exception, "Cannot write headers after they are sent");
+    if (argc < 1 || !JSValueIsNumber(ctx, args[0])) return http_throw(ctx, exception, "res.writeHead requires a status code");
+
+    int status = (int)JSValueToNumber(ctx, args[0], exception);
+    if (status < 100 || status > 999) return http_throw(ctx, exception, "Invalid status code");
+    client->status_code = status;
+
+    size_t next = 1;
+    if (argc > 1 && JSValueIsString(ctx, args[1])) {
+        const char* reason = http_response_copy_string(client, ctx, args[1], &client->reason_len, exception);
+        if (!reason) return JSValueMakeUndefined(ctx);
+        if (memchr(reason, '\r', client->reason_len) || memchr(reason, '\n', client->reason_len)) {
+            return http_throw(ctx, exception, "Invalid character in reason phrase");
+        }
+        client->reason = reason;
+        next = 2;
+    }
+
+    if (argc > next && JSValueIsObject(ctx, args[next])) {
+        JSObjectRef headers = (JSObjectRef)args[next];
+        JSPropertyNameArrayRef names = JSObjectCopyPropertyNames(ctx, headers);
+        size_t count = JSPropertyNameArrayGetCount(names);
+        for (size_t i = 0; i < count; i++) {
+            JSStringRef name = JSPropertyNameArrayGetNameAtIndex(names, i);
+            JSValueRef value = JSObjectGetProperty(ctx, headers, name, exception);
+            if (*exception) break;
+            if (!http_response_set_header(client, ctx, JSValueMakeString(ctx, name), value, true, exception)) break;
+        }
+        JSPropertyNameArrayRelease(names);
+    }
+
+    return thisObject;
+}
+
+// `res.setHeader(name, value)`
+static JSValueRef res_set_header(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || !client->awaiting_response || client->send_file) return thisObject;
+    if (client->headers_sent) return http_throw(ctx, exception, "Cannot set headers after they are sent");
+    if (argc < 2) return http_throw(ctx, exception, "res.setHeader requires a name and value");
+
+    http_response_set_header(client, ctx, args[0], args[1], true, exception);
+    return thisObject;
+}
+
+// `res.getHeader(name)`
+static JSValueRef res_get_header(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || argc < 1) return JSValueMakeUndefined(ctx);
+
+    JSStringRef nameRef = JSValueToStringCopy(ctx, args[0], exception);
+    if (!nameRef) return JSValueMakeUndefined(ctx);
+    char name[256];
+    size_t name_len = JSStringGetUTF8CString(nameRef, name, sizeof(name)) - 1;
+    JSStringRelease(nameRef);
+
+    for (size_t i = 0; i < client->out_header_count; i++) {
+        const HttpOutHeader* h = &client->out_headers[i];
+        if (h->name_len == name_len && strncasecmp(h->name, name, name_len) == 0) {
+            JSStringRef value = js_string_from_utf8(h->value, h->value_len);
+            JSValueRef result = JSValueMakeString(ctx, value);
+            JSStringRelease(value);
+            return result;
+        }
+    }
+    return JSValueMakeUndefined(ctx);
+}
+
+// `res.write(chunk)` - strings, ArrayBuffers and typed arrays
+static JSValueRef res_write(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                            size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || !client->awaiting_response || client->send_file) return JSValueMakeBoolean(ctx, false);
+
+    if (argc > 0 && !JSValueIsUndefined(ctx, args[0]) && !JSValueIsNull(ctx, args[0])) {
+        write_batch_add_value(http_response_batch(client), args[0], exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
+    }
+
+    http_response_flush(client, false);
+    return JSValueMakeBoolean(ctx, true);
+}
+
+// Response "end" method implementation
+JSValueRef res_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                   size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
+    ClientContext* clientCtx = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!clientCtx || !clientCtx->awaiting_response || clientCtx->send_file) return JSValueMakeUndefined(ctx);
+
+    if (argumentCount > 0 && !JSValueIsUndefined(ctx, arguments[0]) && !JSValueIsNull(ctx, arguments[0])) {
+        write_batch_add_value(http_response_batch(clientCtx), arguments[0], exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
+    }
+
+    http_response_end(clientCtx);
+    return JSValueMakeUndefined(ctx);
+}
+
+// `res.json(value)` - serializes `value` straight into the response as UTF-8
+// and ends it; Content-Type defaults to application/json
+static JSValueRef res_json(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                           size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_SPAN("http.json.stringify");
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || !client->awaiting_response || client->send_file) return JSValueMakeUndefined(ctx);
+
+    JSValueRef value = argc > 0 ? args[0] : JSValueMakeUndefined(ctx);
+    json_stringify_to_batch(http_response_batch(client), value, exception);
+    if (*exception) return JSValueMakeUndefined(ctx);
+
+    if (!client->headers_sent && !client->user_content_type) {
+        static const char type[] = "application/json; charset=utf-8";
+        http_response_add_header(client, "Content-Type", type, sizeof(type) - 1);
+        client->user_content_type = true;
+    }
+    return res_end(ctx, function, thisObject, 0, NULL, exception);
+}
+
+// `res.statusCode` getter/setter
+static JSValueRef res_get_status_code(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, client ? client->status_code : 200);
+}
+
+static bool res_set_status_code(JSContextRef ctx, JSObjectRef object, JSStringRef name,
+                                JSValueRef value, JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(object);
+    if (client && !client->headers_sent) {
+        int status = (int)JSValueToNumber(ctx, value, exception);
+        if (status >= 100 && status <= 999) client->status_code = status;
+    }
+    return true;
+}
+
+// ------------------------- Static files (res.sendFile) ------------------------- //
+
+#define HTTP_FILE_CACHE_BUCKETS     256
+#define HTTP_FILE_CACHE_MAX_ENTRIES 1024    // Also bounds the descriptors kept open
+#define HTTP_FILE_CACHE_TTL_MS      1000    // How long a stat result is trusted
+#define HTTP_SENDFILE_MAX_CHUNK     (1u << 30)
+#define HTTP_VARIANT_MAX_FILE       (8 * 1024 * 1024)   // Larger files are sent uncompressed
+#define HTTP_VARIANT_BEST_MAX_FILE  (1024 * 1024)       // Smaller ones get the best ratio
+#define HTTP_VARIANT_CACHE_BYTES    (32 * 1024 * 1024)  // Compressed bytes kept per loop
+
+typedef struct HttpFileVariant HttpFileVariant;
+
+// Open descriptor and validators for one path, shared by every transfer of it
+typedef struct HttpFileEntry {
+    struct HttpFileEntry* next;     // Bucket chain
+    char* path;
+    uint32_t hash;
+    uv_fs_t req;                    // Open/stat in flight
+    uv_file fd;                     // -1 when not open
+    int status;                     // 0, or the cached open/stat error
+    uint64_t checked_at;            // uv_now() of the last validation
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    uv_timespec_t mtime;
+    char etag[40];
+    char last_modified[32];
+    unsigned refs;                  // Transfers reading from `fd`
+    bool loading;
+    bool detached;                  // Replaced in the cache; freed once refs drop to 0
+    HttpSendFile* waiters;          // Transfers waiting on the load in flight
+    HttpFileVariant* variants[CONTENT_ENCODING_COUNT];  // Compressed copies, by coding
+} HttpFileEntry;
+
+// A compressed copy of a file, built once on the threadpool and then served
+// from memory. It is only valid for the size and mtime it was made from.
+struct HttpFileVariant {
+    HttpFileVariant* lru_prev;      // Cache order, most recently served first
+    HttpFileVariant* lru_next;
+    HttpFileEntry* entry;           // NULL once the entry is freed
+    ContentEncoding encoding;
+    uint64_t size;
+    uv_timespec_t mtime;
+    uv_work_t work;
+    uv_file fd;                     // The entry's descriptor, read by the build
+    int level;
+    char* data;
+    size_t len;
+    int status;                     // 0, or why the build failed
+    unsigned refs;                  // Builds and writes using `data`
+    bool ready;
+    bool cached;                    // On the LRU list
+    HttpSendFile* waiters;          // Transfers waiting on the build
+};
+
+enum {
+    HTTP_SENDFILE_WAITING,          // On the file cache or a deferred error
+    HTTP_SENDFILE_FS,               // sendfile()/read() on the threadpool
+    HTTP_SENDFILE_WRITING           // uv_write() in flight; uv_close() cancels it
+};
+
+struct HttpSendFile {
+    ClientContext* client;
+    JSContextRef ctx;
+    JSObjectRef callback;           // Optional completion callback (err)
+    HttpFileEntry* entry;
+    HttpFileVariant* variant;       // Compressed copy being written, if any
+    HttpSendFile* next;             // Waiter chain
+    uv_fs_t req;
+    uv_write_t write_req;
+    uv_buf_t chunk;                 // Pooled buffer for the copy fallback
+    uint64_t offset;
+    uint64_t end;
+    size_t requested;
+    uint64_t timer;
+    int op;
+    int error;
+    int max_age;                    // Cache-Control max-age in seconds, or -1
+    bool keep_alive;
+};
+
+static JADE_THREAD_LOCAL MemPool http_sendfile_pool = MEM_POOL_INIT("http.sendfile", HttpSendFile);
+
+static JADE_THREAD_LOCAL struct {
+    HttpFileEntry* buckets[HTTP_FILE_CACHE_BUCKETS];
+    size_t count;
+    HttpFileVariant* lru_head;
+    HttpFileVariant* lru_tail;
+    size_t variant_bytes;
+} http_file_cache;
+
+static const struct {
+    const char* ext;
+    const char* type;
+} http_mime_types[] = {
+    { "html", "text/html; charset=utf-8" },
+    { "htm", "text/html; charset=utf-8" },
+    { "css", "text/css; charset=utf-8" },
+    { "js", "text/javascript; charset=utf-8" },
+    { "mjs", "text/javascript; charset=utf-8" },
+    { "json", "application/json" },
+    { "map", "application/json" },
+    { "txt", "text/plain; charset=utf-8" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "webp", "image/webp" },
+    { "avif", "image/avif" },
+    { "ico", "image/x-icon" },
+    { "wasm", "application/wasm" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf", "font/ttf" },
+    { "pdf", "application/pdf" },
+    { "mp4", "video/mp4" },
+    { "webm", "video/webm" },
+    { "mp3", "audio/mpeg" },
+    { NULL, NULL }
+};
+
+static const char* http_mime_type(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot && !strchr(dot, '/')) {
+        for (size_t i = 0; http_mime_types[i].ext; i++) {
+            if (strcasecmp(dot + 1, http_mime_types[i].ext) == 0) return http_mime_types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+static bool http_sendfile_defers_close(const HttpSendFile* send) {
+    return send->op != HTTP_SENDFILE_WRITING;
+}
+
+static void http_file_close_fd(uv_file fd) {
+    // close() of a regular file does not block, so it is done inline
+    uv_fs_t req;
+    uv_fs_close(loop, &req, fd, NULL);
+    uv_fs_req_cleanup(&req);
+}
+
+static void http_file_variant_free(HttpFileVariant* variant) {
+    free(variant->data);
+    free(variant);
+}
+
+static void http_file_variant_unlink(HttpFileVariant* variant) {
+    if (!variant->cached) return;
+    if (variant->lru_prev) variant->lru_prev->lru_next = variant->lru_next;
+    else http_file_cache.lru_head = variant->lru_next;
+    if (variant->lru_next) variant->lru_next->lru_prev = variant->lru_prev;
+    else http_file_cache.lru_tail = variant->lru_prev;
+    variant->lru_prev = variant->lru_next = NULL;
+    variant->cached = false;
+    http_file_cache.variant_bytes -= variant->len;
+}
+
+static void http_file_variant_touch(HttpFileVariant* variant) {
+    http_file_variant_unlink(variant);
+    variant->lru_next = http_file_cache.lru_head;
+    if (http_file_cache.lru_head) http_file_cache.lru_head->lru_prev = variant;
+    else http_file_cache.lru_tail = variant;
+    http_file_cache.lru_head = variant;
+    variant->cached = true;
+    http_file_cache.variant_bytes += variant->len;
+}
+
+// Takes a variant out of its entry; one still being written is freed by its last write
+static void http_file_variant_drop(HttpFileVariant* variant) {
+    http_file_variant_unlink(variant);
+    if (variant->entry) variant->entry->variants[variant->encoding] = NULL;
+    variant->entry = NULL;
+    if (variant->refs == 0) http_file_variant_free(variant);
+}
+
+static void http_file_variant_release(HttpFileVariant* variant) {
+    variant->refs--;
+    if (!variant->entry && variant->refs == 0) http_file_variant_free(variant);
+}
+
+// Drops least recently served variants until the cache fits its budget
+static void http_file_variant_evict(void) {
+    HttpFileVariant* variant = http_file_cache.lru_tail;
+    while (variant && http_file_cache.variant_bytes > HTTP_VARIANT_CACHE_BYTES) {
+        HttpFileVariant* prev = variant->lru_prev;
+        if (variant->refs == 0) http_file_variant_drop(variant);
+        variant = prev;
+    }
+}
+
+static void http_file_entry_free(HttpFileEntry* entry) {
+    for (int i = 0; i < CONTENT_ENCODING_COUNT; i++) {
+        if (entry->variants[i]) http_file_variant_drop(entry->variants[i]);
+    }
+    if (entry->fd >= 0) http_file_close_fd(entry->fd);
+    free(entry->path);
+    free(entry);
+}
+
+static void http_file_cache_unlink(HttpFileEntry* entry) {
+    HttpFileEntry** link = &http_file_cache.buckets[entry->hash % HTTP_FILE_CACHE_BUCKETS];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    http_file_cache.count--;
+}
+
+static void http_file_entry_release(HttpFileEntry* entry) {
+    entry->refs--;
+    if (entry->detached && entry->refs == 0) http_file_entry_free(entry);
+}
+
+// Makes room for one entry by dropping the least recently validated idle one
+static void http_file_cache_evict(void) {
+    HttpFileEntry* victim = NULL;
+    for (int b = 0; b < HTTP_FILE_CACHE_BUCKETS; b++) {
+        for (HttpFileEntry* entry = http_file_cache.buckets[b]; entry; entry = entry->next) {
+            if (entry->refs == 0 && !entry->loading &&
+                (!victim || entry->checked_at < victim->checked_at)) victim = entry;
+        }
+    }
+    if (victim) {
+        http_file_cache_unlink(victim);
+        http_file_entry_free(victim);
+    }
+}
+
+static HttpFileEntry* http_file_cache_insert(const char* path, uint32_t hash) {
+    if (http_file_cache.count >= HTTP_FILE_CACHE_MAX_ENTRIES) http_file_cache_evict();
+    HttpFileEntry* entry = calloc(1, sizeof(HttpFileEntry));
+    entry->path = strdup(path);
+    entry->hash = hash;
+    entry->fd = -1;
+    entry->next = http_file_cache.buckets[hash % HTTP_FILE_CACHE_BUCKETS];
+    http_file_cache.buckets[hash % HTTP_FILE_CACHE_BUCKETS] = entry;
+    http_file_cache.count++;
+    return entry;
+}
+
+static void http_sendfile_respond(HttpSendFile* send);
+
+static void http_file_entry_loaded(HttpFileEntry* entry, int status) {
+    entry->status = status;
+    entry->checked_at = uv_now(loop);
+    entry->loading = false;
+
+    HttpSendFile* send = entry->waiters;
+    entry->waiters = NULL;
+    while (send) {
+        HttpSendFile* next = send->next;
+        send->next = NULL;
+        http_sendfile_respond(send);
+        send = next;
+    }
+}
+
+static void on_file_entry_stat(uv_fs_t* req) {
+    HttpFileEntry* entry = (HttpFileEntry*)req->data;
+    int result = (int)req->result;
+    uv_stat_t st = req->statbuf;
+    uv_fs_req_cleanup(req);
+
+    if (result == 0 && !S_ISREG(st.st_mode)) result = S_ISDIR(st.st_mode) ? UV_EISDIR : UV_EINVAL;
+    if (result < 0) {
+        http_file_close_fd(entry->fd);
+        entry->fd = -1;
+        http_file_entry_loaded(entry, result);
+        return;
+    }
+
+    entry->size = st.st_size;
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->mtime = st.st_mtim;
+
+    // Size and mtime only, so every worker and replica derives the same tag
+    uint64_t mtime_ms = (uint64_t)st.st_mtim.tv_sec * 1000 + (uint64_t)st.st_mtim.tv_nsec / 1000000;
+    snprintf(entry->etag, sizeof(entry->etag), "\"%" PRIx64 "-%" PRIx64 "\"", entry->size, mtime_ms);
+
+    time_t mtime = (time_t)st.st_mtim.tv_sec;
+    struct tm tm_utc;
+    gmtime_r(&mtime, &tm_utc);
+    strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+
+    http_file_entry_loaded(entry, 0);
+}
+
+static void on_file_entry_opened(uv_fs_t* req) {
+    HttpFileEntry* entry = (HttpFileEntry*)req->data;
+    int result = (int)req->result;
+    uv_fs_req_cleanup(req);
+
+    if (result < 0) {
+        http_file_entry_loaded(entry, result);
+        return;
+    }
+    entry->fd = result;
+    uv_fs_fstat(loop, &entry->req, entry->fd, on_file_entry_stat);
+}
+
+static void http_file_entry_open(HttpFileEntry* entry) {
+    entry->req.data = entry;
+    int result = uv_fs_open(loop, &entry->req, entry->path, O_RDONLY, 0, on_file_entry_opened);
+    if (result < 0) http_file_entry_loaded(entry, result);
+}
+
+// Revalidation: a cached descriptor is kept only while the path still names the same file
+static void on_file_entry_restat(uv_fs_t* req) {
+    HttpFileEntry* entry = (HttpFileEntry*)req->data;
+    int result = (int)req->result;
+    uv_stat_t st = req->statbuf;
+    uv_fs_req_cleanup(req);
+
+    if (result == 0 && st.st_dev == entry->dev && st.st_ino == entry->ino && st.st_size == entry->size &&
+        st.st_mtim.tv_sec == entry->mtime.tv_sec && st.st_mtim.tv_nsec == entry->mtime.tv_nsec) {
+        http_file_entry_loaded(entry, 0);
+        return;
+    }
+
+    if (entry->refs > 0) {
+        // Transfers in progress keep reading the old file; new ones get a fresh entry
+        HttpFileEntry* fresh = http_file_cache_insert(entry->path, entry->hash);
+        http_file_cache_unlink(entry);
+        entry->detached = true;
+        entry->loading = false;
+        fresh->loading = true;
+        fresh->waiters = entry->waiters;
+        entry->waiters = NULL;
+        for (HttpSendFile* send = fresh->waiters; send; send = send->next) send->entry = fresh;
+        entry = fresh;
+    } else {
+        http_file_close_fd(entry->fd);
+        entry->fd = -1;
+    }
+    http_file_entry_open(entry);
+}
+
+static void http_file_entry_load(HttpFileEntry* entry) {
+    entry->loading = true;
+    entry->req.data = entry;
+    if (entry->fd < 0) {
+        http_file_entry_open(entry);
+        return;
+    }
+    int result = uv_fs_stat(loop, &entry->req, entry->path, on_file_entry_restat);
+    if (result < 0) http_file_entry_loaded(entry, result);
+}
+
+// Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT")
+static bool http_parse_date(const char* value, size_t len, time_t* out) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char buf[40], month[4];
+    struct tm tm = { 0 };
+
+    if (len >= sizeof(buf)) return false;
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+    if (sscanf(buf, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &tm.tm_mday, month, &tm.tm_year,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) return false;
+
+    const char* found = strstr(months, month);
+    if (!found || (found - months) % 3 != 0) return false;
+    tm.tm_mon = (int)(found - months) / 3;
+    tm.tm_year -= 1900;
+    *out = timegm(&tm);
+    return true;
+}
+
+// If-None-Match: "*" or a list of tags, compared weakly
+static bool http_etag_list_matches(const char* list, size_t len, const char* etag) {
+    size_t etag_len = strlen(etag);
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (list[i] == ' ' || list[i] == '\t' || list[i] == ',')) i++;
+        size_t start = i;
+        while (i < len && list[i] != ',') i++;
+        size_t end = i;
+        while (end > start && (list[end - 1] == ' ' || list[end - 1] == '\t')) end--;
+
+        if (end - start == 1 && list[start] == '*') return true;
+        if (end - start > 2 && list[start] == 'W' && list[start + 1] == '/') start += 2;
+        if (end - start == etag_len && memcmp(list + start, etag, etag_len) == 0) return true;
+    }
+    return false;
+}
+
+static bool http_request_is(const HttpParser* p, const char* method) {
+    size_t len = strlen(method);
+    return p->method_len == len && memcmp(p->head + p->method_off, method, len) == 0;
+}
+
+static bool http_sendfile_not_modified(const HttpParser* p, const HttpFileEntry* entry, const char* etag) {
+    size_t len;
+    const char* value = http_parser_find_header(p, "if-none-match", &len);
+    if (value) return http_etag_list_matches(value, len, etag);
+
+    time_t since;
+    value = http_parser_find_header(p, "if-modified-since", &len);
+    return value && http_parse_date(value, len, &since) && (time_t)entry->mtime.tv_sec <= since;
+}
+
+// If-Range needs a strong match on the tag, or the exact Last-Modified date
+static bool http_sendfile_range_applies(const HttpParser* p, const HttpFileEntry* entry) {
+    size_t len;
+    const char* value = http_parser_find_header(p, "if-range", &len);
+    if (!value) return true;
+    if (len > 0 && value[0] == '"') return len == strlen(entry->etag) && memcmp(value, entry->etag, len) == 0;
+    return len == strlen(entry->last_modified) && memcmp(value, entry->last_modified, len) == 0;
+}
 
-// Write callback for uv_write
-void on_write_complete(uv_write_t* req, int status) {
-    free(req->data); // Free the buffer data
-    free(req);       // Free the write request
+static bool http_parse_offset(const char** cursor, const char* end, uint64_t* out) {
+    const char* s = *cursor;
+    uint64_t value = 0;
+    if (s == end || !isdigit((unsigned char)*s)) return false;
+    while (s < end && isdigit((unsigned char)*s)) {
+        if (value > (UINT64_MAX - 9) / 10) return false;
+        value = value * 10 + (uint64_t)(*s++ - '0');
+    }
+    *cursor = s;
+    *out = value;
+    return true;
 }
 
-// Allocate Buffer
-void on_http_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
-    buf->base = (char*)malloc(suggested_size);
-    buf->len = suggested_size;
+// Single "bytes=" ranges only; returns 1 for a usable range, -1 when it is
+// unsatisfiable and 0 when the header should be ignored (multiple or malformed ranges)
+static int http_parse_range(const char* value, size_t len, uint64_t size, uint64_t* start, uint64_t* end) {
+    const char* s = value;
+    const char* stop = value + len;
+    while (stop > s && (stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+
+    if (len < 6 || strncasecmp(s, "bytes=", 6) != 0) return 0;
+    s += 6;
+    if (memchr(s, ',', stop - s)) return 0;
+
+    uint64_t first, last;
+    if (s < stop && *s == '-') {
+        s++;
+        if (!http_parse_offset(&s, stop, &last) || s != stop) return 0;
+        if (last == 0 || size == 0) return -1;
+        *start = last < size ? size - last : 0;
+        *end = size;
+        return 1;
+    }
+
+    if (!http_parse_offset(&s, stop, &first) || s == stop || *s++ != '-') return 0;
+    last = UINT64_MAX;
+    if (s != stop && (!http_parse_offset(&s, stop, &last) || s != stop)) return 0;
+    if (last < first) return 0;
+    if (first >= size) return -1;
+
+    *start = first;
+    *end = last < size ? last + 1 : size;
+    return 1;
 }
 
-// Read Callback
-void on_http_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
-    HttpRequest* req = (HttpRequest*)stream->data;
+// Adds a header whose value the transfer formatted itself
+static void http_response_add_header(ClientContext* client, const char* name, const char* value, size_t value_len) {
+    char* copy = write_batch_alloc(http_response_batch(client), value_len);
+    memcpy(copy, value, value_len);
 
-    if (nread > 0) {
-        // Append to response data
-        req->response_data = realloc(req->response_data, req->response_size + nread + 1);
-        memcpy(req->response_data + req->response_size, buf->base, nread);
-        req->response_size += nread;
-        req->response_data[req->response_size] = '\0';
-
-        // Parse response if headers haven't been parsed yet
-        if (!req->headers_parsed) {
-            char* header_end = strstr(req->response_data, "\r\n\r\n");
-            if (header_end) {
-                // Calculate header length
-                size_t header_len = header_end - req->response_data;
-                
-                // Store headers
-                req->response_headers = malloc(header_len + 1);
-                memcpy(req->response_headers, req->response_data, header_len);
-                req->response_headers[header_len] = '\0';
-                req->headers_size = header_len;
-                req->headers_len = header_len;
-
-                // Parse status code
-                char* status_line = strtok(req->response_headers, "\r\n");
-                if (status_line) {
-                    sscanf(status_line, "HTTP/1.1 %d", &req->status_code);
-                }
+    if (client->out_header_count == client->out_header_cap) {
+        client->out_header_cap = client->out_header_cap ? client->out_header_cap * 2 : 8;
+        client->out_headers = realloc(client->out_headers, client->out_header_cap * sizeof(HttpOutHeader));
+    }
+    HttpOutHeader* h = &client->out_headers[client->out_header_count++];
+    h->name = name;
+    h->name_len = strlen(name);
+    h->value = copy;
+    h->value_len = value_len;
+}
 
-                // Store body
-                size_t body_start = header_len + 4; // Skip \r\n\r\n
-                size_t body_len = req->response_size - body_start;
-                if (body_len > 0) {  // Only allocate if there's a body
-                    req->response_body = malloc(body_len + 1);
-                    memcpy(req->response_body, req->response_data + body_start, body_len);
-                    req->response_body[body_len] = '\0';
-                    req->body_size = body_len;
-                    req->body_len = body_len;
-                } else {
-                    req->response_body = strdup("{}");  // Empty JSON object for empty body
-                    req->body_size = 2;
-                    req->body_len = 2;
-                }
+// ------------------------- Compressed copies ------------------------- //
 
-                req->headers_parsed = true;
-            }
+static void http_file_variant_build(uv_work_t* req) {
+    HttpFileVariant* variant = (HttpFileVariant*)req->data;
+    size_t size = (size_t)variant->size;
+    char* raw = malloc(size ? size : 1);
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(variant->fd, raw + got, size - got, (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            variant->status = n < 0 ? uv_translate_sys_error(errno) : UV_EOF;
+            break;
         }
-    } else {
-        // Create response object
-        JSObjectRef responseObj = JSObjectMake(req->ctx, NULL, NULL);
-        
-        // Add status code
-        JSStringRef statusName = JSStringCreateWithUTF8CString("statusCode");
-        JSObjectSetProperty(req->ctx, responseObj, statusName, 
-                           JSValueMakeNumber(req->ctx, req->status_code), 
-                           kJSPropertyAttributeNone, NULL);
-        JSStringRelease(statusName);
-
-        // Add headers
-        JSObjectRef headersObj = JSObjectMake(req->ctx, NULL, NULL);
-        if (req->response_headers) {
-            char* header_line = strtok(req->response_headers, "\r\n");
-            while (header_line) {
-                char* colon = strchr(header_line, ':');
-                if (colon) {
-                    *colon = '\0';
-                    char* value = colon + 1;
-                    while (*value == ' ') value++; // Skip leading spaces
-
-                    JSStringRef headerName = JSStringCreateWithUTF8CString(header_line);
-                    JSStringRef headerValue = JSStringCreateWithUTF8CString(value);
-                    JSObjectSetProperty(req->ctx, headersObj, headerName,
-                                      JSValueMakeString(req->ctx, headerValue),
-                                      kJSPropertyAttributeNone, NULL);
-                    JSStringRelease(headerName);
-                    JSStringRelease(headerValue);
-                }
-                header_line = strtok(NULL, "\r\n");
-            }
+        got += (size_t)n;
+    }
+
+    if (variant->status == 0) {
+        Compressor* compressor = compressor_new(variant->encoding, variant->level);
+        CompressBuffer out = { 0 };
+        if (compressor && compressor_write(compressor, raw, size, COMPRESS_FINISH, &out)) {
+            // Cached for a while, so give back what the growth left over
+            variant->data = realloc(out.data, out.len + 1);
+            variant->len = out.len;
+        } else {
+            free(out.data);
+            variant->status = UV_ENOMEM;
         }
-        JSStringRef headersName = JSStringCreateWithUTF8CString("headers");
-        JSObjectSetProperty(req->ctx, responseObj, headersName,
-                           JSValueToObject(req->ctx, headersObj, NULL),
-                           kJSPropertyAttributeNone, NULL);
-        JSStringRelease(headersName);
+        compressor_free(compressor);
+    }
+    free(raw);
+}
+
+static void on_file_variant_built(uv_work_t* req, int status) {
+    HttpFileVariant* variant = (HttpFileVariant*)req->data;
+    HttpFileEntry* entry = variant->entry;
+    variant->ready = true;
+    if (status < 0 && variant->status == 0) variant->status = status;
+    if (variant->status == 0) {
+        http_file_variant_touch(variant);
+        http_file_variant_evict();
+    }
 
-        // Add body
-        JSStringRef bodyName = JSStringCreateWithUTF8CString("body");
-        JSStringRef bodyValue = JSStringCreateWithUTF8CString(req->response_body ? req->response_body : "{}");
-        JSObjectSetProperty(req->ctx, responseObj, bodyName,
-                           JSValueMakeString(req->ctx, bodyValue),
-                           kJSPropertyAttributeNone, NULL);
-        JSStringRelease(bodyName);
-        JSStringRelease(bodyValue);
+    HttpSendFile* send = variant->waiters;
+    variant->waiters = NULL;
+    while (send) {
+        HttpSendFile* next = send->next;
+        send->next = NULL;
+        http_sendfile_respond(send);
+        send = next;
+    }
 
-        // Call the JS callback with response
-        JSValueRef args[] = { JSValueMakeNull(req->ctx), JSValueToObject(req->ctx, responseObj, NULL) };
-        JSObjectCallAsFunction(req->ctx, req->callback, NULL, 2, args, NULL);
+    // A failed copy is not kept, so the next request for the file tries again
+    if (variant->status < 0 && variant->entry) http_file_variant_drop(variant);
+    http_file_variant_release(variant);
+    http_file_entry_release(entry);
+}
 
-        // Cleanup
-        uv_close((uv_handle_t*)&req->socket, NULL);
-        free(req->host);
-        free(req->path);
-        free(req->response_data);
-        free(req->response_headers);
-        free(req->response_body);
-        free(req);
+// The entry's copy in `encoding`, whose build is started if there is none;
+// NULL if the build cannot be started. The build holds a reference on the
+// entry, so its descriptor stays open.
+static HttpFileVariant* http_file_variant_get(HttpFileEntry* entry, ContentEncoding encoding, int level) {
+    HttpFileVariant* variant = entry->variants[encoding];
+    if (variant && variant->ready &&
+        (variant->size != entry->size || variant->mtime.tv_sec != entry->mtime.tv_sec ||
+         variant->mtime.tv_nsec != entry->mtime.tv_nsec)) {
+        // The path was revalidated onto a changed file
+        http_file_variant_drop(variant);
+        variant = NULL;
     }
+    if (variant) return variant;
 
-    free(buf->base);
+    variant = calloc(1, sizeof(HttpFileVariant));
+    if (!variant) return NULL;
+    variant->entry = entry;
+    variant->encoding = encoding;
+    variant->size = entry->size;
+    variant->mtime = entry->mtime;
+    variant->fd = entry->fd;
+    variant->level = level;
+    variant->refs = 1;
+    variant->work.data = variant;
+    if (uv_queue_work(loop, &variant->work, http_file_variant_build, on_file_variant_built) < 0) {
+        free(variant);
+        return NULL;
+    }
+    entry->variants[encoding] = variant;
+    entry->refs++;
+    return variant;
 }
 
-// Helper function to check if data is JSON
-static bool is_json_data(const char* data) {
-    if (!data) return false;
-    // Simple check: starts with { and ends with }
-    return data[0] == '{' && data[strlen(data) - 1] == '}';
+// The coding the file is sent in: IDENTITY also where compression does not
+// apply. `vary` is set when the answer depends on Accept-Encoding at all.
+static ContentEncoding http_sendfile_encoding(const HttpSendFile* send, const char* type, size_t type_len,
+                                              bool* vary) {
+    const ClientContext* client = send->client;
+    const HttpParser* p = &client->parser;
+    ContentEncoding encoding = CONTENT_ENCODING_IDENTITY;
+    size_t len;
+
+    *vary = http_response_compressible(client, type, type_len, &encoding);
+    if (!*vary) return CONTENT_ENCODING_IDENTITY;
+
+    // Ranges and handler-set statuses are served from the file itself
+    uint64_t size = send->entry->size;
+    if (client->status_code != 200 || !(http_request_is(p, "GET") || http_request_is(p, "HEAD")) ||
+        http_parser_find_header(p, "range", &len) ||
+        size < client->server->compress_threshold || size > HTTP_VARIANT_MAX_FILE) {
+        return CONTENT_ENCODING_IDENTITY;
+    }
+    return encoding;
 }
 
-// Modify the connect callback to handle different content types
-void on_http_connect(uv_connect_t* req, int status) {
-    if (status < 0) return;
-
-    HttpRequest* http = (HttpRequest*)req->data;
-    char request[1024];
-    
-    // Check the HTTP method
-    if (http->method && strcmp(http->method, "DELETE") == 0) {
-        snprintf(request, sizeof(request),
-            "DELETE %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Connection: close\r\n\r\n",
-            http->path, http->host);
-    } else if (http->method && strcmp(http->method, "PUT") == 0) {
-        const char* content_type = is_json_data(http->request_data) ? 
-            "application/json" : "application/x-www-form-urlencoded";
-            
-        snprintf(request, sizeof(request),
-            "PUT %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: %s\r\n"
-            "Content-Length: %zu\r\n"
-            "Connection: close\r\n\r\n"
-            "%s",
-            http->path, http->host, content_type, http->request_data_len, http->request_data);
-    } else if (http->request_data) {
-        const char* content_type = is_json_data(http->request_data) ? 
-            "application/json" : "application/x-www-form-urlencoded";
-            
-        snprintf(request, sizeof(request),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: %s\r\n"
-            "Content-Length: %zu\r\n"
-            "Connection: close\r\n\r\n"
-            "%s",
-            http->path, http->host, content_type, http->request_data_len, http->request_data);
-    } else {
-        snprintf(request, sizeof(request),
-            "GET %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Connection: close\r\n\r\n",
-            http->path, http->host);
+// Compressed copies get a tag of their own, `"size-mtime-br"`
+static void http_sendfile_etag(const HttpFileEntry* entry, ContentEncoding encoding, char* out, size_t size) {
+    if (encoding == CONTENT_ENCODING_IDENTITY) {
+        snprintf(out, size, "%s", entry->etag);
+        return;
+    }
+    int len = (int)strlen(entry->etag) - 1;
+    snprintf(out, size, "%.*s-%s\"", len, entry->etag, content_encoding_name(encoding));
+}
+
+// Detaches the transfer and reports how it ended
+static void http_sendfile_free(HttpSendFile* send, int status) {
+    ClientContext* client = send->client;
+    JSContextRef ctx = send->ctx;
+
+    client->send_file = NULL;
+    if (client->close_deferred) {
+        client->close_deferred = false;
+        uv_close((uv_handle_t*)&client->handle, on_client_context_closed);
     }
 
-    uv_buf_t write_buf = uv_buf_init(strdup(request), strlen(request));
-    uv_write_t* write_req = malloc(sizeof(uv_write_t));
-    write_req->data = write_buf.base;
-    uv_write(write_req, req->handle, &write_buf, 1, on_write_complete);
-    uv_read_start(req->handle, on_http_alloc, on_http_read);
+    if (send->callback) {
+        JSValueRef err = JSValueMakeNull(ctx);
+        if (status < 0) {
+            JSStringRef msg = JSStringCreateWithUTF8CString(uv_strerror(status));
+            err = JSValueMakeString(ctx, msg);
+            JSStringRelease(msg);
+        }
+
+        JSValueRef exception = NULL;
+        JSObjectCallAsFunction(ctx, send->callback, NULL, 1, &err, &exception);
+        JSValueUnprotect(ctx, send->callback);
+        if (exception) {
+            JSStringRef msg = JSValueToStringCopy(ctx, exception, NULL);
+            char buf[512] = "";
+            if (msg) {
+                JSStringGetUTF8CString(msg, buf, sizeof(buf));
+                JSStringRelease(msg);
+            }
+            fprintf(stderr, "ERROR: Uncaught exception in res.sendFile callback: %s\n", buf);
+        }
+    }
+    pool_free(&http_sendfile_pool, send);
 }
 
-// DNS Resolution Callback
-void on_dns_resolved(uv_getaddrinfo_t* resolver, int status, struct addrinfo* res) {
-    HttpRequest* http = (HttpRequest*)resolver->data;
-    free(resolver);
+// The file could not be served and nothing has been written yet
+static void http_sendfile_fail(HttpSendFile* send, int error) {
+    ClientContext* client = send->client;
 
-    if (status < 0) {
+    // With a callback the response stays open for it to answer
+    if (client->closing || send->callback) {
+        http_sendfile_free(send, client->closing ? UV_ECANCELED : error);
         return;
     }
 
-    uv_tcp_init(uv_default_loop(), &http->socket);
-    http->socket.data = http;
+    client->send_file = NULL;
+    int status = 500;
+    if (error == UV_ENOENT || error == UV_ENOTDIR || error == UV_EISDIR || error == UV_ENAMETOOLONG) status = 404;
+    else if (error == UV_EACCES || error == UV_EPERM) status = 403;
 
-    uv_connect_t* connect_req = malloc(sizeof(uv_connect_t));
-    connect_req->data = http;
-    uv_tcp_connect(connect_req, &http->socket, (const struct sockaddr*)res->ai_addr, on_http_connect);
-    uv_freeaddrinfo(res);
+    const char* text = http_status_text(status);
+    client->status_code = status;
+    client->reason = NULL;
+    write_batch_add(http_response_batch(client), text, strlen(text));
+
+    bool keep_alive = client->keep_alive;
+    http_response_flush(client, true);
+    http_response_finish(client, keep_alive && client->keep_alive);
+    http_sendfile_free(send, 0);
+    http_client_resume(client);
 }
 
-// `http.get(url, callback)`
-JSValueRef http_get(JSContextRef ctx, JSObjectRef function,
-                    JSObjectRef thisObject, size_t argc,
-                    const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 2) return JSValueMakeUndefined(ctx);
+// Ends a transfer whose headers are already on the wire
+static void http_sendfile_done(HttpSendFile* send, int status) {
+    ClientContext* client = send->client;
+    if (send->variant) {
+        http_file_variant_release(send->variant);
+        send->variant = NULL;
+    }
+    http_file_entry_release(send->entry);
+    send->entry = NULL;
 
-    // Parse URL
-    JSStringRef urlRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t urlLen = JSStringGetMaximumUTF8CStringSize(urlRef);
-    char* url = malloc(urlLen);
-    JSStringGetUTF8CString(urlRef, url, urlLen);
-    JSStringRelease(urlRef);
+    if (client->closing) {
+        http_sendfile_free(send, status < 0 ? status : UV_ECANCELED);
+    } else if (status < 0) {
+        // The body is cut short, so the connection cannot be reused
+        http_client_close(client);
+        http_sendfile_free(send, status);
+    } else {
+        bool keep_alive = send->keep_alive;
+        http_response_finish(client, keep_alive);
+        http_sendfile_free(send, 0);
+        if (keep_alive) http_client_resume(client);
+        else http_client_close(client);
+    }
+}
 
-    // Ensure HTTP scheme
-    if (strncmp(url, "http://", 7) != 0) {
-        free(url);
-        return JSValueMakeUndefined(ctx);
+static void http_sendfile_next(HttpSendFile* send);
+
+static void http_sendfile_chunk_written(HttpSendFile* send, int status) {
+    send->op = HTTP_SENDFILE_WAITING;
+    read_buffer_release(&send->chunk);
+
+    if (status < 0) {
+        http_sendfile_done(send, status);
+        return;
     }
+    send->offset += send->requested;
+    runtime_counters.http_server.bytes_written += send->requested;
+    http_sendfile_next(send);
+}
 
-    // Parse host and path
-    char* host_start = url + 7;
-    char* path_start = strchr(host_start, '/');
-    char* host = path_start ? strndup(host_start, path_start - host_start) : strdup(host_start);
-    char* path = path_start ? strdup(path_start) : strdup("/");
+static void on_sendfile_chunk_written(uv_write_t* req, int status) {
+    http_sendfile_chunk_written((HttpSendFile*)req->data, status);
+}
 
-    // Setup HTTP request
-    HttpRequest* http = malloc(sizeof(HttpRequest));
-    http->ctx = ctx;
-    http->callback = (JSObjectRef)args[1];
-    http->host = host;
-    http->path = path;
-    http->response_data = NULL;
-    http->response_size = 0;
-    http->response_len = 0;
-    http->status_code = 0;
-    http->response_headers = NULL;
-    http->headers_size = 0;
-    http->headers_len = 0;
-    http->headers_parsed = false;
-    http->response_body = NULL;
-    http->body_size = 0;
-    http->body_len = 0;
-    http->request_data = NULL;
-    http->request_data_len = 0;
-    http->method = NULL;  // Set the HTTP method to NULL
-
-    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
-    uv_getaddrinfo_t* resolver = malloc(sizeof(uv_getaddrinfo_t));
-    resolver->data = http;
-    uv_getaddrinfo(uv_default_loop(), resolver, on_dns_resolved, http->host, "80", &hints);
-
-    free(url);
-    return JSValueMakeUndefined(ctx);
+static void on_sendfile_tls_chunk_written(WriteBatch* batch, int status) {
+    http_sendfile_chunk_written((HttpSendFile*)batch->data, status);
 }
 
-// `http.post(url, data, callback)`
-JSValueRef http_post(JSContextRef ctx, JSObjectRef function,
-                    JSObjectRef thisObject, size_t argc,
-                    const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 3) {
-        JSStringRef msg = JSStringCreateWithUTF8CString("http.post requires 3 arguments: url, data, and callback");
-        *exception = JSValueMakeString(ctx, msg);
-        JSStringRelease(msg);
-        return JSValueMakeUndefined(ctx);
+static void on_sendfile_chunk_read(uv_fs_t* req) {
+    HttpSendFile* send = (HttpSendFile*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    send->op = HTTP_SENDFILE_WAITING;
+
+    if (send->client->closing || result <= 0) {
+        read_buffer_release(&send->chunk);
+        http_sendfile_done(send, send->client->closing ? UV_ECANCELED : result < 0 ? (int)result : UV_EOF);
+        return;
     }
 
-    // Parse URL
-    JSStringRef urlRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t urlLen = JSStringGetMaximumUTF8CStringSize(urlRef);
-    char* url = malloc(urlLen);
-    JSStringGetUTF8CString(urlRef, url, urlLen);
-    JSStringRelease(urlRef);
+    uv_buf_t buf = uv_buf_init(send->chunk.base, (unsigned int)result);
+    send->requested = (size_t)result;
+    send->op = HTTP_SENDFILE_WRITING;
 
-    // Ensure HTTP scheme
-    if (strncmp(url, "http://", 7) != 0) {
-        free(url);
-        return JSValueMakeUndefined(ctx);
+    // The session encrypts a copy; the chunk itself is released once that is written
+    ClientContext* client = send->client;
+    if (client->tls) {
+        WriteBatch* batch = write_batch_new(send->ctx);
+        write_batch_add(batch, buf.base, buf.len);
+        batch->data = send;
+        tls_session_write(client->tls, batch, on_sendfile_tls_chunk_written);
+        return;
     }
 
-    // Parse host and path
-    char* host_start = url + 7;
-    char* path_start = strchr(host_start, '/');
-    char* host = path_start ? strndup(host_start, path_start - host_start) : strdup(host_start);
-    char* path = path_start ? strdup(path_start) : strdup("/");
+    send->write_req.data = send;
+    int r = uv_write(&send->write_req, (uv_stream_t*)&send->client->handle, &buf, 1, on_sendfile_chunk_written);
+    if (r < 0) {
+        send->op = HTTP_SENDFILE_WAITING;
+        read_buffer_release(&send->chunk);
+        http_sendfile_done(send, r);
+    }
+}
 
-    // Parse data
-    JSStringRef dataRef = JSValueToStringCopy(ctx, args[1], exception);
-    size_t dataLen = JSStringGetMaximumUTF8CStringSize(dataRef);
-    char* data = malloc(dataLen);
-    JSStringGetUTF8CString(dataRef, data, dataLen);
-    JSStringRelease(dataRef);
+// The socket is full: copy one buffer through uv_write(), whose completion
+// says when the socket drained, then go back to sendfile(). TLS connections
+// send every buffer this way, through the session
+static void http_sendfile_copy(HttpSendFile* send) {
+    read_buffer_alloc((uv_handle_t*)&send->client->handle, READ_BUFFER_SIZE, &send->chunk);
+    if (!send->chunk.base) {
+        http_sendfile_done(send, UV_ENOBUFS);
+        return;
+    }
 
-    // Setup HTTP request
-    HttpRequest* http = malloc(sizeof(HttpRequest));
-    http->ctx = ctx;
-    http->callback = (JSObjectRef)args[2];
-    http->host = host;
-    http->path = path;
-    http->response_data = NULL;
-    http->response_size = 0;
-    http->response_len = 0;
-    http->status_code = 0;
-    http->response_headers = NULL;
-    http->headers_size = 0;
-    http->headers_len = 0;
-    http->headers_parsed = false;
-    http->response_body = NULL;
-    http->body_size = 0;
-    http->body_len = 0;
-    http->request_data = data;
-    http->request_data_len = strlen(data);
-    http->method = "POST";  // Set the HTTP method
-
-    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
-    uv_getaddrinfo_t* resolver = malloc(sizeof(uv_getaddrinfo_t));
-    resolver->data = http;
-    uv_getaddrinfo(uv_default_loop(), resolver, on_dns_resolved, http->host, "80", &hints);
-
-    free(url);
-    return JSValueMakeUndefined(ctx);
+    uint64_t left = send->end - send->offset;
+    uv_buf_t buf = uv_buf_init(send->chunk.base, left < READ_BUFFER_SIZE ? (unsigned int)left : READ_BUFFER_SIZE);
+    send->req.data = send;
+    send->op = HTTP_SENDFILE_FS;
+    int result = uv_fs_read(loop, &send->req, send->entry->fd, &buf, 1, (int64_t)send->offset, on_sendfile_chunk_read);
+    if (result < 0) {
+        send->op = HTTP_SENDFILE_WAITING;
+        read_buffer_release(&send->chunk);
+        http_sendfile_done(send, result);
+    }
 }
 
-// `http.put(url, data, callback)`
-JSValueRef http_put(JSContextRef ctx, JSObjectRef function,
-                   JSObjectRef thisObject, size_t argc,
-                   const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 3) {
-        JSStringRef msg = JSStringCreateWithUTF8CString("http.put requires 3 arguments: url, data, and callback");
-        *exception = JSValueMakeString(ctx, msg);
-        JSStringRelease(msg);
-        return JSValueMakeUndefined(ctx);
+static void on_sendfile_sent(uv_fs_t* req) {
+    HttpSendFile* send = (HttpSendFile*)req->data;
+    ssize_t result = req->result;
+    uv_fs_req_cleanup(req);
+    send->op = HTTP_SENDFILE_WAITING;
+
+    if (send->client->closing) {
+        http_sendfile_done(send, UV_ECANCELED);
+    } else if (result > 0) {
+        send->offset += (uint64_t)result;
+        runtime_counters.http_server.bytes_written += (uint64_t)result;
+        if ((size_t)result < send->requested && send->offset < send->end) http_sendfile_copy(send);
+        else http_sendfile_next(send);
+    } else if (result == UV_EAGAIN) {
+        http_sendfile_copy(send);
+    } else {
+        // Zero bytes means the file shrank under us
+        http_sendfile_done(send, result < 0 ? (int)result : UV_EOF);
     }
+}
 
-    // Parse URL
-    JSStringRef urlRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t urlLen = JSStringGetMaximumUTF8CStringSize(urlRef);
-    char* url = malloc(urlLen);
-    JSStringGetUTF8CString(urlRef, url, urlLen);
-    JSStringRelease(urlRef);
+static void http_sendfile_next(HttpSendFile* send) {
+    ClientContext* client = send->client;
+    if (client->closing) {
+        http_sendfile_done(send, UV_ECANCELED);
+        return;
+    }
+    if (send->offset >= send->end) {
+        http_sendfile_done(send, 0);
+        return;
+    }
 
-    // Ensure HTTP scheme
-    if (strncmp(url, "http://", 7) != 0) {
-        free(url);
-        return JSValueMakeUndefined(ctx);
+    // sendfile() would bypass the TLS session, so https bodies are read and encrypted
+    if (client->tls) {
+        http_sendfile_copy(send);
+        return;
     }
 
-    // Parse host and path
-    char* host_start = url + 7;
-    char* path_start = strchr(host_start, '/');
-    char* host = path_start ? strndup(host_start, path_start - host_start) : strdup(host_start);
-    char* path = path_start ? strdup(path_start) : strdup("/");
+    uv_os_fd_t socket_fd;
+    int result = uv_fileno((uv_handle_t*)&client->handle, &socket_fd);
+    if (result < 0) {
+        http_sendfile_done(send, result);
+        return;
+    }
 
-    // Parse data
-    JSStringRef dataRef = JSValueToStringCopy(ctx, args[1], exception);
-    size_t dataLen = JSStringGetMaximumUTF8CStringSize(dataRef);
-    char* data = malloc(dataLen);
-    JSStringGetUTF8CString(dataRef, data, dataLen);
-    JSStringRelease(dataRef);
+    uint64_t left = send->end - send->offset;
+    send->requested = left < HTTP_SENDFILE_MAX_CHUNK ? (size_t)left : HTTP_SENDFILE_MAX_CHUNK;
+    send->req.data = send;
+    send->op = HTTP_SENDFILE_FS;
+    result = uv_fs_sendfile(loop, &send->req, socket_fd, send->entry->fd, (int64_t)send->offset,
+                            send->requested, on_sendfile_sent);
+    if (result < 0) {
+        send->op = HTTP_SENDFILE_WAITING;
+        http_sendfile_done(send, result);
+    }
+}
 
-    // Setup HTTP request
-    HttpRequest* http = malloc(sizeof(HttpRequest));
-    http->ctx = ctx;
-    http->callback = (JSObjectRef)args[2];
-    http->host = host;
-    http->path = path;
-    http->response_data = NULL;
-    http->response_size = 0;
-    http->response_len = 0;
-    http->status_code = 0;
-    http->response_headers = NULL;
-    http->headers_size = 0;
-    http->headers_len = 0;
-    http->headers_parsed = false;
-    http->response_body = NULL;
-    http->body_size = 0;
-    http->body_len = 0;
-    http->request_data = data;
-    http->request_data_len = strlen(data);
-    http->method = "PUT";  // Set the HTTP method
-
-    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
-    uv_getaddrinfo_t* resolver = malloc(sizeof(uv_getaddrinfo_t));
-    resolver->data = http;
-    uv_getaddrinfo(uv_default_loop(), resolver, on_dns_resolved, http->host, "80", &hints);
-
-    free(url);
-    return JSValueMakeUndefined(ctx);
+static void on_sendfile_head_written(WriteBatch* batch, int status) {
+    HttpSendFile* send = (HttpSendFile*)batch->data;
+    if (status >= 0) runtime_counters.http_server.bytes_written += batch->total;
+    send->op = HTTP_SENDFILE_WAITING;
+    if (status < 0) http_sendfile_done(send, status);
+    else http_sendfile_next(send);
 }
 
-// `http.delete(url, callback)`
-JSValueRef http_delete(JSContextRef ctx, JSObjectRef function,
-                      JSObjectRef thisObject, size_t argc,
-                      const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 2) {
-        JSStringRef msg = JSStringCreateWithUTF8CString("http.delete requires 2 arguments: url and callback");
-        *exception = JSValueMakeString(ctx, msg);
-        JSStringRelease(msg);
-        return JSValueMakeUndefined(ctx);
+// Picks status and validators for the request, writes the head, then starts the body
+static void http_sendfile_respond(HttpSendFile* send) {
+    ClientContext* client = send->client;
+    HttpFileEntry* entry = send->entry;
+
+    if (client->closing) {
+        http_sendfile_free(send, UV_ECANCELED);
+        return;
+    }
+    if (entry->status < 0) {
+        send->entry = NULL;
+        http_sendfile_fail(send, entry->status);
+        return;
     }
 
-    // Parse URL
-    JSStringRef urlRef = JSValueToStringCopy(ctx, args[0], exception);
-    size_t urlLen = JSStringGetMaximumUTF8CStringSize(urlRef);
-    char* url = malloc(urlLen);
-    JSStringGetUTF8CString(urlRef, url, urlLen);
-    JSStringRelease(urlRef);
+    const HttpParser* p = &client->parser;
+    size_t type_len;
+    const char* type = client->user_content_type
+        ? http_response_find_header(client, "content-type", &type_len) : NULL;
+    if (!type) {
+        type = http_mime_type(entry->path);
+        type_len = strlen(type);
+    }
 
-    // Ensure HTTP scheme
-    if (strncmp(url, "http://", 7) != 0) {
-        free(url);
-        return JSValueMakeUndefined(ctx);
+    bool vary;
+    ContentEncoding encoding = http_sendfile_encoding(send, type, type_len, &vary);
+    char etag[sizeof(entry->etag) + 8];
+    http_sendfile_etag(entry, encoding, etag, sizeof(etag));
+
+    // The compressed copy is built (or waited for) unless the client's copy is current
+    HttpFileVariant* variant = NULL;
+    if (encoding != CONTENT_ENCODING_IDENTITY && !http_sendfile_not_modified(p, entry, etag)) {
+        int level = entry->size <= HTTP_VARIANT_BEST_MAX_FILE ? COMPRESS_LEVEL_BEST : client->server->compress_level;
+        variant = http_file_variant_get(entry, encoding, level);
+        if (variant && !variant->ready) {
+            send->next = variant->waiters;
+            variant->waiters = send;
+            return;
+        }
+        if (!variant || variant->status < 0) {
+            variant = NULL;
+            encoding = CONTENT_ENCODING_IDENTITY;
+            http_sendfile_etag(entry, encoding, etag, sizeof(etag));
+        }
     }
+    entry->refs++;
 
-    // Parse host and path
-    char* host_start = url + 7;
-    char* path_start = strchr(host_start, '/');
-    char* host = path_start ? strndup(host_start, path_start - host_start) : strdup(host_start);
-    char* path = path_start ? strdup(path_start) : strdup("/");
+    uint64_t start = 0, end = entry->size;
+    char value[80];
+    int n;
 
-    // Setup HTTP request
-    HttpRequest* http = malloc(sizeof(HttpRequest));
-    http->ctx = ctx;
-    http->callback = (JSObjectRef)args[1];
-    http->host = host;
-    http->path = path;
-    http->response_data = NULL;
-    http->response_size = 0;
-    http->response_len = 0;
-    http->status_code = 0;
-    http->response_headers = NULL;
-    http->headers_size = 0;
-    http->headers_len = 0;
-    http->headers_parsed = false;
-    http->response_body = NULL;
-    http->body_size = 0;
-    http->body_len = 0;
-    http->request_data = NULL;
-    http->request_data_len = 0;
-    http->method = "DELETE";  // Set the HTTP method
-
-    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
-    uv_getaddrinfo_t* resolver = malloc(sizeof(uv_getaddrinfo_t));
-    resolver->data = http;
-    uv_getaddrinfo(uv_default_loop(), resolver, on_dns_resolved, http->host, "80", &hints);
-
-    free(url);
-    return JSValueMakeUndefined(ctx);
+    // A status set by the handler (e.g. a 404 page) is served as-is
+    if (client->status_code == 200 && (http_request_is(p, "GET") || http_request_is(p, "HEAD"))) {
+        size_t range_len;
+        const char* range = http_parser_find_header(p, "range", &range_len);
+        if (http_sendfile_not_modified(p, entry, etag)) {
+            client->status_code = 304;
+        } else if (range && http_sendfile_range_applies(p, entry)) {
+            int r = http_parse_range(range, range_len, entry->size, &start, &end);
+            if (r > 0) {
+                client->status_code = 206;
+                n = snprintf(value, sizeof(value), "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64, start, end - 1, entry->size);
+                http_response_add_header(client, "Content-Range", value, n);
+            } else if (r < 0) {
+                client->status_code = 416;
+                start = end = 0;
+                n = snprintf(value, sizeof(value), "bytes */%" PRIu64, entry->size);
+                http_response_add_header(client, "Content-Range", value, n);
+            }
+        }
+    }
+
+    http_response_add_header(client, "Accept-Ranges", "bytes", 5);
+    http_response_add_header(client, "ETag", etag, strlen(etag));
+    http_response_add_header(client, "Last-Modified", entry->last_modified, strlen(entry->last_modified));
+    if (send->max_age >= 0) {
+        n = snprintf(value, sizeof(value), "public, max-age=%d", send->max_age);
+        http_response_add_header(client, "Cache-Control", value, n);
+    }
+    if (vary) http_response_add_header(client, "Vary", "Accept-Encoding", 15);
+    if (client->status_code != 304) {
+        if (!client->user_content_type) http_response_add_header(client, "Content-Type", type, type_len);
+        if (variant) {
+            const char* name = content_encoding_name(encoding);
+            http_response_add_header(client, "Content-Encoding", name, strlen(name));
+        }
+        n = snprintf(value, sizeof(value), "%" PRIu64, variant ? (uint64_t)variant->len : end - start);
+        http_response_add_header(client, "Content-Length", value, n);
+    }
+    client->user_content_type = true;
+    client->user_content_length = true;
+
+    WriteBatch* batch = http_response_batch(client);
+    client->out = NULL;
+    bool has_body = http_response_has_body(client);
+    http_response_build_head(client, batch, true, false, 0);
+
+    send->offset = start;
+    send->end = has_body ? end : start;
+    if (variant) {
+        // The compressed copy goes out with the head, by reference
+        http_file_variant_touch(variant);
+        send->offset = send->end = 0;
+        if (has_body) {
+            write_batch_add(batch, variant->data, variant->len);
+            variant->refs++;
+            send->variant = variant;
+        }
+    }
+    send->keep_alive = client->keep_alive;
+    send->op = HTTP_SENDFILE_WRITING;
+    batch->data = send;
+    http_client_write(client, batch, on_sendfile_head_written);
 }
 
-// ========================= HTTP SERVER (http.createServer) ========================= //
+static void on_sendfile_deferred_error(void* data) {
+    HttpSendFile* send = (HttpSendFile*)data;
+    send->timer = 0;
+    http_sendfile_fail(send, send->error);
+}
 
-typedef struct {
-    uv_tcp_t server;
-    JSContextRef ctx;
-    JSObjectRef callback;
-} HttpServer;
+static void http_sendfile_begin(HttpSendFile* send, const char* path) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = path; *p; p++) hash = (hash ^ (uint8_t)*p) * 16777619u;
 
-// Structure to track client connections
-typedef struct {
-    uv_tcp_t* handle;
-    HttpServer* server;
-    JSObjectRef req;
-    JSObjectRef res;
-} ClientContext;
+    HttpFileEntry* entry = http_file_cache.buckets[hash % HTTP_FILE_CACHE_BUCKETS];
+    while (entry && (entry->hash != hash || strcmp(entry->path, path) != 0)) entry = entry->next;
+    if (!entry) entry = http_file_cache_insert(path, hash);
 
-// Finalize callback for the server object
-static void server_finalize(JSObjectRef object) {
-    HttpServer* server = (HttpServer*)JSObjectGetPrivate(object);
-    if (server) {
-        uv_close((uv_handle_t*)&server->server, NULL);
-        free(server);
+    send->entry = entry;
+    if (entry->loading || entry->checked_at == 0 || uv_now(loop) - entry->checked_at >= HTTP_FILE_CACHE_TTL_MS) {
+        send->next = entry->waiters;
+        entry->waiters = send;
+        if (!entry->loading) http_file_entry_load(entry);
+        return;
+    }
+
+    // Cached failures still reach the callback asynchronously
+    if (entry->status < 0 && send->callback) {
+        send->error = entry->status;
+        send->entry = NULL;
+        send->timer = timer_start(0, 0, on_sendfile_deferred_error, send);
+        return;
     }
+    http_sendfile_respond(send);
 }
 
-// Response "end" method implementation
-JSValueRef res_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
-                   size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
-    ClientContext* clientCtx = (ClientContext*)JSObjectGetPrivate(thisObject);
-    if (!clientCtx) return JSValueMakeUndefined(ctx);
+// `res.sendFile(path[, { root, headers, maxAge }][, callback])`
+static JSValueRef res_send_file(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    ClientContext* client = (ClientContext*)JSObjectGetPrivate(thisObject);
+    if (!client || !client->awaiting_response || client->send_file) return JSValueMakeUndefined(ctx);
+    if (client->headers_sent) return http_throw(ctx, exception, "Cannot send a file after headers are sent");
+    if (argc < 1 || !JSValueIsString(ctx, args[0])) return http_throw(ctx, exception, "res.sendFile requires a path");
 
-    const char* body = "Hello, World!";
-    char response[512];
-    snprintf(response, sizeof(response),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/plain\r\n"
-        "Content-Length: %zu\r\n"
-        "\r\n%s",
-        strlen(body), body);
+    JSObjectRef options = NULL;
+    JSObjectRef callback = NULL;
+    for (size_t i = 1; i < argc && i < 3; i++) {
+        if (!JSValueIsObject(ctx, args[i])) continue;
+        if (JSObjectIsFunction(ctx, (JSObjectRef)args[i])) callback = (JSObjectRef)args[i];
+        else if (!options) options = (JSObjectRef)args[i];
+    }
+
+    char root[PATH_MAX] = "";
+    int max_age = -1;
+    if (options) {
+        JSValueRef value = JSObjectGetProperty(ctx, options, ATOM(root), NULL);
+        if (JSValueIsString(ctx, value)) {
+            JSStringRef str = JSValueToStringCopy(ctx, value, NULL);
+            JSStringGetUTF8CString(str, root, sizeof(root));
+            JSStringRelease(str);
+        }
+
+        value = JSObjectGetProperty(ctx, options, ATOM(maxAge), NULL);
+        if (JSValueIsNumber(ctx, value)) {
+            double seconds = JSValueToNumber(ctx, value, NULL);
+            if (seconds >= 0) max_age = seconds < INT_MAX ? (int)seconds : INT_MAX;
+        }
+
+        value = JSObjectGetProperty(ctx, options, ATOM(headers), NULL);
+        if (JSValueIsObject(ctx, value)) {
+            JSPropertyNameArrayRef names = JSObjectCopyPropertyNames(ctx, (JSObjectRef)value);
+            size_t count = JSPropertyNameArrayGetCount(names);
+            bool ok = true;
+            for (size_t i = 0; ok && i < count; i++) {
+                JSStringRef header = JSPropertyNameArrayGetNameAtIndex(names, i);
+                JSValueRef v = JSObjectGetProperty(ctx, (JSObjectRef)value, header, exception);
+                ok = !*exception && http_response_set_header(client, ctx, JSValueMakeString(ctx, header), v, true, exception);
+            }
+            JSPropertyNameArrayRelease(names);
+            if (!ok) return JSValueMakeUndefined(ctx);
+        }
+    }
+
+    JSStringRef pathRef = JSValueToStringCopy(ctx, args[0], exception);
+    if (!pathRef) return JSValueMakeUndefined(ctx);
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(pathRef);
+    char* rel = malloc(max_len);
+    size_t rel_len = JSStringGetUTF8CString(pathRef, rel, max_len) - 1;
+    JSStringRelease(pathRef);
 
-    uv_buf_t buf = uv_buf_init(strdup(response), strlen(response));
-    uv_write_t* write_req = malloc(sizeof(uv_write_t));
-    write_req->data = buf.base;
-    uv_write(write_req, (uv_stream_t*)clientCtx->handle, &buf, 1, on_write_complete);
+    HttpSendFile* send = pool_calloc(&http_sendfile_pool);
+    send->client = client;
+    send->ctx = ctx;
+    send->max_age = max_age;
+    send->op = HTTP_SENDFILE_WAITING;
+    if (callback) {
+        send->callback = callback;
+        JSValueProtect(ctx, callback);
+    }
+    client->send_file = send;
+
+    // Under a root, request paths may not climb out of it
+    bool rejected = strlen(rel) != rel_len;
+    if (root[0]) {
+        for (const char* s = rel; !rejected && (s = strstr(s, "..")); s += 2) {
+            rejected = (s == rel || s[-1] == '/') && (s[2] == '\0' || s[2] == '/');
+        }
+    }
+
+    char* path = rel;
+    if (root[0] && !rejected) {
+        size_t root_len = strlen(root);
+        while (root_len > 1 && root[root_len - 1] == '/') root_len--;
+        const char* tail = rel;
+        while (*tail == '/') tail++;
+        path = malloc(root_len + strlen(tail) + 2);
+        sprintf(path, "%.*s/%s", (int)root_len, root, tail);
+    }
+
+    if (rejected) {
+        send->error = UV_EACCES;
+        send->timer = timer_start(0, 0, on_sendfile_deferred_error, send);
+    } else {
+        http_sendfile_begin(send, path);
+    }
 
+    if (path != rel) free(path);
+    free(rel);
     return JSValueMakeUndefined(ctx);
 }
 
+static const JSStaticFunction http_response_functions[] = {
+    { "writeHead", res_write_head, kJSPropertyAttributeDontDelete },
+    { "setHeader", res_set_header, kJSPropertyAttributeDontDelete },
+    { "getHeader", res_get_header, kJSPropertyAttributeDontDelete },
+    { "write", res_write, kJSPropertyAttributeDontDelete },
+    { "end", res_end, kJSPropertyAttributeDontDelete },
+    { "json", res_json, kJSPropertyAttributeDontDelete },
+    { "sendFile", res_send_file, kJSPropertyAttributeDontDelete },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue http_response_values[] = {
+    { "statusCode", res_get_status_code, res_set_status_code, kJSPropertyAttributeDontDelete },
+    { NULL, NULL, NULL, 0 }
+};
+
+static const JSStaticFunction http_server_functions[] = {
+    { "listen", http_server_listen, kJSPropertyAttributeNone },
+    { "route", http_server_route, kJSPropertyAttributeNone },
+    { "websocket", http_server_websocket, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+// Parses request bytes (plaintext on https connections) or queues them behind the current request
+static void http_client_receive(ClientContext* client, const char* data, size_t len) {
+    if (client->ws) {
+        if (!client->closing) websocket_receive(client->ws, data, len);
+        return;
+    }
+    runtime_counters.http_server.bytes_read += len;
+    if (client->finished) return;
+
+    if (client->pending_len == client->pending_off && !client->processing) {
+        // Fast path: parse straight out of the read buffer
+        client->processing = true;
+        size_t used = http_client_consume(client, data, len);
+        client->processing = false;
+        if (used < len && !client->finished) {
+            http_client_buffer(client, data + used, len - used);
+        }
+    } else {
+        http_client_buffer(client, data, len);
+    }
+
+    if (!client->closing) http_client_update_reading(client);
+}
+
+static bool on_client_tls_data(void* owner, const char* data, size_t len) {
+    ClientContext* client = (ClientContext*)owner;
+    http_client_receive(client, data, len);
+    return !client->closing;
+}
+
 // Read callback for client data
 void on_client_read(uv_stream_t* client, ssize_t nread, const uv_buf_t* buf) {
+    PROFILE_SPAN("http.server.read");
     ClientContext* clientCtx = (ClientContext*)client->data;
 
-    if (nread > 0) {
-        buf->base[nread] = '\0'; // Ensure null-terminated string
-
-        char method[16], url[256];
-
-        // Extract only the first line of the request
-        char* first_line = strtok(buf->base, "\r\n");
-        if (first_line && sscanf(first_line, "%15s %255s", method, url) == 2) {
-            // Convert method & URL to JavaScript strings
-            JSStringRef methodRef = JSStringCreateWithUTF8CString(method);
-            JSStringRef urlRef = JSStringCreateWithUTF8CString(url);
-
-            // Set req.method
-            JSStringRef methodName = JSStringCreateWithUTF8CString("method");
-            JSObjectSetProperty(clientCtx->server->ctx, clientCtx->req, methodName, JSValueMakeString(clientCtx->server->ctx, methodRef), kJSPropertyAttributeNone, NULL);
-            JSStringRelease(methodRef);
-            JSStringRelease(methodName);
-
-            // Set req.url
-            JSStringRef urlName = JSStringCreateWithUTF8CString("url");
-            JSObjectSetProperty(clientCtx->server->ctx, clientCtx->req, urlName, JSValueMakeString(clientCtx->server->ctx, urlRef), kJSPropertyAttributeNone, NULL);
-            JSStringRelease(urlRef);
-            JSStringRelease(urlName);
-
-            printf("LOG: Received %s request for %s\n", method, url);
-        } else {
-            fprintf(stderr, "ERROR: Failed to parse HTTP request\n");
-        }
+    if (nread < 0) {
+        // EOF or socket error: nothing more can be served on this connection
+        http_client_close(clientCtx);
+    } else if (nread > 0 && clientCtx->tls) {
+        // A failed handshake or close_notify ends the connection
+        if (tls_session_feed(clientCtx->tls, buf->base, (size_t)nread) < 0) http_client_close(clientCtx);
+    } else if (nread > 0) {
+        http_client_receive(clientCtx, buf->base, (size_t)nread);
     }
 
-    free(buf->base);
+    read_buffer_release(buf);
 }
 
 // Handle new HTTP connections
 void on_new_http_connection(uv_stream_t* server, int status) {
+    PROFILE_SPAN("http.server.accept");
     if (status < 0) {
         fprintf(stderr, "ERROR: New connection failed: %s\n", uv_strerror(status));
         return;
     }
 
     HttpServer* httpServer = (HttpServer*)server->data;
-    uv_tcp_t* client = malloc(sizeof(uv_tcp_t));
-    uv_tcp_init(uv_default_loop(), client);
-
-    if (uv_accept(server, (uv_stream_t*)client) == 0) {
-        ClientContext* clientCtx = malloc(sizeof(ClientContext));
-        clientCtx->handle = client;
-        clientCtx->server = httpServer;
-
-        // Create req/res objects
-        clientCtx->req = JSObjectMake(httpServer->ctx, NULL, NULL);
-        clientCtx->res = JSObjectMake(httpServer->ctx, NULL, NULL);
-
-        // Add "end" method to res
-        JSStringRef endName = JSStringCreateWithUTF8CString("end");
-        JSObjectRef endFunc = JSObjectMakeFunctionWithCallback(httpServer->ctx, endName, res_end);
-        JSObjectSetProperty(httpServer->ctx, clientCtx->res, endName, endFunc, kJSPropertyAttributeNone, NULL);
-        JSStringRelease(endName);
-
-        // Associate client context with res object
-        JSObjectSetPrivate(clientCtx->res, clientCtx);
-
-        // Start reading client data
-        client->data = clientCtx;
-        uv_read_start((uv_stream_t*)client, on_http_alloc, on_client_read);
-
-        // Call the JS callback with req and res
-        JSValueRef args[] = { clientCtx->req, clientCtx->res };
-        JSObjectCallAsFunction(httpServer->ctx, httpServer->callback, NULL, 2, args, NULL);
+    ClientContext* clientCtx = pool_calloc(&http_connection_pool);
+    uv_tcp_init(loop, &clientCtx->handle);
+    clientCtx->handle.data = clientCtx;
+    clientCtx->server = httpServer;
+    http_parser_init(&clientCtx->parser, HTTP_PARSER_REQUEST);
+
+    if (uv_accept(server, (uv_stream_t*)&clientCtx->handle) == 0) {
+        uv_tcp_nodelay(&clientCtx->handle, 1);
+        if (httpServer->tls) {
+            clientCtx->tls = tls_session_server(httpServer->tls, (uv_stream_t*)&clientCtx->handle,
+                                                on_client_tls_data, clientCtx);
+            if (!clientCtx->tls) {
+                http_client_close(clientCtx);
+                return;
+            }
+        }
+        http_client_update_reading(clientCtx);
     } else {
         fprintf(stderr, "ERROR: Failed to accept client connection\n");
-        free(client);
+        http_client_close(clientCtx);
     }
 }
 
-// `http.createServer(callback)`
+// `http.createServer([callback])` - without a callback, only `server.route()`
+// routes are served and everything else gets a 404 or 405
 JSValueRef http_create_server(JSContextRef ctx, JSObjectRef function,
                               JSObjectRef thisObject, size_t argc,
                               const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 1) return JSValueMakeUndefined(ctx);
+    bool has_callback = argc > 0 && !JSValueIsUndefined(ctx, args[0]) && !JSValueIsNull(ctx, args[0]);
+    if (has_callback && (!JSValueIsObject(ctx, args[0]) || !JSObjectIsFunction(ctx, (JSObjectRef)args[0]))) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("http.createServer requires a callback function");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    if (!http_response_class) {
+        JSClassDefinition responseClassDef = kJSClassDefinitionEmpty;
+        responseClassDef.className = "ServerResponse";
+        responseClassDef.staticFunctions = http_response_functions;
+        responseClassDef.staticValues = http_response_values;
+        http_response_class = JSClassCreate(&responseClassDef);
+
+        JSClassDefinition serverClassDef = kJSClassDefinitionEmpty;
+        serverClassDef.className = "Server";
+        serverClassDef.staticFunctions = http_server_functions;
+        serverClassDef.finalize = server_finalize;
+        http_server_class = JSClassCreate(&serverClassDef);
+    }
 
     // Create the HttpServer structure
     HttpServer* server = malloc(sizeof(HttpServer));
     server->ctx = ctx;
-    server->callback = (JSObjectRef)args[0];
+    server->callback = has_callback ? (JSObjectRef)args[0] : NULL;
+    server->metrics_path = NULL;
+    server->router = NULL;
+    server->compress = false;
+    server->compress_level = COMPRESS_LEVEL_DEFAULT;
+    server->compress_threshold = HTTP_COMPRESS_THRESHOLD;
+    server->tls = NULL;
+    if (server->callback) JSValueProtect(ctx, server->callback);
 
     // Initialize the TCP server
-    uv_tcp_init(uv_default_loop(), &server->server);
+    uv_tcp_init(loop, &server->server);
     server->server.data = server;
 
-    // Define a JavaScript class for the server object
-    JSClassDefinition serverClassDef = kJSClassDefinitionEmpty;
-    serverClassDef.finalize = server_finalize; // Use the C function for finalization
-    JSClassRef serverClass = JSClassCreate(&serverClassDef);
-    JSObjectRef serverObject = JSObjectMake(ctx, serverClass, server);
-    JSClassRelease(serverClass);
+    // `listen` and `route` come from the class's static function table
+    return JSObjectMake(ctx, http_server_class, server);
+}
+
+static JSValueRef http_get_option(JSContextRef ctx, JSObjectRef options, const char* name) {
+    JSStringRef key = JSStringCreateWithUTF8CString(name);
+    JSValueRef value = JSObjectGetProperty(ctx, options, key, NULL);
+    JSStringRelease(key);
+    return value;
+}
+
+// Copies a PEM option given as a string or a Buffer; NULL if it is neither
+static char* http_pem_option(JSContextRef ctx, JSObjectRef options, const char* name, size_t* len) {
+    JSValueRef value = http_get_option(ctx, options, name);
+    const char* bytes;
+    if (js_value_get_bytes(ctx, value, &bytes, len)) {
+        char* copy = malloc(*len + 1);
+        if (*len) memcpy(copy, bytes, *len);
+        copy[*len] = '\0';
+        return copy;
+    }
+    return JSValueIsString(ctx, value) ? http_value_to_utf8(ctx, value, len, NULL) : NULL;
+}
+
+// `https.createServer({ key, cert }[, callback])` - an HTTP server whose
+// connections are TLS; the PEM certificate chain and key are loaded once here
+JSValueRef https_create_server(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
+                               const JSValueRef args[], JSValueRef* exception) {
+    const char* error = "https.createServer requires { key, cert } options";
+    if (argc < 1 || !JSValueIsObject(ctx, args[0]) || JSObjectIsFunction(ctx, (JSObjectRef)args[0])) {
+        return http_throw(ctx, exception, error);
+    }
+
+    size_t key_len, cert_len;
+    char* key = http_pem_option(ctx, (JSObjectRef)args[0], "key", &key_len);
+    char* cert = http_pem_option(ctx, (JSObjectRef)args[0], "cert", &cert_len);
+    TlsContext* tls = key && cert ? tls_server_context_new(cert, cert_len, key, key_len, &error) : NULL;
+    free(key);
+    free(cert);
+    if (!tls) return http_throw(ctx, exception, error);
+
+    JSValueRef result = http_create_server(ctx, function, thisObject, argc - 1, args + 1, exception);
+    if (*exception) {
+        tls_context_free(tls);
+        return JSValueMakeUndefined(ctx);
+    }
+    HttpServer* server = (HttpServer*)JSObjectGetPrivate((JSObjectRef)result);
+    server->tls = tls;
+    return result;
+}
+
+static void http_server_compression_option(HttpServer* server, JSContextRef ctx, JSObjectRef options) {
+    JSValueRef value = http_get_option(ctx, options, "compression");
+    if (JSValueIsUndefined(ctx, value)) return;
 
-    // Add the `listen` method to the server object
-    JSStringRef listenName = JSStringCreateWithUTF8CString("listen");
-    JSObjectRef listenFunc = JSObjectMakeFunctionWithCallback(ctx, listenName, http_server_listen);
-    JSObjectSetProperty(ctx, serverObject, listenName, listenFunc, kJSPropertyAttributeNone, NULL);
-    JSStringRelease(listenName);
+    server->compress = JSValueToBoolean(ctx, value);
+    if (!server->compress || !JSValueIsObject(ctx, value)) return;
 
-    return serverObject;
+    JSValueRef level = http_get_option(ctx, (JSObjectRef)value, "level");
+    if (JSValueIsNumber(ctx, level)) {
+        double n = JSValueToNumber(ctx, level, NULL);
+        if (n >= 1 && n <= 9) server->compress_level = (int)n;
+    }
+    JSValueRef threshold = http_get_option(ctx, (JSObjectRef)value, "threshold");
+    if (JSValueIsNumber(ctx, threshold)) {
+        double n = JSValueToNumber(ctx, threshold, NULL);
+        if (n >= 0) server->compress_threshold = n < (double)SIZE_MAX ? (size_t)n : SIZE_MAX;
+    }
 }
 
-// `server.listen(port)`
+// `server.listen(port[, { workers }])`
 JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef function,
                               JSObjectRef thisObject, size_t argc,
                               const JSValueRef args[], JSValueRef* exception) {
@@ -669,20 +4300,52 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef function,
     struct sockaddr_in addr;
     uv_ip4_addr("0.0.0.0", port, &addr);
 
+    // `{ workers: N }` fans the script out to N loops sharing this port
+    if (argc > 1) cluster_start(cluster_workers_option(ctx, args[1]));
+
+    // `{ metricsPath: "/metrics" }` serves this loop's Prometheus metrics natively
+    if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+        JSStringRef key = JSStringCreateWithUTF8CString("metricsPath");
+        JSValueRef pathValue = JSObjectGetProperty(ctx, (JSObjectRef)args[1], key, NULL);
+        JSStringRelease(key);
+        if (JSValueIsString(ctx, pathValue)) {
+            JSStringRef pathRef = JSValueToStringCopy(ctx, pathValue, NULL);
+            size_t max = JSStringGetMaximumUTF8CStringSize(pathRef);
+            free(server->metrics_path);
+            server->metrics_path = malloc(max);
+            JSStringGetUTF8CString(pathRef, server->metrics_path, max);
+            JSStringRelease(pathRef);
+        }
+    }
+
+    // `{ compression: true | { level, threshold } }` compresses text-like responses
+    if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+        http_server_compression_option(server, ctx, (JSObjectRef)args[1]);
+    }
+
     // Bind the server to the specified port
-    int bind_result = uv_tcp_bind(&server->server, (const struct sockaddr*)&addr, 0);
+    int bind_result = cluster_bind(&server->server, &addr);
     if (bind_result < 0) {
         fprintf(stderr, "ERROR: Failed to bind to port %d: %s\n", port, uv_strerror(bind_result));
         return JSValueMakeUndefined(ctx);
     }
 
     // Start listening for incoming connections
-    int listen_result = uv_listen((uv_stream_t*)&server->server, 10, on_new_http_connection);
+    int listen_result = uv_listen((uv_stream_t*)&server->server, HTTP_LISTEN_BACKLOG, on_new_http_connection);
     if (listen_result < 0) {
         fprintf(stderr, "ERROR: HTTP server failed to listen on port %d: %s\n", port, uv_strerror(listen_result));
         return JSValueMakeUndefined(ctx);
     }
 
-    printf("LOG: HTTP Server listening on port %d\n", port);
+    // A listening server must outlive the script's last reference to it
+    JSValueProtect(ctx, thisObject);
+
+    if (cluster_worker_id == 0) {
+        if (cluster_worker_count() > 1) {
+            console_printf(CONSOLE_LOG, "HTTP Server listening on port %d (%d workers)", port, cluster_worker_count());
+        } else {
+            console_printf(CONSOLE_LOG, "HTTP Server listening on port %d", port);
+        }
+    }
     return JSValueMakeUndefined(ctx);
-}
\ No newline at end of file
+}
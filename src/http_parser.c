@@ -0,0 +1,475 @@
+/**
+ * =====================================================================================
+ *
+ *        HTTP_PARSER.C - Incremental HTTP/1.1 Message Parser
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Framing HTTP/1.x requests and responses from a byte stream
+ * - Keeping parse state across partial socket reads
+ * - Decoding Content-Length, chunked and read-until-EOF bodies
+ *
+ * Design:
+ * - The head (start line + headers) is accumulated into one buffer and the
+ *   terminator search resumes where the previous read stopped
+ * - Header names/values are stored as offsets into the head buffer, so no
+ *   per-header allocation happens while parsing
+ * - http_parser_execute() stops at the end of a message and reports how many
+ *   bytes it used; the rest belongs to the next (pipelined) message
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "runtime.h"
+
+// Grows a parser-owned buffer geometrically, keeping one spare byte for a NUL
+static bool http_buf_reserve(char** data, size_t* cap, size_t needed) {
+    if (needed + 1 <= *cap) return true;
+
+    size_t new_cap = *cap ? *cap : 256;
+    while (new_cap < needed + 1) new_cap *= 2;
+
+    char* grown = realloc(*data, new_cap);
+    if (!grown) return false;
+    *data = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static bool http_token_equals(const char* s, size_t len, const char* lower) {
+    size_t n = strlen(lower);
+    if (len != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)s[i]) != lower[i]) return false;
+    }
+    return true;
+}
+
+// Checks whether a comma-separated header value contains `token` (case-insensitive)
+static bool http_list_contains(const char* value, size_t len, const char* token) {
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (value[i] == ' ' || value[i] == '\t' || value[i] == ',')) i++;
+        size_t start = i;
+        while (i < len && value[i] != ',') i++;
+        size_t end = i;
+        while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t')) end--;
+        if (http_token_equals(value + start, end - start, token)) return true;
+    }
+    return false;
+}
+
+// Returns true if the last comma-separated element of the value is `token`
+static bool http_list_ends_with(const char* value, size_t len, const char* token) {
+    size_t end = len;
+    while (end > 0 && (value[end - 1] == ' ' || value[end - 1] == '\t')) end--;
+    size_t start = end;
+    while (start > 0 && value[start - 1] != ',') start--;
+    while (start < end && (value[start] == ' ' || value[start] == '\t')) start++;
+    return http_token_equals(value + start, end - start, token);
+}
+
+static bool http_parse_version(const char* s, size_t len, HttpParser* p) {
+    if (len != 8 || memcmp(s, "HTTP/", 5) != 0 || s[6] != '.') return false;
+    if (!isdigit((unsigned char)s[5]) || !isdigit((unsigned char)s[7])) return false;
+    p->version_major = s[5] - '0';
+    p->version_minor = s[7] - '0';
+    return true;
+}
+
+static void http_parser_fail(HttpParser* p, int status) {
+    p->state = HTTP_PARSE_ERROR;
+    p->error = status;
+}
+
+// Parses "METHOD SP target SP HTTP/x.y"
+static bool http_parse_request_line(HttpParser* p, size_t end) {
+    const char* line = p->head;
+    const char* sp1 = memchr(line, ' ', end);
+    if (!sp1 || sp1 == line) return false;
+    const char* rest = sp1 + 1;
+    const char* sp2 = memchr(rest, ' ', end - (rest - line));
+    if (!sp2 || sp2 == rest) return false;
+
+    for (const char* c = line; c < sp1; c++) {
+        if (!isupper((unsigned char)*c) && *c != '-' && *c != '_') return false;
+    }
+    if (sp1 - line > HTTP_MAX_METHOD_LENGTH) return false;
+
+    p->method_off = 0;
+    p->method_len = sp1 - line;
+    p->url_off = rest - line;
+    p->url_len = sp2 - rest;
+    return http_parse_version(sp2 + 1, end - (sp2 + 1 - line), p);
+}
+
+// Parses "HTTP/x.y SP 3DIGIT SP reason"
+static bool http_parse_status_line(HttpParser* p, size_t end) {
+    const char* line = p->head;
+    if (end < 12 || !http_parse_version(line, 8, p) || line[8] != ' ') return false;
+    if (!isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) ||
+        !isdigit((unsigned char)line[11])) return false;
+
+    p->status_code = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    p->reason_off = end > 12 ? 13 : 12;
+    p->reason_len = end > 13 ? end - 13 : 0;
+    return true;
+}
+
+// Applies the framing rules of RFC 7230 section 3.3.3 once the head is known
+static void http_parser_select_body(HttpParser* p) {
+    bool te_seen = false;
+    bool cl_seen = false;
+    bool conn_close = false;
+    bool conn_keep_alive = false;
+    uint64_t content_length = 0;
+
+    for (size_t i = 0; i < p->header_count; i++) {
+        const HttpHeader* h = &p->headers[i];
+        const char* name = p->head + h->name_off;
+        const char* value = p->head + h->value_off;
+
+        if (http_token_equals(name, h->name_len, "content-length")) {
+            uint64_t n = 0;
+            if (h->value_len == 0) { http_parser_fail(p, 400); return; }
+            for (size_t j = 0; j < h->value_len; j++) {
+                if (!isdigit((unsigned char)value[j]) || n > (UINT64_MAX - 9) / 10) {
+                    http_parser_fail(p, 400);
+                    return;
+                }
+                n = n * 10 + (value[j] - '0');
+            }
+            if (cl_seen && n != content_length) { http_parser_fail(p, 400); return; }
+            cl_seen = true;
+            content_length = n;
+        } else if (http_token_equals(name, h->name_len, "transfer-encoding")) {
+            te_seen = true;
+            p->chunked = http_list_ends_with(value, h->value_len, "chunked");
+        } else if (http_token_equals(name, h->name_len, "connection")) {
+            if (http_list_contains(value, h->value_len, "close")) conn_close = true;
+            if (http_list_contains(value, h->value_len, "keep-alive")) conn_keep_alive = true;
+            if (http_list_contains(value, h->value_len, "upgrade")) p->upgrade = true;
+        } else if (http_token_equals(name, h->name_len, "expect")) {
+            p->expect_continue = http_token_equals(value, h->value_len, "100-continue");
+        }
+    }
+
+    // A request carrying both framings is a smuggling vector; refuse it
+    if (te_seen && cl_seen && p->type == HTTP_PARSER_REQUEST) {
+        http_parser_fail(p, 400);
+        return;
+    }
+
+    // HTTP/1.1 is persistent by default, HTTP/1.0 only when asked for
+    bool http11 = p->version_major > 1 || (p->version_major == 1 && p->version_minor >= 1);
+    p->keep_alive = !conn_close && (http11 || conn_keep_alive);
+    p->has_content_length = cl_seen && !te_seen;
+    p->content_length = content_length;
+
+    if (p->type == HTTP_PARSER_RESPONSE &&
+        (p->skip_body || (p->status_code >= 100 && p->status_code < 200) ||
+         p->status_code == 204 || p->status_code == 304)) {
+        p->state = HTTP_PARSE_COMPLETE;
+        return;
+    }
+
+    if (te_seen) {
+        if (!p->chunked) {
+            // A request body must be framed; a response falls back to EOF
+            if (p->type == HTTP_PARSER_REQUEST) { http_parser_fail(p, 501); return; }
+            p->keep_alive = false;
+            p->state = HTTP_PARSE_BODY_EOF;
+            return;
+        }
+        p->state = HTTP_PARSE_CHUNK_SIZE;
+        return;
+    }
+
+    if (cl_seen) {
+        if (content_length > HTTP_MAX_BODY_SIZE) { http_parser_fail(p, 413); return; }
+        p->remaining = content_length;
+        p->state = content_length ? HTTP_PARSE_BODY_IDENTITY : HTTP_PARSE_COMPLETE;
+        return;
+    }
+
+    if (p->type == HTTP_PARSER_RESPONSE) {
+        p->keep_alive = false;
+        p->state = HTTP_PARSE_BODY_EOF;
+    } else {
+        p->state = HTTP_PARSE_COMPLETE;
+    }
+}
+
+// Splits the accumulated head into the start line and header offset table
+static void http_parser_parse_head(HttpParser* p) {
+    size_t len = p->head_len - 4;  // Exclude the final CRLFCRLF
+    char* line_end = memchr(p->head, '\r', len);
+    size_t first_len = line_end ? (size_t)(line_end - p->head) : len;
+
+    bool ok = p->type == HTTP_PARSER_REQUEST
+        ? http_parse_request_line(p, first_len)
+        : http_parse_status_line(p, first_len);
+    if (!ok) { http_parser_fail(p, 400); return; }
+
+    size_t pos = first_len + 2;
+    while (pos < len + 2 && pos < p->head_len) {
+        char* eol = memchr(p->head + pos, '\r', p->head_len - pos);
+        if (!eol || eol[1] != '\n') { http_parser_fail(p, 400); return; }
+        size_t line_len = eol - (p->head + pos);
+        if (line_len == 0) break;
+
+        const char* line = p->head + pos;
+        // Obsolete line folding is rejected, as RFC 7230 allows
+        if (line[0] == ' ' || line[0] == '\t') { http_parser_fail(p, 400); return; }
+
+        const char* colon = memchr(line, ':', line_len);
+        if (!colon || colon == line) { http_parser_fail(p, 400); return; }
+        for (const char* c = line; c < colon; c++) {
+            if (*c == ' ' || *c == '\t') { http_parser_fail(p, 400); return; }
+        }
+
+        if (p->header_count == HTTP_MAX_HEADERS) { http_parser_fail(p, 431); return; }
+
+        const char* value = colon + 1;
+        const char* value_end = line + line_len;
+        while (value < value_end && (*value == ' ' || *value == '\t')) value++;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+
+        HttpHeader* h = &p->headers[p->header_count++];
+        h->name_off = line - p->head;
+        h->name_len = colon - line;
+        h->value_off = value - p->head;
+        h->value_len = value_end - value;
+
+        pos += line_len + 2;
+    }
+
+    http_parser_select_body(p);
+}
+
+// Accumulates head bytes until CRLFCRLF; returns bytes consumed from `data`
+static size_t http_parser_read_head(HttpParser* p, const char* data, size_t len) {
+    size_t skipped = 0;
+
+    // Ignore stray CRLFs between pipelined messages (RFC 7230 section 3.5)
+    if (p->head_len == 0) {
+        while (skipped < len && (data[skipped] == '\r' || data[skipped] == '\n')) skipped++;
+        data += skipped;
+        len -= skipped;
+        if (len == 0) return skipped;
+    }
+
+    size_t prev = p->head_len;
+    size_t take = len;
+    if (prev + take > HTTP_MAX_HEAD_SIZE + 4) take = HTTP_MAX_HEAD_SIZE + 4 - prev;
+    if (!http_buf_reserve(&p->head, &p->head_cap, prev + take)) {
+        http_parser_fail(p, 500);
+        return skipped;
+    }
+    memcpy(p->head + prev, data, take);
+    p->head_len = prev + take;
+
+    // Resume the terminator search three bytes before the new data
+    size_t from = p->scan_pos;
+    char* found = NULL;
+    while (from + 4 <= p->head_len) {
+        char* cr = memchr(p->head + from, '\r', p->head_len - from - 3);
+        if (!cr) break;
+        if (cr[1] == '\n' && cr[2] == '\r' && cr[3] == '\n') {
+            found = cr;
+            break;
+        }
+        from = (cr - p->head) + 1;
+    }
+
+    if (!found) {
+        p->scan_pos = p->head_len >= 3 ? p->head_len - 3 : 0;
+        if (p->head_len > HTTP_MAX_HEAD_SIZE) http_parser_fail(p, 431);
+        return skipped + take;
+    }
+
+    size_t head_end = (found - p->head) + 4;
+    size_t used = head_end - prev;
+    p->head_len = head_end;
+    p->head[head_end] = '\0';
+
+    http_parser_parse_head(p);
+    return skipped + used;
+}
+
+static size_t http_parser_read_body(HttpParser* p, const char* data, size_t len) {
+    size_t take = len;
+    if (p->state == HTTP_PARSE_BODY_IDENTITY || p->state == HTTP_PARSE_CHUNK_DATA) {
+        if (take > p->remaining) take = (size_t)p->remaining;
+    } else if (p->body_len + take > HTTP_MAX_BODY_SIZE) {
+        http_parser_fail(p, 413);
+        return 0;
+    }
+
+    if (!http_buf_reserve(&p->body, &p->body_cap, p->body_len + take)) {
+        http_parser_fail(p, 500);
+        return 0;
+    }
+    memcpy(p->body + p->body_len, data, take);
+    p->body_len += take;
+    p->body[p->body_len] = '\0';
+
+    if (p->state != HTTP_PARSE_BODY_EOF) {
+        p->remaining -= take;
+        if (p->remaining == 0) {
+            p->state = p->state == HTTP_PARSE_BODY_IDENTITY
+                ? HTTP_PARSE_COMPLETE : HTTP_PARSE_CHUNK_DATA_END;
+        }
+    }
+    return take;
+}
+
+// Handles chunk-size lines, chunk terminators and trailers one byte at a time
+static size_t http_parser_read_chunk_meta(HttpParser* p, const char* data, size_t len) {
+    size_t i = 0;
+    while (i < len && (p->state == HTTP_PARSE_CHUNK_SIZE ||
+                       p->state == HTTP_PARSE_CHUNK_DATA_END ||
+                       p->state == HTTP_PARSE_TRAILERS)) {
+        char c = data[i++];
+
+        if (p->state == HTTP_PARSE_CHUNK_DATA_END) {
+            // Expect exactly CRLF after chunk data
+            if ((p->line_len == 0 && c != '\r') || (p->line_len == 1 && c != '\n')) {
+                http_parser_fail(p, 400);
+                return i;
+            }
+            if (++p->line_len == 2) {
+                p->line_len = 0;
+                p->state = HTTP_PARSE_CHUNK_SIZE;
+            }
+            continue;
+        }
+
+        if (c != '\n') {
+            if (p->state == HTTP_PARSE_CHUNK_SIZE && !p->in_chunk_ext) {
+                if (c == ';' || c == ' ' || c == '\t') {
+                    p->in_chunk_ext = true;
+                } else if (c != '\r') {
+                    int digit = isdigit((unsigned char)c) ? c - '0'
+                        : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                        : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                    if (digit < 0 || p->remaining > (HTTP_MAX_BODY_SIZE >> 4)) {
+                        http_parser_fail(p, 400);
+                        return i;
+                    }
+                    p->remaining = (p->remaining << 4) | (uint64_t)digit;
+                }
+            }
+            if (c != '\r') p->line_len++;
+            if (p->line_len > HTTP_MAX_HEAD_SIZE) {
+                http_parser_fail(p, 431);
+                return i;
+            }
+            continue;
+        }
+
+        // End of line
+        if (p->state == HTTP_PARSE_CHUNK_SIZE) {
+            if (p->line_len == 0) { http_parser_fail(p, 400); return i; }
+            p->line_len = 0;
+            p->in_chunk_ext = false;
+            if (p->remaining == 0) {
+                p->state = HTTP_PARSE_TRAILERS;
+            } else if (p->body_len + p->remaining > HTTP_MAX_BODY_SIZE) {
+                http_parser_fail(p, 413);
+                return i;
+            } else {
+                p->state = HTTP_PARSE_CHUNK_DATA;
+            }
+        } else {
+            // Trailer fields are consumed and ignored; an empty line ends the message
+            bool empty = p->line_len == 0;
+            p->line_len = 0;
+            if (empty) p->state = HTTP_PARSE_COMPLETE;
+        }
+    }
+    return i;
+}
+
+void http_parser_init(HttpParser* p, HttpParserType type) {
+    memset(p, 0, sizeof(*p));
+    p->type = type;
+    p->state = HTTP_PARSE_HEAD;
+}
+
+void http_parser_reset(HttpParser* p) {
+    // Keep the buffers so a persistent connection reuses its allocations
+    char* head = p->head;
+    size_t head_cap = p->head_cap;
+    char* body = p->body;
+    size_t body_cap = p->body_cap;
+    HttpParserType type = p->type;
+
+    http_parser_init(p, type);
+    p->head = head;
+    p->head_cap = head_cap;
+    p->body = body;
+    p->body_cap = body_cap;
+}
+
+void http_parser_free(HttpParser* p) {
+    free(p->head);
+    free(p->body);
+    p->head = NULL;
+    p->body = NULL;
+    p->head_cap = 0;
+    p->body_cap = 0;
+}
+
+size_t http_parser_execute(HttpParser* p, const char* data, size_t len) {
+    size_t consumed = 0;
+
+    while (consumed < len) {
+        size_t n = 0;
+        switch (p->state) {
+            case HTTP_PARSE_HEAD:
+                n = http_parser_read_head(p, data + consumed, len - consumed);
+                break;
+            case HTTP_PARSE_BODY_IDENTITY:
+            case HTTP_PARSE_BODY_EOF:
+            case HTTP_PARSE_CHUNK_DATA:
+                n = http_parser_read_body(p, data + consumed, len - consumed);
+                break;
+            case HTTP_PARSE_CHUNK_SIZE:
+            case HTTP_PARSE_CHUNK_DATA_END:
+            case HTTP_PARSE_TRAILERS:
+                n = http_parser_read_chunk_meta(p, data + consumed, len - consumed);
+                break;
+            case HTTP_PARSE_COMPLETE:
+            case HTTP_PARSE_ERROR:
+                return consumed;
+        }
+        consumed += n;
+        if (p->state == HTTP_PARSE_COMPLETE || p->state == HTTP_PARSE_ERROR) break;
+    }
+
+    return consumed;
+}
+
+void http_parser_finish(HttpParser* p) {
+    if (p->state == HTTP_PARSE_BODY_EOF) {
+        p->state = HTTP_PARSE_COMPLETE;
+    } else if (p->state != HTTP_PARSE_COMPLETE && p->state != HTTP_PARSE_ERROR) {
+        http_parser_fail(p, 400);
+    }
+}
+
+const char* http_parser_find_header(const HttpParser* p, const char* name, size_t* value_len) {
+    for (size_t i = 0; i < p->header_count; i++) {
+        const HttpHeader* h = &p->headers[i];
+        if (http_token_equals(p->head + h->name_off, h->name_len, name)) {
+            if (value_len) *value_len = h->value_len;
+            return p->head + h->value_off;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,301 @@
+/**
+ * =====================================================================================
+ *
+ *        HTTP_ROUTER.C - Radix-Tree Request Router (server.route)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Compiling route patterns, with `:name` parameters and a trailing `*name`
+ *   wildcard, into a compressed radix tree
+ * - Matching request paths against it and locating the parameters, before the
+ *   server builds any JS object for the request
+ *
+ * Design:
+ * - Static bytes are stored as edge prefixes; a node's static children are
+ *   found by their first byte with one memchr() over `keys`
+ * - A node may also have one parameter child (one segment) and one wildcard
+ *   child (the remainder); matching tries static, then parameter, then wildcard,
+ *   backtracking out of dead ends, so `/users/new` and `/users/:id` coexist
+ * - Parameters are recorded positionally as (pointer, length) into the path;
+ *   names live on the route, so routes through the same node may name them
+ *   differently
+ * - Routes that end at a node are kept per method; a path that matches only
+ *   with another method reports the node's `Allow` list instead
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+typedef struct HttpRouteNode {
+    char* prefix;                       // Static bytes matched on the way into the node
+    size_t prefix_len;
+    char* keys;                         // First byte of each static child
+    struct HttpRouteNode** children;
+    size_t child_count;
+    struct HttpRouteNode* param;        // `:name` child
+    struct HttpRouteNode* wildcard;     // `*name` child; never has children
+    HttpRoute** routes;                 // Routes ending here, one per method
+    size_t route_count;
+    char* allow;                        // Their methods, joined for an Allow header
+} HttpRouteNode;
+
+struct HttpRouter {
+    HttpRouteNode* root;
+};
+
+static HttpRouteNode* route_node_new(const char* prefix, size_t len) {
+    HttpRouteNode* node = calloc(1, sizeof(HttpRouteNode));
+    if (len) {
+        node->prefix = malloc(len);
+        memcpy(node->prefix, prefix, len);
+        node->prefix_len = len;
+    }
+    return node;
+}
+
+static void route_node_add_child(HttpRouteNode* node, HttpRouteNode* child) {
+    node->keys = realloc(node->keys, node->child_count + 1);
+    node->children = realloc(node->children, (node->child_count + 1) * sizeof(HttpRouteNode*));
+    node->keys[node->child_count] = child->prefix[0];
+    node->children[node->child_count++] = child;
+}
+
+static void route_free(HttpRoute* route) {
+    for (size_t i = 0; i < route->param_count; i++) free(route->names[i]);
+    free(route->names);
+    free(route);
+}
+
+static void route_node_free(HttpRouteNode* node, void (*free_data)(void* data)) {
+    if (!node) return;
+    for (size_t i = 0; i < node->child_count; i++) route_node_free(node->children[i], free_data);
+    route_node_free(node->param, free_data);
+    route_node_free(node->wildcard, free_data);
+    for (size_t i = 0; i < node->route_count; i++) {
+        if (free_data && node->routes[i]->data) free_data(node->routes[i]->data);
+        route_free(node->routes[i]);
+    }
+    free(node->routes);
+    free(node->allow);
+    free(node->keys);
+    free(node->children);
+    free(node->prefix);
+    free(node);
+}
+
+HttpRouter* http_router_new(void) {
+    HttpRouter* router = malloc(sizeof(HttpRouter));
+    router->root = route_node_new(NULL, 0);
+    return router;
+}
+
+void http_router_free(HttpRouter* router, void (*free_data)(void* data)) {
+    if (!router) return;
+    route_node_free(router->root, free_data);
+    free(router);
+}
+
+// Walks (and extends) the tree along static bytes, splitting an edge that
+// only shares part of its prefix
+static HttpRouteNode* route_node_insert_static(HttpRouteNode* node, const char* s, size_t len) {
+    while (len > 0) {
+        const char* hit = node->child_count ? memchr(node->keys, s[0], node->child_count) : NULL;
+        if (!hit) {
+            HttpRouteNode* child = route_node_new(s, len);
+            route_node_add_child(node, child);
+            return child;
+        }
+
+        size_t index = (size_t)(hit - node->keys);
+        HttpRouteNode* child = node->children[index];
+        size_t common = 0;
+        while (common < child->prefix_len && common < len && child->prefix[common] == s[common]) common++;
+
+        if (common < child->prefix_len) {
+            // `mid` keeps the shared bytes and `child` the rest; the first byte is unchanged
+            HttpRouteNode* mid = route_node_new(child->prefix, common);
+            memmove(child->prefix, child->prefix + common, child->prefix_len - common);
+            child->prefix_len -= common;
+            route_node_add_child(mid, child);
+            node->children[index] = mid;
+            child = mid;
+        }
+
+        node = child;
+        s += common;
+        len -= common;
+    }
+    return node;
+}
+
+static void route_node_update_allow(HttpRouteNode* node) {
+    size_t size = 1;
+    bool get = false, head = false;
+    for (size_t i = 0; i < node->route_count; i++) {
+        size += strlen(node->routes[i]->method) + 2;
+        get = get || strcmp(node->routes[i]->method, "GET") == 0;
+        head = head || strcmp(node->routes[i]->method, "HEAD") == 0;
+    }
+    if (get && !head) size += 6;
+
+    free(node->allow);
+    node->allow = malloc(size);
+    size_t len = 0;
+    for (size_t i = 0; i < node->route_count; i++) {
+        len += (size_t)sprintf(node->allow + len, "%s%s", len ? ", " : "", node->routes[i]->method);
+    }
+    if (get && !head) sprintf(node->allow + len, ", HEAD");
+    node->allow[size - 1] = '\0';
+}
+
+static bool route_method_valid(const char* method) {
+    if (strcmp(method, "*") == 0) return true;
+    size_t len = strlen(method);
+    if (len == 0 || len > HTTP_MAX_METHOD_LENGTH) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (method[i] < 'A' || method[i] > 'Z') return false;
+    }
+    return true;
+}
+
+const char* http_router_add(HttpRouter* router, const char* method, const char* pattern, HttpRoute** out) {
+    if (!route_method_valid(method)) return "Invalid route method";
+    if (pattern[0] != '/') return "Route pattern must start with '/'";
+
+    const char* names[HTTP_ROUTE_MAX_PARAMS];
+    size_t name_lens[HTTP_ROUTE_MAX_PARAMS];
+    size_t count = 0;
+
+    // Validate the whole pattern before touching the tree
+    for (const char* p = pattern; *p; p++) {
+        if ((*p != ':' && *p != '*') || p[-1] != '/') continue;
+        char kind = *p;
+        const char* name = p + 1;
+        const char* end = name;
+        while (*end && *end != '/') end++;
+        if (kind == ':' && end == name) return "Route parameter needs a name";
+        if (kind == '*' && *end) return "A route wildcard must be the last segment";
+        if (count == HTTP_ROUTE_MAX_PARAMS) return "Too many route parameters";
+        for (const char* c = name; c < end; c++) {
+            if (*c == ':' || *c == '*') return "Invalid route parameter name";
+        }
+        names[count] = name;
+        name_lens[count++] = (size_t)(end - name);
+        p = end - 1;
+    }
+
+    HttpRouteNode* node = router->root;
+    const char* p = pattern;
+    while (*p) {
+        const char* q = p;
+        while (*q && !((*q == ':' || *q == '*') && q[-1] == '/')) q++;
+        if (q > p) node = route_node_insert_static(node, p, (size_t)(q - p));
+        if (!*q) break;
+
+        HttpRouteNode** next = *q == ':' ? &node->param : &node->wildcard;
+        if (!*next) *next = route_node_new(NULL, 0);
+        node = *next;
+        p = q + 1;
+        while (*p && *p != '/') p++;
+    }
+
+    HttpRoute* route = NULL;
+    for (size_t i = 0; i < node->route_count && !route; i++) {
+        if (strcmp(node->routes[i]->method, method) == 0) route = node->routes[i];
+    }
+    if (route) {
+        // Same shape, possibly different parameter names: take the new ones
+        for (size_t i = 0; i < route->param_count; i++) free(route->names[i]);
+        free(route->names);
+    } else {
+        route = calloc(1, sizeof(HttpRoute));
+        strcpy(route->method, method);
+        node->routes = realloc(node->routes, (node->route_count + 1) * sizeof(HttpRoute*));
+        node->routes[node->route_count++] = route;
+        route_node_update_allow(node);
+    }
+
+    route->names = count ? malloc(count * sizeof(char*)) : NULL;
+    route->param_count = count;
+    for (size_t i = 0; i < count; i++) {
+        const char* name = name_lens[i] ? names[i] : "*";
+        size_t len = name_lens[i] ? name_lens[i] : 1;
+        route->names[i] = malloc(len + 1);
+        memcpy(route->names[i], name, len);
+        route->names[i][len] = '\0';
+    }
+
+    *out = route;
+    return NULL;
+}
+
+// Picks the route for the method at a node where the path ended
+static bool route_node_select(const HttpRouteNode* node, const char* method, size_t method_len,
+                              HttpRouteMatch* match) {
+    if (!node->route_count) return false;
+
+    const HttpRoute* any = NULL;
+    const HttpRoute* get = NULL;
+    for (size_t i = 0; i < node->route_count; i++) {
+        const HttpRoute* route = node->routes[i];
+        if (strlen(route->method) == method_len && memcmp(route->method, method, method_len) == 0) {
+            match->route = route;
+            return true;
+        }
+        if (route->method[0] == '*') any = route;
+        if (strcmp(route->method, "GET") == 0) get = route;
+    }
+
+    bool head = method_len == 4 && memcmp(method, "HEAD", 4) == 0;
+    match->route = head && get ? get : any;
+    if (match->route) return true;
+
+    if (!match->allow) match->allow = node->allow;
+    return false;
+}
+
+static bool route_node_match(const HttpRouteNode* node, const char* method, size_t method_len,
+                             const char* path, size_t len, size_t depth, HttpRouteMatch* match) {
+    if (len == 0 && route_node_select(node, method, method_len, match)) return true;
+
+    if (len > 0 && node->child_count) {
+        const char* hit = memchr(node->keys, path[0], node->child_count);
+        if (hit) {
+            const HttpRouteNode* child = node->children[hit - node->keys];
+            if (child->prefix_len <= len && memcmp(child->prefix, path, child->prefix_len) == 0 &&
+                route_node_match(child, method, method_len, path + child->prefix_len,
+                                 len - child->prefix_len, depth, match)) {
+                return true;
+            }
+        }
+    }
+
+    if (node->param && len > 0 && path[0] != '/' && depth < HTTP_ROUTE_MAX_PARAMS) {
+        const char* slash = memchr(path, '/', len);
+        size_t segment = slash ? (size_t)(slash - path) : len;
+        match->params[depth].value = path;
+        match->params[depth].len = segment;
+        if (route_node_match(node->param, method, method_len, path + segment, len - segment,
+                             depth + 1, match)) {
+            return true;
+        }
+    }
+
+    if (node->wildcard && depth < HTTP_ROUTE_MAX_PARAMS) {
+        match->params[depth].value = path;
+        match->params[depth].len = len;
+        if (route_node_select(node->wildcard, method, method_len, match)) return true;
+    }
+    return false;
+}
+
+bool http_router_match(const HttpRouter* router, const char* method, size_t method_len,
+                       const char* path, size_t path_len, HttpRouteMatch* match) {
+    match->route = NULL;
+    match->allow = NULL;
+    return route_node_match(router->root, method, method_len, path, path_len, 0, match);
+}
@@ -7,10 +7,14 @@
  * 
  * This file implements the bridge between native capabilities and the JavaScript
  * environment. It exposes the following APIs to JavaScript:
- * - Console API (log, warn, info, debug, error)
+ * - Console API (log, warn, info, debug, error, configure)
  * - Timer API (setTimeout, clearTimeout, setInterval, clearInterval)
- * - Process API (argv, exit)
- * - Runtime Info (name, version)
+ * - Process API (argv, exit, poolStats, metrics, hrtime, workerId)
+ * - FS (with fs.promises), HTTP, Net and Buffer namespaces
+ * - Worker threads (Worker, and parentPort/workerData inside a worker)
+ *
+ * All functions live in static tables on classes created once per thread, so
+ * binding a new context only creates the namespace objects and process.argv
  * 
  * Architecture:
  * ┌─────────────┐       ┌─────────────┐
@@ -38,7 +42,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include "runtime.h"
 #include "version.h"
 
@@ -46,130 +49,64 @@
 extern int process_argc;
 extern char** process_argv;
 
-// ================== Helper Functions ================== //
-
-/**
- * Generates a timestamp string in the format "[HH:MM:SS]"
- * @return  Timestamp string (must be freed by caller)
- */
-static char* get_timestamp() {
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
-
-    char* timestamp = malloc(10);  // "[HH:MM:SS]" + null terminator
-    strftime(timestamp, 10, "[%H:%M:%S]", tm_info);
-    return timestamp;
-}
-
-/**
- * Converts multiple JS values to a concatenated string
- * @param ctx       JS context
- * @param argc      Number of arguments
- * @param args      Array of JS values
- * @param exception Exception object (if any)
- * @return          Concatenated string (must be freed by caller)
- */
-static char* js_values_to_string(JSContextRef ctx, size_t argc, const JSValueRef args[], JSValueRef* exception) {
-    if (argc == 0) return strdup("");  // Handle no arguments
-
-    // Temporary array to store C strings
-    char** c_strs = malloc(argc * sizeof(char*));
-    size_t total_len = 0;
-
-    // First pass: convert all JS values to C strings
-    for (size_t i = 0; i < argc; i++) {
-        JSStringRef js_str = JSValueToStringCopy(ctx, args[i], exception);
-        if (*exception) {
-            // Cleanup on error
-            for (size_t j = 0; j < i; j++) free(c_strs[j]);
-            free(c_strs);
-            return NULL;
-        }
-
-        size_t max_len = JSStringGetMaximumUTF8CStringSize(js_str);
-        c_strs[i] = malloc(max_len);
-        JSStringGetUTF8CString(js_str, c_strs[i], max_len);
-        JSStringRelease(js_str);
-
-        total_len += strlen(c_strs[i]) + 1;  // +1 for space or null terminator
-    }
-
-    // Allocate final string buffer
-    char* result = malloc(total_len);
-    result[0] = '\0';
-
-    // Second pass: concatenate all strings
-    for (size_t i = 0; i < argc; i++) {
-        strcat(result, c_strs[i]);
-        if (i < argc - 1) strcat(result, " ");
-        free(c_strs[i]);  // Free individual strings
-    }
-
-    free(c_strs);
-    return result;
-}
-
 // ================== Console API ================== //
 
 /**
- * Generic console output function
- * @param prefix    Prefix for the log (e.g., "LOG", "WARN")
- * @param color     ANSI color code (e.g., "\033[34m" for blue)
- * @param ctx       JS context
- * @param function  JS function reference
- * @param thisObject JS `this` object
- * @param argc      Number of arguments
- * @param args      Array of JS values
- * @param exception Exception object (if any)
+ * Console methods - Format their arguments into the thread's console ring,
+ * which is flushed to stdout once per loop iteration (see console.c)
  */
-static JSValueRef console_output(const char* prefix, const char* color, JSContextRef ctx, JSObjectRef function,
-                                 JSObjectRef thisObject, size_t argc, const JSValueRef args[], JSValueRef* exception) {
-    if (argc == 0) {
-        printf("%s%s: \033[0m\n", color, prefix);  // Handle no arguments
-        return JSValueMakeUndefined(ctx);
-    }
-
-    // Convert all arguments to a single string
-    char* message = js_values_to_string(ctx, argc, args, exception);
-    printf("%s%s: %s\033[0m\n", color, prefix, message);  // Print with color and prefix
-    free(message);
-
-    return JSValueMakeUndefined(ctx);
+static JSValueRef console_output(ConsoleLevel level, JSContextRef ctx, size_t argc,
+                                 const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "console");
+    return console_write_values(ctx, level, argc, args, exception);
 }
 
-// Console methods
-static JSValueRef console_log(JSContextRef ctx, JSObjectRef function, 
-                              JSObjectRef thisObject, size_t argc, 
+static JSValueRef console_log(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
                               const JSValueRef args[], JSValueRef* exception) {
-    return console_output("LOG", "\033[0m", ctx, function, thisObject, argc, args, exception);
+    return console_output(CONSOLE_LOG, ctx, argc, args, exception);
 }
 
-static JSValueRef console_warn(JSContextRef ctx, JSObjectRef function, 
-                               JSObjectRef thisObject, size_t argc, 
+static JSValueRef console_warn(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
                                const JSValueRef args[], JSValueRef* exception) {
-    return console_output("WARN", "\033[33m", ctx, function, thisObject, argc, args, exception);
+    return console_output(CONSOLE_WARN, ctx, argc, args, exception);
 }
 
-static JSValueRef console_info(JSContextRef ctx, JSObjectRef function, 
-                               JSObjectRef thisObject, size_t argc, 
+static JSValueRef console_info(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
                                const JSValueRef args[], JSValueRef* exception) {
-    return console_output("INFO", "\033[34m", ctx, function, thisObject, argc, args, exception);
+    return console_output(CONSOLE_INFO, ctx, argc, args, exception);
 }
 
-static JSValueRef console_debug(JSContextRef ctx, JSObjectRef function, 
-                                JSObjectRef thisObject, size_t argc, 
+static JSValueRef console_debug(JSContextRef ctx, JSObjectRef function,
+                                JSObjectRef thisObject, size_t argc,
                                 const JSValueRef args[], JSValueRef* exception) {
-    return console_output("DEBUG", "\033[90m", ctx, function, thisObject, argc, args, exception);
+    return console_output(CONSOLE_DEBUG, ctx, argc, args, exception);
 }
 
 static JSValueRef console_error(JSContextRef ctx, JSObjectRef function,
-                               JSObjectRef thisObject, size_t argc,
-                               const JSValueRef args[], JSValueRef* exception) {
-    return console_output("ERROR", "\033[31m", ctx, function, thisObject, argc, args, exception);
+                                JSObjectRef thisObject, size_t argc,
+                                const JSValueRef args[], JSValueRef* exception) {
+    return console_output(CONSOLE_ERROR, ctx, argc, args, exception);
 }
 
 // ================== Timer API ================== //
 
+#define TIMER_MAX_DELAY 2147483647.0
+
+// Delays outside [1, 2^31-1] ms (including NaN) run after 1 ms, as in browsers
+static uint64_t timer_delay(double delay) {
+    if (!(delay >= 1) || delay > TIMER_MAX_DELAY) return 1;
+    return (uint64_t)delay;
+}
+
+// IDs are non-negative integers; anything else matches no timer
+static uint64_t timer_id_from_js(double id) {
+    if (!(id >= 0) || id > 9007199254740991.0) return 0;
+    return (uint64_t)id;
+}
+
 /**
  * JS-accessible setTimeout implementation
  * @param args[0]  Callback function
@@ -188,11 +125,12 @@ static JSValueRef js_set_timeout(JSContextRef ctx, JSObjectRef function,
 
     // Extract callback and delay
     JSObjectRef callback = JSValueToObject(ctx, args[0], exception);
-    uint64_t delay = JSValueToNumber(ctx, args[1], exception);
-    
+    double delay = JSValueToNumber(ctx, args[1], exception);
+    if (*exception) return JSValueMakeUndefined(ctx);
+
     // Schedule with event loop
-    set_timeout(ctx, callback, delay);
-    return JSValueMakeUndefined(ctx);
+    uint64_t timer_id = set_timeout(ctx, callback, timer_delay(delay));
+    return JSValueMakeNumber(ctx, (double)timer_id);
 }
 
 /**
@@ -208,7 +146,7 @@ static JSValueRef js_clear_timeout(JSContextRef ctx, JSObjectRef function,
         return JSValueMakeUndefined(ctx);
     }
 
-    uint32_t timer_id = (uint32_t)JSValueToNumber(ctx, args[0], exception);
+    uint64_t timer_id = timer_id_from_js(JSValueToNumber(ctx, args[0], exception));
     if (*exception) return JSValueMakeUndefined(ctx);
 
     clear_timeout(ctx, timer_id);
@@ -229,11 +167,11 @@ static JSValueRef js_set_interval(JSContextRef ctx, JSObjectRef function,
     }
 
     JSObjectRef callback = JSValueToObject(ctx, args[0], exception);
-    uint64_t interval = (uint64_t)JSValueToNumber(ctx, args[1], exception);
+    double interval = JSValueToNumber(ctx, args[1], exception);
     if (*exception) return JSValueMakeUndefined(ctx);
 
-    set_interval(ctx, callback, interval);
-    return JSValueMakeNumber(ctx, next_timer_id - 1);  // Return timer ID
+    uint64_t timer_id = set_interval(ctx, callback, timer_delay(interval));
+    return JSValueMakeNumber(ctx, (double)timer_id);  // Return timer ID
 }
 
 /**
@@ -249,7 +187,7 @@ static JSValueRef js_clear_interval(JSContextRef ctx, JSObjectRef function,
         return JSValueMakeUndefined(ctx);
     }
 
-    uint32_t timer_id = (uint32_t)JSValueToNumber(ctx, args[0], exception);
+    uint64_t timer_id = timer_id_from_js(JSValueToNumber(ctx, args[0], exception));
     if (*exception) return JSValueMakeUndefined(ctx);
 
     clear_interval(ctx, timer_id);
@@ -275,110 +213,236 @@ static JSValueRef js_process_exit(JSContextRef ctx, JSObjectRef function,
     return JSValueMakeUndefined(ctx);
 }
 
+static void set_number_property(JSContextRef ctx, JSObjectRef object, const char* name, double value) {
+    JSStringRef key = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, object, key, JSValueMakeNumber(ctx, value), kJSPropertyAttributeNone, NULL);
+    JSStringRelease(key);
+}
+
+/**
+ * process.poolStats - Counters for the calling loop's object pools
+ * @return  { [poolName]: { objectSize, capacity, inUse, hits, misses } }
+ */
+static JSValueRef js_process_pool_stats(JSContextRef ctx, JSObjectRef function,
+                                        JSObjectRef thisObject, size_t argc,
+                                        const JSValueRef args[], JSValueRef* exception) {
+    JSObjectRef result = JSObjectMake(ctx, NULL, NULL);
+
+    for (MemPool* pool = pool_registry(); pool; pool = pool->next) {
+        JSObjectRef stats = JSObjectMake(ctx, NULL, NULL);
+        set_number_property(ctx, stats, "objectSize", (double)pool->object_size);
+        set_number_property(ctx, stats, "capacity", (double)pool->capacity);
+        set_number_property(ctx, stats, "inUse", (double)pool->in_use);
+        set_number_property(ctx, stats, "hits", (double)pool->hits);
+        set_number_property(ctx, stats, "misses", (double)pool->misses);
+
+        JSStringRef name = JSStringCreateWithUTF8CString(pool->name);
+        JSObjectSetProperty(ctx, result, name, stats, kJSPropertyAttributeNone, NULL);
+        JSStringRelease(name);
+    }
+    return result;
+}
+
+/**
+ * process.hrtime([previous]) - Monotonic time as [seconds, nanoseconds],
+ * relative to `previous` when a tuple from an earlier call is given
+ */
+static JSValueRef js_process_hrtime(JSContextRef ctx, JSObjectRef function,
+                                    JSObjectRef thisObject, size_t argc,
+                                    const JSValueRef args[], JSValueRef* exception) {
+    uint64_t now = uv_hrtime();
+    if (argc > 0 && JSValueIsArray(ctx, args[0])) {
+        JSObjectRef previous = (JSObjectRef)args[0];
+        double sec = JSValueToNumber(ctx, JSObjectGetPropertyAtIndex(ctx, previous, 0, NULL), NULL);
+        double nsec = JSValueToNumber(ctx, JSObjectGetPropertyAtIndex(ctx, previous, 1, NULL), NULL);
+        uint64_t since = (uint64_t)sec * 1000000000ULL + (uint64_t)nsec;
+        now = now > since ? now - since : 0;
+    }
+
+    JSValueRef parts[] = {
+        JSValueMakeNumber(ctx, (double)(now / 1000000000ULL)),
+        JSValueMakeNumber(ctx, (double)(now % 1000000000ULL))
+    };
+    return JSObjectMakeArray(ctx, 2, parts, exception);
+}
+
+/**
+ * process.workerId - 0 outside cluster mode and on the main thread
+ */
+static JSValueRef js_process_worker_id(JSContextRef ctx, JSObjectRef object,
+                                       JSStringRef propertyName, JSValueRef* exception) {
+    return JSValueMakeNumber(ctx, cluster_worker_id);
+}
+
 // ================== API Exposure ================== //
 
+// Every API is a static table on a class built once per thread; JSC only
+// materializes a function object the first time a script reads it, so a new
+// context costs a handful of JSObjectMake calls instead of one
+// JSObjectMakeFunctionWithCallback + JSObjectSetProperty per method
+
+static const JSStaticFunction global_functions[] = {
+    { "setTimeout", js_set_timeout, kJSPropertyAttributeNone },
+    { "clearTimeout", js_clear_timeout, kJSPropertyAttributeNone },
+    { "setInterval", js_set_interval, kJSPropertyAttributeNone },
+    { "clearInterval", js_clear_interval, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction console_functions[] = {
+    { "log", console_log, kJSPropertyAttributeNone },
+    { "warn", console_warn, kJSPropertyAttributeNone },
+    { "info", console_info, kJSPropertyAttributeNone },
+    { "debug", console_debug, kJSPropertyAttributeNone },
+    { "error", console_error, kJSPropertyAttributeNone },
+    { "configure", js_console_configure, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction process_functions[] = {
+    { "exit", js_process_exit, kJSPropertyAttributeNone },
+    { "poolStats", js_process_pool_stats, kJSPropertyAttributeNone },
+    { "metrics", js_process_metrics, kJSPropertyAttributeNone },
+    { "hrtime", js_process_hrtime, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue process_values[] = {
+    { "workerId", js_process_worker_id, NULL, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete },
+    { NULL, NULL, NULL, 0 }
+};
+
+static const JSStaticFunction fs_functions[] = {
+    { "readFile", fs_read_file, kJSPropertyAttributeNone },
+    { "writeFile", fs_write_file, kJSPropertyAttributeNone },
+    { "createReadStream", fs_create_read_stream, kJSPropertyAttributeNone },
+    { "createWriteStream", fs_create_write_stream, kJSPropertyAttributeNone },
+    { "statMany", fs_stat_many, kJSPropertyAttributeNone },
+    { "readMany", fs_read_many, kJSPropertyAttributeNone },
+    { "exists", fs_exists, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction fs_promises_functions[] = {
+    { "readFile", fs_promises_read_file, kJSPropertyAttributeNone },
+    { "writeFile", fs_promises_write_file, kJSPropertyAttributeNone },
+    { "exists", fs_promises_exists, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction http_functions[] = {
+    { "request", http_request, kJSPropertyAttributeNone },
+    { "get", http_get, kJSPropertyAttributeNone },
+    { "post", http_post, kJSPropertyAttributeNone },
+    { "put", http_put, kJSPropertyAttributeNone },
+    { "delete", http_delete, kJSPropertyAttributeNone },
+    { "setAgentOptions", http_set_agent_options, kJSPropertyAttributeNone },
+    { "websocket", http_websocket, kJSPropertyAttributeNone },
+    { "broadcast", websocket_broadcast, kJSPropertyAttributeNone },
+    { "createServer", http_create_server, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+// The client functions take https:// URLs as well; only createServer differs
+static const JSStaticFunction https_functions[] = {
+    { "request", http_request, kJSPropertyAttributeNone },
+    { "get", http_get, kJSPropertyAttributeNone },
+    { "post", http_post, kJSPropertyAttributeNone },
+    { "put", http_put, kJSPropertyAttributeNone },
+    { "delete", http_delete, kJSPropertyAttributeNone },
+    { "websocket", http_websocket, kJSPropertyAttributeNone },
+    { "broadcast", websocket_broadcast, kJSPropertyAttributeNone },
+    { "createServer", https_create_server, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction net_functions[] = {
+    { "createServer", net_create_server, kJSPropertyAttributeNone },
+    { "connect", net_connect, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction buffer_functions[] = {
+    { "from", buffer_from, kJSPropertyAttributeNone },
+    { "alloc", buffer_alloc, kJSPropertyAttributeNone },
+    { "byteLength", buffer_byte_length, kJSPropertyAttributeNone },
+    { "isBuffer", buffer_is_buffer, kJSPropertyAttributeNone },
+    { "concat", buffer_concat, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static JADE_THREAD_LOCAL JSClassRef global_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef console_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef process_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef fs_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef fs_promises_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef http_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef https_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef net_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef buffer_class = NULL;
+
+static JSClassRef make_namespace_class(const char* name, const JSStaticFunction* functions,
+                                       const JSStaticValue* values) {
+    JSClassDefinition def = kJSClassDefinitionEmpty;
+    def.className = name;
+    def.staticFunctions = functions;
+    def.staticValues = values;
+    return JSClassCreate(&def);
+}
+
+JSClassRef js_global_class(void) {
+    if (!global_class) {
+        global_class = make_namespace_class("global", global_functions, NULL);
+        console_class = make_namespace_class("Console", console_functions, NULL);
+        process_class = make_namespace_class("Process", process_functions, process_values);
+        fs_class = make_namespace_class("FileSystem", fs_functions, NULL);
+        fs_promises_class = make_namespace_class("FileSystemPromises", fs_promises_functions, NULL);
+        http_class = make_namespace_class("HTTP", http_functions, NULL);
+        https_class = make_namespace_class("HTTPS", https_functions, NULL);
+        net_class = make_namespace_class("Net", net_functions, NULL);
+        buffer_class = make_namespace_class("BufferConstructor", buffer_functions, NULL);
+    }
+    return global_class;
+}
+
+static JSObjectRef set_namespace(JSContextRef ctx, JSObjectRef global, const char* name, JSClassRef cls) {
+    JSObjectRef object = JSObjectMake(ctx, cls, NULL);
+    JSStringRef key = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, global, key, object, kJSPropertyAttributeNone, NULL);
+    JSStringRelease(key);
+    return object;
+}
+
 /**
  * Exposes native APIs to JS global scope
- * @param ctx  Context to enhance
+ * @param ctx  Context created with js_global_class(), which provides the timers
  */
 void bind_js_native_apis(JSGlobalContextRef ctx) {
-    // Create global object
     JSObjectRef global = JSContextGetGlobalObject(ctx);
-
-    // ================== Console API ================== //
-    JSObjectRef console = JSObjectMake(ctx, NULL, NULL);
-    JSStringRef consoleName = JSStringCreateWithUTF8CString("console");
-    JSObjectSetProperty(ctx, global, consoleName, console, kJSPropertyAttributeNone, NULL);
-    JSStringRelease(consoleName);
-
-    // Add console methods
-    JSStringRef logName = JSStringCreateWithUTF8CString("log");
-    JSObjectSetProperty(ctx, console, logName, JSObjectMakeFunctionWithCallback(ctx, logName, console_log), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(logName);
-
-    JSStringRef warnName = JSStringCreateWithUTF8CString("warn");
-    JSObjectSetProperty(ctx, console, warnName, JSObjectMakeFunctionWithCallback(ctx, warnName, console_warn), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(warnName);
-
-    JSStringRef infoName = JSStringCreateWithUTF8CString("info");
-    JSObjectSetProperty(ctx, console, infoName, JSObjectMakeFunctionWithCallback(ctx, infoName, console_info), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(infoName);
-
-    JSStringRef debugName = JSStringCreateWithUTF8CString("debug");
-    JSObjectSetProperty(ctx, console, debugName, JSObjectMakeFunctionWithCallback(ctx, debugName, console_debug), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(debugName);
-
-    JSStringRef errorName = JSStringCreateWithUTF8CString("error");
-    JSObjectSetProperty(ctx, console, errorName, JSObjectMakeFunctionWithCallback(ctx, errorName, console_error), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(errorName);
-
-    // ================== Timer API ================== //
-    JSStringRef setTimeoutName = JSStringCreateWithUTF8CString("setTimeout");
-    JSObjectSetProperty(ctx, global, setTimeoutName, JSObjectMakeFunctionWithCallback(ctx, setTimeoutName, js_set_timeout), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(setTimeoutName);
-
-    JSStringRef clearTimeoutName = JSStringCreateWithUTF8CString("clearTimeout");
-    JSObjectSetProperty(ctx, global, clearTimeoutName, JSObjectMakeFunctionWithCallback(ctx, clearTimeoutName, js_clear_timeout), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(clearTimeoutName);
-
-    JSStringRef setIntervalName = JSStringCreateWithUTF8CString("setInterval");
-    JSObjectSetProperty(ctx, global, setIntervalName, JSObjectMakeFunctionWithCallback(ctx, setIntervalName, js_set_interval), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(setIntervalName);
-
-    JSStringRef clearIntervalName = JSStringCreateWithUTF8CString("clearInterval");
-    JSObjectSetProperty(ctx, global, clearIntervalName, JSObjectMakeFunctionWithCallback(ctx, clearIntervalName, js_clear_interval), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(clearIntervalName);
-
-    // ================== Process API ================== //
-    JSObjectRef process = JSObjectMake(ctx, NULL, NULL);
-    JSStringRef processName = JSStringCreateWithUTF8CString("process");
-    JSObjectSetProperty(ctx, global, processName, process, kJSPropertyAttributeNone, NULL);
-    JSStringRelease(processName);
-
-    // Add process.argv
-    JSObjectRef argv = JSObjectMakeArray(ctx, 0, NULL, NULL);
+    js_global_class();
+
+    set_namespace(ctx, global, "console", console_class);
+    JSObjectRef fs = set_namespace(ctx, global, "fs", fs_class);
+    set_namespace(ctx, fs, "promises", fs_promises_class);
+    set_namespace(ctx, global, "http", http_class);
+    set_namespace(ctx, global, "https", https_class);
+    set_namespace(ctx, global, "net", net_class);
+    set_namespace(ctx, global, "Buffer", buffer_class);
+    buffer_init(ctx);
+    worker_bind_globals(ctx, global);
+    JSObjectRef process = set_namespace(ctx, global, "process", process_class);
+
+    // process.argv is plain data, so it is the one per-context build step left
+    JSValueRef* args = malloc((process_argc > 0 ? process_argc : 1) * sizeof(JSValueRef));
     for (int i = 0; i < process_argc; i++) {
         JSStringRef arg = JSStringCreateWithUTF8CString(process_argv[i]);
-        JSObjectSetPropertyAtIndex(ctx, argv, i, JSValueMakeString(ctx, arg), NULL);
+        args[i] = JSValueMakeString(ctx, arg);
         JSStringRelease(arg);
     }
+    JSObjectRef argv = JSObjectMakeArray(ctx, (size_t)process_argc, args, NULL);
+    free(args);
+
     JSStringRef argvName = JSStringCreateWithUTF8CString("argv");
     JSObjectSetProperty(ctx, process, argvName, argv, kJSPropertyAttributeNone, NULL);
     JSStringRelease(argvName);
-
-    // Add process.exit
-    JSStringRef exitName = JSStringCreateWithUTF8CString("exit");
-    JSObjectSetProperty(ctx, process, exitName, JSObjectMakeFunctionWithCallback(ctx, exitName, js_process_exit), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(exitName);
-
-    // ================== HTTP API ================== //
-    JSObjectRef http = JSObjectMake(ctx, NULL, NULL);
-    JSStringRef httpName = JSStringCreateWithUTF8CString("http");
-    JSObjectSetProperty(ctx, global, httpName, http, kJSPropertyAttributeNone, NULL);
-    JSStringRelease(httpName);
-
-    // Add http.get
-    JSStringRef getName = JSStringCreateWithUTF8CString("get");
-    JSObjectSetProperty(ctx, http, getName, JSObjectMakeFunctionWithCallback(ctx, getName, http_get), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(getName);
-
-    // Add http.post
-    JSStringRef postName = JSStringCreateWithUTF8CString("post");
-    JSObjectSetProperty(ctx, http, postName, JSObjectMakeFunctionWithCallback(ctx, postName, http_post), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(postName);
-
-    // Add http.put
-    JSStringRef putName = JSStringCreateWithUTF8CString("put");
-    JSObjectSetProperty(ctx, http, putName, JSObjectMakeFunctionWithCallback(ctx, putName, http_put), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(putName);
-
-    // Add http.delete
-    JSStringRef deleteName = JSStringCreateWithUTF8CString("delete");
-    JSObjectSetProperty(ctx, http, deleteName, JSObjectMakeFunctionWithCallback(ctx, deleteName, http_delete), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(deleteName);
-
-    // Add http.createServer
-    JSStringRef createServerName = JSStringCreateWithUTF8CString("createServer");
-    JSObjectSetProperty(ctx, http, createServerName, JSObjectMakeFunctionWithCallback(ctx, createServerName, http_create_server), kJSPropertyAttributeNone, NULL);
-    JSStringRelease(createServerName);
-}
\ No newline at end of file
+}
@@ -12,7 +12,9 @@
  * 
  * Key Features:
  * - Context isolation through JSGlobalContextRef
- * - Direct evaluation of JS scripts
+ * - One context group per thread, shared by every context made on it
+ * - Interned property-name atoms (ATOM(name)) for hot paths
+ * - Direct evaluation of JS scripts, registered under their sourceURL
  * - Automatic API exposure on context creation
  * 
  * Memory Management:
@@ -27,15 +29,40 @@
  */
 
 #include <JavaScriptCore/JavaScript.h>
+#include <stdlib.h>
+#include <string.h>
 #include "runtime.h"
 
+// Contexts made on one thread share a group (one JSC VM), so only the first
+// pays for the VM's builtins; groups are never shared across loops because
+// JSC serializes every context of a group on a single lock
+static JADE_THREAD_LOCAL JSContextGroupRef context_group = NULL;
+
+JADE_THREAD_LOCAL JSStringRef jade_atoms[JADE_ATOM_COUNT];
+
+void atoms_init(void) {
+    static const char* const names[JADE_ATOM_COUNT] = {
+#define JADE_ATOM_NAME(name) #name,
+        JADE_ATOMS(JADE_ATOM_NAME)
+#undef JADE_ATOM_NAME
+    };
+
+    if (jade_atoms[0]) return;
+    for (int i = 0; i < JADE_ATOM_COUNT; i++) {
+        jade_atoms[i] = JSStringCreateWithUTF8CString(names[i]);
+    }
+}
+
 /**
  * Creates a fresh JS execution environment with system APIs
  * returned context must be released with JSGlobalContextRelease()
  */
 JSGlobalContextRef create_js_context() {
-    // Create isolated JS context
-    JSGlobalContextRef ctx = JSGlobalContextCreate(NULL);
+    if (!context_group) context_group = JSContextGroupCreate();
+    atoms_init();
+
+    // The global class carries the timer functions in a static table
+    JSGlobalContextRef ctx = JSGlobalContextCreateInGroup(context_group, js_global_class());
     
     // Attach system APIs to global object
     bind_js_native_apis(ctx);
@@ -43,17 +70,86 @@ JSGlobalContextRef create_js_context() {
     return ctx;
 }
 
+/**
+ * Evaluates `len` bytes of UTF-8 source under `source_url` (shown in stack traces)
+ * @param source  Must be NUL-terminated at source[len]; may be a read-only mapping
+ */
+void execute_js_source(JSGlobalContextRef ctx, const char* source, size_t len, const char* source_url) {
+    // The UTF-8 C-string path keeps all-ASCII sources as 8-bit strings, half the
+    // size of the UTF-16 copy; sources with embedded NULs need the length-aware decoder
+    JSStringRef js_code = memchr(source, '\0', len) ? js_string_from_utf8(source, len)
+                                                     : JSStringCreateWithUTF8CString(source);
+    JSStringRef url = source_url ? JSStringCreateWithUTF8CString(source_url) : NULL;
+
+    JSEvaluateScript(ctx, js_code, NULL, url, 1, NULL);
+
+    if (url) JSStringRelease(url);
+    JSStringRelease(js_code);
+}
+
 /**
  * Executes raw JS code in specified context
  * @param script  Must be UTF-8 encoded null-terminated string
  */
 void execute_js(JSGlobalContextRef ctx, const char* script) {
-    // Convert C string to JSC string
-    JSStringRef js_code = JSStringCreateWithUTF8CString(script);
-    
-    // Execute script with default options
-    JSEvaluateScript(ctx, js_code, NULL, NULL, 1, NULL);
-    
-    // Cleanup JS string resources
-    JSStringRelease(js_code);
-}
\ No newline at end of file
+    execute_js_source(ctx, script, strlen(script), NULL);
+}
+
+/**
+ * Decodes UTF-8 into UTF-16 for JSStringCreateWithCharacters
+ * Unlike JSStringCreateWithUTF8CString this honours `len` and keeps NUL bytes
+ */
+JSStringRef js_string_from_utf8(const char* data, size_t len) {
+    JSChar stack_buf[256];
+    JSChar* out = len <= 256 ? stack_buf : malloc(len * sizeof(JSChar));
+    const unsigned char* s = (const unsigned char*)data;
+    size_t n = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        unsigned char c = s[i];
+
+        // ASCII fast path
+        if (c < 0x80) {
+            out[n++] = c;
+            i++;
+            continue;
+        }
+
+        uint32_t cp = 0xFFFD;
+        size_t need = (c >= 0xC2 && c <= 0xDF) ? 1
+            : (c >= 0xE0 && c <= 0xEF) ? 2
+            : (c >= 0xF0 && c <= 0xF4) ? 3 : 0;
+
+        if (need) {
+            uint32_t v = c & (0x3F >> need);
+            size_t j = 1;
+            for (; j <= need && i + j < len; j++) {
+                if ((s[i + j] & 0xC0) != 0x80) break;
+                v = (v << 6) | (s[i + j] & 0x3F);
+            }
+            if (j == need + 1 &&
+                !(need == 2 && (v < 0x800 || (v >= 0xD800 && v <= 0xDFFF))) &&
+                !(need == 3 && (v < 0x10000 || v > 0x10FFFF))) {
+                cp = v;
+                i += need + 1;
+            } else {
+                i += j;  // Skip the maximal invalid subsequence
+            }
+        } else {
+            i++;
+        }
+
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            out[n++] = (JSChar)(0xD800 + (cp >> 10));
+            out[n++] = (JSChar)(0xDC00 + (cp & 0x3FF));
+        } else {
+            out[n++] = (JSChar)cp;
+        }
+    }
+
+    JSStringRef str = JSStringCreateWithCharacters(out, n);
+    if (out != stack_buf) free(out);
+    return str;
+}
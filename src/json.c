@@ -0,0 +1,124 @@
+/**
+ * =====================================================================================
+ *
+ *        JSON.C - JSON Between Raw UTF-8 Bytes and JS Values
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Parsing a UTF-8 byte range (an HTTP body) straight into a JS value, for
+ *   `res.json()` / `req.json()`
+ * - Serializing a JS value straight into a write batch as UTF-8, for
+ *   `res.json(value)`
+ * - Recognising a JSON document for the client's Content-Type guess
+ *
+ * Scanning:
+ * - A body is scanned 16 bytes at a time (SSE2, or 8 bytes at a time as a
+ *   word-at-a-time loop elsewhere) for bytes that are not 7-bit ASCII, or NUL
+ * - Plain ASCII is handed to JSC as a C string, which the engine keeps as an
+ *   8-bit string, so its JSON parser runs on the bytes at half the size of the
+ *   UTF-16 copy js_string_from_utf8() would make; anything else takes the
+ *   js_string_from_utf8() path, which substitutes U+FFFD for invalid sequences
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Index of the first byte that is NUL or not 7-bit ASCII; `len` when there is none
+static size_t json_plain_prefix(const unsigned char* s, size_t len) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        // A NUL compares to 0xFF, so both cases show up in the sign bits
+        int mask = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero)));
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#else
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (((w - ones) & ~w & highs) | (w & highs)) break;
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (s[i] == 0 || s[i] >= 0x80) return i;
+    }
+    return len;
+}
+
+static bool json_is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool json_is_document(const char* data, size_t len) {
+    if (!data) return false;
+    const unsigned char* s = (const unsigned char*)data;
+    size_t start = 0;
+    while (start < len && json_is_space(s[start])) start++;
+    while (len > start && json_is_space(s[len - 1])) len--;
+    if (len - start < 2) return false;
+    return (s[start] == '{' && s[len - 1] == '}') || (s[start] == '[' && s[len - 1] == ']');
+}
+
+JSValueRef json_parse_utf8(JSContextRef ctx, const char* data, size_t len, JSValueRef* exception) {
+    const unsigned char* s = (const unsigned char*)data;
+    size_t start = 0;
+    while (start < len && json_is_space(s[start])) start++;
+    if (start == len) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("Unexpected end of JSON input");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+
+    JSStringRef text = json_plain_prefix(s + start, len - start) == len - start
+        ? JSStringCreateWithUTF8CString(data + start)
+        : js_string_from_utf8(data + start, len - start);
+    JSValueRef value = JSValueMakeFromJSONString(ctx, text);
+    JSStringRelease(text);
+
+    if (!value) {
+        JSStringRef msg = JSStringCreateWithUTF8CString("Invalid JSON");
+        *exception = JSValueMakeString(ctx, msg);
+        JSStringRelease(msg);
+        return JSValueMakeUndefined(ctx);
+    }
+    return value;
+}
+
+size_t json_stringify_to_batch(WriteBatch* batch, JSValueRef value, JSValueRef* exception) {
+    JSContextRef ctx = batch->ctx;
+    JSStringRef text = JSValueCreateJSONString(ctx, value, 0, exception);
+    if (!text) {
+        if (!*exception) {
+            JSStringRef msg = JSStringCreateWithUTF8CString("Value is not JSON-serializable");
+            *exception = JSValueMakeString(ctx, msg);
+            JSStringRelease(msg);
+        }
+        return 0;
+    }
+
+    // JSC encodes 8-bit strings to UTF-8 without widening them first
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(text);
+    char* dst = write_batch_alloc(batch, max_len);
+    size_t len = JSStringGetUTF8CString(text, dst, max_len) - 1;
+    JSStringRelease(text);
+
+    write_batch_add(batch, dst, len);
+    return len;
+}
@@ -12,11 +12,12 @@
  * 
  * Execution Flow:
  * 1. Parse CLI arguments
- * 2. Read JS file
- * 3. Initialize JSC context
- * 4. Start event loop
- * 5. Execute script
- * 6. Cleanup resources
+ * 2. Map JS file (read it when mapping is not possible)
+ * 3. Start cluster workers (--workers)
+ * 4. Initialize JSC context
+ * 5. Start event loop (and the CPU profiler, --cpu-prof)
+ * 6. Execute script
+ * 7. Write the profile, wait for workers, cleanup resources
  * 
  * Error Handling:
  * - Basic file read errors
@@ -35,11 +36,84 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Global variables for command-line arguments
 int process_argc;
 char** process_argv;
 
+// Script contents; data[len] is always a NUL byte
+typedef struct {
+    char* data;
+    size_t len;
+    bool mapped;
+} ScriptSource;
+
+// Maps the script when the zero-filled tail of its last page can act as the
+// NUL terminator (size not a page multiple); otherwise reads it into memory
+static bool load_script(const char* path, ScriptSource* script) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = S_ISREG(st.st_mode) ? (size_t)st.st_size : 0;
+    long page = sysconf(_SC_PAGESIZE);
+    if (size > 0 && size % (size_t)page != 0) {
+        void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_WILLNEED);
+            close(fd);
+            script->data = data;
+            script->len = size;
+            script->mapped = true;
+            return true;
+        }
+    }
+
+    // Pipes, empty files and page-multiple sizes
+    size_t cap = size ? size + 1 : 65536;
+    size_t len = 0;
+    char* data = malloc(cap);
+    while (data) {
+        if (len + 1 >= cap) {
+            char* grown = realloc(data, cap * 2);
+            if (!grown) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, data + len, cap - len - 1);
+        if (n == 0) break;
+        if (n < 0) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+    if (!data) return false;
+
+    data[len] = '\0';
+    script->data = data;
+    script->len = len;
+    script->mapped = false;
+    return true;
+}
+
 // Function to print version information
 void print_version() {
     printf("Jade Runtime v%s\n", RUNTIME_VERSION);
@@ -52,6 +126,21 @@ void print_help() {
     printf("  --version   Print version\n");
     printf("  --help      Show help\n");
     printf("  --eval <code> Execute inline code\n");
+    printf("  --workers <n|auto> Run the script on n event loops sharing listen ports\n");
+    printf("  --cpu-prof  Sample the main loop thread and write a profile on exit\n");
+    printf("  --cpu-prof-name <file> Profile path; .cpuprofile for Chrome, else collapsed stacks\n");
+    printf("  --cpu-prof-interval <us> Sampling interval in microseconds of CPU time (default 1000)\n");
+}
+
+// Starts the profiler once the loop exists, so its refill handle has a home
+static void start_cpu_profile(bool enabled, const char* name, unsigned interval_us) {
+    if (!enabled) return;
+    char path[PATH_MAX];
+    if (name) snprintf(path, sizeof(path), "%s", name);
+    else snprintf(path, sizeof(path), "jade.%ld.cpuprofile", (long)getpid());
+
+    ProfilerOptions options = { path, interval_us };
+    if (!profiler_start(&options)) fprintf(stderr, "ERROR: Could not start the CPU profiler\n");
 }
 
 
@@ -60,6 +149,14 @@ int main(int argc, char** argv) {
     process_argv = argv;
     char* eval_code = NULL;
     char* script_file = NULL;
+    int workers = 1;
+    bool cpu_prof = false;
+    const char* cpu_prof_name = NULL;
+    unsigned cpu_prof_interval = 0;
+
+    // Writes to a peer that went away must fail with EPIPE, not kill the process
+    // (sendfile() has no MSG_NOSIGNAL equivalent)
+    signal(SIGPIPE, SIG_IGN);
 
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
@@ -76,6 +173,39 @@ int main(int argc, char** argv) {
             }
             eval_code = argv[i + 1];
             i++; // Skip code argument
+        } else if (strcmp(argv[i], "--workers") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --workers requires a count or 'auto'\n");
+                return 1;
+            }
+            if (strcmp(argv[i + 1], "auto") == 0) {
+                workers = cluster_cpu_count();
+            } else {
+                workers = atoi(argv[i + 1]);
+                if (workers < 1) {
+                    fprintf(stderr, "Error: --workers must be at least 1\n");
+                    return 1;
+                }
+            }
+            i++; // Skip count argument
+        } else if (strcmp(argv[i], "--cpu-prof") == 0) {
+            cpu_prof = true;
+        } else if (strcmp(argv[i], "--cpu-prof-name") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --cpu-prof-name requires a file name\n");
+                return 1;
+            }
+            cpu_prof = true;
+            cpu_prof_name = argv[i + 1];
+            i++; // Skip file argument
+        } else if (strcmp(argv[i], "--cpu-prof-interval") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "Error: --cpu-prof-interval requires a positive number of microseconds\n");
+                return 1;
+            }
+            cpu_prof = true;
+            cpu_prof_interval = (unsigned)atoi(argv[i + 1]);
+            i++; // Skip interval argument
         } else {
             script_file = argv[i];
             break;
@@ -84,10 +214,15 @@ int main(int argc, char** argv) {
 
     // Handle --eval
     if (eval_code != NULL) {
+        cluster_set_script(eval_code, strlen(eval_code), NULL);
+        cluster_start(workers);
         JSGlobalContextRef ctx = create_js_context();
         init_event_loop();
+        start_cpu_profile(cpu_prof, cpu_prof_name, cpu_prof_interval);
         execute_js(ctx, eval_code);
         run_event_loop();
+        profiler_stop();
+        cluster_wait();
         JSGlobalContextRelease(ctx);
         return 0;
     }
@@ -99,30 +234,35 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    // Read JS file
-    FILE* f = fopen(argv[1], "rb");
-    if (!f) {
-        fprintf(stderr, "Error: Could not open file %s\n", argv[1]);
+    // Map JS file
+    ScriptSource script;
+    if (!load_script(script_file, &script)) {
+        fprintf(stderr, "Error: Could not open file %s\n", script_file);
         return 1;
     }
-    fseek(f, 0, SEEK_END);
-    long len = ftell(f);
-    rewind(f);
-    char* script = malloc(len + 1);
-    fread(script, 1, len, f);
-    script[len] = '\0';
-    fclose(f);
+
+    // The absolute path becomes the sourceURL seen in stack traces
+    char source_url[PATH_MAX];
+    if (!realpath(script_file, source_url)) snprintf(source_url, sizeof(source_url), "%s", script_file);
+
+    // Workers re-run the same script; the main thread is worker 0
+    cluster_set_script(script.data, script.len, source_url);
+    cluster_start(workers);
 
     // Initialize runtime components
     JSGlobalContextRef ctx = create_js_context();
     init_event_loop();
+    start_cpu_profile(cpu_prof, cpu_prof_name, cpu_prof_interval);
 
     // Execute script and run event loop
-    execute_js(ctx, script);
+    execute_js_source(ctx, script.data, script.len, source_url);
     run_event_loop();
+    profiler_stop();
+    cluster_wait();
 
     // Cleanup
     JSGlobalContextRelease(ctx);
-    free(script);
+    if (script.mapped) munmap(script.data, script.len);
+    else free(script.data);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+/**
+ * =====================================================================================
+ *
+ *        METRICS.C - Runtime Metrics (process.metrics, Prometheus text)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - The per-thread counters modules update inline (socket bytes, threadpool
+ *   jobs, DNS lookups)
+ * - Collecting a snapshot from those counters, the loop probe, memory pool
+ *   occupancy and a walk over the loop's handles
+ * - Presenting the snapshot as a JS object or as Prometheus text
+ *
+ * Cost:
+ * - Counters are plain increments on the owning thread; the handle walk and
+ *   the pool lookups happen only when metrics are read
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+JADE_THREAD_LOCAL RuntimeCounters runtime_counters;
+
+typedef struct {
+    LoopMetrics loop;
+    size_t handles[UV_HANDLE_TYPE_MAX];
+    size_t active_handles;
+    size_t active_requests;
+    size_t http_requests;       // Client requests not yet answered
+    size_t http_connections;    // Server connections open
+    size_t fs_queue;
+    size_t dns_queue;
+    size_t timers;
+    size_t rss;
+} MetricsSnapshot;
+
+static const char* const metrics_socket_names[] = { "net", "http_server", "http_client", "websocket" };
+
+static size_t metrics_pool_in_use(const char* name) {
+    for (MemPool* pool = pool_registry(); pool; pool = pool->next) {
+        if (strcmp(pool->name, name) == 0) return pool->in_use;
+    }
+    return 0;
+}
+
+static void metrics_count_handle(uv_handle_t* handle, void* arg) {
+    MetricsSnapshot* snap = (MetricsSnapshot*)arg;
+    if (!uv_is_active(handle) || uv_is_closing(handle)) return;
+    uv_handle_type type = uv_handle_get_type(handle);
+    if (type > UV_UNKNOWN_HANDLE && type < UV_HANDLE_TYPE_MAX) snap->handles[type]++;
+    snap->active_handles++;
+}
+
+static void metrics_collect(MetricsSnapshot* snap) {
+    memset(snap, 0, sizeof(*snap));
+    loop_metrics_read(&snap->loop);
+    uv_walk(loop, metrics_count_handle, snap);
+    snap->active_requests = loop->active_reqs.count;
+
+    snap->http_requests = metrics_pool_in_use("http.request");
+    snap->http_connections = metrics_pool_in_use("http.connection");
+
+    // Each fs request has at most one operation on the threadpool at a time
+    snap->fs_queue = metrics_pool_in_use("fs.read") + metrics_pool_in_use("fs.write") +
+                     metrics_pool_in_use("fs.exists") + runtime_counters.fs_work;
+    snap->dns_queue = runtime_counters.dns_lookups;
+    snap->timers = timer_count();
+
+    if (uv_resident_set_memory(&snap->rss) != 0) snap->rss = 0;
+}
+
+static const ByteCounters* metrics_socket_bytes(size_t i) {
+    const ByteCounters* counters[] = {
+        &runtime_counters.net, &runtime_counters.http_server, &runtime_counters.http_client,
+        &runtime_counters.websocket
+    };
+    return counters[i];
+}
+
+static double metrics_utilization(const LoopMetrics* m) {
+    uint64_t total = m->busy_ns + m->idle_ns;
+    return total ? (double)m->busy_ns / (double)total : 0.0;
+}
+
+// ------------------------- JS object ------------------------- //
+
+static void metrics_set(JSContextRef ctx, JSObjectRef object, const char* name, double value) {
+    JSStringRef key = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, object, key, JSValueMakeNumber(ctx, value), kJSPropertyAttributeNone, NULL);
+    JSStringRelease(key);
+}
+
+static JSObjectRef metrics_child(JSContextRef ctx, JSObjectRef parent, const char* name) {
+    JSObjectRef child = JSObjectMake(ctx, NULL, NULL);
+    JSStringRef key = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, parent, key, child, kJSPropertyAttributeNone, NULL);
+    JSStringRelease(key);
+    return child;
+}
+
+JSValueRef js_process_metrics(JSContextRef ctx, JSObjectRef function,
+                              JSObjectRef thisObject, size_t argc,
+                              const JSValueRef args[], JSValueRef* exception) {
+    MetricsSnapshot snap;
+    metrics_collect(&snap);
+    JSObjectRef result = JSObjectMake(ctx, NULL, NULL);
+
+    JSObjectRef loopObj = metrics_child(ctx, result, "loop");
+    metrics_set(ctx, loopObj, "iterations", (double)snap.loop.iterations);
+    metrics_set(ctx, loopObj, "iterationMs", snap.loop.last_iteration_ns / 1e6);
+    metrics_set(ctx, loopObj, "busyMs", snap.loop.last_busy_ns / 1e6);
+    metrics_set(ctx, loopObj, "maxBusyMs", snap.loop.max_busy_ns / 1e6);
+    metrics_set(ctx, loopObj, "lagMs", snap.loop.last_lag_ns / 1e6);
+    metrics_set(ctx, loopObj, "maxLagMs", snap.loop.max_lag_ns / 1e6);
+    metrics_set(ctx, loopObj, "utilization", metrics_utilization(&snap.loop));
+
+    JSObjectRef handles = metrics_child(ctx, result, "handles");
+    for (int type = UV_UNKNOWN_HANDLE + 1; type < UV_HANDLE_TYPE_MAX; type++) {
+        if (snap.handles[type]) metrics_set(ctx, handles, uv_handle_type_name((uv_handle_type)type), (double)snap.handles[type]);
+    }
+    metrics_set(ctx, handles, "total", (double)snap.active_handles);
+    metrics_set(ctx, result, "requests", (double)snap.active_requests);
+
+    JSObjectRef http = metrics_child(ctx, result, "http");
+    metrics_set(ctx, http, "clientRequests", (double)snap.http_requests);
+    metrics_set(ctx, http, "serverConnections", (double)snap.http_connections);
+    metrics_set(ctx, http, "dnsCacheHits", (double)runtime_counters.dns_cache_hits);
+
+    static const char* const js_socket_names[] = { "net", "httpServer", "httpClient", "websocket" };
+    JSObjectRef bytes = metrics_child(ctx, result, "bytes");
+    for (size_t i = 0; i < sizeof(js_socket_names) / sizeof(js_socket_names[0]); i++) {
+        JSObjectRef socket = metrics_child(ctx, bytes, js_socket_names[i]);
+        metrics_set(ctx, socket, "read", (double)metrics_socket_bytes(i)->bytes_read);
+        metrics_set(ctx, socket, "written", (double)metrics_socket_bytes(i)->bytes_written);
+    }
+
+    JSObjectRef threadpool = metrics_child(ctx, result, "threadpool");
+    metrics_set(ctx, threadpool, "fs", (double)snap.fs_queue);
+    metrics_set(ctx, threadpool, "dns", (double)snap.dns_queue);
+
+    JSObjectRef tls = metrics_child(ctx, result, "tls");
+    metrics_set(ctx, tls, "handshakes", (double)runtime_counters.tls_handshakes);
+    metrics_set(ctx, tls, "resumed", (double)runtime_counters.tls_resumed);
+
+    metrics_set(ctx, result, "timers", (double)snap.timers);
+    JSObjectRef memory = metrics_child(ctx, result, "memory");
+    metrics_set(ctx, memory, "rss", (double)snap.rss);
+    return result;
+}
+
+// ------------------------- Prometheus text ------------------------- //
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} MetricsText;
+
+static void metrics_printf(MetricsText* text, const char* fmt, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        size_t room = text->cap - text->len;
+        int n = vsnprintf(text->data + text->len, room, fmt, args);
+        va_end(args);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            text->len += (size_t)n;
+            return;
+        }
+        size_t cap = text->cap * 2;
+        while (cap - text->len <= (size_t)n) cap *= 2;
+        char* data = realloc(text->data, cap);
+        if (!data) return;
+        text->data = data;
+        text->cap = cap;
+    }
+}
+
+static void metrics_family(MetricsText* text, const char* name, const char* type, const char* help) {
+    metrics_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+char* metrics_format_prometheus(size_t* len) {
+    MetricsSnapshot snap;
+    metrics_collect(&snap);
+
+    MetricsText text = { malloc(4096), 0, 4096 };
+    if (!text.data) {
+        *len = 0;
+        return NULL;
+    }
+
+    metrics_family(&text, "jade_event_loop_iterations_total", "counter", "Event loop iterations.");
+    metrics_printf(&text, "jade_event_loop_iterations_total %llu\n", (unsigned long long)snap.loop.iterations);
+    metrics_family(&text, "jade_event_loop_busy_seconds_total", "counter", "Time the loop spent outside the poll wait.");
+    metrics_printf(&text, "jade_event_loop_busy_seconds_total %.9f\n", snap.loop.busy_ns / 1e9);
+    metrics_family(&text, "jade_event_loop_idle_seconds_total", "counter", "Time the loop spent blocked waiting for events.");
+    metrics_printf(&text, "jade_event_loop_idle_seconds_total %.9f\n", snap.loop.idle_ns / 1e9);
+    metrics_family(&text, "jade_event_loop_iteration_seconds", "gauge", "Duration of the last loop iteration.");
+    metrics_printf(&text, "jade_event_loop_iteration_seconds %.9f\n", snap.loop.last_iteration_ns / 1e9);
+    metrics_family(&text, "jade_event_loop_lag_seconds", "gauge", "How late the last poll phase returned for its next timer.");
+    metrics_printf(&text, "jade_event_loop_lag_seconds %.9f\n", snap.loop.last_lag_ns / 1e9);
+    metrics_family(&text, "jade_event_loop_lag_max_seconds", "gauge", "Largest lag seen since the loop started.");
+    metrics_printf(&text, "jade_event_loop_lag_max_seconds %.9f\n", snap.loop.max_lag_ns / 1e9);
+
+    metrics_family(&text, "jade_active_handles", "gauge", "Active libuv handles by type.");
+    for (int type = UV_UNKNOWN_HANDLE + 1; type < UV_HANDLE_TYPE_MAX; type++) {
+        if (!snap.handles[type]) continue;
+        metrics_printf(&text, "jade_active_handles{type=\"%s\"} %zu\n",
+                       uv_handle_type_name((uv_handle_type)type), snap.handles[type]);
+    }
+    metrics_family(&text, "jade_active_requests", "gauge", "Active libuv requests.");
+    metrics_printf(&text, "jade_active_requests %zu\n", snap.active_requests);
+
+    metrics_family(&text, "jade_http_client_requests", "gauge", "HTTP client requests in flight.");
+    metrics_printf(&text, "jade_http_client_requests %zu\n", snap.http_requests);
+    metrics_family(&text, "jade_http_server_connections", "gauge", "Open HTTP server connections.");
+    metrics_printf(&text, "jade_http_server_connections %zu\n", snap.http_connections);
+    metrics_family(&text, "jade_http_dns_cache_hits_total", "counter", "HTTP client connects answered from the DNS cache.");
+    metrics_printf(&text, "jade_http_dns_cache_hits_total %llu\n", (unsigned long long)runtime_counters.dns_cache_hits);
+
+    metrics_family(&text, "jade_socket_read_bytes_total", "counter", "Bytes read by socket type.");
+    for (size_t i = 0; i < sizeof(metrics_socket_names) / sizeof(metrics_socket_names[0]); i++) {
+        metrics_printf(&text, "jade_socket_read_bytes_total{socket=\"%s\"} %llu\n", metrics_socket_names[i],
+                       (unsigned long long)metrics_socket_bytes(i)->bytes_read);
+    }
+    metrics_family(&text, "jade_socket_written_bytes_total", "counter", "Bytes written by socket type.");
+    for (size_t i = 0; i < sizeof(metrics_socket_names) / sizeof(metrics_socket_names[0]); i++) {
+        metrics_printf(&text, "jade_socket_written_bytes_total{socket=\"%s\"} %llu\n", metrics_socket_names[i],
+                       (unsigned long long)metrics_socket_bytes(i)->bytes_written);
+    }
+
+    metrics_family(&text, "jade_threadpool_queue_depth", "gauge", "Jobs queued on or running in the threadpool.");
+    metrics_printf(&text, "jade_threadpool_queue_depth{pool=\"fs\"} %zu\n", snap.fs_queue);
+    metrics_printf(&text, "jade_threadpool_queue_depth{pool=\"dns\"} %zu\n", snap.dns_queue);
+    metrics_family(&text, "jade_tls_handshakes_total", "counter", "Completed TLS handshakes.");
+    metrics_printf(&text, "jade_tls_handshakes_total %llu\n", (unsigned long long)runtime_counters.tls_handshakes);
+    metrics_family(&text, "jade_tls_resumed_total", "counter", "TLS handshakes that resumed a session.");
+    metrics_printf(&text, "jade_tls_resumed_total %llu\n", (unsigned long long)runtime_counters.tls_resumed);
+    metrics_family(&text, "jade_timers", "gauge", "Live timers.");
+    metrics_printf(&text, "jade_timers %zu\n", snap.timers);
+    metrics_family(&text, "jade_resident_memory_bytes", "gauge", "Resident set size of the process.");
+    metrics_printf(&text, "jade_resident_memory_bytes %zu\n", snap.rss);
+
+    *len = text.len;
+    return text.data;
+}
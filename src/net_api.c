@@ -1,3 +1,39 @@
+/**
+ * =====================================================================================
+ *
+ *        NET_API.C - TCP Servers and Duplex Sockets (net.createServer / net.connect)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Accepting connections and handing each one to JS as a Socket
+ * - Outbound connections with net.connect()
+ * - "data"/"end" on the read side, write()/end() with "drain" on the write
+ *   side, and a single "close" once both are done or the socket is destroyed
+ *
+ * Flow Control:
+ * - Reading starts when a "data" listener is added and stops on pause(), so a
+ *   slow consumer leaves bytes in the kernel and TCP pushes back on the peer
+ * - write() returns false once the bytes queued in libuv plus those not yet
+ *   flushed reach highWaterMark; "drain" fires when both have fully emptied
+ * - When the peer ends, the socket ends its own side too (no half-open sockets)
+ *
+ * Write Coalescing:
+ * - write() only appends to the socket's pending WriteBatch (strings are
+ *   encoded into its arena, binary data is referenced in place); the batch is
+ *   sent as one vectored uv_try_write/uv_write at the end of the loop tick
+ * - cork() holds writes past the tick until the matching uncork(); end() and
+ *   the connect also flush
+ *
+ * Memory Management:
+ * - A socket's JS object is protected from creation until "close"; the native
+ *   struct is freed by the class finalizer
+ * - A DNS lookup or deferred error holds the socket open; destroy() during one
+ *   closes the handle once it returns
+ *
+ * =====================================================================================
+ */
+
 #include <JavaScriptCore/JavaScript.h>
 #include <uv.h>
 #include <stdlib.h>
@@ -5,8 +41,11 @@
 #include <string.h>
 #include "runtime.h"
 
-// Define a class to store ServerRequest*
-static JSClassRef serverClass = NULL;
+#define NET_SOCKET_DEFAULT_HWM (16 * 1024)
+
+// Classes for server and socket objects, created on first use
+static JADE_THREAD_LOCAL JSClassRef serverClass = NULL;
+static JADE_THREAD_LOCAL JSClassRef socketClass = NULL;
 
 // TCP Server Request Structure
 typedef struct {
@@ -15,15 +54,38 @@ typedef struct {
     JSObjectRef callback;
 } ServerRequest;
 
-// Structure to hold client socket data
 typedef struct {
-    uv_tcp_t* client;
-} ClientRequest;
-
-// Write Callback
-void on_client_write(uv_write_t* req, int status) {
-    free(req->data);
-    free(req);
+    TickTask flush_task;       // First, so the tick callback can cast back
+    uv_tcp_t handle;
+    uv_connect_t connect_req;
+    uv_shutdown_t shutdown_req;
+    JSContextRef ctx;
+    JSObjectRef object;
+    EventListeners listeners;
+    WriteBatch* pending;       // Writes since the last flush
+    unsigned corked;
+    size_t high_water_mark;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    int port;                  // Outbound: applied to the resolved address
+    int deferred_error;
+    bool busy;                 // DNS lookup or deferred error outstanding
+    bool connecting;
+    bool flowing;
+    bool reading;              // uv_read_start() is active
+    bool need_drain;
+    bool ending;               // end() was called; shutdown follows the queued writes
+    bool read_ended;           // Peer sent EOF
+    bool write_ended;          // Shutdown completed
+    bool had_error;
+    bool closing;
+} NetSocket;
+
+static JSValueRef net_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
 }
 
 // Destructor for the server object
@@ -35,61 +97,404 @@ void server_finalize(JSObjectRef object) {
     }
 }
 
-// Client Connection Callback
-void on_new_connection(uv_stream_t* server, int status) {
-    if (status < 0) return;
+// ========================= SOCKET LIFECYCLE ========================= //
 
-    ServerRequest* sr = (ServerRequest*)server->data;
+static void net_socket_update_reading(NetSocket* s);
+static void net_socket_end(NetSocket* s);
+
+static size_t net_socket_buffered(NetSocket* s) {
+    return uv_stream_get_write_queue_size((uv_stream_t*)&s->handle) + (s->pending ? s->pending->total : 0);
+}
+
+static void on_net_socket_closed(uv_handle_t* handle) {
+    NetSocket* s = (NetSocket*)handle->data;
+    JSValueRef args[] = { JSValueMakeBoolean(s->ctx, s->had_error) };
+    event_listeners_emit(&s->listeners, s->ctx, s->object, "close", 1, args);
+    event_listeners_clear(&s->listeners, s->ctx);
+    JSValueUnprotect(s->ctx, s->object);
+}
+
+// Closing cancels the connect, queued writes and shutdown; their callbacks see `closing`
+static void net_socket_close_handle(NetSocket* s) {
+    tick_task_cancel(&s->flush_task);
+    if (s->pending) write_batch_free(s->pending);
+    s->pending = NULL;
+    uv_close((uv_handle_t*)&s->handle, on_net_socket_closed);
+}
+
+static void net_socket_close(NetSocket* s) {
+    if (s->closing) return;
+    s->closing = true;
+    s->flowing = false;
+    if (!s->busy) net_socket_close_handle(s);
+}
+
+static void net_socket_fail(NetSocket* s, int status) {
+    if (s->closing) return;
+    s->had_error = true;
+    JSStringRef msg = JSStringCreateWithUTF8CString(uv_strerror(status));
+    JSValueRef args[] = { JSValueMakeString(s->ctx, msg) };
+    JSStringRelease(msg);
+    event_listeners_emit(&s->listeners, s->ctx, s->object, "error", 1, args);
+    net_socket_close(s);
+}
+
+static void on_net_socket_deferred_error(void* data) {
+    NetSocket* s = (NetSocket*)data;
+    s->busy = false;
+    if (s->closing) net_socket_close_handle(s);
+    else net_socket_fail(s, s->deferred_error);
+}
+
+// Reports an error on the next loop turn, once the caller has attached its listeners
+static void net_socket_fail_later(NetSocket* s, int status) {
+    s->busy = true;
+    s->deferred_error = status;
+    timer_start(0, 0, on_net_socket_deferred_error, s);
+}
+
+static NetSocket* net_socket_new(JSContextRef ctx, size_t high_water_mark) {
+    NetSocket* s = calloc(1, sizeof(NetSocket));
+    s->ctx = ctx;
+    s->high_water_mark = high_water_mark;
+    uv_tcp_init(loop, &s->handle);
+    s->handle.data = s;
+
+    s->object = JSObjectMake(ctx, socketClass, s);
+    JSValueProtect(ctx, s->object);
+    return s;
+}
+
+// ========================= READ SIDE ========================= //
+
+static void on_net_socket_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+    PROFILE_SPAN("net.read");
+    NetSocket* s = (NetSocket*)stream->data;
+
+    if (nread > 0) {
+        // JS owns its copy; the pooled read buffer goes straight back
+        char* bytes = malloc((size_t)nread);
+        memcpy(bytes, buf->base, (size_t)nread);
+        read_buffer_release(buf);
+        s->bytes_read += (uint64_t)nread;
+        runtime_counters.net.bytes_read += (uint64_t)nread;
+
+        JSValueRef args[] = { js_buffer_from_malloc(s->ctx, bytes, (size_t)nread) };
+        event_listeners_emit(&s->listeners, s->ctx, s->object, "data", 1, args);
+        return;
+    }
+
+    read_buffer_release(buf);
+    if (nread == 0) return;
+    if (nread != UV_EOF) {
+        net_socket_fail(s, (int)nread);
+        return;
+    }
+
+    s->read_ended = true;
+    net_socket_update_reading(s);
+    event_listeners_emit(&s->listeners, s->ctx, s->object, "end", 0, NULL);
+
+    if (s->write_ended) net_socket_close(s);
+    else net_socket_end(s);
+}
+
+// Starts or stops reading to match the flowing state
+static void net_socket_update_reading(NetSocket* s) {
+    bool want = s->flowing && !s->read_ended && !s->closing && !s->connecting;
+    if (want == s->reading) return;
+
+    int status = want ? uv_read_start((uv_stream_t*)&s->handle, read_buffer_alloc, on_net_socket_read)
+                      : uv_read_stop((uv_stream_t*)&s->handle);
+    if (status < 0) {
+        net_socket_fail(s, status);
+        return;
+    }
+    s->reading = want;
+}
+
+// ========================= WRITE SIDE ========================= //
+
+static void on_net_socket_written(WriteBatch* batch, int status) {
+    NetSocket* s = (NetSocket*)batch->data;
+    if (s->closing) return;
+    if (status < 0) {
+        net_socket_fail(s, status);
+        return;
+    }
+
+    s->bytes_written += batch->total;
+    runtime_counters.net.bytes_written += batch->total;
+    if (s->need_drain && net_socket_buffered(s) == 0) {
+        s->need_drain = false;
+        event_listeners_emit(&s->listeners, s->ctx, s->object, "drain", 0, NULL);
+    }
+}
+
+// Sends everything written since the last flush as one vectored write
+static void net_socket_flush(NetSocket* s) {
+    tick_task_cancel(&s->flush_task);
+    if (!s->pending || s->connecting || s->closing) return;
+
+    WriteBatch* batch = s->pending;
+    s->pending = NULL;
+    batch->data = s;
+    write_batch_send(batch, (uv_stream_t*)&s->handle, on_net_socket_written);
+}
+
+static void on_net_socket_tick(TickTask* task) {
+    NetSocket* s = (NetSocket*)task;
+    if (!s->corked) net_socket_flush(s);
+}
+
+static void net_socket_write_finished(NetSocket* s) {
+    s->write_ended = true;
+    event_listeners_emit(&s->listeners, s->ctx, s->object, "finish", 0, NULL);
+
+    // Nobody reading means the peer's EOF would never be seen
+    if (s->read_ended || !event_listeners_has(&s->listeners, "data")) net_socket_close(s);
+}
+
+static void on_net_socket_shutdown(uv_shutdown_t* req, int status) {
+    NetSocket* s = (NetSocket*)req->data;
+    if (s->closing) return;
+    if (status < 0 && status != UV_ENOTCONN) net_socket_fail(s, status);
+    else net_socket_write_finished(s);
+}
+
+static void net_socket_shutdown(NetSocket* s) {
+    s->corked = 0;
+    net_socket_flush(s);
+    if (s->closing) return;
+
+    s->shutdown_req.data = s;
+    int status = uv_shutdown(&s->shutdown_req, (uv_stream_t*)&s->handle, on_net_socket_shutdown);
+
+    // ENOTCONN: the peer already tore the connection down, so there is nothing left to end
+    if (status == UV_ENOTCONN) net_socket_write_finished(s);
+    else if (status < 0) net_socket_fail(s, status);
+}
+
+// Half-closes once queued writes are flushed (or right after connecting)
+static void net_socket_end(NetSocket* s) {
+    if (s->ending || s->closing) return;
+    s->ending = true;
+    if (!s->connecting) net_socket_shutdown(s);
+}
+
+// Appends `value` to the pending batch and reports whether the caller may keep writing
+static bool net_socket_write(NetSocket* s, JSValueRef value, JSValueRef* exception) {
+    bool fresh = s->pending == NULL;
+    if (fresh) s->pending = write_batch_new(s->ctx);
+
+    size_t slots = s->pending->nbufs;
+    write_batch_add_value(s->pending, value, exception);
+    if (*exception) {
+        write_batch_clear(s->pending, slots);
+        if (fresh) {
+            write_batch_free(s->pending);
+            s->pending = NULL;
+        }
+        return false;
+    }
+
+    // Connecting sockets flush from the connect callback instead
+    if (!s->corked && !s->connecting) tick_task_schedule(&s->flush_task, on_net_socket_tick);
+
+    if (net_socket_buffered(s) < s->high_water_mark) return true;
+    s->need_drain = true;
+    return false;
+}
+
+// ========================= SOCKET METHODS ========================= //
 
-    // Accept client connection
-    uv_tcp_t* client = (uv_tcp_t*)malloc(sizeof(uv_tcp_t));
-    uv_tcp_init(uv_default_loop(), client);
-    if (uv_accept(server, (uv_stream_t*)client) == 0) {
-        // Create ClientRequest struct
-        ClientRequest* cr = (ClientRequest*)malloc(sizeof(ClientRequest));
-        cr->client = client;
+// `socket.on(event, listener)`; a "data" listener starts reading
+static JSValueRef socket_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                            size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (!s || s->closing) return thisObject;
+    if (argc < 2) return net_throw(ctx, exception, "on() requires an event name and a listener function");
+    if (!event_listeners_on(&s->listeners, ctx, args[0], args[1], exception)) return JSValueMakeUndefined(ctx);
 
-        // Create a JavaScript class for the client object
-        JSClassDefinition classDef = kJSClassDefinitionEmpty;
-        classDef.version = 0;
-        JSClassRef clientClass = JSClassCreate(&classDef);
+    if (!s->flowing && event_listeners_has(&s->listeners, "data")) {
+        s->flowing = true;
+        net_socket_update_reading(s);
+    }
+    return thisObject;
+}
 
-        // Create the JavaScript client object
-        JSObjectRef clientObject = JSObjectMake(sr->ctx, clientClass, cr);
-        JSClassRelease(clientClass);
+// `socket.write(data)` - strings, Buffers, ArrayBuffers and typed arrays
+static JSValueRef socket_write(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                               size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    const char* bytes;
+    size_t len;
+    if (argc < 1 || (!JSValueIsString(ctx, args[0]) && !js_value_get_bytes(ctx, args[0], &bytes, &len))) {
+        return net_throw(ctx, exception, "socket.write requires a string or buffer argument");
+    }
 
-        // Attach `client.write(data)`
-        JSStringRef writeName = JSStringCreateWithUTF8CString("write");
-        JSObjectRef writeFunc = JSObjectMakeFunctionWithCallback(sr->ctx, writeName, client_write);
-        JSObjectSetProperty(sr->ctx, clientObject, writeName, writeFunc, kJSPropertyAttributeNone, NULL);
-        JSStringRelease(writeName);
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (!s || s->ending || s->closing) return JSValueMakeBoolean(ctx, false);
+    return JSValueMakeBoolean(ctx, net_socket_write(s, args[0], exception));
+}
 
-        // **Ensure client object has useful properties**
-        JSStringRef idKey = JSStringCreateWithUTF8CString("id");
-        JSValueRef idValue = JSValueMakeNumber(sr->ctx, (double)(uintptr_t)client);
-        JSObjectSetProperty(sr->ctx, clientObject, idKey, idValue, kJSPropertyAttributeNone, NULL);
-        JSStringRelease(idKey);
+// `socket.end([data])`
+static JSValueRef socket_end(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                             size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (!s || s->ending || s->closing) return thisObject;
 
-        // Call JavaScript callback
-        JSValueRef args[] = { clientObject };
-        JSObjectCallAsFunction(sr->ctx, sr->callback, NULL, 1, args, NULL);
-    } else {
-        uv_close((uv_handle_t*)client, NULL);
-        free(client);
+    if (argc > 0 && !JSValueIsUndefined(ctx, args[0])) {
+        net_socket_write(s, args[0], exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
     }
+    net_socket_end(s);
+    return thisObject;
+}
+
+// `socket.pause()`
+static JSValueRef socket_pause(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                               size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (s && !s->closing) {
+        s->flowing = false;
+        net_socket_update_reading(s);
+    }
+    return thisObject;
+}
+
+// `socket.resume()`
+static JSValueRef socket_resume(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (s && !s->closing) {
+        s->flowing = true;
+        net_socket_update_reading(s);
+    }
+    return thisObject;
+}
+
+// `socket.cork()` - holds writes until the matching uncork()
+static JSValueRef socket_cork(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                              size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (s && !s->closing && !s->ending) s->corked++;
+    return thisObject;
+}
+
+// `socket.uncork()` - the last one sends everything written while corked
+static JSValueRef socket_uncork(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (s && s->corked && --s->corked == 0) net_socket_flush(s);
+    return thisObject;
+}
+
+// `socket.destroy()` - closes at once, dropping anything still queued
+static JSValueRef socket_destroy(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(thisObject);
+    if (s) net_socket_close(s);
+    return thisObject;
+}
+
+// `socket.id` - stable identifier for the connection
+static JSValueRef socket_get_id(JSContextRef ctx, JSObjectRef object,
+                                JSStringRef propertyName, JSValueRef* exception) {
+    return JSValueMakeNumber(ctx, (double)(uintptr_t)JSObjectGetPrivate(object));
+}
+
+static JSValueRef socket_get_bytes_read(JSContextRef ctx, JSObjectRef object,
+                                        JSStringRef propertyName, JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, s ? (double)s->bytes_read : 0);
+}
+
+static JSValueRef socket_get_bytes_written(JSContextRef ctx, JSObjectRef object,
+                                           JSStringRef propertyName, JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, s ? (double)s->bytes_written : 0);
+}
+
+// `socket.writableLength` - bytes accepted by write() but not yet sent
+static JSValueRef socket_get_writable_length(JSContextRef ctx, JSObjectRef object,
+                                             JSStringRef propertyName, JSValueRef* exception) {
+    NetSocket* s = (NetSocket*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, s && !s->closing ? (double)net_socket_buffered(s) : 0);
+}
+
+static void socket_finalize(JSObjectRef object) {
+    free(JSObjectGetPrivate(object));
 }
 
+static const JSStaticFunction server_functions[] = {
+    { "listen", net_server_listen, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticFunction socket_functions[] = {
+    { "on", socket_on, kJSPropertyAttributeNone },
+    { "write", socket_write, kJSPropertyAttributeNone },
+    { "end", socket_end, kJSPropertyAttributeNone },
+    { "cork", socket_cork, kJSPropertyAttributeNone },
+    { "uncork", socket_uncork, kJSPropertyAttributeNone },
+    { "pause", socket_pause, kJSPropertyAttributeNone },
+    { "resume", socket_resume, kJSPropertyAttributeNone },
+    { "destroy", socket_destroy, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue socket_values[] = {
+    { "id", socket_get_id, NULL, kJSPropertyAttributeReadOnly },
+    { "bytesRead", socket_get_bytes_read, NULL, kJSPropertyAttributeReadOnly },
+    { "bytesWritten", socket_get_bytes_written, NULL, kJSPropertyAttributeReadOnly },
+    { "writableLength", socket_get_writable_length, NULL, kJSPropertyAttributeReadOnly },
+    { NULL, NULL, NULL, 0 }
+};
+
+// Creates the class definitions for server and socket objects (only once)
+static void net_init_classes(void) {
+    if (serverClass != NULL) return;
+
+    JSClassDefinition classDef = kJSClassDefinitionEmpty;
+    classDef.className = "Server";
+    classDef.staticFunctions = server_functions;
+    classDef.finalize = server_finalize;
+    serverClass = JSClassCreate(&classDef);
+
+    JSClassDefinition socketDef = kJSClassDefinitionEmpty;
+    socketDef.className = "Socket";
+    socketDef.staticFunctions = socket_functions;
+    socketDef.staticValues = socket_values;
+    socketDef.finalize = socket_finalize;
+    socketClass = JSClassCreate(&socketDef);
+}
+
+// ========================= SERVER ========================= //
+
+// Client Connection Callback
+void on_new_connection(uv_stream_t* server, int status) {
+    PROFILE_SPAN("net.accept");
+    if (status < 0) return;
+
+    ServerRequest* sr = (ServerRequest*)server->data;
+    NetSocket* s = net_socket_new(sr->ctx, NET_SOCKET_DEFAULT_HWM);
+    if (uv_accept(server, (uv_stream_t*)&s->handle) != 0) {
+        net_socket_close(s);
+        return;
+    }
 
+    // Reading starts once the callback adds a "data" listener
+    JSValueRef args[] = { s->object };
+    PROFILE_CALL_SPAN(sr->ctx, sr->callback, "net.connection");
+    JSObjectCallAsFunction(sr->ctx, sr->callback, NULL, 1, args, NULL);
+}
 
 // `net.createServer(callback)`
 JSValueRef net_create_server(JSContextRef ctx, JSObjectRef function,
                              JSObjectRef thisObject, size_t argc,
                              const JSValueRef args[], JSValueRef* exception) {
     if (argc < 1 || !JSValueIsObject(ctx, args[0]) || !JSObjectIsFunction(ctx, (JSObjectRef)args[0])) {
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("net.createServer requires a callback function");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
+        return net_throw(ctx, exception, "net.createServer requires a callback function");
     }
 
     // Create ServerRequest struct
@@ -101,29 +506,16 @@ JSValueRef net_create_server(JSContextRef ctx, JSObjectRef function,
     JSValueProtect(ctx, sr->callback);
 
     // Initialize TCP server
-    uv_tcp_init(uv_default_loop(), &sr->server);
+    uv_tcp_init(loop, &sr->server);
     sr->server.data = sr;
 
-    // Create a class definition for the server object (only once)
-    if (serverClass == NULL) {
-        JSClassDefinition classDef = kJSClassDefinitionEmpty;
-        classDef.finalize = server_finalize;
-        serverClass = JSClassCreate(&classDef);
-    }
-
-    // Create a proper JS object for the server
-    JSObjectRef serverObject = JSObjectMake(ctx, serverClass, sr);
+    net_init_classes();
 
-    // Attach `server.listen(port)`
-    JSStringRef listenName = JSStringCreateWithUTF8CString("listen");
-    JSObjectRef listenFunc = JSObjectMakeFunctionWithCallback(ctx, listenName, net_server_listen);
-    JSObjectSetProperty(ctx, serverObject, listenName, listenFunc, kJSPropertyAttributeNone, NULL);
-    JSStringRelease(listenName);
-
-    return serverObject;
+    // `listen` comes from the class's static function table
+    return JSObjectMake(ctx, serverClass, sr);
 }
 
-// `server.listen(port)`
+// `server.listen(port[, { workers }])`
 JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef function,
                              JSObjectRef thisObject, size_t argc,
                              const JSValueRef args[], JSValueRef* exception) {
@@ -136,8 +528,14 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef function,
     struct sockaddr_in addr;
     uv_ip4_addr("0.0.0.0", port, &addr);
 
-    uv_tcp_bind(&sr->server, (const struct sockaddr*)&addr, 0);
-    int result = uv_listen((uv_stream_t*)&sr->server, 10, on_new_connection);
+    if (argc > 1) cluster_start(cluster_workers_option(ctx, args[1]));
+
+    int result = cluster_bind(&sr->server, &addr);
+    if (result < 0) {
+        fprintf(stderr, "Server bind error: %s\n", uv_strerror(result));
+        return JSValueMakeUndefined(ctx);
+    }
+    result = uv_listen((uv_stream_t*)&sr->server, 10, on_new_connection);
     if (result < 0) {
         fprintf(stderr, "Server listen error: %s\n", uv_strerror(result));
     }
@@ -145,38 +543,130 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef function,
     return JSValueMakeUndefined(ctx);
 }
 
+// ========================= CONNECT ========================= //
 
-// `client.write(data)`
-JSValueRef client_write(JSContextRef ctx, JSObjectRef function,
-                        JSObjectRef thisObject, size_t argc,
-                        const JSValueRef args[], JSValueRef* exception) {
-    if (argc < 1 || !JSValueIsString(ctx, args[0])) {
-        JSStringRef errMsg = JSStringCreateWithUTF8CString("client.write requires a string argument");
-        *exception = JSValueMakeString(ctx, errMsg);
-        JSStringRelease(errMsg);
-        return JSValueMakeUndefined(ctx);
+static void on_net_socket_connect(uv_connect_t* req, int status) {
+    NetSocket* s = (NetSocket*)req->data;
+    if (s->closing) return;
+    s->connecting = false;
+    if (status < 0) {
+        net_socket_fail(s, status);
+        return;
     }
 
-    // Get the client object
-    ClientRequest* cr = (ClientRequest*)JSObjectGetPrivate(thisObject);
-    if (!cr || !cr->client) {
-        return JSValueMakeUndefined(ctx);
+    // Writes made while connecting share a batch with the "connect" listener's
+    bool end_requested = s->ending;
+    event_listeners_emit(&s->listeners, s->ctx, s->object, "connect", 0, NULL);
+    if (s->closing) return;
+
+    if (end_requested) net_socket_shutdown(s);
+    else if (!s->corked) net_socket_flush(s);
+    if (!s->closing) net_socket_update_reading(s);
+}
+
+static void net_socket_connect_to(NetSocket* s, const struct sockaddr* addr) {
+    s->connect_req.data = s;
+    int status = uv_tcp_connect(&s->connect_req, &s->handle, addr, on_net_socket_connect);
+    if (status < 0) net_socket_fail_later(s, status);
+}
+
+static void on_net_resolved(uv_getaddrinfo_t* resolver, int status, struct addrinfo* res) {
+    NetSocket* s = (NetSocket*)resolver->data;
+    free(resolver);
+    runtime_counters.dns_lookups--;
+    s->busy = false;
+
+    if (s->closing || status < 0) {
+        if (status == 0) uv_freeaddrinfo(res);
+        if (s->closing) net_socket_close_handle(s);
+        else net_socket_fail(s, status);
+        return;
     }
 
-    // Convert JS string to C string
-    JSStringRef jsData = JSValueToStringCopy(ctx, args[0], exception);
-    size_t dataLen = JSStringGetMaximumUTF8CStringSize(jsData);
-    char* data = (char*)malloc(dataLen);
-    JSStringGetUTF8CString(jsData, data, dataLen);
-    JSStringRelease(jsData);
+    // Our own servers listen on 0.0.0.0, so an IPv4 answer wins over the first one
+    const struct addrinfo* pick = res;
+    for (const struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET) {
+            pick = ai;
+            break;
+        }
+    }
 
-    // Prepare write request
-    uv_write_t* writeReq = (uv_write_t*)malloc(sizeof(uv_write_t));
-    uv_buf_t buffer = uv_buf_init(data, strlen(data));
-    writeReq->data = data;
+    struct sockaddr_storage addr;
+    memcpy(&addr, pick->ai_addr, pick->ai_addrlen);
+    if (addr.ss_family == AF_INET6) ((struct sockaddr_in6*)&addr)->sin6_port = htons((uint16_t)s->port);
+    else ((struct sockaddr_in*)&addr)->sin_port = htons((uint16_t)s->port);
+    uv_freeaddrinfo(res);
 
-    // Write to the client
-    uv_write(writeReq, (uv_stream_t*)cr->client, &buffer, 1, on_client_write);
+    net_socket_connect_to(s, (const struct sockaddr*)&addr);
+}
 
-    return JSValueMakeUndefined(ctx);
-}     
\ No newline at end of file
+// `net.connect(port[, host][, listener])` / `net.connect({ port, host, highWaterMark }[, listener])`
+JSValueRef net_connect(JSContextRef ctx, JSObjectRef function,
+                       JSObjectRef thisObject, size_t argc,
+                       const JSValueRef args[], JSValueRef* exception) {
+    PROFILE_API_SPAN(ctx, "net.connect");
+    JSValueRef port_value = NULL, host_value = NULL, listener = NULL;
+    double hwm = NET_SOCKET_DEFAULT_HWM;
+    size_t next = 1;
+
+    if (argc > 0 && JSValueIsObject(ctx, args[0])) {
+        JSObjectRef options = (JSObjectRef)args[0];
+        port_value = JSObjectGetProperty(ctx, options, ATOM(port), NULL);
+        host_value = JSObjectGetProperty(ctx, options, ATOM(host), NULL);
+        JSValueRef hwm_value = JSObjectGetProperty(ctx, options, ATOM(highWaterMark), NULL);
+        if (JSValueIsNumber(ctx, hwm_value)) hwm = JSValueToNumber(ctx, hwm_value, NULL);
+    } else if (argc > 0) {
+        port_value = args[0];
+        if (argc > 1 && JSValueIsString(ctx, args[1])) host_value = args[next++];
+    }
+    if (argc > next) listener = args[next];
+
+    double port = port_value && JSValueIsNumber(ctx, port_value) ? JSValueToNumber(ctx, port_value, NULL) : -1;
+    if (!(port >= 1 && port <= 65535) || !(hwm >= 1)) {
+        return net_throw(ctx, exception, "net.connect requires a port between 1 and 65535");
+    }
+
+    char host[256] = "localhost";
+    if (host_value && JSValueIsString(ctx, host_value)) {
+        JSStringRef hostRef = JSValueToStringCopy(ctx, host_value, exception);
+        JSStringGetUTF8CString(hostRef, host, sizeof(host));
+        JSStringRelease(hostRef);
+    }
+
+    net_init_classes();
+    NetSocket* s = net_socket_new(ctx, (size_t)hwm);
+    s->connecting = true;
+    s->port = (int)port;
+    if (listener && !JSValueIsUndefined(ctx, listener)) {
+        JSStringRef name = JSStringCreateWithUTF8CString("connect");
+        JSValueRef nameValue = JSValueMakeString(ctx, name);
+        JSStringRelease(name);
+        if (!event_listeners_on(&s->listeners, ctx, nameValue, listener, exception)) {
+            net_socket_close(s);
+            return JSValueMakeUndefined(ctx);
+        }
+    }
+
+    // Literal addresses never touch the resolver
+    struct sockaddr_storage addr;
+    if (uv_ip4_addr(host, (int)port, (struct sockaddr_in*)&addr) == 0 ||
+        uv_ip6_addr(host, (int)port, (struct sockaddr_in6*)&addr) == 0) {
+        net_socket_connect_to(s, (const struct sockaddr*)&addr);
+        return s->object;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    uv_getaddrinfo_t* resolver = malloc(sizeof(uv_getaddrinfo_t));
+    resolver->data = s;
+    s->busy = true;
+    runtime_counters.dns_lookups++;
+
+    int result = uv_getaddrinfo(loop, resolver, on_net_resolved, host, NULL, &hints);
+    if (result < 0) {
+        runtime_counters.dns_lookups--;
+        free(resolver);
+        net_socket_fail_later(s, result);
+    }
+    return s->object;
+}
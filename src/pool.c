@@ -0,0 +1,123 @@
+/**
+ * =====================================================================================
+ *
+ *        POOL.C - Per-Loop Fixed-Size Object Pools
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Handing out fixed-size objects (requests, connections, uv_*_t) from slabs
+ * - Recycling freed objects through an intrusive free list
+ * - Keeping per-pool hit/miss counters for process.poolStats()
+ * - Recycling 64 KiB socket read buffers (stream.read_buffer)
+ *
+ * Threading:
+ * - Pools are declared JADE_THREAD_LOCAL, so each loop has its own and no
+ *   locking is needed; objects must be freed on the thread that allocated them
+ *
+ * Memory Management:
+ * - Slabs are never returned to the system; a pool's footprint is its peak
+ *   working set
+ * - Fresh slab memory is zeroed, and pool_free() only overwrites the first
+ *   pointer-sized word, so other fields survive a free/alloc round trip
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+#define POOL_SLAB_BYTES     16384
+#define POOL_MIN_PER_SLAB   8
+#define POOL_ALIGN          16
+
+struct MemPoolSlab {
+    struct MemPoolSlab* next;
+    size_t count;
+    // Objects follow, POOL_ALIGN aligned
+};
+
+#define POOL_SLAB_HEADER ((sizeof(struct MemPoolSlab) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+static JADE_THREAD_LOCAL MemPool* pool_list = NULL;
+
+static bool pool_grow(MemPool* pool) {
+    if (!pool->registered) {
+        pool->object_size = (pool->object_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+        pool->registered = true;
+        pool->next = pool_list;
+        pool_list = pool;
+    }
+
+    // Small objects share slabs; anything bigger than a slab gets its own
+    size_t per_slab = POOL_SLAB_BYTES / pool->object_size;
+    if (per_slab == 0) per_slab = 1;
+    else if (per_slab < POOL_MIN_PER_SLAB) per_slab = POOL_MIN_PER_SLAB;
+
+    struct MemPoolSlab* slab = calloc(1, POOL_SLAB_HEADER + per_slab * pool->object_size);
+    if (!slab) return false;
+    slab->count = per_slab;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    // Link objects so the lowest address is handed out first
+    char* base = (char*)slab + POOL_SLAB_HEADER;
+    for (size_t i = per_slab; i-- > 0;) {
+        void** object = (void**)(base + i * pool->object_size);
+        *object = pool->free_list;
+        pool->free_list = object;
+    }
+    pool->capacity += per_slab;
+    return true;
+}
+
+void* pool_alloc(MemPool* pool) {
+    if (pool->free_list) {
+        pool->hits++;
+    } else {
+        pool->misses++;
+        if (!pool_grow(pool)) return NULL;
+    }
+
+    void** object = (void**)pool->free_list;
+    pool->free_list = *object;
+    pool->in_use++;
+    return object;
+}
+
+void* pool_calloc(MemPool* pool) {
+    void* object = pool_alloc(pool);
+    if (object) memset(object, 0, pool->object_size);
+    return object;
+}
+
+void pool_free(MemPool* pool, void* object) {
+    if (!object) return;
+    *(void**)object = pool->free_list;
+    pool->free_list = object;
+    pool->in_use--;
+}
+
+MemPool* pool_registry(void) {
+    return pool_list;
+}
+
+// =====================================================================================
+//                          READ BUFFERS
+// =====================================================================================
+
+typedef struct {
+    char data[READ_BUFFER_SIZE];
+} ReadBuffer;
+
+static JADE_THREAD_LOCAL MemPool read_buffer_pool = MEM_POOL_INIT("stream.read_buffer", ReadBuffer);
+
+void read_buffer_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+    buf->base = pool_alloc(&read_buffer_pool);
+    buf->len = buf->base ? READ_BUFFER_SIZE : 0;   // len 0 makes libuv report UV_ENOBUFS
+}
+
+void read_buffer_release(const uv_buf_t* buf) {
+    if (buf->base) pool_free(&read_buffer_pool, buf->base);
+}
@@ -0,0 +1,796 @@
+/**
+ * =====================================================================================
+ *
+ *        PROFILER.C - Sampling CPU Profiler (--cpu-prof)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - A SIGPROF timer on the loop thread's CPU clock, sampling every
+ *   `--cpu-prof-interval` microseconds of CPU time
+ * - Recording, per sample, the native stack and the thread's span stack
+ * - Writing collapsed stacks (flamegraph.pl) or a Chrome `.cpuprofile` on exit
+ *
+ * Spans:
+ * - PROFILE_SPAN marks native entry points (libuv callbacks, fs/http/net calls)
+ * - PROFILE_API_SPAN also captures the JS stack of the script calling into the
+ *   API, read from an Error created at span entry
+ * - PROFILE_CALL_SPAN marks native-to-JS calls with the callee's name, so time
+ *   spent purely in JS is charged to the callback that was entered
+ * - JSC's public API has no way to walk the JS stack from a signal handler,
+ *   so spans are the JS half of every sample; they are interned into ids at
+ *   entry and the handler copies only ids
+ *
+ * Signal Safety:
+ * - The handler touches preallocated memory only: the current sample chunk, a
+ *   spare chunk the loop thread refills, and the thread-local span stack
+ * - backtrace() is called once up front so its lazy unwinder load is not
+ *   first done inside the handler
+ *
+ * Cost:
+ * - With profiling off a span is one thread-local load and branch
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include "runtime.h"
+
+#define PROFILE_STACK_MAX 64
+#define PROFILE_NATIVE_DEPTH 32
+#define PROFILE_SAMPLE_SPANS 16
+#define PROFILE_CHUNK_SAMPLES 4096
+#define PROFILE_SIGNAL_FRAMES 2     // The handler and the kernel's signal trampoline, at least
+#define PROFILE_JS_STACK_MAX 4096
+
+JADE_THREAD_LOCAL bool profiler_enabled;
+
+// ------------------------- Samples ------------------------- //
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t native_count;
+    uint8_t span_count;
+    uint32_t spans[PROFILE_SAMPLE_SPANS];       // Outermost first
+    void* native[PROFILE_NATIVE_DEPTH];         // Innermost first
+} ProfileSample;
+
+typedef struct ProfileChunk {
+    struct ProfileChunk* next;
+    size_t count;
+    ProfileSample samples[PROFILE_CHUNK_SAMPLES];
+} ProfileChunk;
+
+typedef struct {
+    volatile int depth;
+    uint32_t spans[PROFILE_STACK_MAX];
+} ProfileStack;
+
+static JADE_THREAD_LOCAL ProfileStack span_stack;
+
+// ------------------------- Frames and spans ------------------------- //
+
+typedef struct {
+    char* name;
+    char* url;                  // Script URL, callback kind or "" for native code
+    int line;                   // 1-based, 0 when unknown
+    int column;
+} ProfileFrame;
+
+typedef struct {
+    uint32_t first;             // Index into frame_ids
+    uint32_t count;
+} ProfileSpanFrames;
+
+// Open-addressed string -> id table; ids index a parallel array
+typedef struct {
+    char** keys;
+    uint32_t* ids;
+    size_t cap;
+    size_t count;
+} ProfileIntern;
+
+typedef struct {
+    bool running;
+    bool written;
+    char* path;
+    unsigned interval_us;
+    pthread_t thread;
+#ifdef __linux__
+    timer_t timer;
+#endif
+    struct sigaction previous;
+    uv_check_t refill;
+
+    ProfileChunk* head;
+    ProfileChunk* volatile current;
+    ProfileChunk* volatile spare;
+    volatile size_t dropped;
+    uint64_t started_us;
+
+    ProfileFrame* frames;
+    size_t frame_count, frame_cap;
+    ProfileIntern frame_index;
+
+    ProfileSpanFrames* span_list;
+    size_t span_count, span_cap;
+    uint32_t* frame_ids;
+    size_t frame_id_count, frame_id_cap;
+    ProfileIntern span_index;
+} Profiler;
+
+static Profiler profiler;
+
+static uint64_t profile_hash(const char* s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return h;
+}
+
+// Returns the id for key, or `next_id` after taking ownership of a copy of key
+static uint32_t profile_intern(ProfileIntern* table, const char* key, uint32_t next_id, bool* added) {
+    *added = false;
+    if (table->count * 2 >= table->cap) {
+        size_t cap = table->cap ? table->cap * 2 : 256;
+        char** keys = calloc(cap, sizeof(char*));
+        uint32_t* ids = calloc(cap, sizeof(uint32_t));
+        if (!keys || !ids) {
+            free(keys);
+            free(ids);
+            return UINT32_MAX;
+        }
+        for (size_t i = 0; i < table->cap; i++) {
+            if (!table->keys[i]) continue;
+            size_t j = profile_hash(table->keys[i]) & (cap - 1);
+            while (keys[j]) j = (j + 1) & (cap - 1);
+            keys[j] = table->keys[i];
+            ids[j] = table->ids[i];
+        }
+        free(table->keys);
+        free(table->ids);
+        table->keys = keys;
+        table->ids = ids;
+        table->cap = cap;
+    }
+
+    size_t i = profile_hash(key) & (table->cap - 1);
+    while (table->keys[i]) {
+        if (strcmp(table->keys[i], key) == 0) return table->ids[i];
+        i = (i + 1) & (table->cap - 1);
+    }
+    char* copy = strdup(key);
+    if (!copy) return UINT32_MAX;
+    table->keys[i] = copy;
+    table->ids[i] = next_id;
+    table->count++;
+    *added = true;
+    return next_id;
+}
+
+static void profile_intern_free(ProfileIntern* table) {
+    for (size_t i = 0; i < table->cap; i++) free(table->keys[i]);
+    free(table->keys);
+    free(table->ids);
+    memset(table, 0, sizeof(*table));
+}
+
+static bool profile_grow(void** array, size_t* cap, size_t need, size_t size) {
+    if (need <= *cap) return true;
+    size_t grown = *cap ? *cap * 2 : 256;
+    while (grown < need) grown *= 2;
+    void* data = realloc(*array, grown * size);
+    if (!data) return false;
+    *array = data;
+    *cap = grown;
+    return true;
+}
+
+static uint32_t profile_frame_id(const char* name, const char* url, int line, int column) {
+    char key[1024];
+    snprintf(key, sizeof(key), "%s\x1f%s\x1f%d\x1f%d", name, url, line, column);
+
+    bool added;
+    uint32_t id = profile_intern(&profiler.frame_index, key, (uint32_t)profiler.frame_count, &added);
+    if (!added) return id;
+    if (!profile_grow((void**)&profiler.frames, &profiler.frame_cap, profiler.frame_count + 1, sizeof(ProfileFrame))) {
+        return UINT32_MAX;
+    }
+    ProfileFrame* frame = &profiler.frames[profiler.frame_count++];
+    frame->name = strdup(name);
+    frame->url = strdup(url);
+    frame->line = line;
+    frame->column = column;
+    return id;
+}
+
+static bool profile_span_add_frame(uint32_t frame) {
+    if (frame == UINT32_MAX) return false;
+    if (!profile_grow((void**)&profiler.frame_ids, &profiler.frame_id_cap, profiler.frame_id_count + 1, sizeof(uint32_t))) {
+        return false;
+    }
+    profiler.frame_ids[profiler.frame_id_count++] = frame;
+    return true;
+}
+
+// Parses one line of a JSC Error stack: "name@url:line:column", "url:line:column",
+// "name@[native code]" or a bare name
+static void profile_span_add_js_line(char* text) {
+    char* at = strchr(text, '@');
+    const char* name = "(anonymous)";
+    char* location = text;
+    if (at) {
+        *at = '\0';
+        if (*text) name = text;
+        location = at + 1;
+    } else if (!strchr(text, ':')) {
+        name = text;
+        location = "";
+    }
+
+    int line = 0, column = 0;
+    char* colon = strrchr(location, ':');
+    if (colon && colon != location) {
+        column = atoi(colon + 1);
+        *colon = '\0';
+        colon = strrchr(location, ':');
+        if (colon) {
+            line = atoi(colon + 1);
+            *colon = '\0';
+        } else {
+            line = column;
+            column = 0;
+        }
+    }
+    if (!at && *location) name = "(program)";
+    profile_span_add_frame(profile_frame_id(name, location, line, column));
+}
+
+// `detail` is a JS stack (innermost line first) for API spans, a function name for call spans
+static uint32_t profile_span_id(char kind, const char* label, const char* detail) {
+    size_t key_len = strlen(label) + strlen(detail) + 3;
+    char* key = malloc(key_len);
+    if (!key) return UINT32_MAX;
+    snprintf(key, key_len, "%c%s\x1f%s", kind, label, detail);
+
+    bool added;
+    uint32_t id = profile_intern(&profiler.span_index, key, (uint32_t)profiler.span_count, &added);
+    free(key);
+    if (!added) return id;
+    if (!profile_grow((void**)&profiler.span_list, &profiler.span_cap, profiler.span_count + 1, sizeof(ProfileSpanFrames))) {
+        return UINT32_MAX;
+    }
+
+    ProfileSpanFrames* span = &profiler.span_list[profiler.span_count++];
+    span->first = (uint32_t)profiler.frame_id_count;
+
+    if (kind == 'a' && *detail) {
+        // Walk the stack outermost first so the span's frames read root to leaf
+        char* lines = strdup(detail);
+        if (lines) {
+            size_t count = 1;
+            for (char* p = lines; *p; p++) if (*p == '\n') count++;
+            char** starts = malloc(count * sizeof(char*));
+            if (starts) {
+                size_t n = 0;
+                for (char* line = strtok(lines, "\n"); line; line = strtok(NULL, "\n")) starts[n++] = line;
+                while (n > 0) profile_span_add_js_line(starts[--n]);
+                free(starts);
+            }
+            free(lines);
+        }
+    }
+    if (kind == 'c') profile_span_add_frame(profile_frame_id(*detail ? detail : "(anonymous)", label, 0, 0));
+    else profile_span_add_frame(profile_frame_id(label, "", 0, 0));
+
+    span->count = (uint32_t)profiler.frame_id_count - span->first;
+    return id;
+}
+
+// ------------------------- Sampling ------------------------- //
+
+static uint64_t profile_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static ProfileChunk* profile_chunk_new(void) {
+    ProfileChunk* chunk = malloc(sizeof(ProfileChunk));
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->count = 0;
+    return chunk;
+}
+
+static void profile_refill(void) {
+    if (__atomic_load_n(&profiler.spare, __ATOMIC_RELAXED)) return;
+    ProfileChunk* chunk = profile_chunk_new();
+    __atomic_store_n(&profiler.spare, chunk, __ATOMIC_RELAXED);
+}
+
+static void on_profile_refill(uv_check_t* handle) {
+    profile_refill();
+}
+
+// Interrupted instruction, where the platform exposes it
+static void* profile_signal_pc(void* ucontext) {
+#if defined(__linux__) && defined(__x86_64__)
+    return (void*)((ucontext_t*)ucontext)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__aarch64__)
+    return (void*)((ucontext_t*)ucontext)->uc_mcontext.pc;
+#else
+    return NULL;
+#endif
+}
+
+static void on_profile_signal(int signo, siginfo_t* info, void* ucontext) {
+    if (!profiler.running) return;
+#ifndef __linux__
+    // setitimer() profiles the whole process; only the loop thread has spans
+    if (!pthread_equal(pthread_self(), profiler.thread)) return;
+#endif
+    int saved_errno = errno;
+
+    ProfileChunk* chunk = profiler.current;
+    if (chunk->count == PROFILE_CHUNK_SAMPLES) {
+        ProfileChunk* next = __atomic_exchange_n(&profiler.spare, NULL, __ATOMIC_RELAXED);
+        if (!next) {
+            profiler.dropped++;
+            errno = saved_errno;
+            return;
+        }
+        chunk->next = next;
+        profiler.current = chunk = next;
+    }
+
+    ProfileSample* sample = &chunk->samples[chunk->count];
+    sample->time_us = profile_now_us();
+
+    // The unwinder reports the interrupted frame at its exact pc; everything
+    // before it is the handler side (how many frames that is varies by libc)
+    void* frames[PROFILE_NATIVE_DEPTH + PROFILE_SIGNAL_FRAMES + 2];
+    int n = backtrace(frames, PROFILE_NATIVE_DEPTH + PROFILE_SIGNAL_FRAMES + 2);
+    void* pc = profile_signal_pc(ucontext);
+    int skip = n < PROFILE_SIGNAL_FRAMES ? n : PROFILE_SIGNAL_FRAMES;
+    for (int i = 0; pc && i < n; i++) {
+        if (frames[i] == pc) {
+            skip = i;
+            break;
+        }
+    }
+    int native = n - skip;
+    if (native > PROFILE_NATIVE_DEPTH) native = PROFILE_NATIVE_DEPTH;
+    memcpy(sample->native, frames + skip, (size_t)native * sizeof(void*));
+    sample->native_count = (uint8_t)native;
+
+    int depth = span_stack.depth;
+    if (depth > PROFILE_STACK_MAX) depth = PROFILE_STACK_MAX;
+    if (depth > PROFILE_SAMPLE_SPANS) depth = PROFILE_SAMPLE_SPANS;
+    int spans = 0;
+    for (int i = 0; i < depth; i++) {
+        if (span_stack.spans[i] != UINT32_MAX) sample->spans[spans++] = span_stack.spans[i];
+    }
+    sample->span_count = (uint8_t)spans;
+
+    chunk->count++;
+    errno = saved_errno;
+}
+
+// ------------------------- Spans ------------------------- //
+
+static ProfileSpan profile_span_push(uint32_t id) {
+    int depth = span_stack.depth;
+    if (depth < PROFILE_STACK_MAX) span_stack.spans[depth] = id;
+    // The handler runs on this thread: the slot must be written before depth covers it
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    span_stack.depth = depth + 1;
+    profile_refill();
+    return depth;
+}
+
+ProfileSpan profile_span_enter(const char* label) {
+    if (!profiler_enabled) return -1;
+    return profile_span_push(profile_span_id('n', label, ""));
+}
+
+ProfileSpan profile_span_enter_api(JSContextRef ctx, const char* label) {
+    if (!profiler_enabled) return -1;
+
+    char stack[PROFILE_JS_STACK_MAX] = "";
+    JSObjectRef error = JSObjectMakeError(ctx, 0, NULL, NULL);
+    if (error) {
+        JSValueRef value = JSObjectGetProperty(ctx, error, ATOM(stack), NULL);
+        if (value && JSValueIsString(ctx, value)) {
+            JSStringRef text = JSValueToStringCopy(ctx, value, NULL);
+            if (text) {
+                JSStringGetUTF8CString(text, stack, sizeof(stack));
+                JSStringRelease(text);
+            }
+        }
+    }
+    return profile_span_push(profile_span_id('a', label, stack));
+}
+
+ProfileSpan profile_span_enter_call(JSContextRef ctx, JSObjectRef function, const char* label) {
+    if (!profiler_enabled) return -1;
+
+    char name[128] = "";
+    if (function) {
+        JSValueRef value = JSObjectGetProperty(ctx, function, ATOM(name), NULL);
+        if (value && JSValueIsString(ctx, value)) {
+            JSStringRef text = JSValueToStringCopy(ctx, value, NULL);
+            if (text) {
+                JSStringGetUTF8CString(text, name, sizeof(name));
+                JSStringRelease(text);
+            }
+        }
+    }
+    return profile_span_push(profile_span_id('c', label, name));
+}
+
+void profile_span_exit(ProfileSpan* span) {
+    if (*span < 0) return;
+    span_stack.depth = *span;
+}
+
+// ------------------------- Output ------------------------- //
+
+typedef struct {
+    uint32_t* ids;              // Frame ids, root first
+    size_t count;
+    size_t cap;
+} ProfilePath;
+
+static ProfileIntern native_names;
+static uint32_t* native_frame_ids;
+static size_t native_frame_cap;
+
+// Native frame -> frame id, resolved through the dynamic symbol table
+static uint32_t profile_native_frame(void* address) {
+    char key[32];
+    snprintf(key, sizeof(key), "%p", address);
+    bool added;
+    uint32_t slot = profile_intern(&native_names, key, (uint32_t)native_names.count, &added);
+    if (slot == UINT32_MAX) return UINT32_MAX;
+    if (!added) return native_frame_ids[slot];
+
+    char name[512];
+    Dl_info info;
+    int ok = dladdr(address, &info);
+    if (ok && info.dli_sname) {
+        snprintf(name, sizeof(name), "%s", info.dli_sname);
+    } else if (ok && info.dli_fname) {
+        const char* base = strrchr(info.dli_fname, '/');
+        snprintf(name, sizeof(name), "%s+0x%lx", base ? base + 1 : info.dli_fname,
+                 (unsigned long)((char*)address - (char*)info.dli_fbase));
+    } else {
+        snprintf(name, sizeof(name), "%p", address);
+    }
+
+    uint32_t id = profile_frame_id(name, "", 0, 0);
+    if (!profile_grow((void**)&native_frame_ids, &native_frame_cap, slot + 1, sizeof(uint32_t))) return id;
+    native_frame_ids[slot] = id;
+    return id;
+}
+
+// Spans outermost first, then the native frames that were on the CPU
+static void profile_sample_path(const ProfileSample* sample, ProfilePath* path) {
+    path->count = 0;
+    for (uint8_t i = 0; i < sample->span_count; i++) {
+        const ProfileSpanFrames* span = &profiler.span_list[sample->spans[i]];
+        for (uint32_t f = 0; f < span->count; f++) {
+            if (!profile_grow((void**)&path->ids, &path->cap, path->count + 1, sizeof(uint32_t))) return;
+            path->ids[path->count++] = profiler.frame_ids[span->first + f];
+        }
+    }
+    for (int i = (int)sample->native_count - 1; i >= 0; i--) {
+        uint32_t id = profile_native_frame(sample->native[i]);
+        if (id == UINT32_MAX) continue;
+        if (!profile_grow((void**)&path->ids, &path->cap, path->count + 1, sizeof(uint32_t))) return;
+        path->ids[path->count++] = id;
+    }
+}
+
+static void profile_write_collapsed_frame(FILE* out, const ProfileFrame* frame) {
+    // ';' separates frames and the last space separates the count
+    for (const char* p = frame->name; *p; p++) fputc(*p == ';' ? ':' : *p, out);
+    if (*frame->url) {
+        const char* base = strrchr(frame->url, '/');
+        fprintf(out, " [%s", base ? base + 1 : frame->url);
+        if (frame->line) fprintf(out, ":%d", frame->line);
+        fputc(']', out);
+    }
+}
+
+// One "frame;frame;frame count" line per distinct stack
+static void profile_write_collapsed(FILE* out) {
+    ProfileIntern stacks = { 0 };
+    uint64_t* counts = NULL;
+    size_t count_cap = 0;
+    ProfilePath path = { 0 };
+    size_t key_cap = 256;
+    char* key = malloc(key_cap);
+
+    for (ProfileChunk* chunk = profiler.head; chunk && key; chunk = chunk->next) {
+        for (size_t s = 0; s < chunk->count; s++) {
+            profile_sample_path(&chunk->samples[s], &path);
+            size_t len = 0;
+            for (size_t i = 0; i < path.count; i++) {
+                if (len + 12 >= key_cap) {
+                    char* grown = realloc(key, key_cap * 2);
+                    if (!grown) break;
+                    key = grown;
+                    key_cap *= 2;
+                }
+                len += (size_t)snprintf(key + len, key_cap - len, "%u,", path.ids[i]);
+            }
+            key[len] = '\0';
+
+            bool added;
+            uint32_t id = profile_intern(&stacks, key, (uint32_t)stacks.count, &added);
+            if (id == UINT32_MAX) continue;
+            if (added) {
+                if (!profile_grow((void**)&counts, &count_cap, id + 1, sizeof(uint64_t))) continue;
+                counts[id] = 0;
+            }
+            counts[id]++;
+        }
+    }
+
+    for (size_t i = 0; i < stacks.cap; i++) {
+        if (!stacks.keys[i]) continue;
+        bool first = true;
+        for (char* p = stacks.keys[i]; *p; ) {
+            char* end;
+            unsigned long frame = strtoul(p, &end, 10);
+            if (!first) fputc(';', out);
+            profile_write_collapsed_frame(out, &profiler.frames[frame]);
+            first = false;
+            p = *end ? end + 1 : end;
+        }
+        if (first) fputs("(idle)", out);
+        fprintf(out, " %llu\n", (unsigned long long)counts[stacks.ids[i]]);
+    }
+
+    free(key);
+    free(path.ids);
+    free(counts);
+    profile_intern_free(&stacks);
+}
+
+typedef struct {
+    uint32_t frame;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint64_t hits;
+} ProfileNode;
+
+static void profile_write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+// Chrome DevTools format: a call tree, plus one node id and time delta per sample
+static void profile_write_cpuprofile(FILE* out) {
+    ProfileNode* nodes = malloc(sizeof(ProfileNode));
+    size_t node_count = 1, node_cap = 1;
+    if (!nodes) return;
+    nodes[0].frame = UINT32_MAX;
+    nodes[0].parent = UINT32_MAX;
+    nodes[0].first_child = nodes[0].next_sibling = UINT32_MAX;
+    nodes[0].hits = 0;
+
+    ProfileIntern edges = { 0 };
+    ProfilePath path = { 0 };
+    uint32_t* sample_nodes = NULL;
+    size_t sample_count = 0, sample_cap = 0;
+
+    for (ProfileChunk* chunk = profiler.head; chunk; chunk = chunk->next) {
+        for (size_t s = 0; s < chunk->count; s++) {
+            profile_sample_path(&chunk->samples[s], &path);
+            uint32_t node = 0;
+            for (size_t i = 0; i < path.count; i++) {
+                char key[32];
+                snprintf(key, sizeof(key), "%u,%u", node, path.ids[i]);
+                bool added;
+                uint32_t child = profile_intern(&edges, key, (uint32_t)node_count, &added);
+                if (child == UINT32_MAX) break;
+                if (added) {
+                    if (!profile_grow((void**)&nodes, &node_cap, node_count + 1, sizeof(ProfileNode))) break;
+                    nodes[node_count].frame = path.ids[i];
+                    nodes[node_count].parent = node;
+                    nodes[node_count].first_child = UINT32_MAX;
+                    nodes[node_count].next_sibling = nodes[node].first_child;
+                    nodes[node].first_child = (uint32_t)node_count;
+                    nodes[node_count].hits = 0;
+                    node_count++;
+                }
+                node = child;
+            }
+            nodes[node].hits++;
+            if (!profile_grow((void**)&sample_nodes, &sample_cap, sample_count + 1, sizeof(uint32_t))) continue;
+            sample_nodes[sample_count++] = node;
+        }
+    }
+
+    fputs("{\"nodes\":[", out);
+    for (size_t n = 0; n < node_count; n++) {
+        const ProfileFrame* frame = n ? &profiler.frames[nodes[n].frame] : NULL;
+        fprintf(out, "%s{\"id\":%zu,\"callFrame\":{\"functionName\":", n ? "," : "", n + 1);
+        profile_write_json_string(out, frame ? frame->name : "(root)");
+        fputs(",\"scriptId\":\"0\",\"url\":", out);
+        profile_write_json_string(out, frame ? frame->url : "");
+        // cpuprofile positions are 0-based; -1 means unknown
+        fprintf(out, ",\"lineNumber\":%d,\"columnNumber\":%d},\"hitCount\":%llu,\"children\":[",
+                frame && frame->line ? frame->line - 1 : -1,
+                frame && frame->column ? frame->column - 1 : -1,
+                (unsigned long long)nodes[n].hits);
+        for (uint32_t c = nodes[n].first_child; c != UINT32_MAX; c = nodes[c].next_sibling) {
+            fprintf(out, "%s%u", c == nodes[n].first_child ? "" : ",", c + 1);
+        }
+        fputs("]}", out);
+    }
+
+    uint64_t end_us = profiler.started_us;
+    fputs("],\"samples\":[", out);
+    for (size_t i = 0; i < sample_count; i++) fprintf(out, "%s%u", i ? "," : "", sample_nodes[i] + 1);
+    fputs("],\"timeDeltas\":[", out);
+    uint64_t last = profiler.started_us;
+    size_t i = 0;
+    for (ProfileChunk* chunk = profiler.head; chunk; chunk = chunk->next) {
+        for (size_t s = 0; s < chunk->count && i < sample_count; s++, i++) {
+            uint64_t t = chunk->samples[s].time_us;
+            fprintf(out, "%s%llu", i ? "," : "", (unsigned long long)(t - last));
+            last = end_us = t;
+        }
+    }
+    fprintf(out, "],\"startTime\":%llu,\"endTime\":%llu}\n",
+            (unsigned long long)profiler.started_us, (unsigned long long)end_us);
+
+    free(nodes);
+    free(path.ids);
+    free(sample_nodes);
+    profile_intern_free(&edges);
+}
+
+static bool profile_is_cpuprofile(const char* path) {
+    size_t len = strlen(path);
+    const char* ext = ".cpuprofile";
+    size_t ext_len = strlen(ext);
+    return len >= ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
+static void profile_write(void) {
+    if (profiler.written || !profiler.head) return;
+    profiler.written = true;
+
+    FILE* out = fopen(profiler.path, "w");
+    if (!out) {
+        fprintf(stderr, "ERROR: Could not write CPU profile %s\n", profiler.path);
+        return;
+    }
+    if (profile_is_cpuprofile(profiler.path)) profile_write_cpuprofile(out);
+    else profile_write_collapsed(out);
+    fclose(out);
+
+    if (profiler.dropped) {
+        fprintf(stderr, "ERROR: CPU profile dropped %zu samples (out of memory)\n", (size_t)profiler.dropped);
+    }
+}
+
+// ------------------------- Lifecycle ------------------------- //
+
+static void profile_disarm(void) {
+    if (!profiler.running) return;
+    profiler.running = false;
+    profiler_enabled = false;
+#ifdef __linux__
+    timer_delete(profiler.timer);
+#else
+    struct itimerval off = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_PROF, &off, NULL);
+#endif
+    sigaction(SIGPROF, &profiler.previous, NULL);
+}
+
+// process.exit() ends the process without returning through main()
+static void on_profile_exit(void) {
+    profile_disarm();
+    profile_write();
+}
+
+bool profiler_start(const ProfilerOptions* options) {
+    if (profiler.running || profiler.head) return false;
+
+    profiler.path = strdup(options->path);
+    profiler.interval_us = options->interval_us ? options->interval_us : 1000;
+    profiler.head = profiler.current = profile_chunk_new();
+    profiler.spare = profile_chunk_new();
+    if (!profiler.path || !profiler.head) return false;
+    profiler.thread = pthread_self();
+
+    void* warm[4];
+    backtrace(warm, 4);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = on_profile_signal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &profiler.previous) != 0) return false;
+
+    struct timespec period = {
+        (time_t)(profiler.interval_us / 1000000), (long)(profiler.interval_us % 1000000) * 1000
+    };
+#ifdef __linux__
+    // CPU time of this thread only, delivered to this thread only
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+#ifdef sigev_notify_thread_id
+    event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+#else
+    event._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+#endif
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &profiler.timer) != 0) {
+        sigaction(SIGPROF, &profiler.previous, NULL);
+        return false;
+    }
+    struct itimerspec spec = { period, period };
+    if (timer_settime(profiler.timer, 0, &spec, NULL) != 0) {
+        timer_delete(profiler.timer);
+        sigaction(SIGPROF, &profiler.previous, NULL);
+        return false;
+    }
+#else
+    struct itimerval spec = {
+        { period.tv_sec, period.tv_nsec / 1000 }, { period.tv_sec, period.tv_nsec / 1000 }
+    };
+    if (setitimer(ITIMER_PROF, &spec, NULL) != 0) {
+        sigaction(SIGPROF, &profiler.previous, NULL);
+        return false;
+    }
+#endif
+
+    // Keeps a spare chunk ready between spans, when the loop is all that runs
+    uv_check_init(loop, &profiler.refill);
+    uv_check_start(&profiler.refill, on_profile_refill);
+    uv_unref((uv_handle_t*)&profiler.refill);
+
+    profiler.started_us = profile_now_us();
+    profiler.running = true;
+    profiler_enabled = true;
+    atexit(on_profile_exit);
+    return true;
+}
+
+void profiler_stop(void) {
+    if (!profiler.running) return;
+    profile_disarm();
+    uv_close((uv_handle_t*)&profiler.refill, NULL);
+    uv_run(loop, UV_RUN_NOWAIT);
+    profile_write();
+}
@@ -0,0 +1,225 @@
+/**
+ * =====================================================================================
+ *
+ *        STREAM_WRITE.C - Vectored, Copy-Avoiding Stream Writes
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Collecting header blocks and body slices into one uv_buf_t vector
+ * - Writing ArrayBuffer/typed-array data straight from JSC backing memory
+ * - Sending with uv_try_write first and queueing only what did not fit
+ *
+ * Memory Management:
+ * - Batches come from a per-loop pool
+ * - Bytes the batch owns (formatted headers, UTF-8 copies of JS strings) live
+ *   in a chunked arena, so pointers handed out never move
+ * - JS buffers referenced by a batch stay protected until the write completes
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdlib.h>
+#include <string.h>
+#include "runtime.h"
+
+#define WRITE_BATCH_CHUNK_SIZE 4096
+
+static JADE_THREAD_LOCAL MemPool write_batch_pool = MEM_POOL_INIT("stream.write_batch", WriteBatch);
+
+struct WriteBatchChunk {
+    struct WriteBatchChunk* next;
+    size_t used;
+    size_t cap;
+    char data[];
+};
+
+WriteBatch* write_batch_new(JSContextRef ctx) {
+    WriteBatch* batch = pool_calloc(&write_batch_pool);
+    batch->ctx = ctx;
+    batch->bufs = batch->inline_bufs;
+    batch->bufs_cap = WRITE_BATCH_INLINE_BUFS;
+    return batch;
+}
+
+void write_batch_free(WriteBatch* batch) {
+    for (size_t i = 0; i < batch->pinned_count; i++) {
+        JSValueUnprotect(batch->ctx, batch->pinned[i]);
+    }
+    free(batch->pinned);
+
+    struct WriteBatchChunk* chunk = batch->chunks;
+    while (chunk) {
+        struct WriteBatchChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    if (batch->bufs != batch->inline_bufs) free(batch->bufs);
+    pool_free(&write_batch_pool, batch);
+}
+
+char* write_batch_alloc(WriteBatch* batch, size_t len) {
+    if (batch->inline_used + len <= WRITE_BATCH_INLINE_ARENA) {
+        char* p = batch->inline_arena + batch->inline_used;
+        batch->inline_used += len;
+        return p;
+    }
+
+    struct WriteBatchChunk* chunk = batch->chunks;
+    if (!chunk || chunk->used + len > chunk->cap) {
+        size_t cap = len > WRITE_BATCH_CHUNK_SIZE ? len : WRITE_BATCH_CHUNK_SIZE;
+        chunk = malloc(sizeof(struct WriteBatchChunk) + cap);
+        chunk->used = 0;
+        chunk->cap = cap;
+        chunk->next = batch->chunks;
+        batch->chunks = chunk;
+    }
+
+    char* p = chunk->data + chunk->used;
+    chunk->used += len;
+    return p;
+}
+
+static void write_batch_grow(WriteBatch* batch) {
+    size_t cap = batch->bufs_cap * 2;
+    if (batch->bufs == batch->inline_bufs) {
+        batch->bufs = malloc(cap * sizeof(uv_buf_t));
+        memcpy(batch->bufs, batch->inline_bufs, batch->nbufs * sizeof(uv_buf_t));
+    } else {
+        batch->bufs = realloc(batch->bufs, cap * sizeof(uv_buf_t));
+    }
+    batch->bufs_cap = cap;
+}
+
+size_t write_batch_add(WriteBatch* batch, const char* data, size_t len) {
+    if (batch->nbufs == batch->bufs_cap) write_batch_grow(batch);
+    batch->bufs[batch->nbufs] = uv_buf_init((char*)data, (unsigned int)len);
+    batch->total += len;
+    return batch->nbufs++;
+}
+
+void write_batch_set(WriteBatch* batch, size_t index, const char* data, size_t len) {
+    batch->total -= batch->bufs[index].len;
+    batch->bufs[index] = uv_buf_init((char*)data, (unsigned int)len);
+    batch->total += len;
+}
+
+void write_batch_pin(WriteBatch* batch, JSValueRef value) {
+    if (batch->pinned_count == batch->pinned_cap) {
+        batch->pinned_cap = batch->pinned_cap ? batch->pinned_cap * 2 : 4;
+        batch->pinned = realloc(batch->pinned, batch->pinned_cap * sizeof(JSValueRef));
+    }
+    JSValueProtect(batch->ctx, value);
+    batch->pinned[batch->pinned_count++] = value;
+}
+
+bool js_value_get_bytes(JSContextRef ctx, JSValueRef value, const char** data, size_t* len) {
+    if (!JSValueIsObject(ctx, value)) return false;
+
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, value, NULL);
+    if (type == kJSTypedArrayTypeNone) return false;
+
+    JSObjectRef object = (JSObjectRef)value;
+    if (type == kJSTypedArrayTypeArrayBuffer) {
+        *data = JSObjectGetArrayBufferBytesPtr(ctx, object, NULL);
+        *len = JSObjectGetArrayBufferByteLength(ctx, object, NULL);
+    } else {
+        // The bytes pointer is the start of the backing buffer, not of the view
+        char* base = JSObjectGetTypedArrayBytesPtr(ctx, object, NULL);
+        *data = base ? base + JSObjectGetTypedArrayByteOffset(ctx, object, NULL) : NULL;
+        *len = JSObjectGetTypedArrayByteLength(ctx, object, NULL);
+    }
+    if (!*data) *len = 0;
+    return true;
+}
+
+size_t write_batch_add_value(WriteBatch* batch, JSValueRef value, JSValueRef* exception) {
+    JSContextRef ctx = batch->ctx;
+    const char* bytes;
+    size_t len;
+
+    // Binary data is referenced in place and kept alive until the write completes
+    if (js_value_get_bytes(ctx, value, &bytes, &len)) {
+        if (len == 0) return 0;
+        write_batch_pin(batch, value);
+        write_batch_add(batch, bytes, len);
+        return len;
+    }
+
+    JSStringRef str = JSValueToStringCopy(ctx, value, exception);
+    if (!str) return 0;
+
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(str);
+    char* dst = write_batch_alloc(batch, max_len);
+    len = JSStringGetUTF8CString(str, dst, max_len) - 1;
+    JSStringRelease(str);
+
+    if (len) write_batch_add(batch, dst, len);
+    return len;
+}
+
+void write_batch_clear(WriteBatch* batch, size_t from) {
+    for (size_t i = from; i < batch->nbufs; i++) {
+        batch->total -= batch->bufs[i].len;
+        batch->bufs[i].len = 0;
+    }
+}
+
+static void on_write_batch_complete(uv_write_t* req, int status) {
+    WriteBatch* batch = (WriteBatch*)req->data;
+    if (batch->callback) batch->callback(batch, status);
+    write_batch_free(batch);
+}
+
+int write_batch_send(WriteBatch* batch, uv_stream_t* stream, WriteBatchCallback callback) {
+    batch->callback = callback;
+
+    // Drop placeholder slots that were never filled
+    size_t n = 0;
+    for (size_t i = 0; i < batch->nbufs; i++) {
+        if (batch->bufs[i].len > 0) batch->bufs[n++] = batch->bufs[i];
+    }
+    batch->nbufs = n;
+
+    uv_buf_t* bufs = batch->bufs;
+    size_t nbufs = n;
+
+    // Try to hand everything to the kernel right now; this fails with
+    // UV_EAGAIN when earlier writes are still queued, preserving order
+    if (nbufs > 0) {
+        int written = uv_try_write(stream, bufs, (unsigned int)nbufs);
+        if (written > 0) {
+            size_t left = (size_t)written;
+            while (nbufs > 0 && left >= bufs->len) {
+                left -= bufs->len;
+                bufs++;
+                nbufs--;
+            }
+            if (nbufs > 0) {
+                bufs->base += left;
+                bufs->len -= left;
+            }
+        } else if (written < 0 && written != UV_EAGAIN && written != UV_ENOSYS) {
+            if (callback) callback(batch, written);
+            write_batch_free(batch);
+            return written;
+        }
+    }
+
+    if (nbufs == 0) {
+        if (callback) callback(batch, 0);
+        write_batch_free(batch);
+        return 0;
+    }
+
+    batch->req.data = batch;
+    int result = uv_write(&batch->req, stream, bufs, (unsigned int)nbufs, on_write_batch_complete);
+    if (result < 0) {
+        if (callback) callback(batch, result);
+        write_batch_free(batch);
+    }
+    return result;
+}
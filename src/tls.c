@@ -0,0 +1,421 @@
+/**
+ * =====================================================================================
+ *
+ *        TLS.C - TLS Sessions over libuv Streams (https:// client and server)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Server contexts built from PEM certificates and keys, and the client
+ *   context the HTTP agent shares
+ * - One OpenSSL session per connection, driven from the owner's read
+ *   callback and fed into its existing write path
+ * - Resuming sessions: tickets (and session IDs) on the server, a bounded
+ *   per-thread cache of sessions by host and port on the client
+ *
+ * Design:
+ * - Sessions never touch the socket for reading: memory BIOs sit on both
+ *   sides, the owner passes ciphertext in with tls_session_feed() and gets
+ *   plaintext back through its data callback
+ * - Ciphertext goes out as ordinary write batches, so it takes the same
+ *   uv_try_write() fast path and keeps write order; a plaintext batch's
+ *   callback waits for the batch carrying its ciphertext
+ * - Ticket keys are generated once per process, so every cluster worker
+ *   accepts the tickets any of them issued
+ *
+ * =====================================================================================
+ */
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include "runtime.h"
+
+#define TLS_READ_CHUNK          (16 * 1024)     // One full record
+#define TLS_SESSION_CACHE_MAX   64              // Client sessions kept per thread
+
+struct TlsContext {
+    SSL_CTX* ctx;
+};
+
+// A batch written before the handshake finished
+typedef struct TlsHeldWrite {
+    struct TlsHeldWrite* next;
+    WriteBatch* batch;
+} TlsHeldWrite;
+
+struct TlsSession {
+    SSL* ssl;
+    BIO* in;                    // Ciphertext read from the socket
+    BIO* out;                   // Ciphertext waiting to be written
+    uv_stream_t* stream;
+    TlsDataCallback on_data;
+    void* owner;
+    TlsHeldWrite* held_head;
+    TlsHeldWrite* held_tail;
+    char* cache_key;            // Client sessions: verify flag, host and port
+    bool established;
+    bool shut;
+    char error[192];
+};
+
+typedef struct {
+    char* key;
+    SSL_SESSION* session;
+} TlsCachedSession;
+
+static JADE_THREAD_LOCAL MemPool tls_session_pool = MEM_POOL_INIT("tls.session", TlsSession);
+static JADE_THREAD_LOCAL SSL_CTX* tls_client_ctx = NULL;
+
+// Most recently stored last
+static JADE_THREAD_LOCAL TlsCachedSession tls_client_cache[TLS_SESSION_CACHE_MAX];
+static JADE_THREAD_LOCAL size_t tls_client_cache_count = 0;
+
+static pthread_once_t tls_ticket_once = PTHREAD_ONCE_INIT;
+static unsigned char tls_ticket_keys[80];       // Name, HMAC secret, AES key
+static bool tls_ticket_keys_ready = false;
+
+// ------------------------- Client session cache ------------------------- //
+
+static size_t tls_cache_find(const char* key) {
+    for (size_t i = 0; i < tls_client_cache_count; i++) {
+        if (strcmp(tls_client_cache[i].key, key) == 0) return i;
+    }
+    return TLS_SESSION_CACHE_MAX;
+}
+
+static void tls_cache_remove(size_t index) {
+    free(tls_client_cache[index].key);
+    SSL_SESSION_free(tls_client_cache[index].session);
+    tls_client_cache_count--;
+    memmove(&tls_client_cache[index], &tls_client_cache[index + 1],
+            (tls_client_cache_count - index) * sizeof(TlsCachedSession));
+}
+
+// Takes ownership of `session`; the newest ticket for a host replaces the older one
+static void tls_cache_store(const char* key, SSL_SESSION* session) {
+    size_t index = tls_cache_find(key);
+    if (index < TLS_SESSION_CACHE_MAX) tls_cache_remove(index);
+    else if (tls_client_cache_count == TLS_SESSION_CACHE_MAX) tls_cache_remove(0);
+
+    tls_client_cache[tls_client_cache_count].key = strdup(key);
+    tls_client_cache[tls_client_cache_count].session = session;
+    tls_client_cache_count++;
+}
+
+static int tls_on_new_session(SSL* ssl, SSL_SESSION* session) {
+    TlsSession* tls = (TlsSession*)SSL_get_app_data(ssl);
+    if (!tls || !tls->cache_key || !SSL_SESSION_is_resumable(session)) return 0;
+    tls_cache_store(tls->cache_key, session);
+    return 1;
+}
+
+static SSL_CTX* tls_client_context(void) {
+    if (tls_client_ctx) return tls_client_ctx;
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx) return NULL;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_default_verify_paths(ctx);
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+    // OpenSSL's own client cache is keyed by nothing useful; ours is keyed by host
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, tls_on_new_session);
+    tls_client_ctx = ctx;
+    return ctx;
+}
+
+// ------------------------- Server contexts ------------------------- //
+
+static void tls_ticket_keys_init(void) {
+    tls_ticket_keys_ready = RAND_bytes(tls_ticket_keys, sizeof(tls_ticket_keys)) == 1;
+}
+
+static bool tls_use_certificate_chain(SSL_CTX* ctx, const char* cert, size_t len) {
+    BIO* bio = BIO_new_mem_buf(cert, (int)len);
+    if (!bio) return false;
+
+    X509* leaf = PEM_read_bio_X509_AUX(bio, NULL, NULL, NULL);
+    bool ok = leaf && SSL_CTX_use_certificate(ctx, leaf) == 1;
+    X509_free(leaf);
+
+    // Intermediates follow the leaf; the context owns each one it accepts
+    X509* extra;
+    while (ok && (extra = PEM_read_bio_X509(bio, NULL, NULL, NULL))) {
+        if (SSL_CTX_add_extra_chain_cert(ctx, extra) != 1) {
+            X509_free(extra);
+            ok = false;
+        }
+    }
+    BIO_free(bio);
+    return ok;
+}
+
+static bool tls_use_private_key(SSL_CTX* ctx, const char* key, size_t len) {
+    BIO* bio = BIO_new_mem_buf(key, (int)len);
+    if (!bio) return false;
+    EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    bool ok = pkey && SSL_CTX_use_PrivateKey(ctx, pkey) == 1;
+    EVP_PKEY_free(pkey);
+    BIO_free(bio);
+    return ok;
+}
+
+TlsContext* tls_server_context_new(const char* cert, size_t cert_len, const char* key, size_t key_len,
+                                   const char** error) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        *error = "Could not create a TLS context";
+        return NULL;
+    }
+
+    if (!tls_use_certificate_chain(ctx, cert, cert_len)) {
+        *error = "Invalid TLS certificate";
+    } else if (!tls_use_private_key(ctx, key, key_len)) {
+        *error = "Invalid TLS private key";
+    } else if (SSL_CTX_check_private_key(ctx) != 1) {
+        *error = "TLS private key does not match the certificate";
+    } else {
+        *error = NULL;
+    }
+    ERR_clear_error();
+    if (*error) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"jade", 4);
+
+    pthread_once(&tls_ticket_once, tls_ticket_keys_init);
+    if (tls_ticket_keys_ready) {
+        SSL_CTX_set_tlsext_ticket_keys(ctx, tls_ticket_keys, sizeof(tls_ticket_keys));
+    }
+
+    TlsContext* context = malloc(sizeof(TlsContext));
+    context->ctx = ctx;
+    return context;
+}
+
+void tls_context_free(TlsContext* context) {
+    if (!context) return;
+    // Sessions hold their own reference to the SSL_CTX
+    SSL_CTX_free(context->ctx);
+    free(context);
+}
+
+// ------------------------- Sessions ------------------------- //
+
+static TlsSession* tls_session_new(SSL_CTX* ctx, uv_stream_t* stream, TlsDataCallback on_data, void* owner) {
+    SSL* ssl = ctx ? SSL_new(ctx) : NULL;
+    if (!ssl) return NULL;
+
+    TlsSession* tls = pool_calloc(&tls_session_pool);
+    tls->ssl = ssl;
+    tls->in = BIO_new(BIO_s_mem());
+    tls->out = BIO_new(BIO_s_mem());
+    SSL_set_bio(ssl, tls->in, tls->out);
+    SSL_set_app_data(ssl, tls);
+    tls->stream = stream;
+    tls->on_data = on_data;
+    tls->owner = owner;
+    return tls;
+}
+
+// Sends whatever ciphertext OpenSSL produced; `batch` (may be NULL) is the plaintext it carries
+static int tls_flush(TlsSession* tls, WriteBatch* batch, WriteBatchCallback callback) {
+    size_t pending = BIO_ctrl_pending(tls->out);
+    if (!batch && (pending == 0 || uv_is_closing((uv_handle_t*)tls->stream))) {
+        (void)BIO_reset(tls->out);
+        return 0;
+    }
+
+    WriteBatch* cipher = write_batch_new(batch ? batch->ctx : NULL);
+    if (pending) {
+        char* bytes = write_batch_alloc(cipher, pending);
+        write_batch_add(cipher, bytes, (size_t)BIO_read(tls->out, bytes, (int)pending));
+    }
+    cipher->data = batch;
+    return write_batch_send(cipher, tls->stream, callback);
+}
+
+static void on_tls_written(WriteBatch* cipher, int status) {
+    WriteBatch* batch = (WriteBatch*)cipher->data;
+    if (batch->callback) batch->callback(batch, status);
+    write_batch_free(batch);
+}
+
+static int tls_send(TlsSession* tls, WriteBatch* batch) {
+    for (size_t i = 0; i < batch->nbufs; i++) {
+        if (batch->bufs[i].len == 0) continue;
+        if (SSL_write(tls->ssl, batch->bufs[i].base, (int)batch->bufs[i].len) <= 0) {
+            ERR_clear_error();
+            if (batch->callback) batch->callback(batch, UV_EPROTO);
+            write_batch_free(batch);
+            return UV_EPROTO;
+        }
+    }
+    return tls_flush(tls, batch, on_tls_written);
+}
+
+static int tls_fail(TlsSession* tls, const char* what) {
+    long verify = SSL_get_verify_result(tls->ssl);
+    unsigned long code = ERR_peek_last_error();
+    const char* reason = code ? ERR_reason_error_string(code) : NULL;
+
+    if ((SSL_get_verify_mode(tls->ssl) & SSL_VERIFY_PEER) && verify != X509_V_OK) {
+        snprintf(tls->error, sizeof(tls->error), "TLS certificate verification failed: %s",
+                 X509_verify_cert_error_string(verify));
+    } else if (reason) {
+        snprintf(tls->error, sizeof(tls->error), "%s: %s", what, reason);
+    } else {
+        snprintf(tls->error, sizeof(tls->error), "%s", what);
+    }
+    ERR_clear_error();
+
+    // A session that did not hold up is not worth offering again
+    if (tls->cache_key) {
+        size_t index = tls_cache_find(tls->cache_key);
+        if (index < TLS_SESSION_CACHE_MAX) tls_cache_remove(index);
+    }
+    return UV_EPROTO;
+}
+
+TlsSession* tls_session_server(TlsContext* context, uv_stream_t* stream,
+                               TlsDataCallback on_data, void* owner) {
+    TlsSession* tls = tls_session_new(context->ctx, stream, on_data, owner);
+    if (tls) SSL_set_accept_state(tls->ssl);
+    return tls;
+}
+
+TlsSession* tls_session_client(uv_stream_t* stream, const char* host, int port, bool verify,
+                               TlsDataCallback on_data, void* owner) {
+    TlsSession* tls = tls_session_new(tls_client_context(), stream, on_data, owner);
+    if (!tls) return NULL;
+    SSL* ssl = tls->ssl;
+
+    unsigned char addr[16];
+    bool literal = inet_pton(AF_INET, host, addr) == 1 || inet_pton(AF_INET6, host, addr) == 1;
+    if (!literal) SSL_set_tlsext_host_name(ssl, host);
+    if (verify) {
+        SSL_set_verify(ssl, SSL_VERIFY_PEER, NULL);
+        if (literal) X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+        else SSL_set1_host(ssl, host);
+    }
+
+    // Unverified sessions are cached apart so they can never stand in for a verified one
+    size_t key_len = strlen(host) + 16;
+    tls->cache_key = malloc(key_len);
+    snprintf(tls->cache_key, key_len, "%c%s:%d", verify ? '+' : '-', host, port);
+    size_t index = tls_cache_find(tls->cache_key);
+    if (index < TLS_SESSION_CACHE_MAX) SSL_set_session(ssl, tls_client_cache[index].session);
+
+    // ClientHello
+    SSL_set_connect_state(ssl);
+    ERR_clear_error();
+    SSL_do_handshake(ssl);
+    ERR_clear_error();
+    tls_flush(tls, NULL, NULL);
+    return tls;
+}
+
+int tls_session_feed(TlsSession* tls, const char* data, size_t len) {
+    ERR_clear_error();
+    BIO_write(tls->in, data, (int)len);
+
+    if (!tls->established) {
+        int result = SSL_do_handshake(tls->ssl);
+        if (result != 1) {
+            int err = SSL_get_error(tls->ssl, result);
+            // Our next flight, or the alert explaining the failure
+            tls_flush(tls, NULL, NULL);
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) return 0;
+            return tls_fail(tls, "TLS handshake failed");
+        }
+
+        tls->established = true;
+        runtime_counters.tls_handshakes++;
+        if (SSL_session_reused(tls->ssl)) runtime_counters.tls_resumed++;
+
+        while (tls->held_head) {
+            TlsHeldWrite* held = tls->held_head;
+            tls->held_head = held->next;
+            WriteBatch* batch = held->batch;
+            free(held);
+            tls_send(tls, batch);
+        }
+        tls->held_tail = NULL;
+    }
+
+    char plain[TLS_READ_CHUNK];
+    for (;;) {
+        int n = SSL_read(tls->ssl, plain, sizeof(plain));
+        if (n > 0) {
+            if (!tls->on_data(tls->owner, plain, (size_t)n)) return 0;
+            continue;
+        }
+
+        // Post-handshake messages (tickets, key updates) may need an answer
+        int err = SSL_get_error(tls->ssl, n);
+        tls_flush(tls, NULL, NULL);
+        if (err == SSL_ERROR_WANT_READ) return 0;
+        if (err == SSL_ERROR_ZERO_RETURN) return UV_EOF;
+        return tls_fail(tls, "TLS connection failed");
+    }
+}
+
+int tls_session_write(TlsSession* tls, WriteBatch* batch, WriteBatchCallback callback) {
+    batch->callback = callback;
+    if (tls->established) {
+        ERR_clear_error();
+        return tls_send(tls, batch);
+    }
+
+    TlsHeldWrite* held = malloc(sizeof(TlsHeldWrite));
+    held->next = NULL;
+    held->batch = batch;
+    if (tls->held_tail) tls->held_tail->next = held;
+    else tls->held_head = held;
+    tls->held_tail = held;
+    return 0;
+}
+
+bool tls_session_established(const TlsSession* tls) {
+    return tls->established;
+}
+
+void tls_session_shutdown(TlsSession* tls) {
+    if (!tls->established || tls->shut) return;
+    tls->shut = true;
+    ERR_clear_error();
+    SSL_shutdown(tls->ssl);
+    ERR_clear_error();
+    tls_flush(tls, NULL, NULL);
+}
+
+const char* tls_session_error(const TlsSession* tls) {
+    return tls->error[0] ? tls->error : "TLS connection failed";
+}
+
+void tls_session_free(TlsSession* tls) {
+    if (!tls) return;
+    while (tls->held_head) {
+        TlsHeldWrite* held = tls->held_head;
+        tls->held_head = held->next;
+        if (held->batch->callback) held->batch->callback(held->batch, UV_ECANCELED);
+        write_batch_free(held->batch);
+        free(held);
+    }
+    SSL_free(tls->ssl);
+    free(tls->cache_key);
+    pool_free(&tls_session_pool, tls);
+}
@@ -1,80 +1,617 @@
+/**
+ * =====================================================================================
+ *
+ *        UV_EVENT_LOOP.C - Event Loop and Timer Wheel
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - Owning the calling thread's uv_loop_t
+ * - Multiplexing every JS and native timer onto one backing uv_timer_t
+ * - Running end-of-tick tasks (write coalescing) from a uv_check_t
+ * - Timing every iteration for process.metrics() (loop probe)
+ *
+ * Timer Wheel:
+ * - TIMER_WHEEL_LEVELS levels of 64 slots; level l slots span 64^l ms
+ * - A timer goes to the level of the highest base-64 digit where its expiry
+ *   differs from the wheel's clock, so insert and cancel are O(1)
+ * - Advancing the clock sweeps the slots each level passed over (found via a
+ *   per-level occupancy bitmap) and re-files those timers at lower levels
+ * - The backing timer is armed for the next occupied slot only, and is
+ *   unref'd while every live timer is unref'd
+ *
+ * Tick Tasks:
+ * - Queued tasks run in the check phase, right after the iteration's I/O
+ *   callbacks, so everything those callbacks did is seen at once
+ * - A uv_idle_t runs while tasks are queued so the poll phase does not block
+ *   when a task was queued from a timer or from the main script
+ *
+ * Loop Probe:
+ * - A uv_prepare_t notes when poll must return for the next timer; the
+ *   matching uv_check_t measures how far past that the I/O callbacks ran
+ *   (lag) and, with libuv's idle-time metric, how much of the iteration was
+ *   spent outside the kernel (busy). Both handles are unref'd
+ *
+ * Microtasks:
+ * - JSC drains its microtask queue whenever the outermost call into JS
+ *   returns, so every callback, timer and promise settlement made from a
+ *   libuv phase runs its await continuations before control comes back here.
+ *   Native code therefore settles promises with a plain call (see
+ *   completion.c) and never needs a separate drain step or a zero-delay timer
+ *
+ * Memory Management:
+ * - Timer nodes come from the per-loop "timer.node" pool and go back to it
+ *   once fired or cancelled
+ * - Each node gets a permanent index the first time it is carved; timer IDs
+ *   pack that index with a per-node generation, so stale IDs never match a
+ *   reused node
+ *
+ * =====================================================================================
+ */
+
 #include <JavaScriptCore/JavaScript.h>
 #include <uv.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include "runtime.h"
 
-// Event Loop Definitions
-uv_loop_t* loop = NULL;
+// Event Loop Definitions (one loop per thread in cluster mode)
+JADE_THREAD_LOCAL uv_loop_t* loop = NULL;
+
+static void timer_wheel_close(void);
+static void tick_queue_close(void);
+static void loop_probe_start(void);
+static void loop_probe_close(void);
 
 void init_event_loop(void) {
-    loop = uv_default_loop();
+    if (!loop) loop = uv_default_loop();
 }
 
 void run_event_loop(void) {
+    loop_probe_start();
+    // Microtasks are drained by JSC after each callback, i.e. between phases
     uv_run(loop, UV_RUN_DEFAULT);
+    console_close();
+    loop_probe_close();
+    tick_queue_close();
+    timer_wheel_close();
 }
 
-// Timer request structure
+// =====================================================================================
+//                          LOOP PROBE
+// =====================================================================================
+
 typedef struct {
-    uv_timer_t timer;
+    bool initialized;
+    uv_prepare_t prepare;
+    uv_check_t check;
+    uint64_t poll_deadline;     // hrtime the poll phase was due back by, 0 if unbounded
+    uint64_t last_check;
+    uint64_t last_idle;
+    LoopMetrics stats;
+} LoopProbe;
+
+static JADE_THREAD_LOCAL LoopProbe probe;
+
+// Right before poll: note when the loop has to be back for its next timer
+static void on_probe_prepare(uv_prepare_t* handle) {
+    int timeout = uv_backend_timeout(loop);
+    probe.poll_deadline = timeout >= 0 ? uv_hrtime() + (uint64_t)timeout * 1000000 : 0;
+}
+
+// Right after poll (and the I/O callbacks it ran): close the iteration's books
+static void on_probe_check(uv_check_t* handle) {
+    uint64_t now = uv_hrtime();
+    uint64_t idle = uv_metrics_idle_time(loop);
+    uint64_t iteration = now - probe.last_check;
+    uint64_t idle_delta = idle - probe.last_idle;
+    uint64_t busy = iteration > idle_delta ? iteration - idle_delta : 0;
+    uint64_t lag = probe.poll_deadline && now > probe.poll_deadline ? now - probe.poll_deadline : 0;
+    probe.last_check = now;
+    probe.last_idle = idle;
+
+    LoopMetrics* stats = &probe.stats;
+    stats->iterations++;
+    stats->last_iteration_ns = iteration;
+    stats->last_busy_ns = busy;
+    stats->busy_ns += busy;
+    stats->idle_ns += idle_delta;
+    stats->last_lag_ns = lag;
+    if (busy > stats->max_busy_ns) stats->max_busy_ns = busy;
+    if (lag > stats->max_lag_ns) stats->max_lag_ns = lag;
+}
+
+static void loop_probe_start(void) {
+    if (probe.initialized) return;
+
+    // Only counts time blocked in the kernel; must be set before the loop first runs
+    uv_loop_configure(loop, UV_METRICS_IDLE_TIME);
+
+    uv_prepare_init(loop, &probe.prepare);
+    uv_check_init(loop, &probe.check);
+    uv_prepare_start(&probe.prepare, on_probe_prepare);
+    uv_check_start(&probe.check, on_probe_check);
+    uv_unref((uv_handle_t*)&probe.prepare);
+    uv_unref((uv_handle_t*)&probe.check);
+
+    probe.last_check = uv_hrtime();
+    probe.last_idle = uv_metrics_idle_time(loop);
+    probe.stats.started_ns = probe.last_check;
+    probe.initialized = true;
+}
+
+static void loop_probe_close(void) {
+    if (!probe.initialized) return;
+    probe.initialized = false;
+
+    uv_close((uv_handle_t*)&probe.prepare, NULL);
+    uv_close((uv_handle_t*)&probe.check, NULL);
+    uv_run(loop, UV_RUN_NOWAIT);
+}
+
+void loop_metrics_read(LoopMetrics* out) {
+    *out = probe.stats;
+}
+
+// =====================================================================================
+//                          TICK TASKS
+// =====================================================================================
+
+typedef struct {
+    bool initialized;
+    uv_check_t check;
+    uv_idle_t idle;             // Keeps poll from blocking while tasks are queued
+    TickTask* head;
+    TickTask* tail;
+} TickQueue;
+
+static JADE_THREAD_LOCAL TickQueue ticks;
+
+static void on_tick_idle(uv_idle_t* handle) {
+    // Only active so uv_run() polls with a zero timeout
+}
+
+static void on_tick_check(uv_check_t* handle) {
+    // Tasks queued behind the marker (including reschedules) wait for the next iteration
+    TickTask marker = { 0 };
+    tick_task_schedule(&marker, NULL);
+
+    for (;;) {
+        TickTask* task = ticks.head;
+        tick_task_cancel(task);
+        if (task == &marker) break;
+        task->callback(task);
+    }
+}
+
+void tick_task_schedule(TickTask* task, TickCallback callback) {
+    task->callback = callback;
+    if (task->scheduled) return;
+
+    if (!ticks.initialized) {
+        uv_check_init(loop, &ticks.check);
+        uv_idle_init(loop, &ticks.idle);
+        ticks.initialized = true;
+    }
+    if (!ticks.head) {
+        uv_check_start(&ticks.check, on_tick_check);
+        uv_idle_start(&ticks.idle, on_tick_idle);
+    }
+
+    task->scheduled = true;
+    task->next = NULL;
+    task->prev = ticks.tail;
+    if (ticks.tail) ticks.tail->next = task;
+    else ticks.head = task;
+    ticks.tail = task;
+}
+
+void tick_task_cancel(TickTask* task) {
+    if (!task->scheduled) return;
+    task->scheduled = false;
+
+    if (task->prev) task->prev->next = task->next;
+    else if (ticks.head == task) ticks.head = task->next;
+    if (task->next) task->next->prev = task->prev;
+    else if (ticks.tail == task) ticks.tail = task->prev;
+    task->next = task->prev = NULL;
+
+    if (!ticks.head && ticks.initialized) {
+        uv_check_stop(&ticks.check);
+        uv_idle_stop(&ticks.idle);
+    }
+}
+
+static void tick_queue_close(void) {
+    if (!ticks.initialized) return;
+    ticks.initialized = false;
+
+    uv_close((uv_handle_t*)&ticks.check, NULL);
+    uv_close((uv_handle_t*)&ticks.idle, NULL);
+    uv_run(loop, UV_RUN_NOWAIT);
+}
+
+// =====================================================================================
+//                          TIMER WHEEL
+// =====================================================================================
+
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS  ((64 + TIMER_WHEEL_BITS - 1) / TIMER_WHEEL_BITS)
+
+#define TIMER_INDEX_BITS    24
+#define TIMER_INDEX_MASK    ((1u << TIMER_INDEX_BITS) - 1)
+#define TIMER_GEN_MASK      ((1u << (53 - TIMER_INDEX_BITS)) - 1)  // IDs stay exact JS numbers
+
+typedef enum {
+    TIMER_FREE,
+    TIMER_ARMED,        // Linked into a wheel slot
+    TIMER_PENDING,      // Expired, waiting its turn in the current tick
+    TIMER_FIRING,       // Callback running
+    TIMER_CANCELLED     // Cleared while pending or firing
+} TimerState;
+
+typedef struct TimerNode {
+    struct TimerNode* next;     // First, so pool_free() leaves the rest intact
+    struct TimerNode* prev;
+    uint64_t expiry;
+    uint64_t repeat;
+    uint64_t seq;               // Insertion order, breaks expiry ties
+    uint32_t index;
+    uint32_t generation;
+    uint8_t state;
+    uint8_t level;
+    uint8_t slot;
+    bool unref;                 // Does not keep the loop alive
+
+    TimerCallback native;       // Native callback, or NULL for a JS callback
+    void* data;
     JSContextRef ctx;
     JSObjectRef callback;
-    uint32_t id;
-} TimerRequest;
-
-// Timer registry
-static TimerRequest* timer_registry[1024];  // Fixed-size registry for simplicity
-uint32_t next_timer_id = 0;
-
-// Timer callback handler
-static void on_timer(uv_timer_t* handle) {
-    TimerRequest* tr = (TimerRequest*)handle->data;
-    JSValueProtect(tr->ctx, tr->callback);
-    JSValueRef args[] = { JSValueMakeNumber(tr->ctx, 0) };
-    JSObjectCallAsFunction(tr->ctx, tr->callback, NULL, 1, args, NULL);
-    JSValueUnprotect(tr->ctx, tr->callback);
-}
-
-void set_timeout(JSContextRef ctx, JSObjectRef callback, uint64_t timeout) {
-    TimerRequest* tr = malloc(sizeof(TimerRequest));
-    tr->ctx = ctx;
-    tr->callback = callback;
-    tr->id = next_timer_id++;
-    timer_registry[tr->id] = tr;  // Add to registry
-
-    uv_timer_init(loop, &tr->timer);
-    tr->timer.data = tr;
-    uv_timer_start(&tr->timer, on_timer, timeout, 0);  // No repeat
-    JSValueProtect(ctx, callback);
+} TimerNode;
+
+typedef struct {
+    bool initialized;
+    uv_timer_t backing;
+    uint64_t now;               // Wheel clock (ms, loop time)
+    uint64_t deadline;          // When the backing timer fires, UINT64_MAX if idle
+    uint64_t next_seq;
+    size_t armed;
+    size_t refs;                // Live timers that keep the loop alive
+
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    TimerNode* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+    TimerNode** nodes;          // By index; slot 0 is unused
+    size_t node_count;
+    size_t node_cap;
+
+    TimerNode** expired;
+    size_t expired_cap;
+} TimerWheel;
+
+static JADE_THREAD_LOCAL TimerWheel wheel;
+static JADE_THREAD_LOCAL MemPool timer_node_pool = MEM_POOL_INIT("timer.node", TimerNode);
+
+static inline uint64_t rotr64(uint64_t x, unsigned r) {
+    r &= 63;
+    return r ? (x >> r) | (x << (64 - r)) : x;
 }
 
-void set_interval(JSContextRef ctx, JSObjectRef callback, uint64_t interval) {
-    TimerRequest* tr = malloc(sizeof(TimerRequest));
-    tr->ctx = ctx;
-    tr->callback = callback;
-    tr->id = next_timer_id++;
-    timer_registry[tr->id] = tr;  // Add to registry
+static inline uint64_t rotl64(uint64_t x, unsigned r) {
+    r &= 63;
+    return r ? (x << r) | (x >> (64 - r)) : x;
+}
+
+static inline uint64_t timer_id(const TimerNode* node) {
+    return ((uint64_t)node->generation << TIMER_INDEX_BITS) | node->index;
+}
+
+static TimerNode* timer_node_alloc(void) {
+    TimerNode* node = pool_alloc(&timer_node_pool);
+    if (!node) return NULL;
+
+    if (node->index == 0) {
+        // Never used before: give it a permanent slot in the index table
+        if (wheel.node_count + 1 > TIMER_INDEX_MASK) {
+            pool_free(&timer_node_pool, node);
+            return NULL;
+        }
+        if (wheel.node_count + 1 >= wheel.node_cap) {
+            wheel.node_cap = wheel.node_cap ? wheel.node_cap * 2 : 1024;
+            wheel.nodes = realloc(wheel.nodes, wheel.node_cap * sizeof(TimerNode*));
+        }
+        node->index = (uint32_t)++wheel.node_count;
+        wheel.nodes[node->index] = node;
+    }
+
+    node->generation = (node->generation + 1) & TIMER_GEN_MASK;
+    if (node->generation == 0) node->generation = 1;   // ID 0 is never handed out
+    return node;
+}
+
+static void timer_wheel_update_ref(void) {
+    if (wheel.refs) {
+        uv_ref((uv_handle_t*)&wheel.backing);
+    } else {
+        uv_unref((uv_handle_t*)&wheel.backing);
+    }
+}
+
+static void timer_node_release(TimerNode* node) {
+    if (!node->unref && --wheel.refs == 0) timer_wheel_update_ref();
+    if (!node->native && node->callback) JSValueUnprotect(node->ctx, node->callback);
+    node->callback = NULL;
+    node->native = NULL;
+    node->data = NULL;
+    node->state = TIMER_FREE;
+    pool_free(&timer_node_pool, node);
+}
 
-    uv_timer_init(loop, &tr->timer);
-    tr->timer.data = tr;
-    uv_timer_start(&tr->timer, on_timer, interval, interval);  // Repeat
+static TimerNode* timer_node_lookup(uint64_t id) {
+    uint32_t index = (uint32_t)(id & TIMER_INDEX_MASK);
+    uint32_t generation = (uint32_t)(id >> TIMER_INDEX_BITS);
+    if (index == 0 || index > wheel.node_count) return NULL;
+
+    TimerNode* node = wheel.nodes[index];
+    if (node->state == TIMER_FREE || node->generation != generation) return NULL;
+    return node;
+}
+
+// When the wheel next needs to look at `level`, given its occupancy
+static uint64_t timer_wheel_next_visit(int level, uint64_t occupied) {
+    unsigned shift = level * TIMER_WHEEL_BITS;
+    unsigned digit = (unsigned)((wheel.now >> shift) & TIMER_WHEEL_MASK);
+    uint64_t steps = (uint64_t)__builtin_ctzll(rotr64(occupied, digit + 1)) + 1;
+    return ((wheel.now >> shift) + steps) << shift;
+}
+
+static void on_timer_wheel(uv_timer_t* handle);
+
+static void timer_wheel_arm(uint64_t when) {
+    if (when >= wheel.deadline) return;
+    wheel.deadline = when;
+
+    uint64_t current = uv_now(loop);
+    uv_timer_start(&wheel.backing, on_timer_wheel, when > current ? when - current : 0, 0);
+}
+
+static void timer_wheel_insert(TimerNode* node) {
+    // Callers guarantee expiry > wheel.now, so the XOR is never zero
+    int level = (63 - __builtin_clzll(node->expiry ^ wheel.now)) / TIMER_WHEEL_BITS;
+    int slot = (int)((node->expiry >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+
+    TimerNode** head = &wheel.slots[level][slot];
+    node->prev = NULL;
+    node->next = *head;
+    if (*head) (*head)->prev = node;
+    *head = node;
+
+    node->level = (uint8_t)level;
+    node->slot = (uint8_t)slot;
+    node->state = TIMER_ARMED;
+    wheel.occupied[level] |= 1ULL << slot;
+    wheel.armed++;
+
+    timer_wheel_arm(timer_wheel_next_visit(level, 1ULL << slot));
+}
+
+static void timer_wheel_unlink(TimerNode* node) {
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        wheel.slots[node->level][node->slot] = node->next;
+        if (!node->next) wheel.occupied[node->level] &= ~(1ULL << node->slot);
+    }
+    if (node->next) node->next->prev = node->prev;
+    wheel.armed--;
+}
+
+static int timer_node_compare(const void* a, const void* b) {
+    const TimerNode* x = *(TimerNode* const*)a;
+    const TimerNode* y = *(TimerNode* const*)b;
+    if (x->expiry != y->expiry) return x->expiry < y->expiry ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+// Moves the clock to `target`; returns how many timers landed in wheel.expired
+static size_t timer_wheel_advance(uint64_t target) {
+    TimerNode* swept = NULL;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        unsigned shift = level * TIMER_WHEEL_BITS;
+        uint64_t elapsed = (target >> shift) - (wheel.now >> shift);
+        if (elapsed == 0) break;    // Higher digits did not move either
+
+        uint64_t passed = ~0ULL;
+        if (elapsed < TIMER_WHEEL_SLOTS) {
+            unsigned digit = (unsigned)((wheel.now >> shift) & TIMER_WHEEL_MASK);
+            passed = rotl64((1ULL << elapsed) - 1, digit + 1);
+        }
+
+        uint64_t hit = passed & wheel.occupied[level];
+        wheel.occupied[level] &= ~hit;
+        while (hit) {
+            int slot = __builtin_ctzll(hit);
+            hit &= hit - 1;
+
+            TimerNode* node = wheel.slots[level][slot];
+            wheel.slots[level][slot] = NULL;
+            while (node) {
+                TimerNode* next = node->next;
+                node->next = swept;
+                swept = node;
+                wheel.armed--;
+                node = next;
+            }
+        }
+    }
+
+    wheel.now = target;
+
+    size_t count = 0;
+    while (swept) {
+        TimerNode* node = swept;
+        swept = node->next;
+
+        if (node->expiry > target) {
+            timer_wheel_insert(node);
+            continue;
+        }
+
+        if (count == wheel.expired_cap) {
+            wheel.expired_cap = wheel.expired_cap ? wheel.expired_cap * 2 : 64;
+            wheel.expired = realloc(wheel.expired, wheel.expired_cap * sizeof(TimerNode*));
+        }
+        node->state = TIMER_PENDING;
+        wheel.expired[count++] = node;
+    }
+
+    if (count > 1) qsort(wheel.expired, count, sizeof(TimerNode*), timer_node_compare);
+    return count;
+}
+
+static void timer_node_fire(TimerNode* node) {
+    if (node->native) {
+        node->native(node->data);
+        return;
+    }
+
+    JSContextRef ctx = node->ctx;
+    JSObjectRef callback = node->callback;
     JSValueProtect(ctx, callback);
+    JSValueRef args[] = { JSValueMakeNumber(ctx, 0) };
+    PROFILE_CALL_SPAN(ctx, callback, "timer");
+    JSObjectCallAsFunction(ctx, callback, NULL, 1, args, NULL);
+    JSValueUnprotect(ctx, callback);
 }
 
-void clear_timeout(JSContextRef ctx, uint32_t timer_id) {
-    if (timer_id >= next_timer_id || !timer_registry[timer_id]) {
-        return;  // Invalid timer ID
+static void on_timer_wheel(uv_timer_t* handle) {
+    wheel.deadline = UINT64_MAX;
+
+    uint64_t now = uv_now(loop);
+    size_t count = timer_wheel_advance(now);
+
+    for (size_t i = 0; i < count; i++) {
+        TimerNode* node = wheel.expired[i];
+        if (node->state == TIMER_CANCELLED) {
+            timer_node_release(node);
+            continue;
+        }
+
+        node->state = TIMER_FIRING;
+        timer_node_fire(node);
+
+        if (node->state == TIMER_FIRING && node->repeat) {
+            node->expiry = now + node->repeat;
+            node->seq = wheel.next_seq++;
+            timer_wheel_insert(node);
+        } else {
+            timer_node_release(node);
+        }
+    }
+
+    // Re-arm for whatever is left (inserts above may already have)
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (wheel.occupied[level]) timer_wheel_arm(timer_wheel_next_visit(level, wheel.occupied[level]));
+    }
+}
+
+static TimerNode* timer_wheel_add(uint64_t timeout, uint64_t repeat) {
+    if (!wheel.initialized) {
+        uv_timer_init(loop, &wheel.backing);
+        wheel.initialized = true;
+        wheel.deadline = UINT64_MAX;
+        wheel.now = uv_now(loop);
+    }
+
+    TimerNode* node = timer_node_alloc();
+    if (!node) return NULL;
+
+    // An idle wheel's clock may be far behind; catch it up so the timer files low
+    if (wheel.armed == 0) wheel.now = uv_now(loop);
+
+    node->expiry = uv_now(loop) + (timeout ? timeout : 1);
+    node->repeat = repeat;
+    node->seq = wheel.next_seq++;
+    node->unref = false;
+    if (wheel.refs++ == 0) timer_wheel_update_ref();
+    timer_wheel_insert(node);
+    return node;
+}
+
+static void timer_wheel_close(void) {
+    if (!wheel.initialized) return;
+    wheel.initialized = false;
+
+    uv_timer_stop(&wheel.backing);
+    uv_close((uv_handle_t*)&wheel.backing, NULL);
+    uv_run(loop, UV_RUN_NOWAIT);
+}
+
+size_t timer_count(void) {
+    return timer_node_pool.in_use;
+}
+
+uint64_t timer_start(uint64_t timeout, uint64_t repeat, TimerCallback callback, void* data) {
+    TimerNode* node = timer_wheel_add(timeout, repeat);
+    if (!node) return 0;
+    node->native = callback;
+    node->data = data;
+    return timer_id(node);
+}
+
+void timer_unref(uint64_t id) {
+    TimerNode* node = timer_node_lookup(id);
+    if (!node || node->unref) return;
+    node->unref = true;
+    if (--wheel.refs == 0) timer_wheel_update_ref();
+}
+
+bool timer_stop(uint64_t id) {
+    TimerNode* node = timer_node_lookup(id);
+    if (!node || node->state == TIMER_CANCELLED) return false;
+
+    if (node->state == TIMER_ARMED) {
+        timer_wheel_unlink(node);
+        timer_node_release(node);
+        if (wheel.armed == 0) {
+            uv_timer_stop(&wheel.backing);
+            wheel.deadline = UINT64_MAX;
+        }
+    } else {
+        // Still referenced by the tick in progress, which releases it
+        node->state = TIMER_CANCELLED;
     }
+    return true;
+}
+
+// =====================================================================================
+//                          JS TIMERS
+// =====================================================================================
 
-    TimerRequest* tr = timer_registry[timer_id];
-    uv_timer_stop(&tr->timer);
-    uv_close((uv_handle_t*)&tr->timer, NULL);
-    JSValueUnprotect(tr->ctx, tr->callback);
-    timer_registry[timer_id] = NULL;  // Remove from registry
-    free(tr);
+static uint64_t js_timer_start(JSContextRef ctx, JSObjectRef callback, uint64_t timeout, uint64_t repeat) {
+    TimerNode* node = timer_wheel_add(timeout, repeat);
+    if (!node) return 0;
+    node->ctx = ctx;
+    node->callback = callback;
+    JSValueProtect(ctx, callback);
+    return timer_id(node);
+}
+
+uint64_t set_timeout(JSContextRef ctx, JSObjectRef callback, uint64_t timeout) {
+    return js_timer_start(ctx, callback, timeout, 0);
+}
+
+uint64_t set_interval(JSContextRef ctx, JSObjectRef callback, uint64_t interval) {
+    return js_timer_start(ctx, callback, interval, interval ? interval : 1);
+}
+
+void clear_timeout(JSContextRef ctx, uint64_t timer_id) {
+    timer_stop(timer_id);
 }
 
-void clear_interval(JSContextRef ctx, uint32_t timer_id) {
+void clear_interval(JSContextRef ctx, uint64_t timer_id) {
     clear_timeout(ctx, timer_id);  // Reuse clear_timeout logic
-}
\ No newline at end of file
+}
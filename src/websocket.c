@@ -0,0 +1,955 @@
+/**
+ * =====================================================================================
+ *
+ *        WEBSOCKET.C - WebSocket Framing and Connections (RFC 6455)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - The WebSocket object scripts see: "open"/"message"/"close"/"error",
+ *   send(), close(), terminate(), readyState and bufferedAmount
+ * - Parsing frames straight out of the read buffer: unmasking, fragment
+ *   reassembly, ping/pong and the close handshake never enter JS, which only
+ *   gets whole messages
+ * - Keepalive pings, and `broadcast()`, which encodes a frame once for many
+ *   connections
+ * - Handshake keys; the HTTP module does the upgrade and owns the socket
+ *
+ * Design:
+ * - A WebSocket does not own its stream: the server connection or agent
+ *   socket it was upgraded from keeps the handle, feeds it the bytes it reads
+ *   (plaintext on TLS) and reports back with websocket_detach() once the
+ *   handle is closed
+ * - Payload bytes are unmasked while they are copied into the message
+ *   buffer, 16 bytes at a time with SSE2 (8 at a time elsewhere); a binary
+ *   message's buffer becomes the Buffer handed to JS without another copy
+ * - Frames sent in one loop tick share a WriteBatch, flushed as one vectored
+ *   write; server frames reference binary payloads in place, client frames
+ *   are masked into the batch arena
+ *
+ * Memory Management:
+ * - The JS object is protected from creation until "close"; the native
+ *   struct is freed by the class finalizer
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "runtime.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define WS_GUID                 "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_HEADER           14      // 2 + 8 length bytes + 4 mask bytes
+#define WS_MAX_CONTROL          125
+#define WS_CLOSE_TIMEOUT_MS     5000    // Wait for the peer's close frame before dropping the socket
+#define WS_MESSAGE_KEEP         (64 * 1024)  // Larger text buffers are not kept for the next message
+
+#define WS_OP_CONTINUATION      0x0
+#define WS_OP_TEXT              0x1
+#define WS_OP_BINARY            0x2
+#define WS_OP_CLOSE             0x8
+#define WS_OP_PING              0x9
+#define WS_OP_PONG              0xA
+
+#define WS_CLOSE_NORMAL         1000
+#define WS_CLOSE_PROTOCOL       1002
+#define WS_CLOSE_NO_STATUS      1005
+#define WS_CLOSE_ABNORMAL       1006
+#define WS_CLOSE_INVALID_DATA   1007
+#define WS_CLOSE_TOO_BIG        1009
+
+#define WS_WRITE_CLOSE_AFTER    0x1
+
+// readyState values, as in the browser API
+typedef enum {
+    WS_CONNECTING,
+    WS_OPEN,
+    WS_CLOSING,
+    WS_CLOSED
+} WebSocketState;
+
+struct WebSocket {
+    TickTask flush_task;        // First, so the tick callback can cast back
+    JSContextRef ctx;
+    JSObjectRef object;
+    EventListeners listeners;
+    WebSocketState state;
+    bool client;                // Masks its frames and expects unmasked ones
+    size_t max_payload;
+    uint64_t ping_interval;
+
+    // Transport, lent by the owner between attach and detach
+    uv_stream_t* stream;
+    TlsSession* tls;
+    WebSocketCloseCallback close_transport;
+    void* owner;
+    bool attached;
+    bool transport_closing;
+
+    WriteBatch* pending;        // Frames since the last flush
+
+    // Frame being read
+    uint8_t header[WS_MAX_HEADER];
+    size_t header_len;
+    bool in_payload;
+    bool fin;
+    bool masked;
+    uint8_t opcode;
+    uint8_t mask[4];
+    uint64_t remaining;         // Payload bytes still to come
+    uint64_t payload_off;       // Payload bytes seen, for the mask rotation
+    char control[WS_MAX_CONTROL];
+    size_t control_len;
+    bool receive_ended;         // A close frame or protocol error ends parsing
+
+    // Message being reassembled
+    char* message;
+    size_t message_len;
+    size_t message_cap;
+    uint8_t message_opcode;     // 0 when no message is open
+
+    // Keepalive and closing
+    uint64_t ping_timer;
+    bool awaiting_pong;
+    uint64_t close_timer;
+    bool close_sent;
+    bool close_received;
+    int close_code;
+    char close_reason[WS_MAX_CONTROL];
+    size_t close_reason_len;
+    char* error;                // Reported as "error" before "close"
+};
+
+static JADE_THREAD_LOCAL JSClassRef websocket_class = NULL;
+static JADE_THREAD_LOCAL uint64_t ws_mask_state = 0;
+
+static JSValueRef ws_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
+}
+
+// ========================= HANDSHAKE KEYS ========================= //
+
+void websocket_accept_key(const char* key, size_t len, char accept[WEBSOCKET_ACCEPT_LENGTH + 1]) {
+    char input[128];
+    if (len > sizeof(input) - sizeof(WS_GUID)) len = sizeof(input) - sizeof(WS_GUID);
+    memcpy(input, key, len);
+    memcpy(input + len, WS_GUID, sizeof(WS_GUID) - 1);
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    EVP_Digest(input, len + sizeof(WS_GUID) - 1, digest, &digest_len, EVP_sha1(), NULL);
+    EVP_EncodeBlock((unsigned char*)accept, digest, (int)digest_len);
+}
+
+void websocket_client_key(char key[WEBSOCKET_KEY_LENGTH + 1]) {
+    unsigned char nonce[16];
+    RAND_bytes(nonce, sizeof(nonce));
+    EVP_EncodeBlock((unsigned char*)key, nonce, sizeof(nonce));
+}
+
+// Client frame masks only have to be unpredictable to the page, not secret;
+// a per-thread xorshift seeded from the CSPRNG keeps them off RAND_bytes()
+static void ws_next_mask(uint8_t mask[4]) {
+    if (ws_mask_state == 0) {
+        RAND_bytes((unsigned char*)&ws_mask_state, sizeof(ws_mask_state));
+        ws_mask_state |= 1;
+    }
+    ws_mask_state ^= ws_mask_state << 13;
+    ws_mask_state ^= ws_mask_state >> 7;
+    ws_mask_state ^= ws_mask_state << 17;
+    uint32_t bits = (uint32_t)(ws_mask_state >> 16);
+    memcpy(mask, &bits, 4);
+}
+
+// ========================= MASKING AND VALIDATION ========================= //
+
+// XORs `len` bytes from `src` into `dst` (which may be `src`) with `key`,
+// starting `offset` bytes into the payload
+static void ws_mask_copy(char* dst, const char* src, size_t len, const uint8_t key[4], uint64_t offset) {
+    uint8_t k[4];
+    for (int i = 0; i < 4; i++) k[i] = key[(offset + (uint64_t)i) & 3];
+    uint32_t k32;
+    memcpy(&k32, k, 4);
+    size_t i = 0;
+
+    // Every step is a multiple of 4 bytes, so the key stays in phase
+#if defined(__SSE2__)
+    const __m128i m = _mm_set1_epi32((int)k32);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, m));
+    }
+#endif
+    const uint64_t m64 = (uint64_t)k32 << 32 | k32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        w ^= m64;
+        memcpy(dst + i, &w, 8);
+    }
+    for (; i < len; i++) dst[i] = (char)(src[i] ^ k[i & 3]);
+}
+
+// RFC 3629 UTF-8: no overlong forms, surrogates or code points past U+10FFFF
+static bool ws_utf8_valid(const unsigned char* s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        // ASCII runs go 8 bytes at a time
+        if (i + 8 <= len) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            if (!(w & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t n;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) n = 1;
+        else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+
+        if (i + n >= len) return false;
+        if (s[i + 1] < lo || s[i + 1] > hi) return false;
+        for (size_t k = 2; k <= n; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// ========================= WRITE SIDE ========================= //
+
+static void ws_close_transport(WebSocket* ws);
+static void ws_init_class(void);
+
+static size_t ws_frame_header(uint8_t* out, uint8_t opcode, uint64_t len, const uint8_t* mask) {
+    size_t n = 2;
+    out[0] = (uint8_t)(0x80 | opcode);
+    if (len < 126) {
+        out[1] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (uint8_t)(len >> 8);
+        out[3] = (uint8_t)len;
+        n = 4;
+    } else {
+        out[1] = 127;
+        for (int i = 0; i < 8; i++) out[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+        n = 10;
+    }
+    if (mask) {
+        out[1] |= 0x80;
+        memcpy(out + n, mask, 4);
+        n += 4;
+    }
+    return n;
+}
+
+static size_t ws_buffered(const WebSocket* ws) {
+    size_t queued = ws->stream && !ws->transport_closing ? uv_stream_get_write_queue_size(ws->stream) : 0;
+    return queued + (ws->pending ? ws->pending->total : 0);
+}
+
+static void on_ws_written(WriteBatch* batch, int status) {
+    WebSocket* ws = (WebSocket*)batch->data;
+    if (ws->transport_closing) return;
+    if (status < 0) {
+        ws_close_transport(ws);
+        return;
+    }
+
+    runtime_counters.websocket.bytes_written += batch->total;
+    if (batch->flags & WS_WRITE_CLOSE_AFTER) ws_close_transport(ws);
+}
+
+// Sends every frame queued since the last flush as one vectored write
+static void ws_flush(WebSocket* ws) {
+    tick_task_cancel(&ws->flush_task);
+    if (!ws->pending || !ws->stream || ws->transport_closing) return;
+
+    WriteBatch* batch = ws->pending;
+    ws->pending = NULL;
+    batch->data = ws;
+    if (ws->tls) tls_session_write(ws->tls, batch, on_ws_written);
+    else write_batch_send(batch, ws->stream, on_ws_written);
+}
+
+static void on_ws_tick(TickTask* task) {
+    ws_flush((WebSocket*)task);
+}
+
+// The batch the next frame goes into; it is flushed at the end of the tick
+static WriteBatch* ws_batch(WebSocket* ws) {
+    if (!ws->pending) ws->pending = write_batch_new(ws->ctx);
+    if (ws->stream) tick_task_schedule(&ws->flush_task, on_ws_tick);
+    return ws->pending;
+}
+
+// Queues a frame whose payload is copied (and masked on the client side)
+static void ws_queue_frame(WebSocket* ws, uint8_t opcode, const char* payload, size_t len) {
+    WriteBatch* batch = ws_batch(ws);
+    uint8_t mask[4];
+    if (ws->client) ws_next_mask(mask);
+
+    char* frame = write_batch_alloc(batch, WS_MAX_HEADER + len);
+    size_t header = ws_frame_header((uint8_t*)frame, opcode, len, ws->client ? mask : NULL);
+    if (len && ws->client) ws_mask_copy(frame + header, payload, len, mask, 0);
+    else if (len) memcpy(frame + header, payload, len);
+    write_batch_add(batch, frame, header + len);
+}
+
+// Queues a text or binary message. Server frames reference binary payloads in
+// place; everything a client sends is masked, so it is copied into the arena
+static bool ws_queue_value(WebSocket* ws, JSValueRef value, JSValueRef* exception) {
+    const char* bytes;
+    size_t len;
+    bool binary = js_value_get_bytes(ws->ctx, value, &bytes, &len);
+    if (binary && ws->client) {
+        ws_queue_frame(ws, WS_OP_BINARY, bytes, len);
+        return true;
+    }
+
+    WriteBatch* batch = ws_batch(ws);
+    size_t slot = write_batch_add(batch, NULL, 0);
+    len = write_batch_add_value(batch, value, exception);
+    if (*exception) {
+        write_batch_clear(batch, slot);
+        return false;
+    }
+
+    uint8_t mask[4];
+    if (ws->client) {
+        // A string was encoded into the arena, so it can be masked where it is
+        ws_next_mask(mask);
+        if (len) {
+            uv_buf_t* payload = &batch->bufs[batch->nbufs - 1];
+            ws_mask_copy(payload->base, payload->base, len, mask, 0);
+        }
+    }
+    char* header = write_batch_alloc(batch, WS_MAX_HEADER);
+    size_t header_len = ws_frame_header((uint8_t*)header, binary ? WS_OP_BINARY : WS_OP_TEXT, len,
+                                        ws->client ? mask : NULL);
+    write_batch_set(batch, slot, header, header_len);
+    return true;
+}
+
+static void on_ws_close_timeout(void* data) {
+    WebSocket* ws = (WebSocket*)data;
+    ws->close_timer = 0;
+    ws_close_transport(ws);
+}
+
+// Starts (or answers) the close handshake; the socket is closed once both
+// sides have sent a close frame
+static void ws_send_close(WebSocket* ws, int code, const char* reason, size_t reason_len) {
+    if (ws->close_sent) return;
+    ws->close_sent = true;
+    ws->state = WS_CLOSING;
+
+    char payload[WS_MAX_CONTROL];
+    size_t len = 0;
+    if (code) {
+        payload[0] = (char)(code >> 8);
+        payload[1] = (char)code;
+        if (reason_len) memcpy(payload + 2, reason, reason_len);
+        len = 2 + reason_len;
+    }
+    ws_queue_frame(ws, WS_OP_CLOSE, payload, len);
+
+    if (ws->close_received) ws->pending->flags |= WS_WRITE_CLOSE_AFTER;
+    else if (!ws->close_timer) ws->close_timer = timer_start(WS_CLOSE_TIMEOUT_MS, 0, on_ws_close_timeout, ws);
+    ws_flush(ws);
+}
+
+// ========================= LIFECYCLE ========================= //
+
+static void ws_close_transport(WebSocket* ws) {
+    if (!ws->attached) {
+        ws->state = WS_CLOSING;
+        return;
+    }
+    if (ws->transport_closing) return;
+    ws->transport_closing = true;
+    ws->receive_ended = true;
+    ws->state = WS_CLOSING;
+    ws->close_transport(ws->owner);
+}
+
+// Ends the connection for a protocol error: the peer is told why, then the socket is closed
+static void ws_fail(WebSocket* ws, int code, const char* message) {
+    ws->receive_ended = true;
+    if (!ws->error) ws->error = strdup(message);
+    if (!ws->close_received) {
+        ws->close_code = code;
+        ws->close_received = true;
+    }
+    if (ws->close_sent) ws_close_transport(ws);
+    else ws_send_close(ws, code, NULL, 0);
+}
+
+static void on_ws_ping(void* data) {
+    WebSocket* ws = (WebSocket*)data;
+    if (ws->state != WS_OPEN) return;
+
+    // Nothing at all since the last ping: the peer or the path is gone
+    if (ws->awaiting_pong) {
+        if (!ws->error) ws->error = strdup("WebSocket keepalive timed out");
+        ws_close_transport(ws);
+        return;
+    }
+    ws->awaiting_pong = true;
+    ws_queue_frame(ws, WS_OP_PING, NULL, 0);
+}
+
+WebSocket* websocket_new(JSContextRef ctx, bool client, const WebSocketOptions* options) {
+    ws_init_class();
+
+    WebSocket* ws = calloc(1, sizeof(WebSocket));
+    ws->ctx = ctx;
+    ws->client = client;
+    ws->state = WS_CONNECTING;
+    ws->max_payload = options->max_payload;
+    ws->ping_interval = options->ping_interval;
+    ws->object = JSObjectMake(ctx, websocket_class, ws);
+    JSValueProtect(ctx, ws->object);
+    return ws;
+}
+
+JSObjectRef websocket_object(const WebSocket* ws) {
+    return ws->object;
+}
+
+void websocket_attach(WebSocket* ws, uv_stream_t* stream, TlsSession* tls,
+                      WebSocketCloseCallback close_transport, void* owner) {
+    ws->stream = stream;
+    ws->tls = tls;
+    ws->close_transport = close_transport;
+    ws->owner = owner;
+    ws->attached = true;
+
+    // close() or terminate() while connecting
+    if (ws->state == WS_CLOSING) {
+        ws_close_transport(ws);
+        return;
+    }
+
+    ws->state = WS_OPEN;
+    if (ws->ping_interval) {
+        ws->ping_timer = timer_start(ws->ping_interval, ws->ping_interval, on_ws_ping, ws);
+    }
+    if (ws->client) event_listeners_emit(&ws->listeners, ws->ctx, ws->object, "open", 0, NULL);
+
+    // Sends made while connecting (or by the "open" listener)
+    if (ws->pending && !ws->transport_closing) ws_flush(ws);
+}
+
+static void ws_emit_close(WebSocket* ws) {
+    JSContextRef ctx = ws->ctx;
+    if (ws->error) {
+        JSStringRef msg = JSStringCreateWithUTF8CString(ws->error);
+        JSValueRef args[] = { JSValueMakeString(ctx, msg) };
+        JSStringRelease(msg);
+        event_listeners_emit(&ws->listeners, ctx, ws->object, "error", 1, args);
+    }
+
+    int code = ws->close_received ? ws->close_code : WS_CLOSE_ABNORMAL;
+    JSStringRef reason = js_string_from_utf8(ws->close_reason, ws->close_reason_len);
+    JSValueRef args[] = { JSValueMakeNumber(ctx, code), JSValueMakeString(ctx, reason) };
+    JSStringRelease(reason);
+    event_listeners_emit(&ws->listeners, ctx, ws->object, "close", 2, args);
+    event_listeners_clear(&ws->listeners, ctx);
+    JSValueUnprotect(ctx, ws->object);
+}
+
+static void on_ws_deferred_close(void* data) {
+    WebSocket* ws = (WebSocket*)data;
+    ws->close_timer = 0;
+    ws_emit_close(ws);
+}
+
+void websocket_detach(WebSocket* ws, const char* error) {
+    if (ws->state == WS_CLOSED) return;
+    bool attached = ws->attached;
+    ws->state = WS_CLOSED;
+    ws->stream = NULL;
+    ws->tls = NULL;
+    ws->owner = NULL;
+    ws->attached = false;
+    ws->receive_ended = true;
+
+    tick_task_cancel(&ws->flush_task);
+    if (ws->pending) write_batch_free(ws->pending);
+    ws->pending = NULL;
+    timer_stop(ws->ping_timer);
+    timer_stop(ws->close_timer);
+    ws->ping_timer = ws->close_timer = 0;
+    free(ws->message);
+    ws->message = NULL;
+    ws->message_len = ws->message_cap = 0;
+    if (error && !ws->error) ws->error = strdup(error);
+
+    // A connect that fails before http.websocket() returns reports once the
+    // caller has had a chance to add listeners
+    if (!attached) ws->close_timer = timer_start(0, 0, on_ws_deferred_close, ws);
+    else ws_emit_close(ws);
+}
+
+// ========================= READ SIDE ========================= //
+
+static bool ws_message_reserve(WebSocket* ws, size_t len) {
+    if (len <= ws->message_cap) return true;
+    size_t cap = ws->message_cap ? ws->message_cap : 4096;
+    while (cap < len) cap *= 2;
+    char* grown = realloc(ws->message, cap);
+    if (!grown) return false;
+    ws->message = grown;
+    ws->message_cap = cap;
+    return true;
+}
+
+static void ws_deliver_message(WebSocket* ws) {
+    JSContextRef ctx = ws->ctx;
+    bool binary = ws->message_opcode == WS_OP_BINARY;
+    ws->message_opcode = 0;
+
+    if (!binary && !ws_utf8_valid((const unsigned char*)ws->message, ws->message_len)) {
+        ws_fail(ws, WS_CLOSE_INVALID_DATA, "Invalid UTF-8 in a WebSocket text message");
+        return;
+    }
+
+    JSValueRef data;
+    if (binary) {
+        // The Buffer takes the reassembly buffer; the next message starts a new one
+        if (!ws->message) ws->message = malloc(1);
+        data = js_buffer_from_malloc(ctx, ws->message, ws->message_len);
+        ws->message = NULL;
+        ws->message_cap = 0;
+    } else {
+        JSStringRef text = js_string_from_utf8(ws->message ? ws->message : "", ws->message_len);
+        data = JSValueMakeString(ctx, text);
+        JSStringRelease(text);
+        if (ws->message_cap > WS_MESSAGE_KEEP) {
+            free(ws->message);
+            ws->message = NULL;
+            ws->message_cap = 0;
+        }
+    }
+    ws->message_len = 0;
+
+    JSValueRef args[] = { data, JSValueMakeBoolean(ctx, binary) };
+    PROFILE_SPAN("websocket.message");
+    event_listeners_emit(&ws->listeners, ctx, ws->object, "message", 2, args);
+}
+
+static bool ws_close_code_valid(int code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+           (code >= 3000 && code <= 4999);
+}
+
+static void ws_control_frame(WebSocket* ws) {
+    if (ws->opcode == WS_OP_PING) {
+        if (ws->state == WS_OPEN) ws_queue_frame(ws, WS_OP_PONG, ws->control, ws->control_len);
+        return;
+    }
+    if (ws->opcode == WS_OP_PONG) return;
+
+    // Close: record the peer's status, answer it and stop reading
+    ws->receive_ended = true;
+    int code = WS_CLOSE_NO_STATUS;
+    size_t len = ws->control_len;
+    if (len == 1) {
+        ws_fail(ws, WS_CLOSE_PROTOCOL, "Invalid WebSocket close frame");
+        return;
+    }
+    if (len >= 2) {
+        code = (uint8_t)ws->control[0] << 8 | (uint8_t)ws->control[1];
+        if (!ws_close_code_valid(code)) {
+            ws_fail(ws, WS_CLOSE_PROTOCOL, "Invalid WebSocket close code");
+            return;
+        }
+        if (!ws_utf8_valid((const unsigned char*)ws->control + 2, len - 2)) {
+            ws_fail(ws, WS_CLOSE_INVALID_DATA, "Invalid UTF-8 in a WebSocket close reason");
+            return;
+        }
+        memcpy(ws->close_reason, ws->control + 2, len - 2);
+        ws->close_reason_len = len - 2;
+    }
+    ws->close_code = code;
+    ws->close_received = true;
+
+    if (ws->close_sent) ws_close_transport(ws);
+    else ws_send_close(ws, code == WS_CLOSE_NO_STATUS ? 0 : code, NULL, 0);
+}
+
+static void ws_frame_done(WebSocket* ws) {
+    ws->in_payload = false;
+    ws->header_len = 0;
+
+    if (ws->opcode >= WS_OP_CLOSE) {
+        ws_control_frame(ws);
+    } else if (ws->fin) {
+        ws_deliver_message(ws);
+    }
+}
+
+// Header length once the first two bytes are known
+static size_t ws_header_size(const uint8_t* header, size_t have) {
+    if (have < 2) return 2;
+    size_t n = 2;
+    uint8_t len7 = header[1] & 0x7F;
+    if (len7 == 126) n += 2;
+    else if (len7 == 127) n += 8;
+    if (header[1] & 0x80) n += 4;
+    return n;
+}
+
+// Validates a complete frame header; false once the connection is failing
+static bool ws_frame_begin(WebSocket* ws) {
+    const uint8_t* h = ws->header;
+    ws->fin = (h[0] & 0x80) != 0;
+    ws->opcode = h[0] & 0x0F;
+    ws->masked = (h[1] & 0x80) != 0;
+
+    uint64_t len = h[1] & 0x7F;
+    size_t pos = 2;
+    if (len == 126) {
+        len = (uint64_t)h[2] << 8 | h[3];
+        pos = 4;
+    } else if (len == 127) {
+        len = 0;
+        for (int i = 0; i < 8; i++) len = len << 8 | h[2 + i];
+        pos = 10;
+    }
+    if (ws->masked) memcpy(ws->mask, h + pos, 4);
+
+    // No extensions are negotiated, so the reserved bits must be clear
+    if (h[0] & 0x70) {
+        ws_fail(ws, WS_CLOSE_PROTOCOL, "Reserved WebSocket frame bits set");
+        return false;
+    }
+    if (ws->masked == ws->client) {
+        ws_fail(ws, WS_CLOSE_PROTOCOL, ws->client ? "Masked frame from a WebSocket server"
+                                                  : "Unmasked frame from a WebSocket client");
+        return false;
+    }
+
+    if (ws->opcode >= WS_OP_CLOSE) {
+        if (ws->opcode > WS_OP_PONG || !ws->fin || len > WS_MAX_CONTROL) {
+            ws_fail(ws, WS_CLOSE_PROTOCOL, "Invalid WebSocket control frame");
+            return false;
+        }
+        ws->control_len = 0;
+    } else if (ws->opcode == WS_OP_CONTINUATION) {
+        if (!ws->message_opcode) {
+            ws_fail(ws, WS_CLOSE_PROTOCOL, "WebSocket continuation frame without a message");
+            return false;
+        }
+    } else if (ws->opcode <= WS_OP_BINARY) {
+        if (ws->message_opcode) {
+            ws_fail(ws, WS_CLOSE_PROTOCOL, "WebSocket message started inside another");
+            return false;
+        }
+        ws->message_opcode = ws->opcode;
+        ws->message_len = 0;
+    } else {
+        ws_fail(ws, WS_CLOSE_PROTOCOL, "Unknown WebSocket opcode");
+        return false;
+    }
+
+    if (ws->opcode < WS_OP_CLOSE && len > ws->max_payload - ws->message_len) {
+        ws_fail(ws, WS_CLOSE_TOO_BIG, "WebSocket message exceeds maxPayload");
+        return false;
+    }
+
+    ws->remaining = len;
+    ws->payload_off = 0;
+    ws->in_payload = true;
+    return true;
+}
+
+void websocket_receive(WebSocket* ws, const char* data, size_t len) {
+    runtime_counters.websocket.bytes_read += len;
+
+    // Any traffic shows the peer is alive
+    ws->awaiting_pong = false;
+
+    while (len > 0 && !ws->receive_ended) {
+        if (!ws->in_payload) {
+            size_t need = ws_header_size(ws->header, ws->header_len);
+            while (ws->header_len < need && len > 0) {
+                ws->header[ws->header_len++] = (uint8_t)*data++;
+                len--;
+                need = ws_header_size(ws->header, ws->header_len);
+            }
+            if (ws->header_len < need) return;
+            if (!ws_frame_begin(ws)) return;
+            if (ws->remaining == 0) ws_frame_done(ws);
+            continue;
+        }
+
+        size_t n = ws->remaining < len ? (size_t)ws->remaining : len;
+        char* dst;
+        if (ws->opcode >= WS_OP_CLOSE) {
+            dst = ws->control + ws->control_len;
+            ws->control_len += n;
+        } else {
+            if (!ws_message_reserve(ws, ws->message_len + n)) {
+                ws_fail(ws, WS_CLOSE_TOO_BIG, "Out of memory for a WebSocket message");
+                return;
+            }
+            dst = ws->message + ws->message_len;
+            ws->message_len += n;
+        }
+
+        // Unmasked while copied out of the read buffer
+        if (ws->masked) ws_mask_copy(dst, data, n, ws->mask, ws->payload_off);
+        else memcpy(dst, data, n);
+
+        ws->payload_off += n;
+        ws->remaining -= n;
+        data += n;
+        len -= n;
+        if (ws->remaining == 0) ws_frame_done(ws);
+    }
+}
+
+// ========================= OPTIONS ========================= //
+
+bool websocket_options_read(JSContextRef ctx, JSValueRef value, WebSocketOptions* options,
+                            JSValueRef* exception) {
+    options->max_payload = WEBSOCKET_DEFAULT_MAX_PAYLOAD;
+    options->ping_interval = WEBSOCKET_DEFAULT_PING_INTERVAL;
+    if (!value || !JSValueIsObject(ctx, value)) return true;
+
+    JSObjectRef object = (JSObjectRef)value;
+    JSValueRef max = JSObjectGetProperty(ctx, object, ATOM(maxPayload), exception);
+    if (*exception) return false;
+    if (!JSValueIsUndefined(ctx, max)) {
+        double n = JSValueToNumber(ctx, max, exception);
+        if (*exception) return false;
+        if (!(n >= 1)) {
+            ws_throw(ctx, exception, "Invalid WebSocket maxPayload");
+            return false;
+        }
+        options->max_payload = n > (double)SIZE_MAX / 2 ? SIZE_MAX / 2 : (size_t)n;
+    }
+
+    JSValueRef ping = JSObjectGetProperty(ctx, object, ATOM(pingInterval), exception);
+    if (*exception) return false;
+    if (!JSValueIsUndefined(ctx, ping)) {
+        double n = JSValueToNumber(ctx, ping, exception);
+        if (*exception) return false;
+        if (!(n >= 0)) {
+            ws_throw(ctx, exception, "Invalid WebSocket pingInterval");
+            return false;
+        }
+        options->ping_interval = n > 1e12 ? (uint64_t)1e12 : (uint64_t)n;
+    }
+    return true;
+}
+
+// ========================= JS METHODS ========================= //
+
+// `ws.on(event, listener)` - "open", "message", "close", "error"
+static JSValueRef ws_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                        size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(thisObject);
+    if (!ws || ws->state == WS_CLOSED) return thisObject;
+    if (argc < 2) return ws_throw(ctx, exception, "on() requires an event name and a listener function");
+    if (!event_listeners_on(&ws->listeners, ctx, args[0], args[1], exception)) return JSValueMakeUndefined(ctx);
+    return thisObject;
+}
+
+// `ws.send(data)` - strings as text messages, Buffers and typed arrays as binary;
+// false once the socket is closing
+static JSValueRef ws_send(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                          size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1) return ws_throw(ctx, exception, "ws.send requires a string or buffer argument");
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(thisObject);
+    if (!ws || ws->state >= WS_CLOSING) return JSValueMakeBoolean(ctx, false);
+    return JSValueMakeBoolean(ctx, ws_queue_value(ws, args[0], exception));
+}
+
+// `ws.close([code[, reason]])` - starts the close handshake
+static JSValueRef ws_close(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                           size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(thisObject);
+    int code = WS_CLOSE_NORMAL;
+    if (argc > 0 && !JSValueIsUndefined(ctx, args[0])) {
+        double n = JSValueToNumber(ctx, args[0], exception);
+        if (*exception) return JSValueMakeUndefined(ctx);
+        if (n != WS_CLOSE_NORMAL && !(n >= 3000 && n <= 4999)) {
+            return ws_throw(ctx, exception, "WebSocket close code must be 1000 or 3000-4999");
+        }
+        code = (int)n;
+    }
+
+    char reason[WS_MAX_CONTROL];
+    size_t reason_len = 0;
+    if (argc > 1 && !JSValueIsUndefined(ctx, args[1])) {
+        JSStringRef str = JSValueToStringCopy(ctx, args[1], exception);
+        if (!str) return JSValueMakeUndefined(ctx);
+        char buf[WS_MAX_CONTROL * 4];
+        size_t max = JSStringGetMaximumUTF8CStringSize(str);
+        reason_len = max <= sizeof(buf) ? JSStringGetUTF8CString(str, buf, sizeof(buf)) - 1 : sizeof(buf);
+        JSStringRelease(str);
+        if (reason_len > WS_MAX_CONTROL - 2) return ws_throw(ctx, exception, "WebSocket close reason is too long");
+        memcpy(reason, buf, reason_len);
+    }
+
+    if (!ws || ws->state >= WS_CLOSING) return JSValueMakeUndefined(ctx);
+    if (ws->state == WS_CONNECTING) {
+        ws_close_transport(ws);
+        return JSValueMakeUndefined(ctx);
+    }
+    ws_send_close(ws, code, reason, reason_len);
+    return JSValueMakeUndefined(ctx);
+}
+
+// `ws.terminate()` - drops the connection without a close handshake
+static JSValueRef ws_terminate(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                               size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(thisObject);
+    if (ws && ws->state != WS_CLOSED) ws_close_transport(ws);
+    return JSValueMakeUndefined(ctx);
+}
+
+static JSValueRef ws_get_ready_state(JSContextRef ctx, JSObjectRef object,
+                                     JSStringRef propertyName, JSValueRef* exception) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, ws ? ws->state : WS_CLOSED);
+}
+
+// `ws.bufferedAmount` - bytes accepted by send() but not yet handed to the kernel
+static JSValueRef ws_get_buffered_amount(JSContextRef ctx, JSObjectRef object,
+                                         JSStringRef propertyName, JSValueRef* exception) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, ws && ws->state != WS_CLOSED ? (double)ws_buffered(ws) : 0);
+}
+
+static void ws_finalize(JSObjectRef object) {
+    WebSocket* ws = (WebSocket*)JSObjectGetPrivate(object);
+    if (!ws) return;
+    free(ws->message);
+    free(ws->error);
+    free(ws);
+}
+
+static const JSStaticFunction websocket_functions[] = {
+    { "on", ws_on, kJSPropertyAttributeNone },
+    { "send", ws_send, kJSPropertyAttributeNone },
+    { "close", ws_close, kJSPropertyAttributeNone },
+    { "terminate", ws_terminate, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue websocket_values[] = {
+    { "readyState", ws_get_ready_state, NULL, kJSPropertyAttributeReadOnly },
+    { "bufferedAmount", ws_get_buffered_amount, NULL, kJSPropertyAttributeReadOnly },
+    { NULL, NULL, NULL, 0 }
+};
+
+// Creates the WebSocket class on first use
+static void ws_init_class(void) {
+    if (websocket_class) return;
+
+    JSClassDefinition classDef = kJSClassDefinitionEmpty;
+    classDef.className = "WebSocket";
+    classDef.staticFunctions = websocket_functions;
+    classDef.staticValues = websocket_values;
+    classDef.finalize = ws_finalize;
+    websocket_class = JSClassCreate(&classDef);
+}
+
+// ========================= BROADCAST ========================= //
+
+// `http.broadcast(data, sockets)` - sends one message to every open WebSocket
+// in `sockets`. The server frame is built once and every connection's batch
+// references the same bytes; client sockets, which must mask, each get their
+// own copy. Returns how many sockets it was queued on
+JSValueRef websocket_broadcast(JSContextRef ctx, JSObjectRef function,
+                               JSObjectRef thisObject, size_t argc,
+                               const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 2 || !JSValueIsObject(ctx, args[1])) {
+        return ws_throw(ctx, exception, "broadcast requires data and an array of WebSockets");
+    }
+
+    const char* bytes;
+    size_t len;
+    char* text = NULL;
+    bool binary = js_value_get_bytes(ctx, args[0], &bytes, &len);
+    if (!binary) {
+        JSStringRef str = JSValueToStringCopy(ctx, args[0], exception);
+        if (!str) return JSValueMakeUndefined(ctx);
+        size_t max = JSStringGetMaximumUTF8CStringSize(str);
+        text = malloc(max);
+        len = JSStringGetUTF8CString(str, text, max) - 1;
+        JSStringRelease(str);
+        bytes = text;
+    }
+    uint8_t opcode = binary ? WS_OP_BINARY : WS_OP_TEXT;
+
+    JSObjectRef sockets = (JSObjectRef)args[1];
+    JSValueRef lengthValue = JSObjectGetProperty(ctx, sockets, ATOM(length), exception);
+    double count = *exception ? 0 : JSValueToNumber(ctx, lengthValue, exception);
+    if (*exception || !(count >= 0)) {
+        free(text);
+        return *exception ? JSValueMakeUndefined(ctx) : JSValueMakeNumber(ctx, 0);
+    }
+
+    JSObjectRef frame = NULL;
+    double sent = 0;
+    for (unsigned i = 0; i < (unsigned)count; i++) {
+        JSValueRef item = JSObjectGetPropertyAtIndex(ctx, sockets, i, exception);
+        if (*exception) break;
+        if (!JSValueIsObjectOfClass(ctx, item, websocket_class)) continue;
+        WebSocket* ws = (WebSocket*)JSObjectGetPrivate((JSObjectRef)item);
+        if (!ws || ws->state != WS_OPEN) continue;
+
+        if (ws->client) {
+            ws_queue_frame(ws, opcode, bytes, len);
+        } else {
+            if (!frame) {
+                char* encoded = malloc(WS_MAX_HEADER + len);
+                size_t header = ws_frame_header((uint8_t*)encoded, opcode, len, NULL);
+                if (len) memcpy(encoded + header, bytes, len);
+                frame = js_buffer_from_malloc(ctx, encoded, header + len);
+            }
+            write_batch_add_value(ws_batch(ws), frame, exception);
+        }
+        sent++;
+    }
+
+    free(text);
+    return *exception ? JSValueMakeUndefined(ctx) : JSValueMakeNumber(ctx, sent);
+}
@@ -0,0 +1,637 @@
+/**
+ * =====================================================================================
+ *
+ *        WORKER.C - Worker Threads with Message Passing (new Worker / parentPort)
+ *
+ * =====================================================================================
+ *
+ * Responsible for:
+ * - `new Worker(path[, { workerData }])`: runs a script on its own thread, with
+ *   its own uv_loop_t, JSContextGroupRef and global context
+ * - worker.postMessage() / parentPort.postMessage() and "message" events
+ * - worker.terminate() and the parent's "exit" event
+ *
+ * Message Passing:
+ * - Each direction is a lock-free single-producer/single-consumer queue; the
+ *   consumer is woken with uv_async_send(), which libuv coalesces, and drains
+ *   everything queued so far
+ * - Values are encoded with JSON.stringify; ArrayBuffers, typed arrays and
+ *   Buffers are lifted out as raw byte blobs and rebuilt on the other side as
+ *   the same type around the same bytes, so binary data is never serialized.
+ *   Their markers use a key drawn per message, which user data cannot collide with.
+ *   JSC's C API cannot detach the sender's buffer, so each blob costs one memcpy
+ *   when posted and none when received
+ *
+ * Threading Model:
+ * - A Worker (and its queues) belongs to the thread that created it; inside a
+ *   worker, `parentPort` talks to that thread only
+ * - The worker's uv_async_t is unref'd until parentPort gets a "message"
+ *   listener, so a worker whose script finishes without one exits on its own
+ * - terminate() takes effect once the worker is back in its event loop;
+ *   running JS cannot be interrupted through the public JSC API
+ *
+ * Memory Management:
+ * - The Worker object is protected from creation until "exit"; the channel
+ *   shared by both threads is freed by its finalizer, after the thread joined
+ *
+ * =====================================================================================
+ */
+
+#include <JavaScriptCore/JavaScript.h>
+#include <uv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/rand.h>
+#include "runtime.h"
+
+#define WORKER_BLOB_BUFFER (-1)           // Blob kind for Buffers; others are JSTypedArrayType values
+#define WORKER_EXIT_TERMINATED 1
+
+typedef struct {
+    char* bytes;
+    size_t len;
+    int kind;
+} WorkerBlob;
+
+typedef struct WorkerMessage {
+    struct WorkerMessage* next;
+    char* json;                  // NULL for undefined
+    size_t json_len;
+    WorkerBlob* blobs;
+    size_t blob_count;
+    char blob_key[27];           // Marker property, "__jadeBlob" and 16 random hex digits
+} WorkerMessage;
+
+// Unbounded SPSC queue: `head` is a consumed dummy node, owned by the consumer;
+// `tail` is owned by the producer
+typedef struct {
+    WorkerMessage* head;
+    WorkerMessage* tail;
+} MessageQueue;
+
+typedef struct {
+    uv_thread_t thread;
+    int thread_id;
+    char* path;
+    char* source;
+    size_t source_len;
+    WorkerMessage* worker_data;
+
+    MessageQueue inbox;          // Parent -> worker
+    MessageQueue outbox;         // Worker -> parent
+    uv_mutex_t wake_lock;        // Orders wake-ups against the worker closing its async handle
+    bool worker_awake;           // worker_async may be signalled (guarded by wake_lock)
+    int terminate;               // Atomic
+    int exited;                  // Atomic; exit_code is valid once set
+    int exit_code;
+
+    // Parent thread
+    JSContextRef parent_ctx;
+    JSObjectRef object;
+    EventListeners listeners;
+    uv_async_t parent_async;
+    bool finished;               // "exit" emitted, thread joined
+
+    // Worker thread
+    JSContextRef worker_ctx;
+    JSObjectRef port;
+    EventListeners port_listeners;
+    uv_async_t worker_async;
+} WorkerChannel;
+
+static JADE_THREAD_LOCAL JSClassRef worker_constructor_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef worker_class = NULL;
+static JADE_THREAD_LOCAL JSClassRef port_class = NULL;
+
+// Channel of the worker running on this thread, NULL on the main thread
+static JADE_THREAD_LOCAL WorkerChannel* worker_current = NULL;
+
+// Message the replacer or reviver is working on, and its marker key once it has one
+static JADE_THREAD_LOCAL WorkerMessage* worker_codec_message = NULL;
+static JADE_THREAD_LOCAL JSStringRef worker_codec_key = NULL;
+
+static int worker_next_id = 0;
+
+static JSValueRef worker_throw(JSContextRef ctx, JSValueRef* exception, const char* message) {
+    JSStringRef msg = JSStringCreateWithUTF8CString(message);
+    *exception = JSValueMakeString(ctx, msg);
+    JSStringRelease(msg);
+    return JSValueMakeUndefined(ctx);
+}
+
+// ========================= QUEUE ========================= //
+
+static void message_queue_init(MessageQueue* q) {
+    q->head = q->tail = calloc(1, sizeof(WorkerMessage));
+}
+
+static void worker_message_release(WorkerMessage* msg) {
+    free(msg->json);
+    for (size_t i = 0; i < msg->blob_count; i++) free(msg->blobs[i].bytes);
+    free(msg->blobs);
+    msg->json = NULL;
+    msg->blobs = NULL;
+    msg->blob_count = 0;
+}
+
+// Producer only
+static void message_queue_push(MessageQueue* q, WorkerMessage* msg) {
+    msg->next = NULL;
+    __atomic_store_n(&q->tail->next, msg, __ATOMIC_RELEASE);
+    q->tail = msg;
+}
+
+// Consumer only. The popped node becomes the new dummy head, so its payload moves into `out`
+static bool message_queue_pop(MessageQueue* q, WorkerMessage* out) {
+    WorkerMessage* next = __atomic_load_n(&q->head->next, __ATOMIC_ACQUIRE);
+    if (!next) return false;
+
+    free(q->head);
+    q->head = next;
+    *out = *next;
+    next->json = NULL;
+    next->blobs = NULL;
+    next->blob_count = 0;
+    return true;
+}
+
+// Once neither side can touch the queue any more
+static void message_queue_destroy(MessageQueue* q) {
+    WorkerMessage* msg = q->head;
+    while (msg) {
+        WorkerMessage* next = msg->next;
+        worker_message_release(msg);
+        free(msg);
+        msg = next;
+    }
+    q->head = q->tail = NULL;
+}
+
+// ========================= CODEC ========================= //
+
+// Draws the message's marker key and the JS string the replacer sets it with
+static void worker_blob_key_new(WorkerMessage* msg) {
+    unsigned char nonce[8];
+    if (RAND_bytes(nonce, sizeof(nonce)) != 1) {
+        uint64_t fallback = uv_hrtime() ^ (uint64_t)(uintptr_t)msg;
+        memcpy(nonce, &fallback, sizeof(nonce));
+    }
+    int n = snprintf(msg->blob_key, sizeof(msg->blob_key), "__jadeBlob");
+    for (size_t i = 0; i < sizeof(nonce); i++) n += snprintf(msg->blob_key + n, sizeof(msg->blob_key) - n, "%02x", nonce[i]);
+    worker_codec_key = JSStringCreateWithUTF8CString(msg->blob_key);
+}
+
+static JSObjectRef worker_json_function(JSContextRef ctx, const char* name) {
+    JSStringRef jsonName = JSStringCreateWithUTF8CString("JSON");
+    JSValueRef json = JSObjectGetProperty(ctx, JSContextGetGlobalObject(ctx), jsonName, NULL);
+    JSStringRelease(jsonName);
+
+    JSStringRef fnName = JSStringCreateWithUTF8CString(name);
+    JSValueRef fn = JSObjectGetProperty(ctx, (JSObjectRef)json, fnName, NULL);
+    JSStringRelease(fnName);
+    return (JSObjectRef)fn;
+}
+
+// JSON.stringify replacer: binary values become { <blob key>: index } markers
+static JSValueRef worker_replacer(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                  size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    JSValueRef value = argc > 1 ? args[1] : JSValueMakeUndefined(ctx);
+    const char* bytes;
+    size_t len;
+    if (!JSValueIsObject(ctx, value) || !js_value_get_bytes(ctx, value, &bytes, &len)) return value;
+
+    WorkerMessage* msg = worker_codec_message;
+    if (!worker_codec_key) worker_blob_key_new(msg);
+    msg->blobs = realloc(msg->blobs, (msg->blob_count + 1) * sizeof(WorkerBlob));
+    WorkerBlob* blob = &msg->blobs[msg->blob_count];
+    blob->kind = js_value_is_buffer(ctx, value) ? WORKER_BLOB_BUFFER : (int)JSValueGetTypedArrayType(ctx, value, NULL);
+    blob->len = len;
+    blob->bytes = malloc(len ? len : 1);
+    memcpy(blob->bytes, bytes, len);
+
+    JSObjectRef marker = JSObjectMake(ctx, NULL, NULL);
+    JSObjectSetProperty(ctx, marker, worker_codec_key, JSValueMakeNumber(ctx, (double)msg->blob_count++),
+                        kJSPropertyAttributeNone, NULL);
+    return marker;
+}
+
+static void worker_free_bytes(void* bytes, void* context) {
+    free(bytes);
+}
+
+// JSON.parse reviver: markers turn back into the binary value, taking over the blob's bytes
+static JSValueRef worker_reviver(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                 size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    JSValueRef value = argc > 1 ? args[1] : JSValueMakeUndefined(ctx);
+    if (!JSValueIsObject(ctx, value)) return value;
+
+    JSValueRef index = JSObjectGetProperty(ctx, (JSObjectRef)value, worker_codec_key, NULL);
+    if (!JSValueIsNumber(ctx, index)) return value;
+
+    WorkerMessage* msg = worker_codec_message;
+    double i = JSValueToNumber(ctx, index, NULL);
+    if (!(i >= 0 && i < (double)msg->blob_count) || !msg->blobs[(size_t)i].bytes) return value;
+
+    WorkerBlob* blob = &msg->blobs[(size_t)i];
+    char* bytes = blob->bytes;
+    blob->bytes = NULL;
+
+    if (blob->kind == WORKER_BLOB_BUFFER) return js_buffer_from_malloc(ctx, bytes, blob->len);
+    if (blob->kind == kJSTypedArrayTypeArrayBuffer) {
+        return JSObjectMakeArrayBufferWithBytesNoCopy(ctx, bytes, blob->len, worker_free_bytes, NULL, exception);
+    }
+    return JSObjectMakeTypedArrayWithBytesNoCopy(ctx, (JSTypedArrayType)blob->kind, bytes, blob->len,
+                                                 worker_free_bytes, NULL, exception);
+}
+
+static WorkerMessage* worker_message_encode(JSContextRef ctx, JSValueRef value, JSValueRef* exception) {
+    WorkerMessage* msg = calloc(1, sizeof(WorkerMessage));
+    if (JSValueIsUndefined(ctx, value)) return msg;
+
+    JSValueRef args[] = { value, JSObjectMakeFunctionWithCallback(ctx, NULL, worker_replacer) };
+    worker_codec_message = msg;
+    JSValueRef json = JSObjectCallAsFunction(ctx, worker_json_function(ctx, "stringify"), NULL, 2, args, exception);
+    worker_codec_message = NULL;
+    if (worker_codec_key) {
+        JSStringRelease(worker_codec_key);
+        worker_codec_key = NULL;
+    }
+
+    if (*exception) {
+        worker_message_release(msg);
+        free(msg);
+        return NULL;
+    }
+    if (JSValueIsUndefined(ctx, json)) return msg;   // Functions and symbols
+
+    JSStringRef str = JSValueToStringCopy(ctx, json, NULL);
+    size_t max_len = JSStringGetMaximumUTF8CStringSize(str);
+    msg->json = malloc(max_len);
+    msg->json_len = JSStringGetUTF8CString(str, msg->json, max_len) - 1;
+    JSStringRelease(str);
+    return msg;
+}
+
+static JSValueRef worker_message_decode(JSContextRef ctx, WorkerMessage* msg) {
+    if (!msg->json) return JSValueMakeUndefined(ctx);
+
+    JSStringRef str = js_string_from_utf8(msg->json, msg->json_len);
+    JSValueRef value;
+    if (msg->blob_count == 0) {
+        value = JSValueMakeFromJSONString(ctx, str);
+    } else {
+        JSValueRef args[] = { JSValueMakeString(ctx, str), JSObjectMakeFunctionWithCallback(ctx, NULL, worker_reviver) };
+        worker_codec_message = msg;
+        worker_codec_key = JSStringCreateWithUTF8CString(msg->blob_key);
+        value = JSObjectCallAsFunction(ctx, worker_json_function(ctx, "parse"), NULL, 2, args, NULL);
+        JSStringRelease(worker_codec_key);
+        worker_codec_key = NULL;
+        worker_codec_message = NULL;
+    }
+    JSStringRelease(str);
+    return value ? value : JSValueMakeUndefined(ctx);
+}
+
+// ========================= WORKER THREAD ========================= //
+
+static void worker_wake(WorkerChannel* ch) {
+    uv_mutex_lock(&ch->wake_lock);
+    if (ch->worker_awake) uv_async_send(&ch->worker_async);
+    uv_mutex_unlock(&ch->wake_lock);
+}
+
+static void on_worker_port_async(uv_async_t* handle) {
+    WorkerChannel* ch = (WorkerChannel*)handle->data;
+    if (__atomic_load_n(&ch->terminate, __ATOMIC_ACQUIRE)) {
+        uv_stop(loop);
+        return;
+    }
+
+    WorkerMessage msg;
+    while (message_queue_pop(&ch->inbox, &msg)) {
+        JSValueRef args[] = { worker_message_decode(ch->worker_ctx, &msg) };
+        worker_message_release(&msg);
+        event_listeners_emit(&ch->port_listeners, ch->worker_ctx, ch->port, "message", 1, args);
+        if (__atomic_load_n(&ch->terminate, __ATOMIC_ACQUIRE)) break;
+    }
+}
+
+static void worker_close_handle(uv_handle_t* handle, void* arg) {
+    if (!uv_is_closing(handle)) uv_close(handle, NULL);
+}
+
+static void worker_thread_main(void* arg) {
+    WorkerChannel* ch = (WorkerChannel*)arg;
+    uv_loop_t worker_loop;
+    uv_loop_init(&worker_loop);
+    loop = &worker_loop;
+    worker_current = ch;
+
+    uv_mutex_lock(&ch->wake_lock);
+    uv_async_init(loop, &ch->worker_async, on_worker_port_async);
+    ch->worker_async.data = ch;
+    uv_unref((uv_handle_t*)&ch->worker_async);
+    ch->worker_awake = true;
+    uv_mutex_unlock(&ch->wake_lock);
+
+    // Binds `parentPort` and `workerData` from worker_current
+    JSGlobalContextRef ctx = create_js_context();
+    init_event_loop();
+
+    execute_js_source(ctx, ch->source, ch->source_len, ch->path);
+    free(ch->source);
+    ch->source = NULL;
+
+    // Delivers messages posted before the script added its listener
+    uv_async_send(&ch->worker_async);
+    run_event_loop();
+
+    uv_mutex_lock(&ch->wake_lock);
+    ch->worker_awake = false;
+    uv_mutex_unlock(&ch->wake_lock);
+
+    // terminate() stops the loop with handles still open
+    uv_walk(loop, worker_close_handle, NULL);
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    event_listeners_clear(&ch->port_listeners, ctx);
+    JSValueUnprotect(ctx, ch->port);
+    JSGlobalContextRelease(ctx);
+    uv_loop_close(&worker_loop);
+
+    ch->exit_code = __atomic_load_n(&ch->terminate, __ATOMIC_ACQUIRE) ? WORKER_EXIT_TERMINATED : 0;
+    __atomic_store_n(&ch->exited, 1, __ATOMIC_RELEASE);
+    uv_async_send(&ch->parent_async);
+}
+
+// `parentPort.postMessage(value)`
+static JSValueRef port_post_message(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                    size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(thisObject);
+    if (!ch) return JSValueMakeUndefined(ctx);
+
+    WorkerMessage* msg = worker_message_encode(ctx, argc > 0 ? args[0] : JSValueMakeUndefined(ctx), exception);
+    if (!msg) return JSValueMakeUndefined(ctx);
+    message_queue_push(&ch->outbox, msg);
+    uv_async_send(&ch->parent_async);
+    return JSValueMakeUndefined(ctx);
+}
+
+// `parentPort.on(event, listener)`; a "message" listener keeps the worker alive
+static JSValueRef port_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                          size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(thisObject);
+    if (!ch) return thisObject;
+    if (argc < 2) return worker_throw(ctx, exception, "on() requires an event name and a listener function");
+    if (!event_listeners_on(&ch->port_listeners, ctx, args[0], args[1], exception)) return JSValueMakeUndefined(ctx);
+
+    if (event_listeners_has(&ch->port_listeners, "message")) uv_ref((uv_handle_t*)&ch->worker_async);
+    return thisObject;
+}
+
+static const JSStaticFunction port_functions[] = {
+    { "postMessage", port_post_message, kJSPropertyAttributeNone },
+    { "on", port_on, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+// ========================= PARENT SIDE ========================= //
+
+static void on_worker_parent_closed(uv_handle_t* handle) {
+    WorkerChannel* ch = (WorkerChannel*)handle->data;
+    JSValueUnprotect(ch->parent_ctx, ch->object);
+}
+
+static void on_worker_parent_async(uv_async_t* handle) {
+    WorkerChannel* ch = (WorkerChannel*)handle->data;
+    JSContextRef ctx = ch->parent_ctx;
+
+    // Read the flag first: everything the worker posted before exiting is then queued
+    bool exited = __atomic_load_n(&ch->exited, __ATOMIC_ACQUIRE);
+
+    WorkerMessage msg;
+    while (message_queue_pop(&ch->outbox, &msg)) {
+        JSValueRef args[] = { worker_message_decode(ctx, &msg) };
+        worker_message_release(&msg);
+        event_listeners_emit(&ch->listeners, ctx, ch->object, "message", 1, args);
+    }
+    if (!exited || ch->finished) return;
+
+    uv_thread_join(&ch->thread);
+    ch->finished = true;
+
+    JSValueRef args[] = { JSValueMakeNumber(ctx, ch->exit_code) };
+    event_listeners_emit(&ch->listeners, ctx, ch->object, "exit", 1, args);
+    event_listeners_clear(&ch->listeners, ctx);
+    uv_close((uv_handle_t*)&ch->parent_async, on_worker_parent_closed);
+}
+
+// `worker.postMessage(value[, transferList])`
+static JSValueRef worker_post_message(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                      size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(thisObject);
+    if (!ch || ch->finished || __atomic_load_n(&ch->exited, __ATOMIC_ACQUIRE)) return JSValueMakeUndefined(ctx);
+
+    // Every binary value travels as raw bytes, so the transfer list needs no handling
+    WorkerMessage* msg = worker_message_encode(ctx, argc > 0 ? args[0] : JSValueMakeUndefined(ctx), exception);
+    if (!msg) return JSValueMakeUndefined(ctx);
+    message_queue_push(&ch->inbox, msg);
+    worker_wake(ch);
+    return JSValueMakeUndefined(ctx);
+}
+
+// `worker.on(event, listener)` - "message" and "exit"
+static JSValueRef worker_on(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                            size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(thisObject);
+    if (!ch || ch->finished) return thisObject;
+    if (argc < 2) return worker_throw(ctx, exception, "on() requires an event name and a listener function");
+    if (!event_listeners_on(&ch->listeners, ctx, args[0], args[1], exception)) return JSValueMakeUndefined(ctx);
+    return thisObject;
+}
+
+// `worker.terminate()` - the worker stops at its next event-loop turn and exits with code 1
+static JSValueRef worker_terminate(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                   size_t argc, const JSValueRef args[], JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(thisObject);
+    if (!ch || ch->finished) return JSValueMakeUndefined(ctx);
+
+    __atomic_store_n(&ch->terminate, 1, __ATOMIC_RELEASE);
+    worker_wake(ch);
+    return JSValueMakeUndefined(ctx);
+}
+
+static JSValueRef worker_get_thread_id(JSContextRef ctx, JSObjectRef object,
+                                       JSStringRef propertyName, JSValueRef* exception) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(object);
+    return JSValueMakeNumber(ctx, ch ? ch->thread_id : 0);
+}
+
+static void worker_finalize(JSObjectRef object) {
+    WorkerChannel* ch = (WorkerChannel*)JSObjectGetPrivate(object);
+    if (!ch) return;
+
+    message_queue_destroy(&ch->inbox);
+    message_queue_destroy(&ch->outbox);
+    if (ch->worker_data) {
+        worker_message_release(ch->worker_data);
+        free(ch->worker_data);
+    }
+    uv_mutex_destroy(&ch->wake_lock);
+    free(ch->source);
+    free(ch->path);
+    free(ch);
+}
+
+static const JSStaticFunction worker_functions[] = {
+    { "postMessage", worker_post_message, kJSPropertyAttributeNone },
+    { "on", worker_on, kJSPropertyAttributeNone },
+    { "terminate", worker_terminate, kJSPropertyAttributeNone },
+    { NULL, NULL, 0 }
+};
+
+static const JSStaticValue worker_values[] = {
+    { "threadId", worker_get_thread_id, NULL, kJSPropertyAttributeReadOnly },
+    { NULL, NULL, NULL, 0 }
+};
+
+// Reads the whole script, NUL-terminated for execute_js_source()
+static char* worker_read_script(const char* path, size_t* len) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    size_t cap = 4096, used = 0;
+    char* data = malloc(cap);
+    size_t n;
+    while ((n = fread(data + used, 1, cap - used - 1, file)) > 0) {
+        used += n;
+        if (cap - used - 1 == 0) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+    }
+    fclose(file);
+    data[used] = '\0';
+    *len = used;
+    return data;
+}
+
+// `new Worker(path[, { workerData }])`
+static JSObjectRef worker_construct(JSContextRef ctx, JSObjectRef constructor, size_t argc,
+                                    const JSValueRef args[], JSValueRef* exception) {
+    if (argc < 1 || !JSValueIsString(ctx, args[0])) {
+        worker_throw(ctx, exception, "new Worker requires a script path");
+        return NULL;
+    }
+
+    JSStringRef pathRef = JSValueToStringCopy(ctx, args[0], exception);
+    size_t pathLen = JSStringGetMaximumUTF8CStringSize(pathRef);
+    char* path = malloc(pathLen);
+    JSStringGetUTF8CString(pathRef, path, pathLen);
+    JSStringRelease(pathRef);
+
+    size_t source_len;
+    char* source = worker_read_script(path, &source_len);
+    if (!source) {
+        free(path);
+        worker_throw(ctx, exception, "new Worker could not read the script");
+        return NULL;
+    }
+
+    WorkerMessage* worker_data = NULL;
+    if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+        JSStringRef name = JSStringCreateWithUTF8CString("workerData");
+        JSValueRef data = JSObjectGetProperty(ctx, (JSObjectRef)args[1], name, NULL);
+        JSStringRelease(name);
+        worker_data = worker_message_encode(ctx, data, exception);
+        if (!worker_data) {
+            free(source);
+            free(path);
+            return NULL;
+        }
+    }
+
+    // The absolute path becomes the worker's sourceURL, as for entry scripts
+    char* url = realpath(path, NULL);
+    if (url) {
+        free(path);
+        path = url;
+    }
+
+    WorkerChannel* ch = calloc(1, sizeof(WorkerChannel));
+    ch->thread_id = __atomic_add_fetch(&worker_next_id, 1, __ATOMIC_RELAXED);
+    ch->path = path;
+    ch->source = source;
+    ch->source_len = source_len;
+    ch->worker_data = worker_data;
+    ch->parent_ctx = ctx;
+    message_queue_init(&ch->inbox);
+    message_queue_init(&ch->outbox);
+    uv_mutex_init(&ch->wake_lock);
+
+    uv_async_init(loop, &ch->parent_async, on_worker_parent_async);
+    ch->parent_async.data = ch;
+
+    ch->object = JSObjectMake(ctx, worker_class, ch);
+    JSValueProtect(ctx, ch->object);
+
+    if (uv_thread_create(&ch->thread, worker_thread_main, ch) != 0) {
+        ch->finished = true;
+        uv_close((uv_handle_t*)&ch->parent_async, on_worker_parent_closed);
+        worker_throw(ctx, exception, "new Worker could not start a thread");
+        return NULL;
+    }
+    return ch->object;
+}
+
+// ========================= BINDING ========================= //
+
+void worker_bind_globals(JSContextRef ctx, JSObjectRef global) {
+    if (!worker_constructor_class) {
+        JSClassDefinition ctorDef = kJSClassDefinitionEmpty;
+        ctorDef.className = "WorkerConstructor";
+        ctorDef.callAsConstructor = worker_construct;
+        worker_constructor_class = JSClassCreate(&ctorDef);
+
+        JSClassDefinition workerDef = kJSClassDefinitionEmpty;
+        workerDef.className = "Worker";
+        workerDef.staticFunctions = worker_functions;
+        workerDef.staticValues = worker_values;
+        workerDef.finalize = worker_finalize;
+        worker_class = JSClassCreate(&workerDef);
+
+        JSClassDefinition portDef = kJSClassDefinitionEmpty;
+        portDef.className = "MessagePort";
+        portDef.staticFunctions = port_functions;
+        port_class = JSClassCreate(&portDef);
+    }
+
+    JSStringRef name = JSStringCreateWithUTF8CString("Worker");
+    JSObjectSetProperty(ctx, global, name, JSObjectMake(ctx, worker_constructor_class, NULL),
+                        kJSPropertyAttributeDontEnum, NULL);
+    JSStringRelease(name);
+
+    WorkerChannel* ch = worker_current;
+    if (!ch || ch->port) return;
+
+    // Worker threads only: the first context made on the thread owns the port
+    ch->worker_ctx = ctx;
+    ch->port = JSObjectMake(ctx, port_class, ch);
+    JSValueProtect(ctx, ch->port);
+
+    name = JSStringCreateWithUTF8CString("parentPort");
+    JSObjectSetProperty(ctx, global, name, ch->port, kJSPropertyAttributeDontEnum, NULL);
+    JSStringRelease(name);
+
+    JSValueRef data = JSValueMakeUndefined(ctx);
+    if (ch->worker_data) {
+        data = worker_message_decode(ctx, ch->worker_data);
+        worker_message_release(ch->worker_data);
+        free(ch->worker_data);
+        ch->worker_data = NULL;
+    }
+    name = JSStringCreateWithUTF8CString("workerData");
+    JSObjectSetProperty(ctx, global, name, data, kJSPropertyAttributeDontEnum, NULL);
+    JSStringRelease(name);
+}